@@ -1,6 +1,7 @@
 // h265_bridge_split_dual.c
 // appsink -> (relay) -> two appsrc's (even/odd), each to its own omxh265enc @30fps
 // DMABuf zero-copy relay; appsrc retimes; per-encoder stats.
+// Streaming-thread prints go through Measurement/async_log.h (ALOG_LEVEL=warn mutes them).
 
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
@@ -12,6 +13,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../Measurement/async_log.h"
+
 typedef struct {
     GstElement *appsink;
     GstElement *appsrc_even;
@@ -73,28 +76,28 @@ static gboolean on_bus(GstBus *bus, GstMessage *m, gpointer user){
 static GstPadProbeReturn appsrc_out_probe_even(GstPad *p, GstPadProbeInfo *i, gpointer u){
     (void)p; (void)u; if (GST_PAD_PROBE_INFO_TYPE(i)&GST_PAD_PROBE_TYPE_BUFFER){
         GstBuffer *b = GST_PAD_PROBE_INFO_BUFFER(i);
-        if (!g_log_out_even){ g_print("[MEM] appsrc-even out: DMABuf=%s\n", is_dmabuf(b)?"YES":"NO"); g_log_out_even=TRUE; }
+        if (!g_log_out_even){ ALOG(LOG_INFO, 0, "[MEM] appsrc-even out: DMABuf=%s\n", is_dmabuf(b)?"YES":"NO"); g_log_out_even=TRUE; }
         g_mutex_lock(&g_mu); g_out_even++; g_mutex_unlock(&g_mu);
     } return GST_PAD_PROBE_PASS;
 }
 static GstPadProbeReturn appsrc_out_probe_odd(GstPad *p, GstPadProbeInfo *i, gpointer u){
     (void)p; (void)u; if (GST_PAD_PROBE_INFO_TYPE(i)&GST_PAD_PROBE_TYPE_BUFFER){
         GstBuffer *b = GST_PAD_PROBE_INFO_BUFFER(i);
-        if (!g_log_out_odd){ g_print("[MEM] appsrc-odd out: DMABuf=%s\n", is_dmabuf(b)?"YES":"NO"); g_log_out_odd=TRUE; }
+        if (!g_log_out_odd){ ALOG(LOG_INFO, 0, "[MEM] appsrc-odd out: DMABuf=%s\n", is_dmabuf(b)?"YES":"NO"); g_log_out_odd=TRUE; }
         g_mutex_lock(&g_mu); g_out_odd++; g_mutex_unlock(&g_mu);
     } return GST_PAD_PROBE_PASS;
 }
 static GstPadProbeReturn enc_sink_probe_even(GstPad *p, GstPadProbeInfo *i, gpointer u){
     (void)p; (void)u; if (GST_PAD_PROBE_INFO_TYPE(i)&GST_PAD_PROBE_TYPE_BUFFER){
         GstBuffer *b = GST_PAD_PROBE_INFO_BUFFER(i);
-        if (!g_log_enc_even){ g_print("[MEM] enc-even sink: DMABuf=%s\n", is_dmabuf(b)?"YES":"NO"); g_log_enc_even=TRUE; }
+        if (!g_log_enc_even){ ALOG(LOG_INFO, 0, "[MEM] enc-even sink: DMABuf=%s\n", is_dmabuf(b)?"YES":"NO"); g_log_enc_even=TRUE; }
         g_mutex_lock(&g_mu); g_enc_even++; g_mutex_unlock(&g_mu);
     } return GST_PAD_PROBE_PASS;
 }
 static GstPadProbeReturn enc_sink_probe_odd(GstPad *p, GstPadProbeInfo *i, gpointer u){
     (void)p; (void)u; if (GST_PAD_PROBE_INFO_TYPE(i)&GST_PAD_PROBE_TYPE_BUFFER){
         GstBuffer *b = GST_PAD_PROBE_INFO_BUFFER(i);
-        if (!g_log_enc_odd){ g_print("[MEM] enc-odd sink: DMABuf=%s\n", is_dmabuf(b)?"YES":"NO"); g_log_enc_odd=TRUE; }
+        if (!g_log_enc_odd){ ALOG(LOG_INFO, 0, "[MEM] enc-odd sink: DMABuf=%s\n", is_dmabuf(b)?"YES":"NO"); g_log_enc_odd=TRUE; }
         g_mutex_lock(&g_mu); g_enc_odd++; g_mutex_unlock(&g_mu);
     } return GST_PAD_PROBE_PASS;
 }
@@ -111,10 +114,10 @@ static GstFlowReturn on_new_sample(GstAppSink *sink, gpointer user){
         GstCaps *caps = gst_sample_get_caps(s);
         if (caps && gst_video_info_from_caps(&c->vi, caps)){
             c->video_info_valid = TRUE;
-            g_print("Negotiated: %dx%d %s @ %d/%d\n",
-                    c->vi.width, c->vi.height,
-                    gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(&c->vi)),
-                    c->vi.fps_n, c->vi.fps_d);
+            ALOG(LOG_INFO, 0, "Negotiated: %dx%d %s @ %d/%d\n",
+                 c->vi.width, c->vi.height,
+                 gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(&c->vi)),
+                 c->vi.fps_n, c->vi.fps_d);
             /* lock appsrc caps to 30/1 for each branch */
             GstCaps *caps30 = gst_caps_new_simple("video/x-raw",
                 "format", G_TYPE_STRING, "NV12",
@@ -127,7 +130,7 @@ static GstFlowReturn on_new_sample(GstAppSink *sink, gpointer user){
         } else { gst_sample_unref(s); return GST_FLOW_ERROR; }
     }
 
-    if (!g_log_in){ g_print("[MEM] appsink: DMABuf=%s\n", is_dmabuf(in)?"YES":"NO"); g_log_in=TRUE; }
+    if (!g_log_in){ ALOG(LOG_INFO, 0, "[MEM] appsink: DMABuf=%s\n", is_dmabuf(in)?"YES":"NO"); g_log_in=TRUE; }
 
     gboolean to_even = ((c->frame_idx++ & 1u)==0);
     GstBuffer *out = zero_copy_retime(in);      // no memcpy; timestamps cleared
@@ -159,8 +162,8 @@ static gboolean tick(gpointer u){
     guint64 n0=g_cb, n1=g_push_even, n2=g_push_odd, n3=g_out_even, n4=g_out_odd, n5=g_enc_even, n6=g_enc_odd;
     g_mutex_unlock(&g_mu);
 
-    g_print("[REALTIME] cb %.1f | push even %.1f / odd %.1f | out even %.1f / odd %.1f | enc even %.1f / odd %.1f fps\n",
-        (n0-c0)/dt, (n1-c1)/dt, (n2-c2)/dt, (n3-c3)/dt, (n4-c4)/dt, (n5-c5)/dt, (n6-c6)/dt);
+    g_print("[REALTIME] cb %.1f | push even %.1f / odd %.1f | out even %.1f / odd %.1f | enc even %.1f / odd %.1f fps | log dropped %" G_GUINT64_FORMAT "\n",
+        (n0-c0)/dt, (n1-c1)/dt, (n2-c2)/dt, (n3-c3)/dt, (n4-c4)/dt, (n5-c5)/dt, (n6-c6)/dt, AsyncLog::instance().dropped());
 
     last=now; c0=n0; c1=n1; c2=n2; c3=n3; c4=n4; c5=n5; c6=n6;
     return TRUE;
@@ -292,5 +295,7 @@ int main(int argc, char **argv){
     gst_object_unref(pipe1);
     gst_object_unref(pipe2a);
     gst_object_unref(pipe2b);
+    AsyncLog::instance().report();
+    AsyncLog::instance().stop();
     return 0;
 }
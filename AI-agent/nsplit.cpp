@@ -0,0 +1,381 @@
+// nsplit.cpp
+// appsink -> (relay) -> N appsrc's, each to its own encoder instance.
+// Generalizes aplit.cpp (even/odd over two 30fps encoders) to any shard count, so encoder
+// throughput scales with the number of encoder instances (or cores, with --encoder=sw).
+//
+// Sharding (--mode):
+//   frame    frame i goes to shard i % N; every shard runs at fps/N (live: 4K60 over
+//            two 30fps encoders, or N software encoders)
+//   segment  contiguous chunks of --segment-frames frames, chunk c to shard c % N.
+//            GOP length = chunk length and a key unit is forced at every chunk start, so
+//            each chunk decodes on its own (offline / batch; reassemble by PTS)
+// Retiming: appsrc does not timestamp; frame i is stamped PTS = i / fps on whichever
+// shard gets it (monotonic per shard, shards line up on one timeline), DURATION = time
+// until that shard's next frame. Memory is relayed zero-copy as in aplit.cpp.
+// Stats: per-shard and total push / encoded rates, output bitrate and encode latency
+// (encoder sink -> encoder src, in order per shard).
+//
+// Build:
+// g++ -O2 -std=c++17 nsplit.cpp -o nsplit \
+//   $(pkg-config --cflags --libs gstreamer-1.0 gstreamer-app-1.0 gstreamer-video-1.0 gstreamer-allocators-1.0)
+//
+// Run:
+//   ./nsplit --shards=2 --width=3840 --height=2160 --fps=60          # omx, UDP ports 5004, 5006
+//   ./nsplit --shards=4 --encoder=sw --src=test --fps=60              # x264enc x4, test pattern
+//   ./nsplit --shards=3 --mode=segment --segment-frames=60 --encoder=sw --src=test \
+//            --frames=1800 --out=chunks                               # chunks-0.h264 ...
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
+#include <gst/allocators/gstdmabuf.h>
+#include <glib.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define MAX_SHARDS 16
+
+typedef struct Shard {
+    int         index{0};
+    GstElement *pipe{nullptr};
+    GstElement *appsrc{nullptr};
+
+    std::atomic<guint64> pushed{0};
+    std::atomic<guint64> push_errors{0};
+    std::atomic<guint64> enc_in{0};
+    std::atomic<guint64> enc_out{0};
+    std::atomic<guint64> bytes{0};
+    std::atomic<guint64> lat_sum_us{0};
+    std::atomic<guint64> lat_max_us{0};
+
+    std::mutex          mu;
+    std::deque<gint64>  inflight;   // encoder sink arrival times, oldest first
+} Shard;
+
+typedef struct {
+    GstElement *capture_pipe;
+    GstElement *appsink;
+    std::vector<std::unique_ptr<Shard>> shards;
+    gboolean    segment_mode;
+    gint        segment_frames;
+    gint        fps;
+    guint64     max_frames;         // 0 = run until Ctrl+C
+    GstClockTime frame_dur;
+    guint64     frame_idx;
+    gboolean    eos_sent;
+    gint        shards_eos;
+} Ctx;
+
+static volatile sig_atomic_t g_stop=0;
+static GTimer *g_timer=NULL;
+static gboolean g_log_in=FALSE;
+
+static void on_sigint(int s){ (void)s; g_stop=1; }
+
+static gboolean is_dmabuf(GstBuffer *b){
+    if (!b) return FALSE;
+    for (guint i=0, n=gst_buffer_n_memory(b); i<n; ++i){
+        GstMemory *m = gst_buffer_peek_memory(b,i);
+        if (m && gst_is_dmabuf_memory(m)) return TRUE;
+    }
+    return FALSE;
+}
+
+// New buffer sharing the input's memory, stamped for its shard
+static GstBuffer* zero_copy_retime(GstBuffer *in, GstClockTime pts, GstClockTime dur){
+    GstBuffer *out = gst_buffer_new();
+    gst_buffer_copy_into(out, in, GST_BUFFER_COPY_METADATA, 0, -1);
+    for (guint i=0, n=gst_buffer_n_memory(in); i<n; ++i)
+        gst_buffer_append_memory(out, gst_memory_ref(gst_buffer_peek_memory(in,i)));
+    GST_BUFFER_PTS(out)=pts;
+    GST_BUFFER_DTS(out)=GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DURATION(out)=dur;
+    return out;
+}
+
+static int shard_of(const Ctx *c, guint64 idx){
+    const guint64 n = c->shards.size();
+    return (int)(c->segment_mode ? (idx / (guint64)c->segment_frames) % n : idx % n);
+}
+
+static gboolean on_bus(GstBus *bus, GstMessage *m, gpointer user){
+    (void)bus; Ctx *c=(Ctx*)user;
+    switch (GST_MESSAGE_TYPE(m)){
+    case GST_MESSAGE_ERROR: {
+        GError *e=NULL; gchar *dbg=NULL;
+        gst_message_parse_error(m,&e,&dbg);
+        g_printerr("[BUS] ERROR from %s: %s\n", GST_OBJECT_NAME(m->src), e->message);
+        if (dbg) g_printerr("[BUS] DEBUG: %s\n", dbg);
+        g_clear_error(&e); g_free(dbg);
+        g_stop=1;
+        break; }
+    case GST_MESSAGE_EOS:
+        if (GST_MESSAGE_SRC(m) == GST_OBJECT(c->capture_pipe)) {
+            // Source ended: let every encoder flush its last GOP
+            if (!c->eos_sent) { for (auto &x : c->shards) gst_app_src_end_of_stream(GST_APP_SRC(x->appsrc)); c->eos_sent = TRUE; }
+            break;
+        }
+        // Shard flushed (after --frames or source EOS); stop once all are
+        if (++c->shards_eos >= (gint)c->shards.size()) { g_print("[BUS] all %d shards at EOS\n", c->shards_eos); g_stop=1; }
+        break;
+    default: break;
+    }
+    return TRUE;
+}
+
+/* probes for stats */
+static GstPadProbeReturn enc_sink_probe(GstPad *p, GstPadProbeInfo *i, gpointer u){
+    (void)p; Shard *s=(Shard*)u;
+    if (GST_PAD_PROBE_INFO_TYPE(i)&GST_PAD_PROBE_TYPE_BUFFER){
+        s->enc_in.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(s->mu);
+        s->inflight.push_back(g_get_monotonic_time());
+    } return GST_PAD_PROBE_PASS;
+}
+static GstPadProbeReturn enc_src_probe(GstPad *p, GstPadProbeInfo *i, gpointer u){
+    (void)p; Shard *s=(Shard*)u;
+    if (GST_PAD_PROBE_INFO_TYPE(i)&GST_PAD_PROBE_TYPE_BUFFER){
+        GstBuffer *b = GST_PAD_PROBE_INFO_BUFFER(i);
+        s->enc_out.fetch_add(1, std::memory_order_relaxed);
+        s->bytes.fetch_add(gst_buffer_get_size(b), std::memory_order_relaxed);
+        gint64 t_in = 0;
+        {
+            std::lock_guard<std::mutex> lock(s->mu);
+            if (!s->inflight.empty()){ t_in = s->inflight.front(); s->inflight.pop_front(); }
+        }
+        if (t_in){
+            guint64 lat = (guint64)(g_get_monotonic_time() - t_in);
+            s->lat_sum_us.fetch_add(lat, std::memory_order_relaxed);
+            guint64 prev = s->lat_max_us.load(std::memory_order_relaxed);
+            while (lat > prev && !s->lat_max_us.compare_exchange_weak(prev, lat)) {}
+        }
+    } return GST_PAD_PROBE_PASS;
+}
+
+/* appsink -> relay -> shard appsrc */
+static GstFlowReturn on_new_sample(GstAppSink *sink, gpointer user){
+    Ctx *c=(Ctx*)user;
+    GstSample *s = gst_app_sink_pull_sample(sink);
+    if (!s) return GST_FLOW_ERROR;
+    GstBuffer *in = gst_sample_get_buffer(s);
+    if (!in){ gst_sample_unref(s); return GST_FLOW_ERROR; }
+
+    if (c->eos_sent){ gst_sample_unref(s); return GST_FLOW_OK; }
+    if (!g_log_in){ g_print("[MEM] appsink: DMABuf=%s\n", is_dmabuf(in)?"YES":"NO"); g_log_in=TRUE; }
+
+    const guint64 idx = c->frame_idx++;
+    Shard *sh = c->shards[shard_of(c, idx)].get();
+    const GstClockTime pts = idx * c->frame_dur;
+    // Frame mode: next frame for this shard is N frames later; segment mode: the next one
+    const GstClockTime dur = c->segment_mode ? c->frame_dur : c->frame_dur * c->shards.size();
+
+    if (c->segment_mode && idx % (guint64)c->segment_frames == 0){
+        // Chunk start: new GOP so the chunk stands alone
+        gst_element_send_event(sh->appsrc,
+            gst_video_event_new_downstream_force_key_unit(GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, pts, TRUE,
+                                                          (guint)(idx / (guint64)c->segment_frames)));
+    }
+
+    GstFlowReturn ret = gst_app_src_push_buffer(GST_APP_SRC(sh->appsrc), zero_copy_retime(in, pts, dur));
+    if (ret==GST_FLOW_OK) sh->pushed.fetch_add(1, std::memory_order_relaxed);
+    else sh->push_errors.fetch_add(1, std::memory_order_relaxed);
+    gst_sample_unref(s);
+
+    if (c->max_frames && c->frame_idx >= c->max_frames){
+        for (auto &x : c->shards) gst_app_src_end_of_stream(GST_APP_SRC(x->appsrc));
+        c->eos_sent = TRUE;
+        g_print("%" G_GUINT64_FORMAT " frames relayed, draining encoders\n", c->frame_idx);
+    }
+    return GST_FLOW_OK;
+}
+
+static gboolean tick(gpointer u){
+    Ctx *c=(Ctx*)u;
+    static gdouble last=0;
+    static guint64 prev_push[MAX_SHARDS], prev_out[MAX_SHARDS], prev_bytes[MAX_SHARDS], prev_lat[MAX_SHARDS];
+    if (!g_timer) return TRUE;
+    gdouble now=g_timer_elapsed(g_timer,NULL);
+    gdouble dt=now-last; if (last!=0 && dt<2.0) return TRUE;
+
+    guint64 sum_push=0, sum_out=0, sum_bytes=0, sum_lat=0, max_lat=0;
+    for (auto &x : c->shards){
+        Shard *s=x.get(); int k=s->index;
+        guint64 push=s->pushed.load(), out=s->enc_out.load(), bytes=s->bytes.load(), lat=s->lat_sum_us.load();
+        size_t inflight;
+        { std::lock_guard<std::mutex> lock(s->mu); inflight=s->inflight.size(); }
+        if (last!=0){
+            guint64 d_out=out-prev_out[k];
+            g_print("  shard %2d: push %6.1f fps | enc %6.1f fps | %8.1f kbps | enc latency %6.2f ms (max %6.2f) | inflight %zu | push errors %" G_GUINT64_FORMAT "\n",
+                k, (push-prev_push[k])/dt, d_out/dt, (bytes-prev_bytes[k])*8.0/dt/1000.0,
+                d_out ? (lat-prev_lat[k])/(gdouble)d_out/1000.0 : 0.0, s->lat_max_us.load()/1000.0,
+                inflight, s->push_errors.load());
+            sum_push+=push-prev_push[k]; sum_out+=d_out; sum_bytes+=bytes-prev_bytes[k]; sum_lat+=lat-prev_lat[k];
+            if (s->lat_max_us.load()>max_lat) max_lat=s->lat_max_us.load();
+        }
+        prev_push[k]=push; prev_out[k]=out; prev_bytes[k]=bytes; prev_lat[k]=lat;
+    }
+    if (last!=0){
+        g_print("[REALTIME] %d shards (%s): relayed %6.1f fps | encoded %6.1f fps total | %8.1f kbps | enc latency %6.2f ms avg, %6.2f max\n",
+            (int)c->shards.size(), c->segment_mode ? "segment" : "frame", sum_push/dt, sum_out/dt, sum_bytes*8.0/dt/1000.0,
+            sum_out ? sum_lat/(gdouble)sum_out/1000.0 : 0.0, max_lat/1000.0);
+    }
+    last=now;
+    return TRUE;
+}
+
+// Encoder + sink part of one shard pipeline
+static gchar* shard_tail(gboolean sw, gboolean h265, int br, int gop, int slices, int threads,
+                         const gchar *out_prefix, int k, const gchar *host, int port){
+    const gchar *codec = h265 ? "h265" : "h264";
+    gchar *enc = sw
+        ? (h265 ? g_strdup_printf("videoconvert ! x265enc name=enc tune=zerolatency speed-preset=ultrafast bitrate=%d key-int-max=%d", br, gop)
+                : g_strdup_printf("videoconvert ! x264enc name=enc tune=zerolatency speed-preset=ultrafast bitrate=%d key-int-max=%d threads=%d", br, gop, threads))
+        : g_strdup_printf("omx%senc name=enc control-rate=low-latency target-bitrate=%d "
+                          "gop-mode=low-delay-p gop-length=%d periodicity-idr=%d num-slices=%d prefetch-buffer=true filler-data=false",
+                          codec, br, gop, gop, slices);
+    gchar *sink = out_prefix
+        ? g_strdup_printf("%sparse ! filesink location=%s-%d.%s", codec, out_prefix, k, codec)
+        : g_strdup_printf("rtp%spay pt=96 mtu=1400 config-interval=1 ! udpsink host=%s port=%d sync=false", codec, host, port + 2*k);
+    gchar *tail = g_strdup_printf("%s ! video/x-%s,alignment=au,stream-format=byte-stream ! %s", enc, codec, sink);
+    g_free(enc); g_free(sink);
+    return tail;
+}
+
+int main(int argc, char **argv){
+    gst_init(&argc,&argv);
+
+    gint bitrate_kbps=10000, fps=60, width=1920, height=1080;
+    const gchar *host="192.168.25.69"; gint port=5004; // shard k on port + 2k
+    gint slices=8, n_shards=2, segment_frames=60, sw_threads=1;
+    gboolean segment_mode=FALSE, sw=FALSE, h265=TRUE, test_src=FALSE;
+    const gchar *out_prefix=NULL;
+    guint64 max_frames=0;
+    for (int i=1;i<argc;i++){
+        if (g_str_has_prefix(argv[i],"--bitrate=")) bitrate_kbps=atoi(argv[i]+10);
+        else if (g_str_has_prefix(argv[i],"--fps=")) fps=atoi(argv[i]+6);
+        else if (g_str_has_prefix(argv[i],"--width=")) width=atoi(argv[i]+8);
+        else if (g_str_has_prefix(argv[i],"--height=")) height=atoi(argv[i]+9);
+        else if (g_str_has_prefix(argv[i],"--host=")) host=argv[i]+7;
+        else if (g_str_has_prefix(argv[i],"--port=")) port=atoi(argv[i]+7);
+        else if (g_str_has_prefix(argv[i],"--slices=")) slices=atoi(argv[i]+9);
+        else if (g_str_has_prefix(argv[i],"--shards=")) n_shards=atoi(argv[i]+9);
+        else if (g_str_has_prefix(argv[i],"--mode=")) segment_mode=g_ascii_strcasecmp(argv[i]+7,"segment")==0;
+        else if (g_str_has_prefix(argv[i],"--segment-frames=")) segment_frames=atoi(argv[i]+17);
+        else if (g_str_has_prefix(argv[i],"--encoder=")) sw=g_ascii_strcasecmp(argv[i]+10,"sw")==0;
+        else if (g_str_has_prefix(argv[i],"--sw-threads=")) sw_threads=atoi(argv[i]+13);
+        else if (g_str_has_prefix(argv[i],"--codec=")) h265=g_ascii_strcasecmp(argv[i]+8,"h264")!=0;
+        else if (g_str_has_prefix(argv[i],"--src=")) test_src=g_ascii_strcasecmp(argv[i]+6,"test")==0;
+        else if (g_str_has_prefix(argv[i],"--frames=")) max_frames=g_ascii_strtoull(argv[i]+9,NULL,10);
+        else if (g_str_has_prefix(argv[i],"--out=")) out_prefix=argv[i]+6;
+    }
+    if ((width&1)||(height&1)){ g_printerr("NV12 requires even WxH\n"); return -1; }
+    if (n_shards<1 || n_shards>MAX_SHARDS){ g_printerr("--shards must be 1..%d\n", MAX_SHARDS); return -1; }
+    if (fps<=0 || segment_frames<=0 || sw_threads<=0){ g_printerr("--fps, --segment-frames and --sw-threads must be > 0\n"); return -1; }
+
+    // Each shard carries 1/N of the frames in either mode
+    const gint br_each = bitrate_kbps/n_shards;
+    // Frame mode: every shard runs at fps/N (as a fraction, N need not divide fps)
+    const gint shard_fps_n = fps;
+    const gint shard_fps_d = segment_mode ? 1 : n_shards;
+    // GOP: one second of shard frames, or exactly one chunk
+    const gint gop = segment_mode ? segment_frames : MAX(1, fps/n_shards);
+
+    g_print("Shard mode: %dx%d@%dfps -> %d %s %s encoders (%s), %d kbps each, GOP %d\n",
+            width,height,fps, n_shards, sw ? "software" : "omx", h265 ? "H.265" : "H.264",
+            segment_mode ? "segments" : "frame round-robin", br_each, gop);
+    if (segment_mode) g_print("Segments of %d frames, chunk c -> shard c %% %d\n", segment_frames, n_shards);
+    if (out_prefix) g_print("Writing %s-<shard>.%s\n", out_prefix, h265 ? "h265" : "h264");
+    else g_print("UDP %s ports %d..%d (step 2)\n", host, port, port + 2*(n_shards-1));
+
+    Ctx c{};
+    c.segment_mode=segment_mode; c.segment_frames=segment_frames; c.fps=fps; c.max_frames=max_frames;
+    c.frame_dur=gst_util_uint64_scale_int(GST_SECOND, 1, fps);
+
+    // Pipeline 1: camera (or test pattern) -> appsink
+    GError *err=NULL;
+    gchar *p1 = test_src
+        ? g_strdup_printf(
+            "videotestsrc is-live=true pattern=ball ! "
+            "video/x-raw,format=NV12,width=%d,height=%d,framerate=%d/1 ! "
+            "appsink name=cap_sink emit-signals=true max-buffers=3 drop=true sync=false",
+            width,height,fps)
+        : g_strdup_printf(
+            "v4l2src device=/dev/video0 io-mode=dmabuf do-timestamp=true ! "
+            "video/x-raw,format=NV12,width=%d,height=%d,framerate=%d/1 ! "
+            "videorate drop-only=true max-rate=%d ! "
+            "appsink name=cap_sink emit-signals=true max-buffers=3 drop=true sync=false",
+            width,height,fps,fps);
+    GstElement *pipe1 = gst_parse_launch(p1,&err); g_free(p1);
+    if (!pipe1){ g_printerr("pipe1: %s\n", err?err->message:"(unknown)"); g_clear_error(&err); return -1; }
+    c.capture_pipe = pipe1;
+    c.appsink = gst_bin_get_by_name(GST_BIN(pipe1),"cap_sink");
+    if (!c.appsink){ g_printerr("get appsink failed\n"); gst_object_unref(pipe1); return -1; }
+
+    // Shard pipelines: appsrc -> encoder k
+    GstClock *clk = gst_system_clock_obtain();
+    gst_pipeline_use_clock(GST_PIPELINE(pipe1), clk);
+    for (int k=0;k<n_shards;k++){
+        std::unique_ptr<Shard> s(new Shard());
+        s->index=k;
+        gchar *tail = shard_tail(sw, h265, br_each, gop, slices, sw_threads, out_prefix, k, host, port);
+        gchar *p2 = g_strdup_printf(
+            "appsrc name=src is-live=true format=GST_FORMAT_TIME do-timestamp=false block=true max-bytes=%d ! "
+            "video/x-raw(memory:DMABuf),format=NV12,width=%d,height=%d,framerate=%d/%d; "
+            "video/x-raw,format=NV12,width=%d,height=%d,framerate=%d/%d ! "
+            "queue max-size-buffers=12 max-size-time=0 max-size-bytes=0 %s! %s",
+            8*1024*1024, width,height,shard_fps_n,shard_fps_d, width,height,shard_fps_n,shard_fps_d,
+            // Batch segments must not lose frames; live shards shed rather than stall capture
+            segment_mode ? "" : "leaky=downstream ", tail);
+        g_free(tail);
+        s->pipe = gst_parse_launch(p2,&err); g_free(p2);
+        if (!s->pipe){ g_printerr("shard %d: %s\n", k, err?err->message:"(unknown)"); g_clear_error(&err); return -1; }
+        s->appsrc = gst_bin_get_by_name(GST_BIN(s->pipe),"src");
+        if (!s->appsrc){ g_printerr("shard %d: get appsrc failed\n", k); return -1; }
+        gst_pipeline_use_clock(GST_PIPELINE(s->pipe), clk);
+
+        if (GstElement *enc = gst_bin_get_by_name(GST_BIN(s->pipe),"enc")){
+            if (GstPad *sp = gst_element_get_static_pad(enc,"sink")){ gst_pad_add_probe(sp, GST_PAD_PROBE_TYPE_BUFFER, enc_sink_probe, s.get(), NULL); gst_object_unref(sp); }
+            if (GstPad *sp = gst_element_get_static_pad(enc,"src")){ gst_pad_add_probe(sp, GST_PAD_PROBE_TYPE_BUFFER, enc_src_probe, s.get(), NULL); gst_object_unref(sp); }
+            gst_object_unref(enc);
+        }
+        GstBus *b=gst_element_get_bus(s->pipe); gst_bus_add_watch(b,on_bus,&c); gst_object_unref(b);
+        c.shards.push_back(std::move(s));
+    }
+    gst_object_unref(clk);
+
+    // connect callback, buses, loop, stats
+    g_signal_connect(c.appsink, "new-sample", G_CALLBACK(on_new_sample), &c);
+    GMainLoop *loop = g_main_loop_new(NULL,FALSE);
+    GstBus *b1=gst_element_get_bus(pipe1);
+    gst_bus_add_watch(b1,on_bus,&c);
+    gst_object_unref(b1);
+
+    g_timer=g_timer_new(); g_timeout_add(100, tick, &c);
+    signal(SIGINT, on_sigint);
+
+    for (auto &s : c.shards) gst_element_set_state(s->pipe, GST_STATE_PLAYING);
+    gst_element_set_state(pipe1, GST_STATE_PLAYING);
+    g_print("Running %d encoder shards. Ctrl+C to exit.\n", n_shards);
+
+    while (!g_stop){ g_main_context_iteration(NULL,FALSE); g_usleep(1000); }
+
+    gst_element_set_state(pipe1, GST_STATE_NULL);
+    for (auto &s : c.shards){
+        gst_element_set_state(s->pipe, GST_STATE_NULL);
+        gst_object_unref(s->appsrc);
+        gst_object_unref(s->pipe);
+    }
+
+    if (g_timer) g_timer_destroy(g_timer);
+    g_main_loop_unref(loop);
+    gst_object_unref(c.appsink);
+    gst_object_unref(pipe1);
+    return 0;
+}
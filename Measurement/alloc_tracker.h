@@ -0,0 +1,236 @@
+// alloc_tracker.h
+// Allocation counting for "no allocations per frame in steady state". Built with
+// -DALLOC_TRACKER the program's malloc family is interposed (new, g_malloc, g_slice and
+// GstBuffer allocations all end up there); each allocation is counted against the
+// pipeline stage the calling thread is in. Without the define everything compiles and
+// counts nothing.
+//
+//   static const int st_pack = alloc_stage("pack");          // setup, before streaming
+//   static const int st_dev  = alloc_stage("device", false); // counted, not enforced
+//   { AllocScope scope(st_pack); ... }                       // per frame
+//   AllocTracker::instance().frame();                        // once per frame
+//   AllocTracker::instance().report();                       // allocs and bytes per frame
+//
+// Test mode: AllocTracker::instance().check(warmup_frames) arms the tracker after the
+// warm-up; from then on any allocation in an enforced stage is a violation (stage, size,
+// frame; the first ALLOC_MAX_VIOLATIONS are kept) and violations() > 0 fails the run.
+// check() refuses (returns false) in a build without the hook.
+// Allocations outside any scope (GStreamer's own threads, the main loop) are counted as
+// "untagged" and never enforced.
+//
+// The hook runs inside malloc: it only touches a thread_local stage index and relaxed
+// atomics in constant-initialized storage, never allocates and never prints. GLib older
+// than 2.76 keeps its own slice magazines and reads G_SLICE before main() runs, so on those
+// versions G_SLICE=always-malloc must already be in the environment; check() refuses
+// without it rather than miss every g_slice allocation.
+
+#ifndef _ALLOC_TRACKER_H_
+#define _ALLOC_TRACKER_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <atomic>
+
+#define ALLOC_MAX_STAGES     16
+#define ALLOC_MAX_VIOLATIONS 32
+
+struct AllocStageCounters {
+    const char *name;
+    bool checked;
+    std::atomic<uint64_t> allocs;
+    std::atomic<uint64_t> bytes;
+    uint64_t prev_allocs, prev_bytes;   // report() only
+};
+
+struct AllocViolation {
+    int stage;
+    uint64_t size;
+    uint64_t frame;
+};
+
+class AllocTracker {
+public:
+    static AllocTracker &instance() { return tracker_; }
+
+    static constexpr bool hooked() {
+#ifdef ALLOC_TRACKER
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Stage 0 is "untagged"; returns -1 when the table is full
+    int add_stage(const char *name, bool checked) {
+        const int i = nstages_.load(std::memory_order_relaxed);
+        if (i > ALLOC_MAX_STAGES) return -1;
+        stages_[i].name = name;
+        stages_[i].checked = checked;
+        nstages_.store(i + 1, std::memory_order_release);
+        return i;
+    }
+
+    static int &current_stage() { return t_stage_; }
+
+    // From the hook: no allocation, no locks
+    void note(size_t size) {
+        const int s = t_stage_;
+        AllocStageCounters &c = stages_[s];
+        c.allocs.fetch_add(1, std::memory_order_relaxed);
+        c.bytes.fetch_add(size, std::memory_order_relaxed);
+        if (s > 0 && c.checked && armed_.load(std::memory_order_relaxed)) {
+            const uint64_t n = nviolations_.fetch_add(1, std::memory_order_relaxed);
+            if (n < ALLOC_MAX_VIOLATIONS) {
+                violations_[n].stage = s;
+                violations_[n].size = size;
+                violations_[n].frame = frames_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Test mode: enforce after warmup_frames calls to frame(). Returns false (and arms
+    // nothing) without the hook, where a check could only pass vacuously.
+    bool check(uint64_t warmup_frames) {
+        if (!hooked()) {
+            g_printerr("Allocation check: built without -DALLOC_TRACKER, nothing is counted\n");
+            return false;
+        }
+        if (glib_check_version(2, 76, 0) != NULL &&
+            g_strcmp0(g_getenv("G_SLICE"), "always-malloc") != 0) {
+            g_printerr("Allocation check: GLib %u.%u uses slice magazines, "
+                       "run with G_SLICE=always-malloc\n", glib_major_version, glib_minor_version);
+            return false;
+        }
+        warmup_ = warmup_frames;
+        checking_ = true;
+        return true;
+    }
+
+    void frame() {
+        const uint64_t n = frames_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (checking_ && n == warmup_) armed_.store(true, std::memory_order_relaxed);
+    }
+
+    bool armed() const { return armed_.load(std::memory_order_relaxed); }
+    uint64_t frames() const { return frames_.load(std::memory_order_relaxed); }
+    uint64_t violations() const { return nviolations_.load(std::memory_order_relaxed); }
+
+    // Allocations and bytes per frame per stage since the previous call; single caller
+    void report() {
+        const uint64_t frames = frames_.load(std::memory_order_relaxed);
+        const uint64_t dn = frames - prev_frames_;
+        prev_frames_ = frames;
+        if (dn == 0) return;
+        g_print("Allocations per frame (%" G_GUINT64_FORMAT " frames%s):", dn,
+                checking_ ? (armed() ? ", checked" : ", warming up") : "");
+        const int n = nstages_.load(std::memory_order_acquire);
+        for (int i = 0; i < n; ++i) {
+            AllocStageCounters &c = stages_[i];
+            const uint64_t a = c.allocs.load(std::memory_order_relaxed), b = c.bytes.load(std::memory_order_relaxed);
+            g_print(" | %s%s %.1f (%.1f KB)", i ? c.name : "untagged", i && !c.checked ? "*" : "",
+                    (double)(a - c.prev_allocs) / dn, (b - c.prev_bytes) / 1024.0 / dn);
+            c.prev_allocs = a;
+            c.prev_bytes = b;
+        }
+        g_print("\n");
+        print_violations();
+    }
+
+    // New violations since the previous call
+    void print_violations() {
+        const uint64_t n = violations();
+        for (uint64_t i = printed_; i < n && i < ALLOC_MAX_VIOLATIONS; ++i) {
+            const AllocViolation &v = violations_[i];
+            g_printerr("[ALLOC] stage=%s size=%" G_GUINT64_FORMAT " frame=%" G_GUINT64_FORMAT "\n",
+                       stages_[v.stage].name, v.size, v.frame);
+        }
+        if (n > ALLOC_MAX_VIOLATIONS && printed_ < n)
+            g_printerr("[ALLOC] ... %" G_GUINT64_FORMAT " violations in total\n", n);
+        printed_ = n;
+    }
+
+private:
+    constexpr AllocTracker() = default;
+
+    static AllocTracker tracker_;
+    static thread_local int t_stage_;
+
+    AllocStageCounters stages_[ALLOC_MAX_STAGES + 1]{{"untagged", false, {0}, {0}, 0, 0}};
+    std::atomic<int> nstages_{1};
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<bool> armed_{false};
+    std::atomic<uint64_t> nviolations_{0};
+    AllocViolation violations_[ALLOC_MAX_VIOLATIONS]{};
+    uint64_t warmup_{0};
+    bool checking_{false};
+    uint64_t prev_frames_{0}, printed_{0};   // report() only
+};
+
+// Constant-initialized: usable from malloc calls made before main()
+inline AllocTracker AllocTracker::tracker_;
+inline thread_local int AllocTracker::t_stage_ = 0;
+
+static inline int alloc_stage(const char *name, bool checked = true) {
+    return AllocTracker::instance().add_stage(name, checked);
+}
+
+// Attributes this thread's allocations to a stage for the enclosed block
+class AllocScope {
+public:
+    explicit AllocScope(int stage) : prev_(AllocTracker::current_stage()) {
+        if (stage > 0) AllocTracker::current_stage() = stage;
+    }
+    ~AllocScope() { leave(); }
+
+    // Ends the attribution before the end of the block
+    void leave() { AllocTracker::current_stage() = prev_; }
+    AllocScope(const AllocScope &) = delete;
+    AllocScope &operator=(const AllocScope &) = delete;
+
+private:
+    int prev_;
+};
+
+/* ---------- malloc interposer (-DALLOC_TRACKER) ---------- */
+
+#ifdef ALLOC_TRACKER
+// One translation unit per program includes this (every program here is a single file)
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+void *__libc_memalign(size_t, size_t);
+void __libc_free(void *);
+
+void *malloc(size_t n) {
+    AllocTracker::instance().note(n);
+    return __libc_malloc(n);
+}
+void *calloc(size_t count, size_t n) {
+    AllocTracker::instance().note(count * n);
+    return __libc_calloc(count, n);
+}
+void *realloc(void *p, size_t n) {
+    AllocTracker::instance().note(n);
+    return __libc_realloc(p, n);
+}
+void free(void *p) { __libc_free(p); }
+void *memalign(size_t align, size_t n) {
+    AllocTracker::instance().note(n);
+    return __libc_memalign(align, n);
+}
+void *aligned_alloc(size_t align, size_t n) { return memalign(align, n); }
+int posix_memalign(void **out, size_t align, size_t n) {
+    if (align < sizeof(void *) || (align & (align - 1))) return EINVAL;
+    void *p = memalign(align, n);
+    if (!p) return ENOMEM;
+    *out = p;
+    return 0;
+}
+}
+#endif
+
+#endif
+// _ALLOC_TRACKER_H_
@@ -0,0 +1,124 @@
+// appsrc_flow.h
+// Demand-driven feeding of an appsrc: only start work on a frame if appsrc will take it.
+//
+// appsrc keeps an internal queue bounded by max-bytes. It emits enough-data when the
+// queue is full and need-data when it drops below min-percent of that. AppsrcFlow
+// follows those two signals, and also checks current-level-bytes, because signals arrive
+// late and the bridges have several frames in flight:
+//   admit()  called before any processing. False while appsrc is saturated (enough-data
+//            seen and no need-data since, or not even one more frame fits); the caller
+//            sheds or holds the frame instead of spending CPU/FPGA time on it.
+//   push()   replaces gst_app_src_push_buffer. A frame that arrives while appsrc is
+//            saturated counts as wasted work: processed, only to sit in (or overflow)
+//            the appsrc queue.
+// With gating off (observe mode) admit() always says yes but the counters still run,
+// which gives the before/after comparison.
+//
+// max-bytes is sized in frames once the frame size is known (set_frame_bytes()).
+// admit() / push() may be called from any thread.
+
+#ifndef _APPSRC_FLOW_H_
+#define _APPSRC_FLOW_H_
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <stdint.h>
+#include <atomic>
+
+struct AppsrcFlowStats {
+    std::atomic<uint64_t> need_data{0};
+    std::atomic<uint64_t> enough_data{0};
+    std::atomic<uint64_t> admitted{0};
+    std::atomic<uint64_t> shed{0};          // refused by admit(): no work done
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> wasted{0};        // processed, but appsrc was saturated at push
+    std::atomic<uint64_t> push_errors{0};
+    std::atomic<uint64_t> max_level_bytes{0};
+};
+
+class AppsrcFlow {
+public:
+    AppsrcFlow() = default;
+    AppsrcFlow(const AppsrcFlow &) = delete;
+    AppsrcFlow &operator=(const AppsrcFlow &) = delete;
+
+    // queue_frames: appsrc queue depth in frames; gate: false = observe only
+    void configure(int queue_frames, bool gate) {
+        queue_frames_ = queue_frames > 0 ? queue_frames : 1;
+        gate_ = gate;
+    }
+
+    void attach(GstElement *appsrc) {
+        appsrc_ = appsrc;
+        // need-data again once half the queue has drained
+        g_object_set(appsrc_, "min-percent", 50, NULL);
+        g_signal_connect(appsrc_, "need-data", G_CALLBACK(need_data_cb), this);
+        g_signal_connect(appsrc_, "enough-data", G_CALLBACK(enough_data_cb), this);
+    }
+
+    // Bytes per output frame; (re)sizes max-bytes
+    void set_frame_bytes(uint64_t bytes) {
+        if (!appsrc_ || bytes == 0 || bytes == frame_bytes_.load(std::memory_order_relaxed)) return;
+        frame_bytes_.store(bytes, std::memory_order_relaxed);
+        g_object_set(appsrc_, "max-bytes", (guint64)(bytes * queue_frames_), NULL);
+    }
+
+    bool gating() const { return gate_; }
+    int queue_frames() const { return queue_frames_; }
+    uint64_t frame_bytes() const { return frame_bytes_.load(std::memory_order_relaxed); }
+    uint64_t max_bytes() const { return frame_bytes() * (uint64_t)queue_frames_; }
+    uint64_t level_bytes() const { return appsrc_ ? gst_app_src_get_current_level_bytes(GST_APP_SRC(appsrc_)) : 0; }
+    const AppsrcFlowStats &stats() const { return stats_; }
+
+    // appsrc cannot take another frame right now
+    bool saturated() const {
+        if (!starved_.load(std::memory_order_acquire)) return true;
+        const uint64_t fb = frame_bytes();
+        return fb > 0 && level_bytes() + fb > max_bytes();
+    }
+
+    bool admit() {
+        if (gate_ && saturated()) {
+            stats_.shed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        stats_.admitted.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Takes ownership of buf, like gst_app_src_push_buffer
+    GstFlowReturn push(GstBuffer *buf) {
+        if (saturated()) stats_.wasted.fetch_add(1, std::memory_order_relaxed);
+        GstFlowReturn ret = gst_app_src_push_buffer(GST_APP_SRC(appsrc_), buf);
+        if (ret == GST_FLOW_OK) stats_.pushed.fetch_add(1, std::memory_order_relaxed);
+        else stats_.push_errors.fetch_add(1, std::memory_order_relaxed);
+
+        const uint64_t level = level_bytes();
+        uint64_t prev = stats_.max_level_bytes.load(std::memory_order_relaxed);
+        while (level > prev && !stats_.max_level_bytes.compare_exchange_weak(prev, level)) {}
+        return ret;
+    }
+
+private:
+    static void need_data_cb(GstElement *, guint, gpointer user_data) {
+        auto *f = (AppsrcFlow *)user_data;
+        f->starved_.store(true, std::memory_order_release);
+        f->stats_.need_data.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void enough_data_cb(GstElement *, gpointer user_data) {
+        auto *f = (AppsrcFlow *)user_data;
+        f->starved_.store(false, std::memory_order_release);
+        f->stats_.enough_data.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    GstElement *appsrc_{nullptr};
+    int queue_frames_{2};
+    bool gate_{true};
+    std::atomic<uint64_t> frame_bytes_{0};
+    std::atomic<bool> starved_{true};   // need-data more recent than enough-data
+    AppsrcFlowStats stats_;
+};
+
+#endif
+// _APPSRC_FLOW_H_
@@ -0,0 +1,349 @@
+// async_log.h
+// Logging that never blocks the streaming thread. A log call copies its arguments into
+// a fixed-size record and pushes it to a lock-free ring; a background thread formats and
+// writes it. A g_print per frame on a serial console costs milliseconds; this costs a
+// ring push.
+//
+//   ALOG(LOG_INFO, 1000, "Elapsed time %.2f    Counter: %d\n", elapsed, frame);  // at most 1/s
+//   ALOG(LOG_WARN, 0, "[MEM] appsink: DMABuf=%s\n", dmabuf ? "YES" : "NO");     // no limit
+//   AsyncLog::instance().set_level(LOG_WARN);     // or ALOG_LEVEL=debug|info|warn|error
+//   AsyncLog::instance().report();                // written / dropped / rate-limited / filtered
+//
+// Each ALOG call site has its own rate limit (minimum interval in ms, 0 = none); the
+// messages it suppresses are counted and the next one it prints ends in "[+N suppressed]".
+// Filtered and rate-limited calls return before the arguments are evaluated, so they
+// must have no side effects.
+//
+// Formatting is lazy: the record keeps the site's format string and the raw arguments
+// (integers, doubles, pointers; strings are copied, up to ASYNC_LOG_STR_BYTES in total
+// per record), the drain thread runs printf on them. Length modifiers in the format are
+// ignored (arguments are stored widened), so G_GUINT64_FORMAT and plain %d both work;
+// '*' widths are not supported.
+//
+// When the ring is full the record is dropped and counted, never waited for. The drain
+// thread polls rather than parks, so producers never touch a mutex. Records left at exit
+// are written by the destructor.
+
+#ifndef _ASYNC_LOG_H_
+#define _ASYNC_LOG_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include "frame_ring.h"
+
+#define ASYNC_LOG_CAPACITY  1024
+#define ASYNC_LOG_MAX_ARGS  8
+#define ASYNC_LOG_STR_BYTES 96
+#define ASYNC_LOG_IDLE_US   2000
+
+enum LogLevel { LOG_DEBUG = 0, LOG_INFO, LOG_WARN, LOG_ERROR };
+
+// One per ALOG call site (static); the format string must outlive the program
+struct LogSite {
+    const char *fmt;
+    LogLevel level;
+    int64_t interval_us;
+    std::atomic<int64_t> next_us{0};
+    std::atomic<uint64_t> suppressed{0};
+
+    LogSite(const char *f, LogLevel l, int64_t iv) : fmt(f), level(l), interval_us(iv) {}
+};
+
+struct LogArg {
+    enum Kind : uint8_t { INT, UINT, DOUBLE, PTR, STR } kind;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void *p;
+        uint32_t str;   // offset into LogRecord::strings
+    };
+};
+
+struct LogRecord {
+    const LogSite *site;
+    uint64_t suppressed;   // by the site since its previous record
+    uint8_t nargs;
+    uint8_t truncated;     // more arguments than ASYNC_LOG_MAX_ARGS
+    uint16_t str_used;
+    LogArg args[ASYNC_LOG_MAX_ARGS];
+    char strings[ASYNC_LOG_STR_BYTES];
+};
+
+class AsyncLog {
+public:
+    static AsyncLog &instance() {
+        static AsyncLog log;
+        return log;
+    }
+
+    void set_level(LogLevel l) { level_.store(l, std::memory_order_relaxed); }
+    LogLevel level() const { return (LogLevel)level_.load(std::memory_order_relaxed); }
+
+    // Severity and rate limit; true = format the arguments and write()
+    bool admit(LogSite &s) {
+        if (s.level < level_.load(std::memory_order_relaxed)) {
+            filtered_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (s.interval_us <= 0) return true;
+        const int64_t now = g_get_monotonic_time();
+        int64_t next = s.next_us.load(std::memory_order_relaxed);
+        // Losing the CAS means another thread just took this interval's slot
+        if (now < next || !s.next_us.compare_exchange_strong(next, now + s.interval_us, std::memory_order_relaxed)) {
+            s.suppressed.fetch_add(1, std::memory_order_relaxed);
+            rate_limited_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // Producer side: copies the arguments, one try_push, never blocks
+    template <typename... Args>
+    void write(LogSite &s, const Args &...args) {
+        LogRecord r;
+        r.site = &s;
+        r.suppressed = s.interval_us > 0 ? s.suppressed.exchange(0, std::memory_order_relaxed) : 0;
+        r.nargs = 0;
+        r.truncated = 0;
+        r.str_used = 0;
+        int unused[] = {0, (pack(r, args), 0)...};
+        (void)unused;
+        if (!ring_.try_push(r)) dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    uint64_t rate_limited() const { return rate_limited_.load(std::memory_order_relaxed); }
+    uint64_t filtered() const { return filtered_.load(std::memory_order_relaxed); }
+
+    // Totals since startup; goes through the ring like any other message
+    void report();
+
+    // Writes what is queued and ends the drain thread; later messages are dropped
+    void stop() {
+        if (!worker_.joinable()) return;
+        quit_.store(true, std::memory_order_release);
+        worker_.join();
+    }
+
+    ~AsyncLog() { stop(); }
+
+private:
+    AsyncLog() : ring_(ASYNC_LOG_CAPACITY) {
+        const char *env = getenv("ALOG_LEVEL");
+        if (env) {
+            if (!g_ascii_strcasecmp(env, "debug")) set_level(LOG_DEBUG);
+            else if (!g_ascii_strcasecmp(env, "info")) set_level(LOG_INFO);
+            else if (!g_ascii_strcasecmp(env, "warn")) set_level(LOG_WARN);
+            else if (!g_ascii_strcasecmp(env, "error")) set_level(LOG_ERROR);
+        }
+        worker_ = std::thread([this] { run(); });
+    }
+    AsyncLog(const AsyncLog &) = delete;
+    AsyncLog &operator=(const AsyncLog &) = delete;
+
+    /* ---------- producer: argument capture ---------- */
+
+    static LogArg *next_arg(LogRecord &r) {
+        if (r.nargs == ASYNC_LOG_MAX_ARGS) {
+            r.truncated = 1;
+            return nullptr;
+        }
+        return &r.args[r.nargs++];
+    }
+
+    static void pack_str(LogRecord &r, const char *s) {
+        LogArg *a = next_arg(r);
+        if (!a) return;
+        a->kind = LogArg::STR;
+        a->str = r.str_used;
+        if (!s) s = "(null)";
+        // Always room for the terminator: the last byte is never handed out
+        const size_t room = ASYNC_LOG_STR_BYTES - 1 - r.str_used;
+        size_t n = strlen(s);
+        if (n > room) n = room;
+        memcpy(r.strings + r.str_used, s, n);
+        r.strings[r.str_used + n] = '\0';
+        r.str_used += n + (r.str_used + n < ASYNC_LOG_STR_BYTES - 1 ? 1 : 0);
+    }
+
+    static void pack(LogRecord &r, const char *s) { pack_str(r, s); }
+    static void pack(LogRecord &r, char *s) { pack_str(r, s); }
+    static void pack(LogRecord &r, const std::string &s) { pack_str(r, s.c_str()); }
+
+    static void pack(LogRecord &r, double v) {
+        LogArg *a = next_arg(r);
+        if (!a) return;
+        a->kind = LogArg::DOUBLE;
+        a->d = v;
+    }
+
+    template <typename T>
+    static void pack(LogRecord &r, T *v) {
+        LogArg *a = next_arg(r);
+        if (!a) return;
+        a->kind = LogArg::PTR;
+        a->p = (const void *)v;
+    }
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, int>::type = 0>
+    static void pack(LogRecord &r, T v) {
+        LogArg *a = next_arg(r);
+        if (!a) return;
+        if (std::is_signed<T>::value || std::is_enum<T>::value) {
+            a->kind = LogArg::INT;
+            a->i = (int64_t)v;
+        } else {
+            a->kind = LogArg::UINT;
+            a->u = (uint64_t)v;
+        }
+    }
+
+    /* ---------- drain thread: formatting ---------- */
+
+    void run() {
+        LogRecord r;
+        std::string out;
+        for (;;) {
+            if (ring_.try_pop(r)) {
+                format(r, out);
+                emit(r.site->level, out);
+                continue;
+            }
+            if (quit_.load(std::memory_order_acquire)) {
+                while (ring_.try_pop(r)) {
+                    format(r, out);
+                    emit(r.site->level, out);
+                }
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(ASYNC_LOG_IDLE_US));
+        }
+    }
+
+    void emit(LogLevel level, const std::string &s) {
+        FILE *f = level >= LOG_WARN ? stderr : stdout;
+        fwrite(s.data(), 1, s.size(), f);
+        fflush(f);
+        written_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // printf over the stored arguments, one conversion at a time
+    static void format(const LogRecord &r, std::string &out) {
+        out.clear();
+        const char *p = r.site->fmt;
+        int argi = 0;
+        char spec[32], buf[256];
+        while (*p) {
+            if (*p != '%') {
+                const char *q = strchr(p, '%');
+                const size_t n = q ? (size_t)(q - p) : strlen(p);
+                out.append(p, n);
+                p += n;
+                continue;
+            }
+            if (p[1] == '%') {
+                out += '%';
+                p += 2;
+                continue;
+            }
+            // %[flags][width][.precision][length]conv; length is dropped, ours is appended
+            const char *start = p++;
+            size_t sl = 0;
+            spec[sl++] = '%';
+            while (*p && strchr("-+ #0123456789.", *p) && sl < sizeof(spec) - 4) spec[sl++] = *p++;
+            while (*p && strchr("hlLqjzt", *p)) ++p;
+            const char conv = *p;
+            if (!conv) {
+                out.append(start);
+                break;
+            }
+            ++p;
+            if (argi >= r.nargs) {
+                out.append(r.truncated ? "<?>" : start, r.truncated ? 3 : (size_t)(p - start));
+                continue;
+            }
+            const LogArg &a = r.args[argi++];
+            int n = 0;
+            if (strchr("diouxXc", conv)) {
+                const int64_t iv = a.kind == LogArg::DOUBLE ? (int64_t)a.d : a.i;
+                if (conv == 'c') {
+                    spec[sl++] = 'c';
+                    spec[sl] = '\0';
+                    n = snprintf(buf, sizeof(buf), spec, (int)iv);
+                } else {
+                    spec[sl++] = 'l';
+                    spec[sl++] = 'l';
+                    spec[sl++] = conv;
+                    spec[sl] = '\0';
+                    n = snprintf(buf, sizeof(buf), spec, (long long)iv);
+                }
+            } else if (strchr("eEfFgGaA", conv)) {
+                const double dv = a.kind == LogArg::DOUBLE ? a.d
+                                  : a.kind == LogArg::UINT ? (double)a.u
+                                                           : (double)a.i;
+                spec[sl++] = conv;
+                spec[sl] = '\0';
+                n = snprintf(buf, sizeof(buf), spec, dv);
+            } else if (conv == 's') {
+                spec[sl++] = 's';
+                spec[sl] = '\0';
+                n = snprintf(buf, sizeof(buf), spec, a.kind == LogArg::STR ? r.strings + a.str : "<?>");
+            } else if (conv == 'p') {
+                spec[sl++] = 'p';
+                spec[sl] = '\0';
+                n = snprintf(buf, sizeof(buf), spec, a.p);
+            } else {
+                out.append(start, p - start);   // unsupported (%n, %*d): verbatim
+                continue;
+            }
+            if (n > 0) out.append(buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+        }
+        if (r.suppressed) {
+            char tail[48];
+            snprintf(tail, sizeof(tail), " [+%" G_GUINT64_FORMAT " suppressed]", r.suppressed);
+            const bool nl = !out.empty() && out.back() == '\n';
+            if (nl) out.pop_back();
+            out += tail;
+            if (nl) out += '\n';
+        }
+    }
+
+    MpmcRing<LogRecord> ring_;
+    std::thread worker_;
+    std::atomic<bool> quit_{false};
+    std::atomic<int> level_{LOG_INFO};
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> rate_limited_{0};
+    std::atomic<uint64_t> filtered_{0};
+};
+
+// Filtered / rate-limited calls don't evaluate the arguments
+#define ALOG(level, every_ms, ...)                                                          \
+    do {                                                                                    \
+        static LogSite alog_site_(ALOG_FMT_(__VA_ARGS__, ""), level, (int64_t)(every_ms) * 1000); \
+        AsyncLog &alog_ = AsyncLog::instance();                                             \
+        if (alog_.admit(alog_site_)) ALOG_WRITE_(alog_, alog_site_, __VA_ARGS__);           \
+    } while (0)
+#define ALOG_FMT_(fmt, ...) fmt
+#define ALOG_WRITE_(log, site, fmt, ...) (log).write(site, ##__VA_ARGS__)
+
+inline void AsyncLog::report() {
+    static LogSite site("Log: written %" G_GUINT64_FORMAT " | dropped %" G_GUINT64_FORMAT " (ring full) | rate-limited %"
+                        G_GUINT64_FORMAT " | filtered %" G_GUINT64_FORMAT "\n", LOG_INFO, 0);
+    write(site, written(), dropped(), rate_limited(), filtered());
+}
+
+#endif
+// _ASYNC_LOG_H_
@@ -0,0 +1,135 @@
+// backend_bench.cpp
+// Head-to-head per-frame overhead of the OpenCL (xcl2) and native XRT backends.
+// Feeds the same synthetic Y planes through each backend and prints the host-side
+// write / kernel / read split, p50/p99 of the total, and the output mismatch count.
+//
+// Build:
+// g++ -O3 -DNDEBUG -std=c++17 -DWITH_XRT backend_bench.cpp -o backend_bench \
+//   $(pkg-config --cflags --libs glib-2.0) -lpthread -lxilinxopencl -lOpenCL \
+//   -I<path_to_xcl2_header> -I$XILINX_XRT/include -L$XILINX_XRT/lib -lxrt_coreutil
+//
+// Run (hardware or XCL_EMULATION_MODE=sw_emu):
+//   ./backend_bench --width=3840 --height=2160 --frames=300 --backends=ocl,xrt --xclbin=krnl_hist_equalize.xclbin
+//   (--kernel=<name> benchmarks another kernel from the same xclbin)
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "frame_backend.h"
+#include "synthetic_frame.h"
+
+struct BenchResult {
+    std::vector<uint64_t> total_us;
+    uint64_t write_us{0};
+    uint64_t kernel_us{0};
+    uint64_t read_us{0};
+    int failures{0};
+};
+
+static uint64_t percentile(std::vector<uint64_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t idx = (size_t)(p * (double)(v.size() - 1));
+    return v[idx];
+}
+
+int main(int argc, char *argv[]) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    int width = 1920, height = 1080, frames = 200, warmup = 10;
+    const char *backends = "ocl,xrt";
+    const char *xclbin_path = NULL;
+    const char *kernel_name = NULL;
+
+    for (int i=1;i<argc;++i){
+        if (g_str_has_prefix(argv[i],"--width=")) { int w=atoi(strchr(argv[i],'=')+1); if(w>0) width=w; }
+        else if (g_str_has_prefix(argv[i],"--height=")) { int h=atoi(strchr(argv[i],'=')+1); if(h>0) height=h; }
+        else if (g_str_has_prefix(argv[i],"--frames=")) { int f=atoi(strchr(argv[i],'=')+1); if(f>0) frames=f; }
+        else if (g_str_has_prefix(argv[i],"--warmup=")) { int w=atoi(strchr(argv[i],'=')+1); if(w>=0) warmup=w; }
+        else if (g_str_has_prefix(argv[i],"--backends=")) { backends = strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--xclbin=")) { xclbin_path = strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--kernel=")) { kernel_name = strchr(argv[i],'=')+1; }
+    }
+
+    const size_t y_size = (size_t)width * (size_t)height;
+    std::vector<uint8_t> y_in(y_size);
+    std::vector<uint8_t> y_ref;   // first backend's output, for cross-checking
+    std::vector<uint8_t> y_out(y_size);
+
+    g_print("Backend bench: %dx%d, %d frames (+%d warm-up)%s\n", width, height, frames, warmup,
+            g_getenv("XCL_EMULATION_MODE") ? " [emulation]" : "");
+
+    gchar **names = g_strsplit(backends, ",", -1);
+    for (gchar **n = names; *n; ++n) {
+        std::unique_ptr<FrameBackend> be = make_frame_backend(*n, xclbin_path);
+        if (be && kernel_name) be->request_kernel(kernel_name);
+        if (!be || !be->init(width, height)) {
+            g_printerr("Skipping backend '%s'\n", *n);
+            continue;
+        }
+
+        BenchResult res;
+        res.total_us.reserve(frames);
+        size_t mismatched = 0;
+
+        for (int f = 0; f < warmup + frames; ++f) {
+            fill_synthetic_frame(y_in, width, height, f);
+            if (!be->process_y(y_in.data(), y_out.data(), width, height)) {
+                res.failures++;
+                continue;
+            }
+            if (f < warmup) continue;
+
+            const BackendTimings &t = be->last_timings();
+            res.total_us.push_back(t.total_us);
+            res.write_us += t.write_us;
+            res.kernel_us += t.kernel_us;
+            res.read_us += t.read_us;
+
+            // Last frame is kept to compare backends bit-for-bit
+            if (f == warmup + frames - 1) {
+                if (y_ref.empty()) {
+                    y_ref = y_out;
+                } else {
+                    for (size_t i = 0; i < y_size; ++i) mismatched += (y_ref[i] != y_out[i]);
+                }
+            }
+        }
+
+        size_t n_ok = res.total_us.size();
+        if (n_ok == 0) {
+            g_printerr("Backend '%s': no successful frames (%d failures)\n", *n, res.failures);
+            continue;
+        }
+        uint64_t sum_total = 0;
+        for (uint64_t v : res.total_us) sum_total += v;
+        double avg_total = (double)sum_total / n_ok / 1000.0;
+        double avg_kernel = (double)res.kernel_us / n_ok / 1000.0;
+
+        g_print(
+            "\n=== %s (%s) ===\n"
+            "Frames: %zu ok, %d failed\n"
+            "Avg write:   %7.3f ms\n"
+            "Avg kernel:  %7.3f ms\n"
+            "Avg read:    %7.3f ms\n"
+            "Avg total:   %7.3f ms (p50 %.3f, p99 %.3f, max %.3f)\n"
+            "Overhead:    %7.3f ms/frame outside the kernel\n"
+            "Mismatch vs first backend: %zu px\n",
+            be->name(), be->active_kernel_name(), n_ok, res.failures,
+            (double)res.write_us / n_ok / 1000.0,
+            avg_kernel,
+            (double)res.read_us / n_ok / 1000.0,
+            avg_total,
+            percentile(res.total_us, 0.50) / 1000.0,
+            percentile(res.total_us, 0.99) / 1000.0,
+            percentile(res.total_us, 1.00) / 1000.0,
+            avg_total - avg_kernel,
+            mismatched);
+    }
+    g_strfreev(names);
+    return 0;
+}
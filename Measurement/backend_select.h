@@ -0,0 +1,280 @@
+// backend_select.h
+// Cost-model backend choice per negotiated geometry.
+//
+// Every candidate FrameBackend (cpu, ocl/xrt, passthrough) is timed on a synthetic Y
+// plane of the stream's width x height. Results are kept in a small text cache keyed by
+// backend/kernel and geometry, so later runs at the same resolution skip the
+// measurement. The selector then picks the fastest processing backend whose p95 fits in
+// the frame budget (period * headroom). Passthrough is only used when none fits.
+// Call select() again when caps change, or after reselect() when a candidate switched
+// kernels (a requested switch is adopted first, so the new kernel is what gets timed);
+// every decision is logged with the numbers behind it.
+//
+// Cache format, one line per entry:
+//   <backend>/<kernel> <width> <height> <frames> <mean_us> <p95_us>
+
+#ifndef _BACKEND_SELECT_H_
+#define _BACKEND_SELECT_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frame_backend.h"
+
+struct CalibEntry {
+    std::string key;
+    int width{0};
+    int height{0};
+    int frames{0};
+    uint64_t mean_us{0};
+    uint64_t p95_us{0};
+};
+
+class BackendSelector {
+public:
+    BackendSelector() {}
+
+    // Candidates, in order of preference when timings tie. Takes ownership.
+    void add(std::unique_ptr<FrameBackend> be) {
+        if (be) candidates_.push_back(std::move(be));
+    }
+
+    void set_fps(int fps) { fps_ = fps > 0 ? fps : 60; }
+    void set_headroom(double h) { headroom_ = std::min(std::max(h, 0.1), 1.0); }
+    void set_calibration_frames(int n) { calib_frames_ = std::max(n, 3); }
+    void set_cache_path(const char *path) { cache_path_ = path ? path : ""; }
+    // Ignore cached entries and measure again (entries are rewritten afterwards)
+    void set_recalibrate(bool r) { recalibrate_ = r; }
+
+    FrameBackend *active() const { return active_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // Any candidate that drives the device, for the kernel/chain control commands
+    FrameBackend *fpga() const {
+        for (const auto &c : candidates_) {
+            if (!is_host(c.get())) return c.get();
+        }
+        return nullptr;
+    }
+
+    // Forget the measurements for the current geometry; the next select() re-measures
+    void invalidate() {
+        recalibrate_ = true;
+        reselect();
+    }
+
+    // Choose again at the next select(), keeping cached timings (e.g. after a kernel switch)
+    void reselect() { width_ = height_ = 0; }
+
+    // Choose a backend for width x height. Returns the active one (unchanged when the
+    // geometry has not changed), or nullptr when no candidate could be initialised.
+    FrameBackend *select(int width, int height) {
+        if (active_ && width == width_ && height == height_) return active_;
+        if (!cache_loaded_) load_cache();
+
+        const uint64_t period_us = 1000000 / (uint64_t)fps_;
+        const uint64_t budget_us = (uint64_t)((double)period_us * headroom_);
+        g_print("[select] %dx%d @ %d fps: frame budget %.2f ms (%.0f%% of %.2f ms)\n", width, height, fps_,
+                budget_us / 1000.0, headroom_ * 100.0, period_us / 1000.0);
+
+        struct Row {
+            FrameBackend *be;
+            CalibEntry e;
+            bool ok;
+            bool cached;
+        };
+        std::vector<Row> rows;
+        bool cache_dirty = false;
+        for (const auto &c : candidates_) {
+            c->apply_pending_kernel();   // key and timings are for the kernel that will run
+            Row r{c.get(), {}, false, false};
+            std::string key = key_for(c.get());
+            const CalibEntry *hit = recalibrate_ ? nullptr : find(key, width, height);
+            if (hit) {
+                // Cached timings still need a live backend
+                r.ok = c->init(width, height);
+                r.e = *hit;
+                r.cached = true;
+            } else {
+                r.ok = measure(c.get(), width, height, r.e);
+                if (r.ok) {
+                    store(r.e);
+                    cache_dirty = true;
+                }
+            }
+            rows.push_back(r);
+        }
+        recalibrate_ = false;
+        if (cache_dirty) save_cache();
+
+        // Fastest processing backend that fits, else passthrough, else the fastest one
+        const Row *best = nullptr, *fastest = nullptr, *fallback = nullptr;
+        for (const Row &r : rows) {
+            if (!r.ok) continue;
+            if (is_passthrough(r.be)) {
+                if (!fallback) fallback = &r;
+                continue;
+            }
+            if (!fastest || r.e.p95_us < fastest->e.p95_us) fastest = &r;
+            if (r.e.p95_us <= budget_us && (!best || r.e.p95_us < best->e.p95_us)) best = &r;
+        }
+
+        for (const Row &r : rows) {
+            if (!r.ok) {
+                g_print("[select]   %-28s unavailable\n", key_for(r.be).c_str());
+                continue;
+            }
+            g_print("[select]   %-28s mean %6.2f ms  p95 %6.2f ms  %-6s (%s)\n", r.e.key.c_str(),
+                    r.e.mean_us / 1000.0, r.e.p95_us / 1000.0,
+                    is_passthrough(r.be) ? "-" : (r.e.p95_us <= budget_us ? "fits" : "misses"),
+                    r.cached ? "cached" : "measured");
+        }
+
+        const Row *pick = nullptr;
+        if (best) {
+            pick = best;
+            g_print("[select] -> %s: fastest processing backend within the %.2f ms budget\n",
+                    pick->be->name(), budget_us / 1000.0);
+        } else if (fallback) {
+            pick = fallback;
+            if (fastest) {
+                g_print("[select] -> %s: no processing backend fits (fastest %s p95 %.2f ms > %.2f ms)\n",
+                        pick->be->name(), fastest->be->name(), fastest->e.p95_us / 1000.0, budget_us / 1000.0);
+            } else {
+                g_print("[select] -> %s: no processing backend available\n", pick->be->name());
+            }
+        } else if (fastest) {
+            pick = fastest;
+            g_print("[select] -> %s: misses the budget (p95 %.2f ms > %.2f ms) but is the fastest available\n",
+                    pick->be->name(), fastest->e.p95_us / 1000.0, budget_us / 1000.0);
+        } else {
+            g_printerr("[select] No usable backend for %dx%d\n", width, height);
+            return nullptr;
+        }
+
+        active_ = pick->be;
+        width_ = width;
+        height_ = height;
+        return active_;
+    }
+
+private:
+    static bool is_passthrough(const FrameBackend *be) { return strcmp(be->name(), "passthrough") == 0; }
+    static bool is_host(const FrameBackend *be) { return is_passthrough(be) || strcmp(be->name(), "cpu") == 0; }
+
+    static std::string key_for(const FrameBackend *be) {
+        return std::string(be->name()) + "/" + be->active_kernel_name();
+    }
+
+    // Time process_y() end to end on a synthetic low-contrast plane
+    bool measure(FrameBackend *be, int width, int height, CalibEntry &out) {
+        if (!be->init(width, height)) return false;
+        const size_t y_size = (size_t)width * (size_t)height;
+        std::vector<uint8_t> y_in(y_size), y_out(y_size);
+        for (int r = 0; r < height; ++r) {
+            for (int c = 0; c < width; ++c) y_in[(size_t)r * width + c] = (uint8_t)(64 + ((r + c) & 63));
+        }
+
+        const int warmup = 3;
+        std::vector<uint64_t> samples;
+        samples.reserve(calib_frames_);
+        for (int f = 0; f < warmup + calib_frames_; ++f) {
+            auto t0 = std::chrono::steady_clock::now();
+            if (!be->process_y(y_in.data(), y_out.data(), width, height)) return false;
+            uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - t0).count();
+            if (f >= warmup) samples.push_back(us);
+        }
+
+        uint64_t sum = 0;
+        for (uint64_t v : samples) sum += v;
+        std::sort(samples.begin(), samples.end());
+        out.key = key_for(be);
+        out.width = width;
+        out.height = height;
+        out.frames = (int)samples.size();
+        out.mean_us = sum / samples.size();
+        out.p95_us = samples[(size_t)(0.95 * (double)(samples.size() - 1))];
+        return true;
+    }
+
+    const CalibEntry *find(const std::string &key, int width, int height) const {
+        for (const auto &e : cache_) {
+            if (e.key == key && e.width == width && e.height == height) return &e;
+        }
+        return nullptr;
+    }
+
+    void store(const CalibEntry &e) {
+        for (auto &c : cache_) {
+            if (c.key == e.key && c.width == e.width && c.height == e.height) {
+                c = e;
+                return;
+            }
+        }
+        cache_.push_back(e);
+    }
+
+    void load_cache() {
+        cache_loaded_ = true;
+        if (cache_path_.empty()) return;
+        FILE *f = fopen(cache_path_.c_str(), "r");
+        if (!f) return;
+        char line[256], key[128];
+        while (fgets(line, sizeof(line), f)) {
+            if (line[0] == '#') continue;
+            CalibEntry e;
+            unsigned long long mean = 0, p95 = 0;
+            if (sscanf(line, "%127s %d %d %d %llu %llu", key, &e.width, &e.height, &e.frames, &mean, &p95) == 6) {
+                e.key = key;
+                e.mean_us = mean;
+                e.p95_us = p95;
+                cache_.push_back(e);
+            }
+        }
+        fclose(f);
+        g_print("[select] Loaded %zu calibration entries from %s\n", cache_.size(), cache_path_.c_str());
+    }
+
+    void save_cache() const {
+        if (cache_path_.empty()) return;
+        std::string tmp = cache_path_ + ".tmp";
+        FILE *f = fopen(tmp.c_str(), "w");
+        if (!f) {
+            g_printerr("[select] Cannot write %s\n", tmp.c_str());
+            return;
+        }
+        fprintf(f, "# backend/kernel width height frames mean_us p95_us\n");
+        for (const auto &e : cache_) {
+            fprintf(f, "%s %d %d %d %llu %llu\n", e.key.c_str(), e.width, e.height, e.frames,
+                    (unsigned long long)e.mean_us, (unsigned long long)e.p95_us);
+        }
+        fclose(f);
+        rename(tmp.c_str(), cache_path_.c_str());
+    }
+
+    std::vector<std::unique_ptr<FrameBackend>> candidates_;
+    FrameBackend *active_{nullptr};
+    int width_{0};
+    int height_{0};
+
+    int fps_{60};
+    double headroom_{0.85};   // the rest of the period goes to mapping, UV fill and push
+    int calib_frames_{20};
+    bool recalibrate_{false};
+
+    std::string cache_path_;
+    bool cache_loaded_{false};
+    std::vector<CalibEntry> cache_;
+};
+
+#endif
+// _BACKEND_SELECT_H_
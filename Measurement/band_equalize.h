@@ -0,0 +1,105 @@
+// band_equalize.h
+// Intra-frame parallel histogram equalization of an 8-bit plane.
+//
+// The plane is cut into row bands (a few per thread, so one interrupted core doesn't
+// leave the others idle at the end) and run on a persistent ForkJoinPool:
+//   1. each band adds into the private histogram of the thread that runs it; the
+//      histograms are cache-line aligned and padded, so no two threads write the same line
+//   2. after the join the per-thread histograms are summed and the LUT is built once
+//      (hist_lut.h, same result as cv::equalizeHist); nothing is shared during the
+//      parallel phases, so there are no locks or atomics on the pixel path
+//   3. a second parallel pass applies the LUT band by band
+// in and out may alias (in-place).
+
+#ifndef _BAND_EQUALIZE_H_
+#define _BAND_EQUALIZE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "hist_lut.h"
+#include "thread_pool.h"
+
+struct BandEqualizeStats {
+    uint64_t hist_us{0};   // phase 1
+    uint64_t lut_us{0};    // reduce + LUT
+    uint64_t apply_us{0};  // phase 2
+    uint64_t total_us{0};
+    int bands{0};
+};
+
+class BandEqualizer {
+public:
+    // threads: total way parallelism including the caller (1 = run inline)
+    explicit BandEqualizer(int threads = 1, int bands_per_thread = 4)
+        : pool_(std::max(threads, 1) - 1), hist_(pool_.concurrency()),
+          bands_per_thread_(std::max(bands_per_thread, 1)) {}
+
+    BandEqualizer(const BandEqualizer &) = delete;
+    BandEqualizer &operator=(const BandEqualizer &) = delete;
+
+    int threads() const { return pool_.concurrency(); }
+    const BandEqualizeStats &last() const { return last_; }
+    const uint8_t *lut() const { return lut_; }
+
+    void equalize(const uint8_t *in, size_t in_stride, uint8_t *out, size_t out_stride, int width, int height) {
+        if (width <= 0 || height <= 0) return;
+        auto t0 = std::chrono::steady_clock::now();
+        const int n_bands = std::min(height, pool_.concurrency() * bands_per_thread_);
+
+        for (auto &h : hist_) memset(h.bins, 0, sizeof(h.bins));
+        pool_.run(n_bands, [&](int band, int worker) {
+            int r0 = band_start(height, band, n_bands);
+            int r1 = band_start(height, band + 1, n_bands);
+            hist_accumulate(in + (size_t)r0 * in_stride, in_stride, width, r1 - r0, hist_[worker].bins);
+        });
+        auto t1 = std::chrono::steady_clock::now();
+
+        // 256 x threads adds: cheaper on the caller than another fork-join
+        for (size_t w = 1; w < hist_.size(); ++w) {
+            for (int i = 0; i < HIST_BINS; ++i) hist_[0].bins[i] += hist_[w].bins[i];
+        }
+        lut_from_hist(hist_[0].bins, (uint64_t)width * (uint64_t)height, lut_);
+        auto t2 = std::chrono::steady_clock::now();
+
+        pool_.run(n_bands, [&](int band, int) {
+            int r0 = band_start(height, band, n_bands);
+            int r1 = band_start(height, band + 1, n_bands);
+            lut_apply(in + (size_t)r0 * in_stride, in_stride, out + (size_t)r0 * out_stride, out_stride,
+                      width, r1 - r0, lut_);
+        });
+        auto t3 = std::chrono::steady_clock::now();
+
+        last_.hist_us = us_between(t0, t1);
+        last_.lut_us = us_between(t1, t2);
+        last_.apply_us = us_between(t2, t3);
+        last_.total_us = us_between(t0, t3);
+        last_.bands = n_bands;
+    }
+
+private:
+    // Padded so per-thread histograms never share a cache line
+    struct alignas(64) PaddedHist {
+        uint32_t bins[HIST_BINS];
+    };
+
+    static int band_start(int rows, int band, int n_bands) {
+        return (int)((int64_t)rows * band / n_bands);
+    }
+
+    static uint64_t us_between(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(b - a).count();
+    }
+
+    ForkJoinPool pool_;
+    std::vector<PaddedHist> hist_;
+    int bands_per_thread_;
+    uint8_t lut_[HIST_BINS]{};
+    BandEqualizeStats last_{};
+};
+
+#endif
+// _BAND_EQUALIZE_H_
@@ -0,0 +1,129 @@
+// band_equalize_bench.cpp
+// Scaling curve for the band-parallel equalizer (band_equalize.h): 1..N threads at
+// 2K (1920x1080) and 4K (3840x2160) on a synthetic Y plane. For every thread count the
+// output is checked against a plain single-threaded equalization (hist_lut.h, which
+// matches cv::equalizeHist bit for bit).
+//
+// Reported per row: median and p95 frame time, frames/s, speed-up over 1 thread,
+// parallel efficiency (speed-up / threads) and the median split between histogram,
+// reduce+LUT and apply.
+//
+// Build:
+// g++ -O3 -DNDEBUG -std=c++17 band_equalize_bench.cpp -o band_equalize_bench \
+//   $(pkg-config --cflags --libs glib-2.0) -lpthread
+//
+// Run:
+//   ./band_equalize_bench                       # 1..nproc threads, 2K and 4K
+//   ./band_equalize_bench --max-threads=4 --frames=200 --bands-per-thread=2
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "band_equalize.h"
+
+struct Geometry {
+    const char *name;
+    int width;
+    int height;
+};
+
+// Gradient plus noise, with a dark and a saturated block so the LUT is non-trivial
+static void fill_plane(std::vector<uint8_t> &plane, int width, int height) {
+    uint32_t s = 0x12345678u;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+            int v = 40 + (x * 120) / width + (y * 40) / height + (int)(s & 15);
+            if (x < width / 8 && y < height / 8) v = 8 + (int)(s & 3);
+            if (x > width * 7 / 8 && y > height * 7 / 8) v = 250;
+            plane[(size_t)y * width + x] = (uint8_t)std::min(v, 255);
+        }
+    }
+}
+
+static void reference_equalize(const uint8_t *in, uint8_t *out, int width, int height) {
+    uint32_t hist[HIST_BINS] = {0};
+    uint8_t lut[HIST_BINS];
+    hist_accumulate(in, width, width, height, hist);
+    lut_from_hist(hist, (uint64_t)width * height, lut);
+    lut_apply(in, width, out, width, width, height, lut);
+}
+
+static uint64_t median(std::vector<uint64_t> v) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+static uint64_t p95(std::vector<uint64_t> v) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(0.95 * (double)(v.size() - 1))];
+}
+
+int main(int argc, char *argv[]) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    int max_threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    int frames = 100, warmup = 5, bands_per_thread = 4;
+
+    for (int i=1;i<argc;++i){
+        if (g_str_has_prefix(argv[i],"--max-threads=")) { int t=atoi(strchr(argv[i],'=')+1); if(t>0) max_threads=t; }
+        else if (g_str_has_prefix(argv[i],"--frames=")) { int f=atoi(strchr(argv[i],'=')+1); if(f>0) frames=f; }
+        else if (g_str_has_prefix(argv[i],"--warmup=")) { int w=atoi(strchr(argv[i],'=')+1); if(w>=0) warmup=w; }
+        else if (g_str_has_prefix(argv[i],"--bands-per-thread=")) { int b=atoi(strchr(argv[i],'=')+1); if(b>0) bands_per_thread=b; }
+    }
+
+    const Geometry geoms[] = {{"2K", 1920, 1080}, {"4K", 3840, 2160}};
+
+    g_print("Band equalize scaling: 1..%d threads, %d frames (+%d warm-up), %d bands/thread, %u cores online\n",
+            max_threads, frames, warmup, bands_per_thread, std::thread::hardware_concurrency());
+
+    int failures = 0;
+    for (const Geometry &g : geoms) {
+        const size_t n = (size_t)g.width * g.height;
+        std::vector<uint8_t> in(n), out(n), ref(n);
+        fill_plane(in, g.width, g.height);
+        reference_equalize(in.data(), ref.data(), g.width, g.height);
+
+        g_print("\n%s %dx%d\n", g.name, g.width, g.height);
+        g_print("  threads  median ms   p95 ms     fps   speedup  eff%%   hist ms   lut ms  apply ms  check\n");
+
+        double base_ms = 0.0;
+        for (int t = 1; t <= max_threads; ++t) {
+            BandEqualizer eq(t, bands_per_thread);
+            std::vector<uint64_t> total, hist, lut, apply;
+            total.reserve(frames); hist.reserve(frames); lut.reserve(frames); apply.reserve(frames);
+
+            for (int f = 0; f < warmup + frames; ++f) {
+                eq.equalize(in.data(), g.width, out.data(), g.width, g.width, g.height);
+                if (f < warmup) continue;
+                const BandEqualizeStats &s = eq.last();
+                total.push_back(s.total_us);
+                hist.push_back(s.hist_us);
+                lut.push_back(s.lut_us);
+                apply.push_back(s.apply_us);
+            }
+
+            const bool exact = memcmp(out.data(), ref.data(), n) == 0;
+            if (!exact) failures++;
+
+            const double med_ms = median(total) / 1000.0;
+            if (t == 1) base_ms = med_ms;
+            const double speedup = med_ms > 0.0 ? base_ms / med_ms : 0.0;
+            g_print("  %7d  %9.3f  %7.3f  %6.1f  %7.2fx  %4.0f  %8.3f  %7.3f  %8.3f  %s\n",
+                    t, med_ms, p95(total) / 1000.0, med_ms > 0.0 ? 1000.0 / med_ms : 0.0,
+                    speedup, 100.0 * speedup / t,
+                    median(hist) / 1000.0, median(lut) / 1000.0, median(apply) / 1000.0,
+                    exact ? "exact" : "MISMATCH");
+        }
+    }
+
+    if (failures) g_printerr("\n%d run(s) did not match the single-threaded reference\n", failures);
+    return failures ? 1 : 0;
+}
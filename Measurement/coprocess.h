@@ -0,0 +1,275 @@
+// coprocess.h
+// Heterogeneous CPU + device equalization of one Y plane, split by rows.
+//
+// Each frame:
+//   1. rows [0, split) go to the device, rows [split, H) to a CPU fork-join pool
+//   2. both sides build partial histograms concurrently (CPU: one padded histogram per thread)
+//   3. partial histograms are summed into one global histogram -> one LUT (hist_lut.h)
+//   4. both sides apply that LUT to their own rows concurrently
+//   5. the split is moved toward the ratio at which both sides would have finished
+//      together, using the rows/us each side actually achieved this frame
+//
+// The output is bit-identical to equalizing the whole frame at once, whatever the split.
+// RowDevice is the seam for the accelerator; EmulatedRowDevice stands in for it with a
+// configurable throughput and launch latency so the balancer can be exercised without
+// hardware.
+
+#ifndef _COPROCESS_H_
+#define _COPROCESS_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hist_lut.h"
+#include "thread_pool.h"
+
+/* ---------- Device side ---------- */
+
+class RowDevice {
+public:
+    virtual ~RowDevice() {}
+    virtual const char *name() const = 0;
+    // Histogram of `rows` rows starting at plane (accumulates into hist)
+    virtual bool hist_rows(const uint8_t *plane, size_t stride, int width, int rows, uint32_t *hist) = 0;
+    // out = lut[in] over `rows` rows
+    virtual bool apply_rows(const uint8_t *in, size_t in_stride, uint8_t *out, size_t out_stride,
+                            int width, int rows, const uint8_t *lut) = 0;
+};
+
+// Does the work on the host, then pads each call out to launch_us + pixels / throughput
+class EmulatedRowDevice : public RowDevice {
+public:
+    EmulatedRowDevice(double mpix_per_s, int launch_us) { set_speed(mpix_per_s, launch_us); }
+
+    const char *name() const override { return "emulated"; }
+
+    // May be called from any thread; affects the next call
+    void set_speed(double mpix_per_s, int launch_us) {
+        mpix_per_s_.store(mpix_per_s > 0.1 ? mpix_per_s : 0.1, std::memory_order_relaxed);
+        launch_us_.store(launch_us > 0 ? launch_us : 0, std::memory_order_relaxed);
+    }
+    double mpix_per_s() const { return mpix_per_s_.load(std::memory_order_relaxed); }
+
+    bool hist_rows(const uint8_t *plane, size_t stride, int width, int rows, uint32_t *hist) override {
+        auto t0 = std::chrono::steady_clock::now();
+        hist_accumulate(plane, stride, width, rows, hist);
+        pad_to(t0, (size_t)width * rows);
+        return true;
+    }
+
+    bool apply_rows(const uint8_t *in, size_t in_stride, uint8_t *out, size_t out_stride,
+                    int width, int rows, const uint8_t *lut) override {
+        auto t0 = std::chrono::steady_clock::now();
+        lut_apply(in, in_stride, out, out_stride, width, rows, lut);
+        pad_to(t0, (size_t)width * rows);
+        return true;
+    }
+
+private:
+    void pad_to(std::chrono::steady_clock::time_point t0, size_t pixels) {
+        double us = launch_us_.load(std::memory_order_relaxed) +
+                    (double)pixels / mpix_per_s_.load(std::memory_order_relaxed);
+        std::this_thread::sleep_until(t0 + std::chrono::microseconds((int64_t)us));
+    }
+
+    std::atomic<double> mpix_per_s_{100.0};
+    std::atomic<int> launch_us_{0};
+};
+
+// Drives a RowDevice from its own thread so the CPU bands run while the device is busy
+class DeviceRunner {
+public:
+    DeviceRunner() : thread_([this] { main(); }) {}
+
+    ~DeviceRunner() {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void submit(std::function<bool()> job) {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            job_ = std::move(job);
+            has_job_ = true;
+            done_ = false;
+        }
+        cv_.notify_all();
+    }
+
+    // Blocks until the submitted job finished; returns its success and busy time
+    bool wait(uint64_t *busy_us) {
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [this] { return done_; });
+        if (busy_us) *busy_us = busy_us_;
+        return ok_;
+    }
+
+private:
+    void main() {
+        for (;;) {
+            std::function<bool()> job;
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                cv_.wait(lk, [this] { return has_job_ || stop_; });
+                if (stop_) return;
+                job = std::move(job_);
+                has_job_ = false;
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            bool ok = job();
+            uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - t0).count();
+            {
+                std::lock_guard<std::mutex> lk(mu_);
+                ok_ = ok;
+                busy_us_ = us;
+                done_ = true;
+            }
+            cv_.notify_all();
+        }
+    }
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::function<bool()> job_;
+    bool has_job_{false};
+    bool done_{true};
+    bool stop_{false};
+    bool ok_{true};
+    uint64_t busy_us_{0};
+    std::thread thread_;
+};
+
+/* ---------- Row-split scheduler ---------- */
+
+struct CoprocStats {
+    double ratio{0};          // share of rows given to the device this frame
+    int dev_rows{0};
+    int cpu_rows{0};
+    uint64_t dev_us{0};       // device busy time, both phases
+    uint64_t cpu_us{0};       // CPU pool time, both phases
+    uint64_t frame_us{0};     // wall time of the whole frame
+};
+
+class RowSplitScheduler {
+public:
+    // cpu_threads counts the caller, so 3 means two helper threads + the calling thread
+    RowSplitScheduler(RowDevice *dev, int cpu_threads, double initial_ratio = 0.5, double gain = 0.5)
+        : dev_(dev), pool_(std::max(cpu_threads, 1) - 1), ratio_(initial_ratio), gain_(gain),
+          cpu_hist_(pool_.concurrency()) {}
+
+    double ratio() const { return ratio_; }
+    const CoprocStats &last() const { return last_; }
+
+    // Never hand either side fewer than this share, so both keep producing rate samples
+    void set_ratio_bounds(double min_share) { min_share_ = std::min(std::max(min_share, 0.0), 0.45); }
+
+    bool process(const uint8_t *in, size_t in_stride, uint8_t *out, size_t out_stride, int width, int height) {
+        auto t_frame = std::chrono::steady_clock::now();
+
+        int split = ((int)(ratio_ * height + 0.5)) & ~1;
+        split = std::min(std::max(split, 2), height - 2);
+        const int cpu_rows = height - split;
+        const uint8_t *cpu_in = in + (size_t)split * in_stride;
+        uint8_t *cpu_out = out + (size_t)split * out_stride;
+
+        // Phase 1: partial histograms
+        memset(dev_hist_, 0, sizeof(dev_hist_));
+        dev_runner_.submit([=] { return dev_->hist_rows(in, in_stride, width, split, dev_hist_); });
+
+        for (auto &h : cpu_hist_) memset(h.bins, 0, sizeof(h.bins));
+        uint64_t cpu_us = run_cpu_bands(cpu_rows, [&](int r0, int rows, int worker) {
+            hist_accumulate(cpu_in + (size_t)r0 * in_stride, in_stride, width, rows, cpu_hist_[worker].bins);
+        });
+
+        uint64_t dev_us = 0;
+        if (!dev_runner_.wait(&dev_us)) return false;
+
+        // Merge into one global LUT
+        uint32_t global[HIST_BINS];
+        memcpy(global, dev_hist_, sizeof(global));
+        for (const auto &h : cpu_hist_) {
+            for (int i = 0; i < HIST_BINS; ++i) global[i] += h.bins[i];
+        }
+        lut_from_hist(global, (uint64_t)width * height, lut_);
+
+        // Phase 2: apply on both sides
+        dev_runner_.submit([=] { return dev_->apply_rows(in, in_stride, out, out_stride, width, split, lut_); });
+        cpu_us += run_cpu_bands(cpu_rows, [&](int r0, int rows, int) {
+            lut_apply(cpu_in + (size_t)r0 * in_stride, in_stride, cpu_out + (size_t)r0 * out_stride, out_stride,
+                      width, rows, lut_);
+        });
+
+        uint64_t dev_apply_us = 0;
+        if (!dev_runner_.wait(&dev_apply_us)) return false;
+        dev_us += dev_apply_us;
+
+        last_.ratio = ratio_;
+        last_.dev_rows = split;
+        last_.cpu_rows = cpu_rows;
+        last_.dev_us = dev_us;
+        last_.cpu_us = cpu_us;
+        last_.frame_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t_frame).count();
+
+        rebalance(split, cpu_rows, dev_us, cpu_us);
+        return true;
+    }
+
+private:
+    // Padded so per-thread histograms never share a cache line
+    struct alignas(64) PaddedHist {
+        uint32_t bins[HIST_BINS];
+    };
+
+    template <typename Fn>
+    uint64_t run_cpu_bands(int rows, Fn &&fn) {
+        auto t0 = std::chrono::steady_clock::now();
+        // A few bands per thread keeps the tail short when one core is interrupted
+        const int n_bands = std::min(rows, pool_.concurrency() * 4);
+        pool_.run(n_bands, [&](int band, int worker) {
+            int r0 = (int)((int64_t)rows * band / n_bands);
+            int r1 = (int)((int64_t)rows * (band + 1) / n_bands);
+            if (r1 > r0) fn(r0, r1 - r0, worker);
+        });
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+    }
+
+    // Move toward the split where both sides finish together
+    void rebalance(int dev_rows, int cpu_rows, uint64_t dev_us, uint64_t cpu_us) {
+        if (dev_us == 0 || cpu_us == 0) return;
+        double dev_rate = (double)dev_rows / (double)dev_us;
+        double cpu_rate = (double)cpu_rows / (double)cpu_us;
+        double target = dev_rate / (dev_rate + cpu_rate);
+        ratio_ += gain_ * (target - ratio_);
+        ratio_ = std::min(std::max(ratio_, min_share_), 1.0 - min_share_);
+    }
+
+    RowDevice *dev_;
+    DeviceRunner dev_runner_;
+    ForkJoinPool pool_;
+    double ratio_;
+    double gain_;
+    double min_share_{0.02};
+
+    std::vector<PaddedHist> cpu_hist_;
+    uint32_t dev_hist_[HIST_BINS]{};
+    uint8_t lut_[HIST_BINS]{};
+    CoprocStats last_{};
+};
+
+#endif
+// _COPROCESS_H_
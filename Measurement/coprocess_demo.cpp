@@ -0,0 +1,143 @@
+// coprocess_demo.cpp
+// Row-split CPU + device equalization with per-frame load balancing (coprocess.h).
+// The device is emulated at a configurable throughput / launch latency, optionally
+// changing speed mid-run, so the split ratio can be watched converging and re-converging.
+// Every frame is checked bit-for-bit against a whole-frame single-thread equalization.
+// The emulated device still does its pixels on the host before sleeping, so give it a
+// spare core (cpu-threads < nproc) or the wall-clock numbers include that contention.
+//
+// Build:
+// g++ -O3 -DNDEBUG -std=c++17 coprocess_demo.cpp -o coprocess_demo \
+//   $(pkg-config --cflags --libs glib-2.0) -lpthread
+//
+// Run:
+//   ./coprocess_demo --width=3840 --height=2160 --frames=300 --cpu-threads=4 \
+//       --dev-mpix=800 --dev-latency-us=300 --switch-at=150 --switch-mpix=200
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "coprocess.h"
+#include "synthetic_frame.h"
+
+static void equalize_reference(const std::vector<uint8_t> &in, std::vector<uint8_t> &out, int width, int height) {
+    uint32_t hist[HIST_BINS] = {0};
+    uint8_t lut[HIST_BINS];
+    hist_accumulate(in.data(), width, width, height, hist);
+    lut_from_hist(hist, (uint64_t)width * height, lut);
+    lut_apply(in.data(), width, out.data(), width, width, height, lut);
+}
+
+int main(int argc, char *argv[]) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    int width = 1920, height = 1080, frames = 200;
+    int cpu_threads = 4, dev_latency_us = 200;
+    double dev_mpix = 400.0;
+    int switch_at = -1;
+    double switch_mpix = 0;
+    int print_every = 10;
+
+    for (int i=1;i<argc;++i){
+        if (g_str_has_prefix(argv[i],"--width=")) { int w=atoi(strchr(argv[i],'=')+1); if(w>0) width=w; }
+        else if (g_str_has_prefix(argv[i],"--height=")) { int h=atoi(strchr(argv[i],'=')+1); if(h>=8) height=h; }
+        else if (g_str_has_prefix(argv[i],"--frames=")) { int f=atoi(strchr(argv[i],'=')+1); if(f>0) frames=f; }
+        else if (g_str_has_prefix(argv[i],"--cpu-threads=")) { int t=atoi(strchr(argv[i],'=')+1); if(t>0) cpu_threads=t; }
+        else if (g_str_has_prefix(argv[i],"--dev-mpix=")) { double m=atof(strchr(argv[i],'=')+1); if(m>0) dev_mpix=m; }
+        else if (g_str_has_prefix(argv[i],"--dev-latency-us=")) { int l=atoi(strchr(argv[i],'=')+1); if(l>=0) dev_latency_us=l; }
+        else if (g_str_has_prefix(argv[i],"--switch-at=")) { switch_at=atoi(strchr(argv[i],'=')+1); }
+        else if (g_str_has_prefix(argv[i],"--switch-mpix=")) { switch_mpix=atof(strchr(argv[i],'=')+1); }
+        else if (g_str_has_prefix(argv[i],"--print-every=")) { int p=atoi(strchr(argv[i],'=')+1); if(p>0) print_every=p; }
+    }
+
+    const size_t y_size = (size_t)width * (size_t)height;
+    std::vector<uint8_t> y_in(y_size), y_out(y_size), y_ref(y_size);
+
+    EmulatedRowDevice dev(dev_mpix, dev_latency_us);
+    RowSplitScheduler sched(&dev, cpu_threads);
+
+    g_print("Co-processing: %dx%d, %d frames, %d CPU threads, device %s %.0f Mpix/s + %d us/launch\n",
+            width, height, frames, cpu_threads, dev.name(), dev_mpix, dev_latency_us);
+    if (switch_at >= 0 && switch_mpix > 0)
+        g_print("Device speed changes to %.0f Mpix/s at frame %d\n", switch_mpix, switch_at);
+
+    // CPU-only baseline with the same pool size, for the speed-up figure
+    uint64_t cpu_only_us = 0;
+    {
+        ForkJoinPool pool(cpu_threads - 1);
+        std::vector<uint32_t> hists((size_t)pool.concurrency() * HIST_BINS);
+        uint8_t lut[HIST_BINS];
+        fill_synthetic_frame(y_in, width, height, 0);
+        const int reps = 5;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int rep = 0; rep < reps; ++rep) {
+            const int n_bands = pool.concurrency() * 4;
+            std::fill(hists.begin(), hists.end(), 0);
+            pool.run(n_bands, [&](int band, int worker) {
+                int r0 = (int)((int64_t)height * band / n_bands), r1 = (int)((int64_t)height * (band + 1) / n_bands);
+                hist_accumulate(y_in.data() + (size_t)r0 * width, width, width, r1 - r0,
+                                hists.data() + (size_t)worker * HIST_BINS);
+            });
+            for (int w = 1; w < pool.concurrency(); ++w)
+                for (int b = 0; b < HIST_BINS; ++b) hists[b] += hists[(size_t)w * HIST_BINS + b];
+            lut_from_hist(hists.data(), y_size, lut);
+            pool.run(n_bands, [&](int band, int) {
+                int r0 = (int)((int64_t)height * band / n_bands), r1 = (int)((int64_t)height * (band + 1) / n_bands);
+                lut_apply(y_in.data() + (size_t)r0 * width, width, y_out.data() + (size_t)r0 * width, width,
+                          width, r1 - r0, lut);
+            });
+        }
+        cpu_only_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t0).count() / reps;
+    }
+    // Device-only is modelled: two launches over the full frame
+    double dev_only_ms = (2.0 * dev_latency_us + 2.0 * (double)y_size / dev_mpix) / 1000.0;
+    g_print("Baselines: CPU only %.2f ms, device only %.2f ms (modelled)\n\n", cpu_only_us / 1000.0, dev_only_ms);
+
+    g_print("%6s %7s %9s %9s %9s %8s\n", "frame", "ratio", "dev ms", "cpu ms", "frame ms", "imbal%");
+
+    uint64_t sum_frame_us = 0;
+    int counted = 0;
+    size_t mismatched = 0;
+    for (int f = 0; f < frames; ++f) {
+        if (f == switch_at && switch_mpix > 0) {
+            dev.set_speed(switch_mpix, dev_latency_us);
+            g_print("-- device now %.0f Mpix/s --\n", switch_mpix);
+        }
+
+        fill_synthetic_frame(y_in, width, height, f);
+        if (!sched.process(y_in.data(), width, y_out.data(), width, width, height)) {
+            g_printerr("Frame %d failed\n", f);
+            continue;
+        }
+
+        equalize_reference(y_in, y_ref, width, height);
+        if (memcmp(y_ref.data(), y_out.data(), y_size) != 0) {
+            for (size_t i = 0; i < y_size; ++i) mismatched += (y_ref[i] != y_out[i]);
+        }
+
+        const CoprocStats &s = sched.last();
+        // Second half of the run (or of each speed segment) reflects the converged split
+        if (f >= frames / 2 && (switch_at < 0 || f >= switch_at + (frames - switch_at) / 2)) {
+            sum_frame_us += s.frame_us;
+            counted++;
+        }
+        if (f % print_every == 0 || f == frames - 1) {
+            uint64_t hi = std::max(s.dev_us, s.cpu_us), lo = std::min(s.dev_us, s.cpu_us);
+            g_print("%6d %7.3f %9.2f %9.2f %9.2f %7.1f%%\n", f, s.ratio, s.dev_us / 1000.0, s.cpu_us / 1000.0,
+                    s.frame_us / 1000.0, hi ? 100.0 * (double)(hi - lo) / (double)hi : 0.0);
+        }
+    }
+
+    double avg_ms = counted ? (double)sum_frame_us / counted / 1000.0 : 0.0;
+    g_print("\nConverged ratio: %.3f of rows on the device\n"
+            "Avg frame (converged): %.2f ms, vs CPU only %.2f ms / device only %.2f ms\n"
+            "Mismatch vs whole-frame equalization: %zu px\n",
+            sched.ratio(), avg_ms, cpu_only_us / 1000.0, dev_only_ms, mismatched);
+    return mismatched ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+// copy_account.h
+// Accounted frame copies. Every copy / fill / conversion on the processing path goes
+// through a named CopySite, which tallies bytes read and written; the report puts the
+// traffic per frame next to the theoretical minimum and the memcpy bandwidth measured
+// at startup, so removing a copy shows up as a number.
+//
+//   memcpy_acct(COPY_SITE("host_in"), dst, src, y_size);
+//   memset_acct(COPY_SITE("uv_fill"), dst + y_size, 128, uv_size);
+//   cv::Mat y = clone_acct(COPY_SITE("y_clone"), roi);
+//   copy_to_acct(COPY_SITE("in_copy"), src, dst);
+//   convert_acct(COPY_SITE("bgr2i420"), bgr, i420, [&] { cv::cvtColor(bgr, i420, code); });
+//   copy_note(COPY_SITE("uv_interleave"), read_bytes, written_bytes);  // hand-written loops
+//
+//   CopyAccount &acct = CopyAccount::instance();
+//   acct.measure_bandwidth();               // once, ~0.1 s, before streaming
+//   acct.set_min_bytes_per_frame(y_size + frame_size);   // read input once, write output once
+//   acct.report(frames_since_last, fps);    // from the status tick
+//
+// Traffic is bytes read + bytes written (a memcpy of n bytes moves 2n, a memset n). The
+// bandwidth is measured the same way (2n per memcpy of a buffer larger than the caches),
+// so "budget" is the share of what the memory system sustains for plain copies. Sites
+// are registered once per call site (COPY_SITE keeps a static reference); counting is
+// two relaxed atomic adds.
+
+#ifndef _COPY_ACCOUNT_H_
+#define _COPY_ACCOUNT_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct CopySite {
+    std::string name;
+    std::atomic<uint64_t> read{0};
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> calls{0};
+    // report() only
+    uint64_t prev_read{0}, prev_written{0}, prev_calls{0};
+};
+
+class CopyAccount {
+public:
+    static CopyAccount &instance() {
+        static CopyAccount a;
+        return a;
+    }
+
+    // Same name -> same site (two call sites may share one on purpose)
+    CopySite &site(const char *name) {
+        std::lock_guard<std::mutex> lock(mu_);
+        for (auto &s : sites_) if (s->name == name) return *s;
+        sites_.emplace_back(new CopySite());
+        sites_.back()->name = name;
+        return *sites_.back();
+    }
+
+    static void note(CopySite &s, uint64_t read, uint64_t written) {
+        s.read.fetch_add(read, std::memory_order_relaxed);
+        s.written.fetch_add(written, std::memory_order_relaxed);
+        s.calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Best of a few memcpy runs over a buffer well past the last-level cache; bytes/s of traffic
+    double measure_bandwidth(size_t bytes = 64u << 20, int runs = 5) {
+        std::unique_ptr<uint8_t[]> a(new uint8_t[bytes]), b(new uint8_t[bytes]);
+        memset(a.get(), 1, bytes);
+        memset(b.get(), 2, bytes);   // fault both in before timing
+        double best = 0.0;
+        for (int i = 0; i < runs; ++i) {
+            const int64_t t0 = g_get_monotonic_time();
+            memcpy(b.get(), a.get(), bytes);
+            // b is never read: without this the copy is a dead store the compiler may drop
+            __asm__ __volatile__("" : : "r"(b.get()) : "memory");
+            const int64_t dt = g_get_monotonic_time() - t0;
+            if (dt > 0) {
+                const double bw = 2.0 * bytes / (dt / 1e6);
+                if (bw > best) best = bw;
+            }
+        }
+        bandwidth_ = best;
+        g_print("Copy bandwidth: %.2f GB/s (memcpy, %zu MB, read + write)\n", best / 1e9, bytes >> 20);
+        return best;
+    }
+
+    double bandwidth() const { return bandwidth_; }
+
+    // Traffic a frame can't avoid (e.g. read the input once, write the output once)
+    void set_min_bytes_per_frame(uint64_t bytes) { min_per_frame_ = bytes; }
+
+    // Per-frame traffic per site over the interval since the previous call; single caller
+    void report(uint64_t frames, double fps) {
+        std::lock_guard<std::mutex> lock(mu_);
+        struct Row { const CopySite *s; uint64_t traffic, calls; };
+        std::vector<Row> rows;
+        uint64_t total = 0;
+        for (auto &sp : sites_) {
+            CopySite &s = *sp;
+            const uint64_t r = s.read.load(std::memory_order_relaxed), w = s.written.load(std::memory_order_relaxed);
+            const uint64_t c = s.calls.load(std::memory_order_relaxed);
+            Row row{&s, (r - s.prev_read) + (w - s.prev_written), c - s.prev_calls};
+            s.prev_read = r;
+            s.prev_written = w;
+            s.prev_calls = c;
+            total += row.traffic;
+            if (row.calls) rows.push_back(row);
+        }
+        if (frames == 0) return;
+
+        const double per_frame = (double)total / frames;
+        g_print("Copies: %.2f MB/frame", per_frame / 1e6);
+        if (min_per_frame_) g_print(" (minimum %.2f MB, %.2fx)", min_per_frame_ / 1e6, per_frame / min_per_frame_);
+        if (fps > 0) {
+            g_print(" = %.2f GB/s at %.1f fps", per_frame * fps / 1e9, fps);
+            if (bandwidth_ > 0) g_print(", %.0f%% of %.2f GB/s", 100.0 * per_frame * fps / bandwidth_, bandwidth_ / 1e9);
+        }
+        g_print("\n");
+        for (const Row &row : rows) {
+            g_print("  %-16s %8.2f MB/frame %5.1f%%  %.1f calls/frame\n", row.s->name.c_str(),
+                    (double)row.traffic / frames / 1e6, total ? 100.0 * row.traffic / total : 0.0,
+                    (double)row.calls / frames);
+        }
+    }
+
+private:
+    CopyAccount() = default;
+    std::mutex mu_;
+    std::vector<std::unique_ptr<CopySite>> sites_;
+    double bandwidth_{0.0};
+    uint64_t min_per_frame_{0};
+};
+
+// Site for this call site, looked up once
+#define COPY_SITE(name) \
+    ([]() -> CopySite & { static CopySite &s_ = CopyAccount::instance().site(name); return s_; }())
+
+static inline void copy_note(CopySite &s, uint64_t read, uint64_t written) { CopyAccount::note(s, read, written); }
+
+static inline void *memcpy_acct(CopySite &s, void *dst, const void *src, size_t n) {
+    CopyAccount::note(s, n, n);
+    return memcpy(dst, src, n);
+}
+
+static inline void *memset_acct(CopySite &s, void *dst, int value, size_t n) {
+    CopyAccount::note(s, 0, n);
+    return memset(dst, value, n);
+}
+
+// cv::Mat (or anything with total() / elemSize() / clone() / copyTo()), no OpenCV include here
+template <typename M>
+static inline M clone_acct(CopySite &s, const M &src) {
+    const uint64_t n = (uint64_t)src.total() * src.elemSize();
+    CopyAccount::note(s, n, n);
+    return src.clone();
+}
+
+template <typename M>
+static inline void copy_to_acct(CopySite &s, const M &src, M &dst) {
+    const uint64_t n = (uint64_t)src.total() * src.elemSize();
+    CopyAccount::note(s, n, n);
+    src.copyTo(dst);
+}
+
+// A conversion fn reading src and writing dst (cvtColor and friends); sizes after the call
+template <typename M, typename Fn>
+static inline void convert_acct(CopySite &s, const M &src, const M &dst, Fn &&fn) {
+    fn();
+    CopyAccount::note(s, (uint64_t)src.total() * src.elemSize(), (uint64_t)dst.total() * dst.elemSize());
+}
+
+#endif
+// _COPY_ACCOUNT_H_
@@ -0,0 +1,139 @@
+// deadline_scheduler.h
+// Earliest-deadline-first frame queue for a single processing thread.
+//
+// Every frame carries its capture time. Its deadline is
+//     capture + deadline_frames * frame_period
+// where the period comes from the negotiated framerate. pop() hands out the frame with
+// the earliest deadline that can still make it, given the current service-time estimate
+// (EMA of measured processing times). Frames that cannot are dropped there and counted
+// as late drops; nothing is dropped just because the queue is long. complete() records
+// whether a processed frame finished in time (missed otherwise).
+//
+// Main thread only. Times are monotonic microseconds (g_get_monotonic_time()).
+
+#ifndef _DEADLINE_SCHEDULER_H_
+#define _DEADLINE_SCHEDULER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <queue>
+#include <vector>
+
+struct DeadlineStats {
+    uint64_t queued{0};
+    uint64_t completed{0};
+    uint64_t on_time{0};
+    uint64_t missed{0};          // processed, but finished after the deadline
+    uint64_t late_dropped{0};    // dropped before processing: could no longer make it
+    uint64_t max_depth{0};
+    int64_t  worst_lateness_us{0};
+    int64_t  min_slack_us{INT64_MAX};   // tightest on-time finish
+};
+
+// Handed out with each frame, passed back to complete()
+struct DeadlineTicket {
+    uint64_t seq{0};
+    int64_t capture_us{0};
+    int64_t deadline_us{0};
+    int64_t start_us{0};
+};
+
+template <typename T>
+class DeadlineScheduler {
+public:
+    DeadlineScheduler() = default;
+    explicit DeadlineScheduler(double deadline_frames) : deadline_frames_(deadline_frames) {}
+
+    void set_frame_period_us(int64_t period_us) { if (period_us > 0) period_us_ = period_us; }
+    void set_deadline_frames(double frames) { if (frames > 0.0) deadline_frames_ = frames; }
+    // false: never drop, only count misses
+    void set_drop_late(bool drop) { drop_late_ = drop; }
+
+    int64_t frame_period_us() const { return period_us_; }
+    int64_t budget_us() const { return (int64_t)(deadline_frames_ * (double)period_us_); }
+    int64_t service_estimate_us() const { return service_est_us_; }
+    size_t size() const { return heap_.size(); }
+    bool empty() const { return heap_.empty(); }
+    const DeadlineStats &stats() const { return stats_; }
+
+    void push(T item, int64_t capture_us) {
+        Entry e;
+        e.item = item;
+        e.ticket.seq = next_seq_++;
+        e.ticket.capture_us = capture_us;
+        e.ticket.deadline_us = capture_us + budget_us();
+        heap_.push(e);
+        stats_.queued++;
+        if (heap_.size() > stats_.max_depth) stats_.max_depth = heap_.size();
+    }
+
+    // Earliest-deadline frame that can still finish in time. Hopeless ones go to
+    // drop(item) on the way. Returns false when nothing is left.
+    template <typename DropFn>
+    bool pop(T &item, DeadlineTicket &ticket, int64_t now_us, DropFn drop) {
+        while (!heap_.empty()) {
+            Entry e = heap_.top();
+            heap_.pop();
+            if (drop_late_ && now_us + service_est_us_ > e.ticket.deadline_us) {
+                stats_.late_dropped++;
+                drop(e.item);
+                continue;
+            }
+            item = e.item;
+            ticket = e.ticket;
+            ticket.start_us = now_us;
+            return true;
+        }
+        return false;
+    }
+
+    // Frame finished (pushed downstream) at done_us
+    void complete(const DeadlineTicket &ticket, int64_t done_us) {
+        int64_t service = done_us - ticket.start_us;
+        service_est_us_ = have_estimate_ ? service_est_us_ + (service - service_est_us_) / 8 : service;
+        have_estimate_ = true;
+
+        stats_.completed++;
+        int64_t slack = ticket.deadline_us - done_us;
+        if (slack >= 0) {
+            stats_.on_time++;
+            if (slack < stats_.min_slack_us) stats_.min_slack_us = slack;
+        } else {
+            stats_.missed++;
+            if (-slack > stats_.worst_lateness_us) stats_.worst_lateness_us = -slack;
+        }
+    }
+
+    // Shutdown
+    template <typename DropFn>
+    void clear(DropFn drop) {
+        while (!heap_.empty()) {
+            drop(heap_.top().item);
+            heap_.pop();
+        }
+    }
+
+private:
+    struct Entry {
+        T item;
+        DeadlineTicket ticket;
+    };
+    struct Later {
+        bool operator()(const Entry &a, const Entry &b) const {
+            if (a.ticket.deadline_us != b.ticket.deadline_us) return a.ticket.deadline_us > b.ticket.deadline_us;
+            return a.ticket.seq > b.ticket.seq;
+        }
+    };
+
+    double deadline_frames_{2.0};
+    int64_t period_us_{16667};
+    bool drop_late_{true};
+    int64_t service_est_us_{0};
+    bool have_estimate_{false};
+    uint64_t next_seq_{0};
+    std::priority_queue<Entry, std::vector<Entry>, Later> heap_;
+    DeadlineStats stats_{};
+};
+
+#endif
+// _DEADLINE_SCHEDULER_H_
@@ -0,0 +1,165 @@
+// flight_decode.cpp
+// Prints a flight recorder file (layout in flight_format.h): the live ring or an incident
+// snapshot <path>.<n>. Shows the last --seconds before the incident (or before the
+// newest record when the file has none), then a summary: frames out, drops by reason,
+// the longest gap between frames and how long each stage had been quiet.
+//
+// Build:
+// g++ -O2 -std=c++17 flight_decode.cpp -o flight_decode $(pkg-config --cflags --libs glib-2.0)
+//
+// Run:
+//   ./flight_decode flight.rec.1                 last 5 s before incident 1
+//   ./flight_decode flight.rec --seconds=30
+//   ./flight_decode flight.rec --all --drops     whole ring, drops and events only
+//
+// Columns: time relative to the incident (ms), wall clock, record kind, frame number,
+// stage offsets from capture (dequeue / processed / pushed, ms), backend time (ms),
+// queue depths (work queue / scheduler / appsrc KB), backend, reason.
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include "flight_format.h"
+
+static void wall_clock(const FlightHeader &h, int64_t mono_us, char *out, size_t len) {
+    const int64_t real_us = h.start_real_us + (mono_us - h.start_mono_us);
+    time_t secs = (time_t)(real_us / 1000000);
+    struct tm tm;
+    localtime_r(&secs, &tm);
+    char hms[16];
+    strftime(hms, sizeof(hms), "%H:%M:%S", &tm);
+    snprintf(out, len, "%s.%06d", hms, (int)(real_us % 1000000));
+}
+
+static const char *backend_name(const FlightHeader &h, uint8_t id) {
+    if (id >= FLIGHT_MAX_BACKENDS || !h.backends[id][0]) return "-";
+    return h.backends[id];
+}
+
+int main(int argc, char *argv[]) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    const char *path = NULL;
+    double seconds = 5.0;
+    gboolean all = FALSE, drops_only = FALSE;
+    for (int i=1;i<argc;++i){
+        if (g_str_has_prefix(argv[i],"--seconds=")) { double s=atof(strchr(argv[i],'=')+1); if(s>0) seconds=s; }
+        else if (g_strcmp0(argv[i],"--all")==0) { all = TRUE; }
+        else if (g_strcmp0(argv[i],"--drops")==0) { drops_only = TRUE; }
+        else if (argv[i][0] != '-') { path = argv[i]; }
+    }
+    if (!path) {
+        g_printerr("Usage: %s FILE [--seconds=S] [--all] [--drops]\n", argv[0]);
+        return 1;
+    }
+
+    gchar *data = NULL;
+    gsize len = 0;
+    GError *err = NULL;
+    if (!g_file_get_contents(path, &data, &len, &err)) {
+        g_printerr("Cannot read %s: %s\n", path, err ? err->message : "?");
+        g_clear_error(&err);
+        return 1;
+    }
+    FlightHeader h;
+    if (len < FLIGHT_HEADER_SIZE || memcmp(data, FLIGHT_MAGIC, sizeof(FLIGHT_MAGIC)) != 0) {
+        g_printerr("%s is not a flight recorder file\n", path);
+        g_free(data);
+        return 1;
+    }
+    memcpy(&h, data, sizeof(h));
+    if (h.record_size != sizeof(FlightRecord) || h.header_size != FLIGHT_HEADER_SIZE ||
+        len < h.header_size + h.capacity * h.record_size) {
+        g_printerr("%s: unsupported layout (record %u bytes, header %u, capacity %" G_GUINT64_FORMAT ")\n", path,
+                   h.record_size, h.header_size, h.capacity);
+        g_free(data);
+        return 1;
+    }
+
+    // Valid records: committed (seq != 0) and still in the slot their number maps to
+    std::vector<FlightRecord> recs;
+    recs.reserve((size_t)h.capacity);
+    const FlightRecord *slots = (const FlightRecord *)(data + h.header_size);
+    uint64_t torn = 0;
+    for (uint64_t i = 0; i < h.capacity; ++i) {
+        FlightRecord r;
+        memcpy(&r, &slots[i], sizeof(r));
+        if (r.seq == 0) {
+            if (r.t_us) torn++;
+            continue;
+        }
+        if ((r.seq - 1) % h.capacity != i) { torn++; continue; }
+        recs.push_back(r);
+    }
+    g_free(data);
+    std::sort(recs.begin(), recs.end(), [](const FlightRecord &a, const FlightRecord &b) { return a.seq < b.seq; });
+
+    char wall[32];
+    g_print("%s: %s (pid %d), %" G_GUINT64_FORMAT " records of %" G_GUINT64_FORMAT " slots, %" G_GUINT64_FORMAT
+            " written in total, %" G_GUINT64_FORMAT " incomplete\n",
+            path, h.program, h.pid, (guint64)recs.size(), h.capacity, h.head, torn);
+    if (recs.empty()) return 0;
+
+    const bool have_incident = h.incident_mono_us != 0;
+    const int64_t end_us = have_incident ? h.incident_mono_us : recs.back().t_us;
+    if (have_incident) {
+        wall_clock(h, h.incident_mono_us, wall, sizeof(wall));
+        g_print("Incident %u at %s: %s\n", h.incidents, wall, h.incident);
+    } else {
+        g_print("No incident recorded; times are relative to the newest record\n");
+    }
+    const int64_t begin_us = all ? INT64_MIN : end_us - (int64_t)(seconds * 1e6);
+
+    g_print("\n%10s %-15s %-5s %8s %8s %8s %8s %7s %4s %4s %6s %-12s %s\n", "t ms", "wall", "kind", "frame", "deq",
+            "proc", "push", "backend", "wq", "sq", "srcKB", "backend", "reason");
+    uint64_t frames = 0, drops[FR_REASONS] = {};
+    int64_t prev_frame_us = 0, max_gap_us = 0, max_gap_at = 0;
+    for (const FlightRecord &r : recs) {
+        if (r.t_us < begin_us) continue;
+        if (r.kind == FR_FRAME) {
+            frames++;
+            if (prev_frame_us && r.t_us - prev_frame_us > max_gap_us) {
+                max_gap_us = r.t_us - prev_frame_us;
+                max_gap_at = r.t_us;
+            }
+            prev_frame_us = r.t_us;
+        } else if (r.kind == FR_DROP && r.reason < FR_REASONS) {
+            drops[r.reason]++;
+        }
+        if (drops_only && r.kind == FR_FRAME) continue;
+
+        wall_clock(h, r.t_us, wall, sizeof(wall));
+        g_print("%10.2f %-15s %-5s %8" G_GUINT64_FORMAT, (r.t_us - end_us) / 1000.0, wall, flight_kind_name(r.kind),
+                r.frame);
+        if (r.kind == FR_FRAME) {
+            g_print(" %8.2f %8.2f %8.2f %7.2f", r.dequeue_us / 1000.0, r.processed_us / 1000.0, r.pushed_us / 1000.0,
+                    r.backend_us / 1000.0);
+        } else {
+            g_print(" %8s %8s %8s %7s", "", "", "", "");
+        }
+        g_print(" %4u %4u %6u %-12s %s", r.work_q, r.sched_q, r.appsrc_kb, backend_name(h, r.backend),
+                flight_reason_name(r.reason));
+        if (r.kind == FR_EVENT && r.reason == FR_CAPS) g_print(" %ux%u", r.aux >> 16, r.aux & 0xffff);
+        else if (r.aux) g_print(" (%u)", r.aux);
+        g_print("\n");
+    }
+
+    g_print("\nSummary: %" G_GUINT64_FORMAT " frames out", frames);
+    for (int i = 1; i < FR_REASONS; ++i) {
+        if (drops[i]) g_print(" | %s %" G_GUINT64_FORMAT, flight_reason_name((uint8_t)i), drops[i]);
+    }
+    g_print("\n");
+    if (max_gap_us) g_print("Longest gap between frames: %.1f ms, ending %.1f ms before the end\n", max_gap_us / 1000.0,
+                            (end_us - max_gap_at) / 1000.0);
+    for (int s = 0; s < FLIGHT_MAX_STAGES && h.stages[s][0]; ++s) {
+        if (h.stage_last_us[s]) g_print("Stage %-10s last progress %.1f ms before the end\n", h.stages[s],
+                                        (end_us - h.stage_last_us[s]) / 1000.0);
+        else g_print("Stage %-10s never progressed\n", h.stages[s]);
+    }
+    return 0;
+}
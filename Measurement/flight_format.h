@@ -0,0 +1,96 @@
+// flight_format.h
+// On-disk layout of the flight recorder file (flight_recorder.h): the header page and
+// the 64-byte records, plus their names. No GStreamer or threading dependencies, so the
+// offline decoder (flight_decode.cpp) only needs this file.
+
+#ifndef _FLIGHT_FORMAT_H_
+#define _FLIGHT_FORMAT_H_
+
+#include <stdint.h>
+
+#define FLIGHT_MAGIC "FLTREC1"
+#define FLIGHT_HEADER_SIZE 4096
+#define FLIGHT_MAX_STAGES 8
+#define FLIGHT_MAX_BACKENDS 16
+
+enum FlightKind : uint8_t {
+    FR_FRAME = 1,        // frame went out; stage offsets filled in
+    FR_DROP,             // frame dropped, see reason
+    FR_EVENT,            // something happened to the pipeline (caps, backend, incident)
+};
+
+enum FlightReason : uint8_t {
+    FR_NONE = 0,
+    FR_LATE,             // missed its deadline in the scheduler
+    FR_OVERWRITE,        // overwritten in a full hand-off queue
+    FR_SHED,             // appsrc full, shed before processing
+    FR_MAP_FAILED,
+    FR_ALLOC_FAILED,
+    FR_BACKEND_FAILED,
+    FR_PUSH_FAILED,
+    FR_CAPS,             // event: new geometry (aux = width << 16 | height)
+    FR_BACKEND,          // event: backend selected (backend field)
+    FR_INCIDENT,         // event: dump triggered (aux = incident number)
+    FR_REASONS
+};
+
+static inline const char *flight_kind_name(uint8_t k) {
+    switch (k) {
+        case FR_FRAME: return "frame";
+        case FR_DROP:  return "drop";
+        case FR_EVENT: return "event";
+        default:       return "?";
+    }
+}
+
+static inline const char *flight_reason_name(uint8_t r) {
+    static const char *names[FR_REASONS] = {"",           "late",           "overwrite",   "shed",
+                                            "map-failed", "alloc-failed",   "backend-failed",
+                                            "push-failed", "caps",          "backend",     "incident"};
+    return r < FR_REASONS ? names[r] : "?";
+}
+
+// One cache line. Stage times are microsecond offsets from capture_us (0 = not reached).
+struct FlightRecord {
+    uint64_t seq;            // 1-based record number; 0 while being written
+    uint64_t frame;          // v4l2 sequence number
+    int64_t  capture_us;     // monotonic capture time
+    int64_t  t_us;           // monotonic time the record was written
+    uint32_t dequeue_us;     // picked up for processing
+    uint32_t processed_us;   // backend done
+    uint32_t pushed_us;      // handed to appsrc
+    uint32_t backend_us;     // time inside the backend call
+    uint16_t work_q;         // queue depths when recorded
+    uint16_t sched_q;
+    uint32_t appsrc_kb;
+    uint8_t  kind;           // FlightKind
+    uint8_t  reason;         // FlightReason
+    uint8_t  backend;        // index into FlightHeader::backends, 0xff = none
+    uint8_t  flags;
+    uint32_t aux;
+};
+static_assert(sizeof(FlightRecord) == 64, "FlightRecord must stay one cache line");
+
+struct FlightHeader {
+    char     magic[8];
+    uint32_t header_size;
+    uint32_t record_size;
+    uint64_t capacity;
+    uint64_t head;               // records ever claimed (atomic builtins)
+    int64_t  start_mono_us;      // monotonic <-> wall clock anchor
+    int64_t  start_real_us;
+    int32_t  pid;
+    uint32_t incidents;          // atomic builtins (signal handler and watchdog)
+    char     program[32];
+    char     stages[FLIGHT_MAX_STAGES][16];
+    int64_t  stage_last_us[FLIGHT_MAX_STAGES];   // last progress per stage (monotonic)
+    char     backends[FLIGHT_MAX_BACKENDS][16];
+    // Latest incident
+    int64_t  incident_mono_us;
+    uint64_t incident_head;
+    char     incident[192];
+};
+static_assert(sizeof(FlightHeader) <= FLIGHT_HEADER_SIZE, "FlightHeader must fit its page");
+
+#endif
+// _FLIGHT_FORMAT_H_
@@ -0,0 +1,331 @@
+// flight_recorder.h
+// Always-on flight recorder: a fixed-size binary ring of per-frame records in a
+// MAP_SHARED file, so the last seconds before a freeze or crash are on disk even when
+// the process dies without flushing anything.
+//
+//   FlightRecorder fr;
+//   fr.open("flight.rec", 1 << 16, "fpgaworker");       // ~4 MB, ~18 min of 60 fps
+//   int cap = fr.add_stage("capture");                  // stall detection per stage
+//   fr.progress(cap);                                   // stage advanced
+//   FlightRecord *r = fr.begin(FR_FRAME); ...; fr.commit(r);
+//   fr.start_watchdog(500);                             // dump when a stage stalls 500 ms
+//   fr.incident("bus error: ...");                      // dump now
+//
+// Stall detection is a StallWatchdog (stall_watchdog.h) over the same stages: its
+// on_stall turns a stall into an incident and its thread writes the snapshots, so there
+// is one detector, one thread and one threshold.
+//
+// Recording claims a slot with one atomic add and fills one 64-byte record in place:
+// tens of nanoseconds, no lock, no allocation, any thread. A record's seq is cleared
+// while it is written and set last, so half-written records are recognizable.
+//
+// Incidents (bus error, stalled stage, SIGUSR1) copy the ring to <path>.<n> from the
+// watchdog's thread, with the reason and time in the snapshot header. Fatal signals
+// (SIGSEGV, SIGBUS, SIGABRT, SIGFPE) only write the reason into the live file's header
+// and re-raise: the mapped pages reach the file without help. SIGINT/SIGTERM are left to
+// the program so it can shut down cleanly; mark() stamps the header the same way.
+// Decode either file with flight_decode.
+
+#ifndef _FLIGHT_RECORDER_H_
+#define _FLIGHT_RECORDER_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "flight_format.h"
+#include "stall_watchdog.h"
+
+class FlightRecorder {
+public:
+    FlightRecorder() = default;
+    FlightRecorder(const FlightRecorder &) = delete;
+    FlightRecorder &operator=(const FlightRecorder &) = delete;
+    ~FlightRecorder() { close(); }
+
+    // Map (and size) the ring file; the previous contents are discarded
+    bool open(const char *path, size_t records, const char *program) {
+        if (map_) return true;
+        if (records == 0) records = 1;
+        const size_t bytes = FLIGHT_HEADER_SIZE + records * sizeof(FlightRecord);
+        int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            g_printerr("Flight recorder: cannot open %s: %s\n", path, strerror(errno));
+            return false;
+        }
+        if (ftruncate(fd, (off_t)bytes) != 0) {
+            g_printerr("Flight recorder: cannot size %s: %s\n", path, strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            g_printerr("Flight recorder: mmap %s: %s\n", path, strerror(errno));
+            return false;
+        }
+        map_ = (uint8_t *)p;
+        bytes_ = bytes;
+        path_ = path;
+        hdr_ = (FlightHeader *)map_;
+        rec_ = (FlightRecord *)(map_ + FLIGHT_HEADER_SIZE);
+        capacity_ = records;
+
+        memcpy(hdr_->magic, FLIGHT_MAGIC, sizeof(hdr_->magic));
+        hdr_->header_size = FLIGHT_HEADER_SIZE;
+        hdr_->record_size = sizeof(FlightRecord);
+        hdr_->capacity = records;
+        hdr_->start_mono_us = g_get_monotonic_time();
+        hdr_->start_real_us = g_get_real_time();
+        hdr_->pid = (int32_t)getpid();
+        g_strlcpy(hdr_->program, program ? program : "", sizeof(hdr_->program));
+        // Touch every page now rather than on the first lap of the ring
+        memset(rec_, 0, records * sizeof(FlightRecord));
+        return true;
+    }
+
+    bool active() const { return map_ != nullptr; }
+    const char *path() const { return path_.c_str(); }
+
+    // Stages whose progress the watchdog checks; returns the index for progress()
+    int add_stage(const char *name) {
+        if (!map_ || stages_ >= FLIGHT_MAX_STAGES) return -1;
+        g_strlcpy(hdr_->stages[stages_], name, sizeof(hdr_->stages[0]));
+        stall_.add_stage(name);     // same index
+        return stages_++;
+    }
+
+    // The header copy is what survives a crash; the watchdog's drives the stall check
+    void progress(int stage) {
+        if (stage < 0 || !map_) return;
+        __atomic_store_n(&hdr_->stage_last_us[stage], g_get_monotonic_time(), __ATOMIC_RELAXED);
+        stall_.progress(stage);
+    }
+
+    // Index of a backend name in the header table; the caller keeps it (one lookup per
+    // backend switch, not per frame)
+    uint8_t backend_id(const char *name) {
+        if (!map_ || !name) return 0xff;
+        std::lock_guard<std::mutex> lock(mu_);
+        for (int i = 0; i < FLIGHT_MAX_BACKENDS; ++i) {
+            if (!hdr_->backends[i][0]) {
+                g_strlcpy(hdr_->backends[i], name, sizeof(hdr_->backends[0]));
+                return (uint8_t)i;
+            }
+            if (strncmp(hdr_->backends[i], name, sizeof(hdr_->backends[0]) - 1) == 0) return (uint8_t)i;
+        }
+        return 0xff;
+    }
+
+    // Claim and clear the next slot; fill it, then commit() on the same thread.
+    // nullptr when closed.
+    FlightRecord *begin(FlightKind kind, FlightReason reason = FR_NONE) {
+        if (!map_) return nullptr;
+        const uint64_t n = __atomic_fetch_add(&hdr_->head, 1, __ATOMIC_RELAXED);
+        FlightRecord *r = &rec_[n % capacity_];
+        __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        const uint64_t seq = n + 1;
+        memset((uint8_t *)r + sizeof(r->seq), 0, sizeof(FlightRecord) - sizeof(r->seq));
+        r->kind = kind;
+        r->reason = reason;
+        r->backend = 0xff;
+        r->t_us = g_get_monotonic_time();
+        pending_seq() = seq;
+        return r;
+    }
+
+    void commit(FlightRecord *r) {
+        if (!r) return;
+        __atomic_store_n(&r->seq, pending_seq(), __ATOMIC_RELEASE);
+    }
+
+    // Drop or event without per-stage data
+    void note(FlightKind kind, FlightReason reason, uint64_t frame, uint32_t aux = 0) {
+        FlightRecord *r = begin(kind, reason);
+        if (!r) return;
+        r->frame = frame;
+        r->aux = aux;
+        commit(r);
+    }
+
+    // Microsecond offset of t from capture, for the stage fields
+    static uint32_t offset(int64_t capture_us, int64_t t_us) {
+        return t_us > capture_us ? (uint32_t)std::min<int64_t>(t_us - capture_us, UINT32_MAX) : 0;
+    }
+
+    /* ---------- incidents ---------- */
+
+    // Snapshot the ring with this reason; runs on the watchdog thread (or right here
+    // when there is none). Safe from any thread, not from a signal handler.
+    void incident(const char *reason) {
+        if (!map_) return;
+        request(reason);
+        if (stall_.running()) stall_.wake();
+        else service();
+    }
+
+    // Watchdog: dumps when a stage that has advanced before stops for stall_ms (once per
+    // stall, most upstream stage; 0 = no stall dumps) and serves incident() / SIGUSR1
+    // requests on its thread
+    void start_watchdog(int stall_ms) {
+        if (!map_ || stall_.running()) return;
+        stall_.on_stall([this](const StallReport &r) {
+            char reason[128];
+            snprintf(reason, sizeof(reason), "stall: %s made no progress for %" G_GINT64_FORMAT " ms",
+                     r.stage_name.c_str(), r.stalled_us / 1000);
+            request(reason);
+        });
+        stall_.on_poll([this] {
+            if (signal_dump_.exchange(false, std::memory_order_relaxed)) request("signal SIGUSR1");
+            service();
+        });
+        stall_.start(stall_ms);
+    }
+
+    void stop_watchdog() {
+        if (!stall_.running()) return;
+        stall_.stop();
+        service();          // a request that raced with shutdown
+    }
+
+    // Stamp the live header with reason, no snapshot (e.g. an orderly exit on SIGINT)
+    void mark(const char *reason) {
+        if (map_) stamp(hdr_, reason, "");
+    }
+
+    // SIGUSR1 snapshots (via the watchdog); fatal signals stamp the live header and
+    // re-raise with the default action
+    void install_signal_handlers() {
+        if (!map_) return;
+        signal_target() = this;
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_signal;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESETHAND;
+        const int fatal[] = {SIGSEGV, SIGBUS, SIGABRT, SIGFPE};
+        for (int s : fatal) sigaction(s, &sa, NULL);
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &sa, NULL);
+    }
+
+    void close() {
+        stop_watchdog();
+        if (signal_target() == this) signal_target() = nullptr;
+        if (map_) {
+            msync(map_, bytes_, MS_ASYNC);
+            munmap(map_, bytes_);
+            map_ = nullptr;
+        }
+    }
+
+private:
+    static uint64_t &pending_seq() {
+        thread_local uint64_t seq = 0;
+        return seq;
+    }
+
+    static FlightRecorder *&signal_target() {
+        static FlightRecorder *target = nullptr;
+        return target;
+    }
+
+    // Async-signal-safe: plain stores into the mapping, no allocation, no locks
+    static void stamp(FlightHeader *h, const char *what, const char *name) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        h->incident_mono_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        h->incident_head = __atomic_load_n(&h->head, __ATOMIC_RELAXED);
+        size_t i = 0;
+        for (const char *s = what; *s && i < sizeof(h->incident) - 1; ++s) h->incident[i++] = *s;
+        for (const char *s = name; *s && i < sizeof(h->incident) - 1; ++s) h->incident[i++] = *s;
+        h->incident[i] = 0;
+        __atomic_add_fetch(&h->incidents, 1, __ATOMIC_RELAXED);
+    }
+
+    static void on_signal(int sig) {
+        FlightRecorder *fr = signal_target();
+        if (fr && fr->map_) {
+            if (sig == SIGUSR1) {
+                fr->signal_dump_.store(true, std::memory_order_relaxed);
+                return;
+            }
+            const char *name = sig == SIGSEGV ? "SIGSEGV" : sig == SIGBUS ? "SIGBUS" : sig == SIGABRT ? "SIGABRT"
+                             : "SIGFPE";
+            stamp(fr->hdr_, "signal ", name);
+        }
+        raise(sig);     // SA_RESETHAND restored the default action
+    }
+
+    void request(const char *reason) {
+        std::lock_guard<std::mutex> lock(mu_);
+        g_strlcpy(pending_reason_, reason, sizeof(pending_reason_));
+        dump_requested_ = true;
+    }
+
+    // Write <path>.<n>: header with the incident, then the records as they are now
+    void service() {
+        char reason[sizeof(pending_reason_)];
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            if (!dump_requested_) return;
+            dump_requested_ = false;
+            memcpy(reason, pending_reason_, sizeof(reason));
+        }
+        const uint32_t n = __atomic_add_fetch(&hdr_->incidents, 1, __ATOMIC_RELAXED);
+        hdr_->incident_mono_us = g_get_monotonic_time();
+        hdr_->incident_head = __atomic_load_n(&hdr_->head, __ATOMIC_RELAXED);
+        g_strlcpy(hdr_->incident, reason, sizeof(hdr_->incident));
+        note(FR_EVENT, FR_INCIDENT, 0, n);
+
+        std::string out = path_ + "." + std::to_string(n);
+        int fd = ::open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            g_printerr("Flight recorder: cannot write %s: %s\n", out.c_str(), strerror(errno));
+            return;
+        }
+        // Records being written during the copy show up with seq 0 and are skipped
+        size_t off = 0;
+        while (off < bytes_) {
+            ssize_t w = write(fd, map_ + off, bytes_ - off);
+            if (w <= 0) {
+                if (w < 0 && errno == EINTR) continue;
+                g_printerr("Flight recorder: short write to %s\n", out.c_str());
+                break;
+            }
+            off += (size_t)w;
+        }
+        ::close(fd);
+        g_printerr("Flight recorder: %s -> %s\n", reason, out.c_str());
+    }
+
+    uint8_t      *map_{nullptr};
+    size_t        bytes_{0};
+    std::string   path_;
+    FlightHeader *hdr_{nullptr};
+    FlightRecord *rec_{nullptr};
+    size_t        capacity_{0};
+    int           stages_{0};
+
+    StallWatchdog stall_;
+    std::mutex    mu_;
+    bool          dump_requested_{false};
+    char          pending_reason_[192]{};
+    std::atomic<bool> signal_dump_{false};
+};
+
+#endif
+// _FLIGHT_RECORDER_H_
@@ -5,12 +5,59 @@
 // g++ -O3 -DNDEBUG -std=c++17 relay_debug_nv12_mainthread_fpga.cpp -o relay_debug_mainthread_fpga \
 //   $(pkg-config --cflags --libs gstreamer-1.0 gstreamer-app-1.0 gstreamer-video-1.0) -lpthread \
 //   -lxilinxopencl -lOpenCL -I<path_to_xcl2_header>
+//
+// Add -DWITH_XRT -I$XILINX_XRT/include -lxrt_coreutil to enable --backend=xrt
+// (native XRT path, see frame_backend.h).
+//
+// --backend=auto times cpu, the FPGA backend (--fpga=ocl|xrt) and passthrough at startup
+// on --width x --height and keeps the fastest one that fits the frame budget; timings are
+// cached in --calib-cache (see backend_select.h). Re-evaluated after a kernel switch and
+// if caps change to another geometry.
+//
+// Frames are processed earliest-deadline-first (deadline_scheduler.h): deadline =
+// capture time + --deadline-frames (default 2) frame periods of the negotiated rate.
+// Only frames that can no longer make their deadline are dropped.
+//
+// appsrc is fed on demand (appsrc_flow.h): a frame is only processed if appsrc has room
+// for it (--appsrc-queue frames, default 2); otherwise it is shed before any work.
+// --appsrc-flow=observe processes everything and just counts the wasted frames.
+//
+// --pace hands processed frames to a clock-disciplined pacer (frame_pacer.h) instead of
+// pushing them directly: exact 1/fps output with regenerated PTS, a --pace-jitter frame
+// cushion, and its input and output as two more jitter points (below).
+//
+// Every probe point (camera queue, appsink, encoder sink, payloader output) also keeps
+// inter-frame jitter histograms (frame_jitter.h): deviation of the arrival interval and
+// the PTS difference from the nominal frame time, p50/p99/max per status interval,
+// intervals over 1.5 frame times, and the stage that adds the most jitter.
+//
+// Counters and latency histograms live in a metrics registry (metrics.h); rates use the
+// measured status interval. --metrics-json=FILE appends one JSON line per interval,
+// --metrics-port=[ADDR:]PORT serves Prometheus text on /metrics.
+//
+// --trace-latency tags every captured frame (latency_trace.h) and reports per-stage and
+// capture-to-network latency percentiles; timestamps regenerated for appsrc don't matter.
+//
+// --trace-events=FILE records every frame's stages (capture callback, map, alloc,
+// equalize with device write/kernel/read, push, encode) as Chrome trace JSON for
+// ui.perfetto.dev (trace_events.h), written at exit or on the "trace" command.
+// --trace-ring=SECONDS keeps only the last seconds; --trace-buffer=N events per thread.
+//
+// A flight recorder (flight_recorder.h) is always on: one 64-byte record per frame or
+// drop in an mmap'd ring, --flight=FILE (default flight.rec, --no-flight to disable),
+// --flight-records=N. A bus error, a stage without progress for --flight-stall-ms
+// (default 2000) or SIGUSR1 snapshots it to FILE.<n>; decode with flight_decode.
+//
+// --copy-report accounts every copy on the processing path (copy_account.h: the
+// backend's device transfers and the UV fill) and reports traffic per frame against
+// the minimum and the measured memcpy bandwidth.
 
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
 #include <gst/app/gstappsrc.h>
 #include <gst/video/video.h>
 #include <glib.h>
+#include <glib-unix.h>
 #include <atomic>
 #include <string.h>
 #include <stdlib.h>
@@ -18,61 +65,48 @@
 #include <chrono>
 #include <memory>
 
-// OpenCL/FPGA includes
-#include <CL/cl.h>
-#include <CL/opencl.h>
+// OpenCL/XRT FPGA backends + host backends, chosen per geometry
 #include <vector>
-#include "xcl2.hpp"
+#include "frame_backend.h"
+#include "backend_select.h"
+#include "frame_ring.h"
+#include "deadline_scheduler.h"
+#include "appsrc_flow.h"
+#include "frame_pacer.h"
+#include "frame_jitter.h"
+#include "metrics.h"
+#include "flight_recorder.h"
+#include "latency_trace.h"
+#include "trace_events.h"
+#include "copy_account.h"
 
 struct Counters {
-    // Frame counters for rate calculation
-    std::atomic<uint64_t> camera_frames{0};      // Frames captured from camera
-    std::atomic<uint64_t> fpga_input_frames{0};  // Frames sent to FPGA
-    std::atomic<uint64_t> fpga_output_frames{0}; // Frames processed by FPGA
-    std::atomic<uint64_t> encoder_frames{0};     // Frames sent to encoder
-    std::atomic<uint64_t> output_bytes{0};       // Output bytes for bitrate calculation
-
-    // Previous counts for rate calculation
-    uint64_t prev_camera_frames{0};
-    uint64_t prev_fpga_input_frames{0};
-    uint64_t prev_fpga_output_frames{0};
-    uint64_t prev_encoder_frames{0};
-    uint64_t prev_output_bytes{0};
-
-    std::atomic<uint64_t> processing_errors{0};
-    std::atomic<uint64_t> total_processing_time_us{0};
-    std::atomic<uint64_t> total_idle_calls{0};
+    MetricsRegistry reg{"fpgaworker"};
+
+    // Frame counters (rates come from reg.tick())
+    MetricCounter &camera_frames      = reg.counter("camera_frames_total", "Frames captured from camera");
+    MetricCounter &fpga_input_frames  = reg.counter("fpga_input_frames_total", "Frames sent to FPGA");
+    MetricCounter &fpga_output_frames = reg.counter("fpga_output_frames_total", "Frames processed by FPGA");
+    MetricCounter &encoder_frames     = reg.counter("encoder_frames_total", "Frames sent to encoder");
+    MetricCounter &output_bytes       = reg.counter("output_bytes_total", "Payloaded output bytes");
+    MetricCounter &processing_errors  = reg.counter("processing_errors_total", "Processing errors and drops");
+    MetricCounter &total_idle_calls   = reg.counter("idle_calls_total", "Main loop idle callbacks");
+
+    MetricHistogram &processing_us    = reg.histogram("processing_us", "Main thread time per frame");
+
+    // Backend phase breakdown (host wall time)
+    MetricHistogram &backend_write_us  = reg.histogram("backend_write_us", "Backend input transfer");
+    MetricHistogram &backend_kernel_us = reg.histogram("backend_kernel_us", "Backend kernel run");
+    MetricHistogram &backend_read_us   = reg.histogram("backend_read_us", "Backend output transfer");
+
+    MetricGauge &queue_frames         = reg.gauge("queue_frames", "Frames waiting for processing");
+    MetricGauge &appsrc_level         = reg.gauge("appsrc_level_bytes", "Bytes queued in appsrc");
 };
 
-// FPGA OpenCL context structure
-struct FPGAContext {
-    cl::Platform platform;
-    cl::Device device;
-    cl::Context context;
-    cl::CommandQueue queue;
-    cl::Program program;
-    cl::Kernel kernel;
-    
-    // Memory buffers - aligned for FPGA
-    cl::Buffer img_y_in;
-    cl::Buffer img_y_in_ref;
-    cl::Buffer img_y_out;
-    
-    // Host buffers - aligned for better performance
-    std::vector<uint8_t> host_in_buffer;
-    std::vector<uint8_t> host_out_buffer;
-    
-    bool initialized{false};
-    int max_width{0};
-    int max_height{0};
-    
-    ~FPGAContext() {
-        cleanup();
-    }
-    
-    void cleanup() {
-        initialized = false;
-    }
+// Frame plus the monotonic time it was captured (appsink thread -> main loop)
+struct StampedFrame {
+    GstBuffer *buf;
+    int64_t    capture_us;
 };
 
 struct CustomData {
@@ -82,99 +116,51 @@ struct CustomData {
     GstVideoInfo video_info{};
 
     // Main thread processing (replaces worker threads)
-    GAsyncQueue *work_q{nullptr};        // Still need the queue
+    std::unique_ptr<SpscRing<StampedFrame>> work_q; // appsink thread -> main loop, lock-free
     guint        idle_source_id{0};      // GLib idle source ID
-    gboolean     processing_active{FALSE}; // Track if idle processing is running
-    int          frames_per_batch{1};    // Process N frames per idle call (start with 1 for FPGA)
+    std::atomic<bool> processing_active{false}; // idle dispatcher armed (appsink thread sets, main loop clears)
     gint64       avg_frame_time_us{10000}; // Rolling average processing time (higher for FPGA)
     std::atomic<bool> stop{false};
-    
-    // FPGA optimization settings
-    int          max_queue_depth{8};     // Maximum frames to queue
-    gboolean     drop_frames{TRUE};      // Enable frame dropping when overloaded
+
+    // EDF order and deadline drops (main thread); period follows the negotiated caps
+    DeadlineScheduler<GstBuffer*> sched;
+    std::atomic<int64_t> frame_period_us{0};
+    gboolean     drop_frames{TRUE};      // Drop frames that can no longer make their deadline
+
+    AppsrcFlow   flow;                   // need-data / enough-data / level backpressure
+    FramePacer   pacer;                  // --pace: owns PTS and push timing
 
     Counters     ctr{};
+    MetricsExporter metrics{ctr.reg};
+    LatencyTrace trace;
+    FrameJitter  jitter;                     // inter-frame intervals per probe point
+    int          jt_camera{-1}, jt_appsink{-1}, jt_encoder{-1}, jt_output{-1};
+    int          jt_pace_in{-1}, jt_pace_out{-1};  // --pace only
+    const char  *trace_events_path{nullptr};  // --trace-events
+    bool         copy_report{false};         // --copy-report
+    uint64_t     copy_prev_frames{0};        // status_tick only
+    FlightRecorder flight;                   // per-frame records for post-mortems
+    int          fr_capture{-1}, fr_process{-1}, fr_encoder{-1}, fr_network{-1};  // stall stages
+    uint8_t      fr_backend{0xff};           // flight id of the active backend
     GMainLoop   *loop{nullptr};
     
-    // FPGA context
-    FPGAContext fpga_ctx{};
+    // Backend candidates and the per-geometry choice (owned by the selector)
+    BackendSelector selector;
+    FrameBackend   *backend{nullptr};    // active one, main thread only
+    FrameBackend   *fpga{nullptr};       // device candidate, target of the kernel/chain commands
+
+    // Negotiated geometry, (width << 32) | height, written by the streaming thread
+    std::atomic<uint64_t> caps_geometry{0};
+    GstCaps     *last_caps{nullptr};
 };
 
-/* ---------- FPGA OpenCL Initialization ---------- */
-
-static gboolean init_fpga_context(CustomData *d, int width, int height) {
-    FPGAContext &ctx = d->fpga_ctx;
-    
-    if (ctx.initialized && ctx.max_width >= width && ctx.max_height >= height) {
-        return TRUE; // Already initialized with sufficient size
-    }
-    
-    // Clean up previous context if reinitializing
-    if (ctx.initialized) {
-        ctx.cleanup();
-    }
-    
-    try {
-        // Get Xilinx device using XCL utilities
-        std::vector<cl::Device> devices = xcl::get_xil_devices();
-        if (devices.empty()) {
-            g_printerr("No Xilinx devices found\n");
-            return FALSE;
-        }
-        
-        ctx.device = devices[0];
-        std::string device_name = ctx.device.getInfo<CL_DEVICE_NAME>();
-        g_print("Using device: %s\n", device_name.c_str());
-        
-        // Create context and command queue
-        ctx.context = cl::Context(ctx.device);
-        ctx.queue = cl::CommandQueue(ctx.context, ctx.device, CL_QUEUE_PROFILING_ENABLE);
-        
-        // Load binary file using XCL utilities (matching your approach)
-        std::string binaryFile = xcl::find_binary_file(device_name, "krnl_hist_equalize");
-        cl::Program::Binaries bins = xcl::import_binary_file(binaryFile);
-        std::vector<cl::Device> devices_for_program = {ctx.device};
-        ctx.program = cl::Program(ctx.context, devices_for_program, bins);
-        
-        // Create kernel
-        ctx.kernel = cl::Kernel(ctx.program, "equalizeHist_accel");
-        
-        // Set up buffers for maximum expected size
-        ctx.max_width = std::max(width, 1920);
-        ctx.max_height = std::max(height, 1080);
-        size_t max_y_size = ctx.max_width * ctx.max_height;
-        
-        // Align to 256-bit boundaries for FPGA efficiency
-        size_t aligned_size = ((max_y_size + 31) / 32) * 32;
-        
-        // Create OpenCL buffers using C++ API
-        ctx.img_y_in = cl::Buffer(ctx.context, CL_MEM_READ_ONLY, aligned_size);
-        ctx.img_y_in_ref = cl::Buffer(ctx.context, CL_MEM_READ_ONLY, aligned_size);
-        ctx.img_y_out = cl::Buffer(ctx.context, CL_MEM_WRITE_ONLY, aligned_size);
-        
-        // Allocate host buffers
-        ctx.host_in_buffer.resize(aligned_size);
-        ctx.host_out_buffer.resize(aligned_size);
-        
-        ctx.initialized = TRUE;
-        g_print("FPGA context initialized for max size %dx%d\n", ctx.max_width, ctx.max_height);
-        return TRUE;
-        
-    } catch (const GError& e) {
-        g_printerr("OpenCL initialization error");
-        return FALSE;
-    } catch (const std::exception& e) {
-        g_printerr("Exception in init_fpga_context: %s\n", e.what());
-        return FALSE;
-    }
-}
-
 /* ---------- Pad probes ---------- */
 
 static GstPadProbeReturn probe_cam_out(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
     auto *d = (CustomData*)user_data;
     if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
-        d->ctr.camera_frames.fetch_add(1, std::memory_order_relaxed);
+        d->ctr.camera_frames.add();
+        d->jitter.on_buffer(d->jt_camera, GST_PAD_PROBE_INFO_BUFFER(info));
     }
     return GST_PAD_PROBE_OK;
 }
@@ -182,7 +168,8 @@ static GstPadProbeReturn probe_cam_out(GstPad *pad, GstPadProbeInfo *info, gpoin
 static GstPadProbeReturn probe_apps_sink(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
     auto *d = (CustomData*)user_data;
     if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
-        d->ctr.fpga_input_frames.fetch_add(1, std::memory_order_relaxed);
+        d->ctr.fpga_input_frames.add();
+        d->jitter.on_buffer(d->jt_appsink, GST_PAD_PROBE_INFO_BUFFER(info));
     }
     return GST_PAD_PROBE_OK;
 }
@@ -191,7 +178,19 @@ static GstPadProbeReturn probe_encoder_sink(GstPad *pad, GstPadProbeInfo *info,
     auto *d = (CustomData*)user_data;
     if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
         GstBuffer *b = GST_PAD_PROBE_INFO_BUFFER(info);
-        d->ctr.encoder_frames.fetch_add(1, std::memory_order_relaxed);
+        d->ctr.encoder_frames.add();
+        d->flight.progress(d->fr_encoder);
+        d->jitter.on_buffer(d->jt_encoder, b);
+        // Encoder in -> out span, keyed by PTS (no reordering with low-delay-p)
+        trace_async_begin("encode", GST_BUFFER_PTS(b));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// Only installed with --trace-events
+static GstPadProbeReturn probe_encoder_src(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
+        trace_async_end("encode", GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info)));
     }
     return GST_PAD_PROBE_OK;
 }
@@ -200,107 +199,162 @@ static GstPadProbeReturn probe_output(GstPad *pad, GstPadProbeInfo *info, gpoint
     auto *d = (CustomData*)user_data;
     if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
         GstBuffer *b = GST_PAD_PROBE_INFO_BUFFER(info);
-        d->ctr.output_bytes.fetch_add(gst_buffer_get_size(b), std::memory_order_relaxed);
+        d->ctr.output_bytes.add(gst_buffer_get_size(b));
+        d->flight.progress(d->fr_network);
+        d->jitter.on_buffer(d->jt_output, b);   // first RTP packet of each frame
     }
     return GST_PAD_PROBE_OK;
 }
 
+/* ---------- Backend choice ---------- */
+
+// Run the cost model for width x height (main thread): at startup for --width/--height,
+// after a kernel switch or recalibrate command, and on a caps change
+static gboolean choose_backend(CustomData *d, int width, int height) {
+    FrameBackend *prev = d->backend;
+    d->backend = d->selector.select(width, height);
+    if (d->backend && d->backend != prev) {
+        g_print("Backend for %dx%d: %s (%s)\n", width, height, d->backend->name(), d->backend->active_kernel_name());
+        d->fr_backend = d->flight.backend_id(d->backend->name());
+        if (FlightRecord *r = d->flight.begin(FR_EVENT, FR_BACKEND)) {
+            r->backend = d->fr_backend;
+            d->flight.commit(r);
+        }
+    }
+    return d->backend != nullptr;
+}
+
+// Per frame: only a caps change to another geometry re-selects (the capsfilter pins
+// --width/--height, so normally the startup choice stands)
+static gboolean ensure_backend(CustomData *d) {
+    uint64_t geom = d->caps_geometry.load(std::memory_order_acquire);
+    int width = (int)(geom >> 32);
+    int height = (int)(geom & 0xffffffffu);
+    if (width <= 0 || height <= 0) return FALSE;
+    if (d->backend && width == d->selector.width() && height == d->selector.height()) return TRUE;
+    return choose_backend(d, width, height);
+}
+
+/* ---------- Flight records (main thread) ---------- */
+
+static void flight_queues(CustomData *d, FlightRecord *r) {
+    r->work_q = (uint16_t)d->work_q->size();
+    r->sched_q = (uint16_t)d->sched.size();
+    r->appsrc_kb = (uint32_t)(d->flow.level_bytes() / 1024);
+    r->backend = d->fr_backend;
+}
+
+static void flight_drop(CustomData *d, FlightReason reason, GstBuffer *buf, int64_t capture_us = 0) {
+    FlightRecord *r = d->flight.begin(FR_DROP, reason);
+    if (!r) return;
+    r->frame = GST_BUFFER_OFFSET(buf);
+    r->capture_us = capture_us;
+    flight_queues(d, r);
+    d->flight.commit(r);
+}
+
 /* ---------- Single frame processing function with FPGA ---------- */
 
-static gboolean process_single_frame_fpga(CustomData *d, GstBuffer *inbuf) {
+static gboolean process_single_frame_fpga(CustomData *d, GstBuffer *inbuf, const DeadlineTicket &ticket) {
     try {
         auto start_time = std::chrono::high_resolution_clock::now();
-        
+        const uint64_t frame = GST_BUFFER_OFFSET(inbuf);   // v4l2 sequence number
+        TRACE_SCOPE("process", frame);
+
         // Map input buffer for reading
         GstMapInfo map_info;
-        if (!gst_buffer_map(inbuf, &map_info, GST_MAP_READ)) {
-            d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+        gboolean mapped;
+        {
+            TRACE_SCOPE("map", frame);
+            mapped = gst_buffer_map(inbuf, &map_info, GST_MAP_READ);
+        }
+        if (!mapped) {
+            d->ctr.processing_errors.add();
+            flight_drop(d, FR_MAP_FAILED, inbuf, ticket.capture_us);
             return FALSE;
         }
 
-        if (!d->video_info_valid) {
+        if (!ensure_backend(d)) {
             gst_buffer_unmap(inbuf, &map_info);
+            flight_drop(d, FR_BACKEND_FAILED, inbuf, ticket.capture_us);
             return FALSE;
         }
 
-        int width = d->video_info.width;
-        int height = d->video_info.height;
+        int width = d->selector.width();
+        int height = d->selector.height();
         size_t y_size = (size_t)width * (size_t)height;
         size_t uv_size = (size_t)width * (size_t)height / 2;
 
         if (map_info.size < y_size + uv_size) {
             gst_buffer_unmap(inbuf, &map_info);
-            d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+            d->ctr.processing_errors.add();
+            flight_drop(d, FR_MAP_FAILED, inbuf, ticket.capture_us);
             return FALSE;
         }
 
-        // Initialize FPGA context if needed
-        if (!init_fpga_context(d, width, height)) {
+        d->flow.set_frame_bytes(y_size + uv_size);
+
+        // Create output buffer; the backend reads back straight into it
+        GstBuffer *outbuf;
+        GstMapInfo out_map_info;
+        {
+            TRACE_SCOPE("alloc", frame);
+            outbuf = gst_buffer_new_allocate(NULL, y_size + uv_size, NULL);
+            mapped = outbuf && gst_buffer_map(outbuf, &out_map_info, GST_MAP_WRITE);
+        }
+        if (!outbuf) {
             gst_buffer_unmap(inbuf, &map_info);
-            d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+            d->ctr.processing_errors.add();
+            flight_drop(d, FR_ALLOC_FAILED, inbuf, ticket.capture_us);
             return FALSE;
         }
-
-        FPGAContext &ctx = d->fpga_ctx;
-
-        // Copy Y plane data to host buffer
-        memcpy(ctx.host_in_buffer.data(), map_info.data, y_size);
-        
-        // For histogram equalization, we use the same frame as both input and reference
-        memcpy(ctx.host_in_buffer.data(), map_info.data, y_size); // Same data for reference
-        
-        // Transfer input data to FPGA using C++ API (non-blocking)
-        ctx.queue.enqueueWriteBuffer(ctx.img_y_in, CL_FALSE, 0, y_size, ctx.host_in_buffer.data());
-        
-        // Transfer reference data to FPGA (same as input for histogram equalization) (non-blocking)
-        ctx.queue.enqueueWriteBuffer(ctx.img_y_in_ref, CL_FALSE, 0, y_size, ctx.host_in_buffer.data());
-
-        // Set kernel arguments using C++ API
-        ctx.kernel.setArg(0, ctx.img_y_in);
-        ctx.kernel.setArg(1, ctx.img_y_in_ref);
-        ctx.kernel.setArg(2, ctx.img_y_out);
-        ctx.kernel.setArg(3, height);
-        ctx.kernel.setArg(4, width);
-
-        // Execute kernel (non-blocking)
-        cl::Event kernel_event;
-        ctx.queue.enqueueTask(ctx.kernel, nullptr, &kernel_event);
-
-        // Read back result (blocking on kernel completion)
-        ctx.queue.enqueueReadBuffer(ctx.img_y_out, CL_TRUE, 0, y_size, ctx.host_out_buffer.data());
-
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
-        
-        // Update rolling average processing time
-        gint64 frame_time = duration.count();
-        d->avg_frame_time_us = (d->avg_frame_time_us * 9 + frame_time) / 10; // Rolling average
-        
-        d->ctr.total_processing_time_us.fetch_add(frame_time, std::memory_order_relaxed);
-
-        // Create output buffer
-        GstBuffer *outbuf = gst_buffer_new_allocate(NULL, y_size + uv_size, NULL);
-        if (!outbuf) {
+        if (!mapped) {
+            gst_buffer_unref(outbuf);
             gst_buffer_unmap(inbuf, &map_info);
-            d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+            d->ctr.processing_errors.add();
+            flight_drop(d, FR_ALLOC_FAILED, inbuf, ticket.capture_us);
             return FALSE;
         }
 
-        // Map output buffer and reconstruct NV12
-        GstMapInfo out_map_info;
-        if (gst_buffer_map(outbuf, &out_map_info, GST_MAP_WRITE)) {
-            // Copy processed Y plane from FPGA
-            memcpy(out_map_info.data, ctx.host_out_buffer.data(), y_size);
-            // Fill UV with neutral value 128
-            memset(out_map_info.data + y_size, 128, uv_size);
+        // Equalize Y on the device (input frame doubles as the histogram reference)
+        const int64_t eq_begin = g_get_monotonic_time();
+        gboolean equalized = d->backend->process_y(map_info.data, out_map_info.data, width, height);
+        const int64_t eq_done = g_get_monotonic_time();
+        if (trace_enabled()) {
+            // Device phases back to back from the start of the call (host wall time)
+            const BackendTimings &bt = d->backend->last_timings();
+            trace_complete("equalize", eq_begin, eq_done, frame);
+            trace_complete("device_write", eq_begin, eq_begin + bt.write_us, frame);
+            trace_complete("kernel", eq_begin + bt.write_us, eq_begin + bt.write_us + bt.kernel_us, frame);
+            trace_complete("device_read", eq_begin + bt.write_us + bt.kernel_us,
+                           eq_begin + bt.write_us + bt.kernel_us + bt.read_us, frame);
+        }
+        if (!equalized) {
             gst_buffer_unmap(outbuf, &out_map_info);
-        } else {
             gst_buffer_unref(outbuf);
             gst_buffer_unmap(inbuf, &map_info);
-            d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+            d->ctr.processing_errors.add();
+            flight_drop(d, FR_BACKEND_FAILED, inbuf, ticket.capture_us);
             return FALSE;
         }
+        // Fill UV with neutral value 128
+        memset_acct(COPY_SITE("uv_fill"), out_map_info.data + y_size, 128, uv_size);
+        gst_buffer_unmap(outbuf, &out_map_info);
+
+        auto end_time = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+
+        // Update rolling average processing time
+        gint64 frame_time = duration.count();
+        d->avg_frame_time_us = (d->avg_frame_time_us * 9 + frame_time) / 10; // Rolling average
 
+        d->ctr.processing_us.record(frame_time);
+        const BackendTimings &bt = d->backend->last_timings();
+        d->ctr.backend_write_us.record(bt.write_us);
+        d->ctr.backend_kernel_us.record(bt.kernel_us);
+        d->ctr.backend_read_us.record(bt.read_us);
+
+        d->trace.carry(inbuf, outbuf);
         gst_buffer_unmap(inbuf, &map_info);
 
         // Fresh timestamps in appsrc pipeline
@@ -309,21 +363,39 @@ static gboolean process_single_frame_fpga(CustomData *d, GstBuffer *inbuf) {
         GST_BUFFER_DURATION(outbuf) = GST_CLOCK_TIME_NONE;
 
         // Count FPGA output frame
-        d->ctr.fpga_output_frames.fetch_add(1, std::memory_order_relaxed);
+        d->ctr.fpga_output_frames.add();
+        d->trace.mark(TRACE_PROCESSED, outbuf);
 
-        GstFlowReturn ret = gst_app_src_push_buffer(GST_APP_SRC(d->appsrc), outbuf);
-        if (ret != GST_FLOW_OK) {
-            gst_buffer_unref(outbuf);
-            return FALSE;
+        // Paced: the pacer stamps and pushes at the next slot
+        GstFlowReturn pushed = GST_FLOW_OK;
+        if (d->pacer.running()) {
+            d->pacer.submit(outbuf);
+        } else {
+            // appsrc takes ownership, also on failure
+            TRACE_SCOPE("push", frame);
+            pushed = d->flow.push(outbuf);
         }
 
-        return TRUE;
+        if (FlightRecord *r = d->flight.begin(pushed == GST_FLOW_OK ? FR_FRAME : FR_DROP,
+                                              pushed == GST_FLOW_OK ? FR_NONE : FR_PUSH_FAILED)) {
+            r->frame = frame;
+            r->capture_us = ticket.capture_us;
+            r->dequeue_us = FlightRecorder::offset(ticket.capture_us, ticket.start_us);
+            r->processed_us = FlightRecorder::offset(ticket.capture_us, eq_done);
+            r->pushed_us = FlightRecorder::offset(ticket.capture_us, r->t_us);
+            r->backend_us = (uint32_t)(eq_done - eq_begin);
+            flight_queues(d, r);
+            d->flight.commit(r);
+        }
+        d->flight.progress(d->fr_process);
+
+        return pushed == GST_FLOW_OK;
 
     } catch (const GError& e) {
         g_printerr("OpenCL initialization error");
         return FALSE;
     } catch (const std::exception& e) {
-        d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+        d->ctr.processing_errors.add();
         g_printerr("FPGA processing error: %s\n", e.what());
         return FALSE;
     }
@@ -331,79 +403,61 @@ static gboolean process_single_frame_fpga(CustomData *d, GstBuffer *inbuf) {
 
 /* ---------- Main thread idle processing ---------- */
 
+// Dispatcher going idle. new_sample_cb only arms it when the flag is clear, so a frame
+// pushed between the last ring check and the clear would wait for the next arrival:
+// look at the ring again after clearing, and keep running if something came in and the
+// appsink thread did not re-arm meanwhile.
+static gboolean idle_disarm(CustomData *d) {
+    d->processing_active.store(false, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (d->work_q->size() == 0) return G_SOURCE_REMOVE;
+    bool expected = false;
+    return d->processing_active.compare_exchange_strong(expected, true) ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
 static gboolean process_frames_idle(gpointer user_data) {
     auto *d = (CustomData*)user_data;
     
     if (d->stop.load(std::memory_order_acquire)) {
-        d->processing_active = FALSE;
+        d->processing_active.store(false);
         return G_SOURCE_REMOVE;
     }
     
-    d->ctr.total_idle_calls.fetch_add(1, std::memory_order_relaxed);
-    
-    gint64 start_time = g_get_monotonic_time();
-    const gint64 TIME_BUDGET_US = 12000; // 12ms budget per idle call (adjusted for FPGA)
-    int processed_count = 0;
-    
-    // Aggressive frame dropping if queue is backing up
-    int current_queue_length = g_async_queue_length(d->work_q);
-    if (current_queue_length > d->max_queue_depth && d->drop_frames) {
-        // Drop frames to prevent backup
-        int frames_to_drop = current_queue_length - (d->max_queue_depth / 2);
-        for (int i = 0; i < frames_to_drop; i++) {
-            gpointer dropped_item = g_async_queue_try_pop(d->work_q);
-            if (dropped_item) {
-                gst_buffer_unref((GstBuffer*)dropped_item);
-                d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed); // Count as processing error for monitoring
-            } else {
-                break;
-            }
-        }
-        g_print("Dropped %d frames to prevent queue backup (queue was %d deep)\n", 
-                frames_to_drop, current_queue_length);
+    d->ctr.total_idle_calls.add();
+
+    // Move everything that arrived into the EDF queue (deadline from the current rate)
+    int64_t period = d->frame_period_us.load(std::memory_order_relaxed);
+    if (period > 0) d->sched.set_frame_period_us(period);
+    StampedFrame sf;
+    while (d->work_q->try_pop(sf)) d->sched.push(sf.buf, sf.capture_us);
+
+    // One frame per dispatch: the main loop gets to run its other sources (bus, status,
+    // control) between frames, and the next pick sees frames that arrived meanwhile
+    GstBuffer *inbuf = nullptr;
+    DeadlineTicket ticket;
+    if (!d->sched.pop(inbuf, ticket, g_get_monotonic_time(), [d](GstBuffer *late) {
+            flight_drop(d, FR_LATE, late);
+            gst_buffer_unref(late);
+            d->ctr.processing_errors.add(); // Count as processing error for monitoring
+        })) {
+        // Nothing left
+        return idle_disarm(d);
     }
-    
-    // Dynamic batch size based on performance and queue depth
-    int max_batch = 1; // Conservative default for FPGA
-    if (d->avg_frame_time_us < 8000 && current_queue_length < 3) { // < 8ms per frame and low queue
-        max_batch = 2;
-    } else if (d->avg_frame_time_us > 15000 || current_queue_length > 5) { // > 15ms per frame or high queue
-        max_batch = 1;
+
+    // appsrc full: shed this frame before doing any work and wait for the next arrival;
+    // the rest stay queued and face the deadline check again then
+    if (!d->flow.admit()) {
+        flight_drop(d, FR_SHED, inbuf, ticket.capture_us);
+        gst_buffer_unref(inbuf);
+        return idle_disarm(d);
     }
-    
-    // Process frames within time budget
-    while (processed_count < max_batch) {
-        // Non-blocking pop - return immediately if no frames
-        gpointer item = g_async_queue_try_pop(d->work_q);
-        if (!item) {
-            // No more frames available
-            if (processed_count == 0) {
-                // No frames processed, can deactivate idle processing
-                d->processing_active = FALSE;
-                return G_SOURCE_REMOVE;
-            }
-            break; // Processed some frames, continue idle source
-        }
-        
-        GstBuffer *inbuf = (GstBuffer*)item;
-        
-        // Process single frame with FPGA
-        if (process_single_frame_fpga(d, inbuf)) {
-            processed_count++;
-        }
-        
-        gst_buffer_unref(inbuf); // Release input buffer
-        
-        // Check if we've exceeded our time budget
-        gint64 elapsed = g_get_monotonic_time() - start_time;
-        if (elapsed > TIME_BUDGET_US) {
-            break; // Yield control back to main loop
-        }
+
+    // Process single frame with FPGA
+    if (process_single_frame_fpga(d, inbuf, ticket)) {
+        d->sched.complete(ticket, g_get_monotonic_time());
     }
-    
-    // Update batch size for next time
-    d->frames_per_batch = max_batch;
-    
+    gst_buffer_unref(inbuf); // Release input buffer
+
     return G_SOURCE_CONTINUE; // Keep the idle source active
 }
 
@@ -416,24 +470,60 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
     if (!sample) return GST_FLOW_ERROR;
     GstBuffer *inbuf = gst_sample_get_buffer(sample);
     if (!inbuf) { gst_sample_unref(sample); return GST_FLOW_ERROR; }
-
-    // Cache caps once (diagnostic only)
-    if (!d->video_info_valid) {
-        if (GstCaps *caps = gst_sample_get_caps(sample)) {
-            if (gst_video_info_from_caps(&d->video_info, caps)) {
-                d->video_info_valid = TRUE;
+    TRACE_SCOPE("capture_cb", GST_BUFFER_OFFSET(inbuf));
+    d->flight.progress(d->fr_capture);
+
+    // Re-parse caps only when they change; a new geometry triggers backend re-selection
+    GstCaps *caps = gst_sample_get_caps(sample);
+    if (caps && caps != d->last_caps) {
+        gst_caps_replace(&d->last_caps, caps);
+        if (gst_video_info_from_caps(&d->video_info, caps)) {
+            uint64_t geom = ((uint64_t)d->video_info.width << 32) | (uint32_t)d->video_info.height;
+            if (geom != d->caps_geometry.load(std::memory_order_relaxed)) {
                 g_print("Video info: %dx%d\n", d->video_info.width, d->video_info.height);
+                d->flight.note(FR_EVENT, FR_CAPS, GST_BUFFER_OFFSET(inbuf),
+                               ((uint32_t)d->video_info.width << 16) | ((uint32_t)d->video_info.height & 0xffff));
             }
+            d->caps_geometry.store(geom, std::memory_order_release);
+            if (d->video_info.fps_n > 0 && d->video_info.fps_d > 0) {
+                d->frame_period_us.store((int64_t)d->video_info.fps_d * 1000000 / d->video_info.fps_n,
+                                         std::memory_order_relaxed);
+                d->jitter.set_period_us(d->frame_period_us.load(std::memory_order_relaxed));
+            }
+            d->video_info_valid = TRUE;
         }
     }
 
+    // Capture time: the buffer's PTS on the pipeline clock (the system clock, same
+    // monotonic base as g_get_monotonic_time). Arrival time if that doesn't look sane.
+    const int64_t now_us = g_get_monotonic_time();
+    int64_t capture_us = now_us;
+    GstClockTime pts = GST_BUFFER_PTS(inbuf);
+    if (GST_CLOCK_TIME_IS_VALID(pts)) {
+        int64_t clock_us = (int64_t)((gst_element_get_base_time(GST_ELEMENT(appsink)) + pts) / 1000);
+        if (clock_us <= now_us && now_us - clock_us < 1000000) capture_us = clock_us;
+    }
+
     // O(1): ref buffer, queue to main thread processing, unref sample
     gst_buffer_ref(inbuf);
-    g_async_queue_push(d->work_q, inbuf);
-
-    // Trigger idle processing if not already active
-    if (!d->processing_active) {
-        d->processing_active = TRUE;
+    // Overwriting only happens if the main loop stalls badly; deadline drops are the
+    // scheduler's job
+    d->work_q->push_overwrite(StampedFrame{inbuf, capture_us}, [d](StampedFrame old) {
+        // Streaming thread: the scheduler's depth is the main loop's to read
+        if (FlightRecord *r = d->flight.begin(FR_DROP, FR_OVERWRITE)) {
+            r->frame = GST_BUFFER_OFFSET(old.buf);
+            r->capture_us = old.capture_us;
+            r->work_q = (uint16_t)d->work_q->size();
+            d->flight.commit(r);
+        }
+        gst_buffer_unref(old.buf);
+        d->ctr.processing_errors.add();
+    });
+
+    // Trigger idle processing if not already active (the ring push above comes first;
+    // idle_disarm re-checks the ring after clearing the flag)
+    bool expected = false;
+    if (d->processing_active.compare_exchange_strong(expected, true)) {
         d->idle_source_id = g_idle_add(process_frames_idle, d);
     }
 
@@ -446,67 +536,138 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
 static gboolean status_tick(gpointer user_data) {
     auto *d = (CustomData*)user_data;
 
-    // Get current frame counts
-    uint64_t current_camera = d->ctr.camera_frames.load();
-    uint64_t current_fpga_in = d->ctr.fpga_input_frames.load();
-    uint64_t current_fpga_out = d->ctr.fpga_output_frames.load();
-    uint64_t current_encoder = d->ctr.encoder_frames.load();
-    uint64_t current_output_bytes = d->ctr.output_bytes.load();
-
-    // Calculate frame rates (frames per second over 2 second interval)
-    double camera_fps = (current_camera - d->ctr.prev_camera_frames) / 2.0;
-    double fpga_input_fps = (current_fpga_in - d->ctr.prev_fpga_input_frames) / 2.0;
-    double fpga_output_fps = (current_fpga_out - d->ctr.prev_fpga_output_frames) / 2.0;
-    double encoder_fps = (current_encoder - d->ctr.prev_encoder_frames) / 2.0;
-    
-    // Calculate output bitrate in kbps (kilobits per second over 2 second interval)
-    double output_bitrate_kbps = ((current_output_bytes - d->ctr.prev_output_bytes) * 8.0) / (2.0 * 1000.0);
-
     // Queue length and processing info
-    const int qlen = g_async_queue_length(d->work_q);
-    const uint64_t proc_errors = d->ctr.processing_errors.load();
-    const uint64_t total_proc_time = d->ctr.total_processing_time_us.load();
-    const uint64_t processed_total = current_fpga_out;
-
-    double avg_proc_time_ms = 0.0;
-    if (processed_total > 0) {
-        avg_proc_time_ms = (double)total_proc_time / (double)processed_total / 1000.0; // convert µs to ms
-    }
+    const int qlen = (int)d->work_q->size() + (int)d->sched.size();
+    d->ctr.queue_frames.set(qlen);
+    d->ctr.appsrc_level.set((int64_t)d->flow.level_bytes());
+
+    // Rates over the measured interval: the timer fires late when the main loop is busy
+    const double interval_s = d->ctr.reg.tick();
+    double camera_fps = d->ctr.camera_frames.rate();
+    double fpga_input_fps = d->ctr.fpga_input_frames.rate();
+    double fpga_output_fps = d->ctr.fpga_output_frames.rate();
+    double encoder_fps = d->ctr.encoder_frames.rate();
+    double output_bitrate_kbps = d->ctr.output_bytes.rate() * 8.0 / 1000.0;
+
+    const uint64_t proc_errors = d->ctr.processing_errors.value();
+    const MetricHistogram::Summary &pt = d->ctr.processing_us.interval();
+    double avg_proc_time_ms = d->ctr.processing_us.mean_us() / 1000.0;
+    double avg_write_ms  = d->ctr.backend_write_us.mean_us() / 1000.0;
+    double avg_kernel_ms = d->ctr.backend_kernel_us.mean_us() / 1000.0;
+    double avg_read_ms   = d->ctr.backend_read_us.mean_us() / 1000.0;
 
     g_print(
-        "\n=== FPGA FRAME RATE MONITORING (every 2s) ===\n"
+        "\n=== FPGA FRAME RATE MONITORING (%.2fs interval) ===\n"
         "Camera Capture Rate:     %6.1f fps\n"
         "FPGA Input Rate:         %6.1f fps\n"
         "FPGA Output Rate:        %6.1f fps\n"
         "Encoder Input Rate:      %6.1f fps\n"
         "Output Bitrate:          %6.1f kbps\n"
         "\n"
-        "Queue Length: %d (max=%d) | Processing Errors/Drops: %" G_GUINT64_FORMAT " | Avg Process Time: %.2f ms\n"
-        "Processing Status: %s (batch=%d, avg_frame_time=%.1fms)\n"
-        "FPGA Status: %s | Frame Dropping: %s\n",
+        "Queue Length: %d | Processing Errors/Drops: %" G_GUINT64_FORMAT " | Avg Process Time: %.2f ms"
+        " (interval p50 %.2f / p99 %.2f / max %.2f ms)\n"
+        "Processing Status: %s (avg_frame_time=%.1fms)\n"
+        "FPGA Status: %s (%s/%s: write %.2f / kernel %.2f / read %.2f ms) | Frame Dropping: %s\n",
+        interval_s,
         camera_fps,
         fpga_input_fps,
         fpga_output_fps,
         encoder_fps,
         output_bitrate_kbps,
-        qlen, d->max_queue_depth, proc_errors, avg_proc_time_ms,
-        d->processing_active ? "ACTIVE" : "IDLE",
-        d->frames_per_batch,
+        qlen, proc_errors, avg_proc_time_ms, pt.p50_us / 1000.0, pt.p99_us / 1000.0, pt.max_us / 1000.0,
+        d->processing_active.load(std::memory_order_relaxed) ? "ACTIVE" : "IDLE",
         d->avg_frame_time_us / 1000.0,
-        d->fpga_ctx.initialized ? "INITIALIZED" : "NOT INITIALIZED",
+        d->backend ? "INITIALIZED" : "NOT SELECTED",
+        d->backend ? d->backend->name() : "-", d->backend ? d->backend->active_kernel_name() : "-",
+        avg_write_ms, avg_kernel_ms, avg_read_ms,
         d->drop_frames ? "ENABLED" : "DISABLED"
     );
 
-    // Store current counts as previous for next calculation
-    d->ctr.prev_camera_frames = current_camera;
-    d->ctr.prev_fpga_input_frames = current_fpga_in;
-    d->ctr.prev_fpga_output_frames = current_fpga_out;
-    d->ctr.prev_encoder_frames = current_encoder;
-    d->ctr.prev_output_bytes = current_output_bytes;
+    const DeadlineStats &ds = d->sched.stats();
+    g_print("Deadlines (budget %.1f ms = %.1f frames, service est %.2f ms): on time %" G_GUINT64_FORMAT
+            " | missed %" G_GUINT64_FORMAT " (worst +%.2f ms) | late drops %" G_GUINT64_FORMAT
+            " | min slack %.2f ms | max depth %" G_GUINT64_FORMAT "\n",
+            d->sched.budget_us() / 1000.0, (double)d->sched.budget_us() / (double)d->sched.frame_period_us(),
+            d->sched.service_estimate_us() / 1000.0, ds.on_time, ds.missed, ds.worst_lateness_us / 1000.0,
+            ds.late_dropped, ds.on_time ? ds.min_slack_us / 1000.0 : 0.0, ds.max_depth);
+
+    const AppsrcFlowStats &fs = d->flow.stats();
+    g_print("appsrc (%s): level %" G_GUINT64_FORMAT " / %" G_GUINT64_FORMAT " KB (peak %" G_GUINT64_FORMAT
+            ") | need-data %" G_GUINT64_FORMAT " | enough-data %" G_GUINT64_FORMAT " | admitted %" G_GUINT64_FORMAT
+            " | shed %" G_GUINT64_FORMAT " | wasted %" G_GUINT64_FORMAT " | push errors %" G_GUINT64_FORMAT "\n",
+            d->flow.gating() ? "demand-driven" : "observe", d->flow.level_bytes() / 1024, d->flow.max_bytes() / 1024,
+            fs.max_level_bytes.load() / 1024, fs.need_data.load(), fs.enough_data.load(), fs.admitted.load(),
+            fs.shed.load(), fs.wasted.load(), fs.push_errors.load());
+
+    if (d->pacer.running()) d->pacer.report();
+    d->jitter.report();
+    d->trace.report();
+
+    if (d->copy_report) {
+        const uint64_t frames = d->ctr.fpga_output_frames.value();
+        CopyAccount::instance().report(frames - d->copy_prev_frames, fpga_output_fps);
+        d->copy_prev_frames = frames;
+    }
+
+    d->metrics.write_json();
 
     return TRUE;
 }
 
+/* ---------- stdin control channel ---------- */
+
+// Commands (one per line):
+//   recalibrate     re-time every backend on the current geometry and choose again
+//   kernels         list the kernels in the loaded xclbin
+//   kernel <name>   switch the active kernel and choose the backend again (the new
+//                   kernel is timed unless cached)
+//   chain <mask> <gamma> <alpha> <beta>
+//                   stage registers for equalizeHist_chain_accel
+//   trace           write the --trace-events file now (ring mode: the last seconds)
+static gboolean control_cb(GIOChannel *ch, GIOCondition cond, gpointer user_data) {
+    auto *d = (CustomData*)user_data;
+    if (cond & (G_IO_HUP | G_IO_ERR)) return G_SOURCE_REMOVE;
+
+    gchar *line = NULL;
+    gsize len = 0;
+    GIOStatus st = g_io_channel_read_line(ch, &line, &len, NULL, NULL);
+    if (st == G_IO_STATUS_EOF) return G_SOURCE_REMOVE;
+    if (st != G_IO_STATUS_NORMAL || !line) { g_free(line); return G_SOURCE_CONTINUE; }
+
+    g_strstrip(line);
+    if (g_strcmp0(line, "recalibrate") == 0) {
+        const int width = d->selector.width(), height = d->selector.height();
+        d->selector.invalidate();
+        if (width > 0 && height > 0) choose_backend(d, width, height);
+    } else if (g_strcmp0(line, "trace") == 0) {
+        if (d->trace_events_path) TraceEvents::instance().write_chrome_json(d->trace_events_path);
+        else g_print("Event tracing is off (--trace-events=FILE)\n");
+    } else if (!d->fpga && line[0]) {
+        g_print("No FPGA backend in this run (--backend=%s)\n", d->backend ? d->backend->name() : "?");
+    } else if (g_strcmp0(line, "kernels") == 0) {
+        if (d->fpga->kernels().empty()) g_print("xclbin not loaded (device backend failed to initialise)\n");
+        d->fpga->print_kernels();
+    } else if (g_str_has_prefix(line, "kernel ")) {
+        const char *name = g_strstrip(line + 7);
+        if (d->fpga->request_kernel(name)) {
+            g_print("Kernel switch to '%s'\n", name);
+            const int width = d->selector.width(), height = d->selector.height();
+            d->selector.reselect();
+            if (width > 0 && height > 0) choose_backend(d, width, height);
+        }
+    } else if (g_str_has_prefix(line, "chain ")) {
+        ChainParams p = d->fpga->chain_params();
+        if (sscanf(line + 6, "%i %f %f %f", &p.stage_mask, &p.gamma, &p.alpha, &p.beta) >= 1) {
+            d->fpga->set_chain_params(p);
+            g_print("Chain: mask=0x%x gamma=%.2f alpha=%.2f beta=%.1f\n", p.stage_mask, p.gamma, p.alpha, p.beta);
+        }
+    } else if (line[0]) {
+        g_print("Unknown command '%s' (recalibrate | kernels | kernel <name> | chain <mask> <gamma> <alpha> <beta>)\n", line);
+    }
+    g_free(line);
+    return G_SOURCE_CONTINUE;
+}
+
 /* ---------- bus watch (quit main loop) ---------- */
 
 static gboolean bus_cb(GstBus *bus, GstMessage *msg, gpointer user_data) {
@@ -516,6 +677,9 @@ static gboolean bus_cb(GstBus *bus, GstMessage *msg, gpointer user_data) {
             GError *e=NULL; gchar *dbg=NULL;
             gst_message_parse_error(msg, &e, &dbg);
             g_printerr("ERROR from %s: %s\n", GST_OBJECT_NAME(msg->src), e->message);
+            gchar *why = g_strdup_printf("bus error from %s: %s", GST_OBJECT_NAME(msg->src), e->message);
+            d->flight.incident(why);
+            g_free(why);
             g_error_free(e); g_free(dbg);
             if (d->loop) g_main_loop_quit(d->loop);
             break;
@@ -529,6 +693,17 @@ static gboolean bus_cb(GstBus *bus, GstMessage *msg, gpointer user_data) {
     return TRUE;
 }
 
+// Ctrl+C / SIGTERM: leave the main loop so the shutdown path (trace file, reports) runs;
+// the flight recorder's header notes why the run ended
+static gboolean quit_on_signal(CustomData *d, const char *why) {
+    d->flight.mark(why);
+    if (d->loop) g_main_loop_quit(d->loop);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean sigint_cb(gpointer user_data) { return quit_on_signal((CustomData*)user_data, "signal SIGINT"); }
+static gboolean sigterm_cb(gpointer user_data) { return quit_on_signal((CustomData*)user_data, "signal SIGTERM"); }
+
 int main(int argc, char *argv[]) {
     setvbuf(stdout, NULL, _IONBF, 0);
     gst_init(&argc, &argv);
@@ -536,6 +711,27 @@ int main(int argc, char *argv[]) {
     gboolean use_h265 = FALSE;
     int bitrate_kbps = 20000; // Match basic.cpp default (20 Mbps)
     int v_width = 1920, v_height = 1080, fps = 60; // defaults
+    const char *backend_name = "ocl";
+    const char *fpga_name = "ocl";       // device backend used by --backend=auto
+    const char *xclbin_path = NULL;
+    const char *kernel_name = NULL;
+    const char *calib_cache = "backend_calib.txt";
+    int cpu_threads = 2, calib_frames = 20;
+    gboolean recalibrate = FALSE;
+    double deadline_frames = 2.0;
+    gboolean drop_late = TRUE;
+    int appsrc_queue = 2;
+    gboolean appsrc_gate = TRUE;
+    const char *metrics_json = NULL, *metrics_listen = NULL;
+    gboolean trace_latency = FALSE;
+    const char *trace_events = NULL;
+    double trace_ring_s = 0.0;
+    int trace_buffer = 1 << 16;
+    const char *flight_path = "flight.rec";
+    int flight_records = 1 << 16, flight_stall_ms = 2000;
+    gboolean pace = FALSE, pace_repeat = TRUE;
+    int pace_jitter = 2;
+    gboolean copy_report = FALSE;
 
     // --- argv parsing ---
     for (int i=1;i<argc;++i){
@@ -549,16 +745,110 @@ int main(int argc, char *argv[]) {
         else if (g_strcmp0(argv[i],"--height")==0 && i+1<argc){ int h=atoi(argv[i+1]); if(h>0) v_height=h; }
         else if (g_str_has_prefix(argv[i],"--fps=")) { const char* v=strchr(argv[i],'='); if(v){ int f=atoi(v+1); if(f>0) fps=f; } }
         else if (g_strcmp0(argv[i],"--fps")==0 && i+1<argc){ int f=atoi(argv[i+1]); if(f>0) fps=f; }
+        else if (g_str_has_prefix(argv[i],"--backend=")) { backend_name = strchr(argv[i],'=')+1; }
+        else if (g_strcmp0(argv[i],"--backend")==0 && i+1<argc){ backend_name = argv[++i]; }
+        else if (g_str_has_prefix(argv[i],"--xclbin=")) { xclbin_path = strchr(argv[i],'=')+1; }
+        else if (g_strcmp0(argv[i],"--xclbin")==0 && i+1<argc){ xclbin_path = argv[++i]; }
+        else if (g_str_has_prefix(argv[i],"--kernel=")) { kernel_name = strchr(argv[i],'=')+1; }
+        else if (g_strcmp0(argv[i],"--kernel")==0 && i+1<argc){ kernel_name = argv[++i]; }
+        else if (g_str_has_prefix(argv[i],"--fpga=")) { fpga_name = strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--cpu-threads=")) { int t=atoi(strchr(argv[i],'=')+1); if(t>0) cpu_threads=t; }
+        else if (g_str_has_prefix(argv[i],"--calib-cache=")) { calib_cache = strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--calib-frames=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) calib_frames=n; }
+        else if (g_strcmp0(argv[i],"--recalibrate")==0) { recalibrate = TRUE; }
+        else if (g_str_has_prefix(argv[i],"--deadline-frames=")) { double f=atof(strchr(argv[i],'=')+1); if(f>0) deadline_frames=f; }
+        else if (g_strcmp0(argv[i],"--no-drop")==0) { drop_late = FALSE; }
+        else if (g_str_has_prefix(argv[i],"--appsrc-queue=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) appsrc_queue=n; }
+        else if (g_str_has_prefix(argv[i],"--appsrc-flow=")) { appsrc_gate = g_ascii_strcasecmp(strchr(argv[i],'=')+1, "observe") != 0; }
+        else if (g_strcmp0(argv[i],"--pace")==0) { pace = TRUE; }
+        else if (g_str_has_prefix(argv[i],"--pace-jitter=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) pace_jitter=n; pace = TRUE; }
+        else if (g_strcmp0(argv[i],"--pace-no-repeat")==0) { pace_repeat = FALSE; }
+        else if (g_str_has_prefix(argv[i],"--metrics-json=")) { metrics_json=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--metrics-port=")) { metrics_listen=strchr(argv[i],'=')+1; }
+        else if (g_strcmp0(argv[i],"--trace-latency")==0) { trace_latency=TRUE; }
+        else if (g_str_has_prefix(argv[i],"--trace-events=")) { trace_events=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--trace-ring=")) { double v=atof(strchr(argv[i],'=')+1); if(v>0) trace_ring_s=v; }
+        else if (g_str_has_prefix(argv[i],"--trace-buffer=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) trace_buffer=n; }
+        else if (g_str_has_prefix(argv[i],"--flight=")) { flight_path=strchr(argv[i],'=')+1; }
+        else if (g_strcmp0(argv[i],"--no-flight")==0) { flight_path=NULL; }
+        else if (g_str_has_prefix(argv[i],"--flight-records=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) flight_records=n; }
+        else if (g_str_has_prefix(argv[i],"--flight-stall-ms=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>=0) flight_stall_ms=n; }
+        else if (g_strcmp0(argv[i],"--copy-report")==0) { copy_report=TRUE; }
     }
-    g_print("Encoder: %s, target-bitrate: %d kbps, FPGA main thread processing, %dx%d@%dfps\n",
-            use_h265 ? "H.265" : "H.264", bitrate_kbps, v_width, v_height, fps);
+    g_print("Encoder: %s, target-bitrate: %d kbps, FPGA main thread processing (%s backend), %dx%d@%dfps\n",
+            use_h265 ? "H.265" : "H.264", bitrate_kbps, backend_name, v_width, v_height, fps);
 
     CustomData d{};
-    d.work_q = g_async_queue_new();
-    d.frames_per_batch = 1; // Start with 1 frame per batch for FPGA
-    d.processing_active = FALSE;
-    d.max_queue_depth = 6; // Reasonable queue depth for 60fps
-    d.drop_frames = TRUE;  // Enable aggressive frame dropping
+    d.work_q.reset(new SpscRing<StampedFrame>(16, true));
+    d.processing_active.store(false);
+    d.drop_frames = drop_late;
+    // Deadline budget in frame periods; the period is replaced by the negotiated one
+    d.sched.set_deadline_frames(deadline_frames);
+    d.sched.set_frame_period_us(1000000 / fps);
+    d.sched.set_drop_late(drop_late);
+    d.flow.configure(appsrc_queue, appsrc_gate);
+    d.pacer.configure(fps, 1, pace_jitter, pace_repeat);
+    d.jitter.enable(d.ctr.reg);
+    d.jitter.set_period_us(1000000 / fps);
+    d.jt_camera  = d.jitter.add_point("camera");
+    d.jt_appsink = d.jitter.add_point("appsink");
+    if (pace) {
+        d.jt_pace_in  = d.jitter.add_point("pace_in");
+        d.jt_pace_out = d.jitter.add_point("pace_out");
+        d.pacer.set_jitter(&d.jitter, d.jt_pace_in, d.jt_pace_out);
+    }
+    d.jt_encoder = d.jitter.add_point("encoder");
+    d.jt_output  = d.jitter.add_point("output");
+    if (metrics_json && !d.metrics.open_json(metrics_json)) return -1;
+    if (metrics_listen && !d.metrics.serve(metrics_listen)) return -1;
+    if (trace_latency) d.trace.enable(d.ctr.reg);
+    if (trace_events) {
+        d.trace_events_path = trace_events;
+        TraceEvents::instance().enable((size_t)trace_buffer, trace_ring_s);
+        TraceEvents::instance().set_thread_name("main-loop");
+        if (trace_ring_s > 0) g_print("Event trace: ring of the last %.1f s -> %s\n", trace_ring_s, trace_events);
+        else g_print("Event trace: first %d events per thread -> %s\n", trace_buffer, trace_events);
+    }
+    if (copy_report) {
+        // Minimum: read the captured Y plane once, write the NV12 output once
+        const uint64_t y_size = (uint64_t)v_width * v_height;
+        d.copy_report = true;
+        CopyAccount::instance().set_min_bytes_per_frame(y_size + y_size * 3 / 2);
+        CopyAccount::instance().measure_bandwidth();
+    }
+    // Not fatal: the stream runs without a recorder
+    if (flight_path && d.flight.open(flight_path, (size_t)flight_records, "fpgaworker")) {
+        d.fr_capture = d.flight.add_stage("capture");
+        d.fr_process = d.flight.add_stage("process");
+        d.fr_encoder = d.flight.add_stage("encoder");
+        d.fr_network = d.flight.add_stage("network");
+        d.flight.install_signal_handlers();
+        g_print("Flight recorder: %d records -> %s (stall dump after %d ms, SIGUSR1 to dump)\n", flight_records,
+                flight_path, flight_stall_ms);
+    }
+
+    // Candidates for the cost model; a named backend is the only candidate
+    const gboolean auto_backend = g_ascii_strcasecmp(backend_name, "auto") == 0;
+    const char *names[3] = {NULL, NULL, NULL};
+    if (auto_backend) { names[0] = "cpu"; names[1] = fpga_name; names[2] = "passthrough"; }
+    else { names[0] = backend_name; }
+    for (const char *n : names) {
+        if (!n) continue;
+        std::unique_ptr<FrameBackend> be = make_frame_backend(n, xclbin_path, cpu_threads);
+        if (!be) {
+            if (!auto_backend) return -1;
+            continue;
+        }
+        if (g_strcmp0(n, "cpu") != 0 && g_strcmp0(n, "passthrough") != 0) d.fpga = be.get();
+        d.selector.add(std::move(be));
+    }
+    if (kernel_name && d.fpga) d.fpga->request_kernel(kernel_name);
+    d.selector.set_fps(fps);
+    d.selector.set_cache_path(calib_cache);
+    d.selector.set_calibration_frames(calib_frames);
+    d.selector.set_recalibrate(recalibrate);
+    // Calibrate (or load the cached timings) now rather than on the first frames
+    if (!choose_backend(&d, v_width, v_height)) return -1;
 
     // Capture pipeline with more aggressive buffering for FPGA
     GError *err=NULL;
@@ -580,27 +870,27 @@ int main(int argc, char *argv[]) {
     gchar *src_str=NULL;
     if (use_h265) {
         src_str = g_strdup_printf(
-            "appsrc name=my_src is-live=true format=GST_FORMAT_TIME do-timestamp=true ! "
+            "appsrc name=my_src is-live=true format=GST_FORMAT_TIME do-timestamp=%s ! "
             "video/x-raw,format=NV12,width=%d,height=%d,framerate=%d/1 ! "
             "queue name=q_after_src leaky=downstream max-size-buffers=2 max-size-time=0 max-size-bytes=0 ! "
             "omxh265enc name=enc num-slices=8 periodicity-idr=240 cpb-size=500 gdr-mode=horizontal "
             "initial-delay=250 control-rate=low-latency prefetch-buffer=true target-bitrate=%d "
             "gop-mode=low-delay-p ! video/x-h265,alignment=au ! "
             "rtph265pay name=pay ! "
-            "udpsink buffer-size=60000000 host=192.168.25.69 port=5004 async=false max-lateness=-1 qos-dscp=60",
-            v_width, v_height, fps, bitrate_kbps
+            "udpsink name=net buffer-size=60000000 host=192.168.25.69 port=5004 async=false max-lateness=-1 qos-dscp=60",
+            pace ? "false" : "true", v_width, v_height, fps, bitrate_kbps
         );
     } else {
         src_str = g_strdup_printf(
-            "appsrc name=my_src is-live=true format=GST_FORMAT_TIME do-timestamp=true ! "
+            "appsrc name=my_src is-live=true format=GST_FORMAT_TIME do-timestamp=%s ! "
             "video/x-raw,format=NV12,width=%d,height=%d,framerate=%d/1 ! "
             "queue name=q_after_src leaky=downstream max-size-buffers=2 max-size-time=0 max-size-bytes=0 ! "
             "omxh264enc name=enc num-slices=8 periodicity-idr=240 cpb-size=500 gdr-mode=horizontal "
             "initial-delay=250 control-rate=low-latency prefetch-buffer=true target-bitrate=%d "
             "gop-mode=low-delay-p ! video/x-h264,alignment=nal ! "
             "rtph264pay name=pay ! "
-            "udpsink buffer-size=60000000 host=192.168.25.69 port=5004 async=false max-lateness=-1 qos-dscp=60",
-            v_width, v_height, fps, bitrate_kbps
+            "udpsink name=net buffer-size=60000000 host=192.168.25.69 port=5004 async=false max-lateness=-1 qos-dscp=60",
+            pace ? "false" : "true", v_width, v_height, fps, bitrate_kbps
         );
     }
     GstElement *src_pipe = gst_parse_launch(src_str, &err);
@@ -618,6 +908,7 @@ int main(int argc, char *argv[]) {
         gst_object_unref(sink_pipe);
         return -1;
     }
+    d.flow.attach(d.appsrc);
 
     // Setup probes for frame rate monitoring
     {
@@ -645,6 +936,12 @@ int main(int argc, char *argv[]) {
                 gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, probe_encoder_sink, &d, NULL); 
                 gst_object_unref(p); 
             } 
+            if (trace_enabled()) {
+                if (GstPad *p = gst_element_get_static_pad(enc, "src")) {
+                    gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, probe_encoder_src, &d, NULL);
+                    gst_object_unref(p);
+                }
+            }
             gst_object_unref(enc); 
         }
     }
@@ -660,6 +957,15 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // Latency trace points (capture meta is carried across the bridge in process_single_frame_fpga)
+    if (d.trace.enabled()) {
+        d.trace.add_probe(sink_pipe, "v4l2src0", "src", TRACE_CAPTURE);
+        d.trace.add_probe(sink_pipe, "cv_sink", "sink", TRACE_APPSINK);
+        d.trace.add_probe(src_pipe, "enc", "sink", TRACE_ENCODER);
+        d.trace.add_probe(src_pipe, "pay", "sink", TRACE_PAYLOADER);
+        d.trace.add_probe(src_pipe, "net", "sink", TRACE_UDPSINK);
+    }
+
     // Callback (triggers main thread idle processing)
     g_signal_connect(d.appsink, "new-sample", G_CALLBACK(new_sample_cb), &d);
 
@@ -669,36 +975,57 @@ int main(int argc, char *argv[]) {
     GstBus *bus_src  = gst_element_get_bus(src_pipe);
     gst_bus_add_watch(bus_sink, bus_cb, &d);
     gst_bus_add_watch(bus_src,  bus_cb, &d);
+    g_unix_signal_add(SIGINT, sigint_cb, &d);
+    g_unix_signal_add(SIGTERM, sigterm_cb, &d);
     g_timeout_add_seconds(2, status_tick, &d);
 
+    // Runtime kernel selection from stdin (same xclbin, no reprogramming)
+    GIOChannel *ctl = g_io_channel_unix_new(0);
+    g_io_add_watch(ctl, (GIOCondition)(G_IO_IN | G_IO_HUP | G_IO_ERR), control_cb, &d);
+
     // Start & run
     gst_element_set_state(src_pipe,  GST_STATE_PLAYING);
     gst_element_set_state(sink_pipe, GST_STATE_PLAYING);
+    if (d.trace.enabled() && gst_element_get_state(sink_pipe, NULL, NULL, GST_SECOND) != GST_STATE_CHANGE_FAILURE) {
+        d.trace.set_capture_clock(sink_pipe);
+    }
+    if (pace) {
+        // Pacer slots are pipeline-clock times: wait for PLAYING so base time is set
+        gst_element_get_state(src_pipe, NULL, NULL, 2 * GST_SECOND);
+        if (!d.pacer.start(src_pipe, [&d](GstBuffer *b) { return d.flow.push(b); })) {
+            g_printerr("Pacing disabled, pushing frames directly\n");
+        } else {
+            g_print("Pacing output at %d fps with a %d frame cushion (%s on underrun)\n",
+                    fps, pace_jitter, pace_repeat ? "repeat last frame" : "skip slot");
+        }
+    }
     g_print("FPGA histogram equalization processing with frame rate monitoring. Press Ctrl+C to exit.\n");
     g_print("Make sure equalizeHist_accel.xclbin is in the current directory.\n");
+    d.flight.start_watchdog(flight_stall_ms);
     g_main_loop_run(d.loop);
 
-    // Shutdown
+    // Shutdown (stages stop advancing from here on: not a stall)
+    d.flight.stop_watchdog();
     d.stop.store(true, std::memory_order_release);
+    d.pacer.stop();
     
     // Remove idle source if still active
-    if (d.processing_active && d.idle_source_id > 0) {
+    if (d.processing_active.load() && d.idle_source_id > 0) {
         g_source_remove(d.idle_source_id);
-        d.processing_active = FALSE;
+        d.processing_active.store(false);
     }
     
-    // Drain worker queue
-    while (GstBuffer *b = (GstBuffer*)g_async_queue_try_pop(d.work_q)) {
-        gst_buffer_unref(b);
-    }
-
-    if (d.work_q) { 
-        g_async_queue_unref(d.work_q); 
-        d.work_q = nullptr; 
+    // Drain worker queue and scheduler
+    StampedFrame sf;
+    while (d.work_q->try_pop(sf)) {
+        gst_buffer_unref(sf.buf);
     }
+    d.sched.clear([](GstBuffer *b) { gst_buffer_unref(b); });
+    gst_caps_replace(&d.last_caps, NULL);
 
     gst_element_set_state(sink_pipe, GST_STATE_NULL);
     gst_element_set_state(src_pipe,  GST_STATE_NULL);
+    if (d.trace_events_path) TraceEvents::instance().write_chrome_json(d.trace_events_path);
     gst_object_unref(bus_sink);
     gst_object_unref(bus_src);
     gst_object_unref(d.appsink);
@@ -706,6 +1033,7 @@ int main(int argc, char *argv[]) {
     gst_object_unref(sink_pipe);
     gst_object_unref(src_pipe);
     g_main_loop_unref(d.loop);
+    g_io_channel_unref(ctl);
     
     g_print("FPGA main thread processing shutdown complete.\n");
     return 0;
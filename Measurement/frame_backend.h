@@ -0,0 +1,625 @@
+// frame_backend.h
+// Y-plane equalization backends shared by the FPGA bridges.
+//
+//   OclBackend - OpenCL C++ wrapper via xcl2.hpp (the path fpgaworker.cpp has always used)
+//   XrtBackend - native XRT: xrt::bo with explicit partial sync(), one xrt::run reused
+//                across frames, buffers placed with xrt::kernel::group_id()
+//
+//   CpuBackend, PassthroughBackend - host-only equivalents with the same interface, so
+//                the cost model in backend_select.h can rank all of them together
+//
+// All take a contiguous Y plane in and write a contiguous Y plane out, so a bridge can
+// switch with --backend=ocl|xrt|cpu|passthrough and compare per-frame overhead on the same stream.
+// Host <-> device transfers and the passthrough copy are accounted (copy_account.h) as
+// dma_to_device / dma_from_device / passthrough.
+//
+// Kernel catalog: the xclbin is loaded once and every kernel in it is enumerated and
+// instantiated up front; the catalog is immutable from then on. request_kernel() only
+// records the choice (before the load: the start-up kernel, under a mutex; after it: an
+// atomic pending index); the switch happens at the start of the next process_y() call,
+// i.e. on a frame boundary, with no context/program rebuild. Argument layouts are looked up by kernel name (see
+// kernel_layout_for) and fall back to the argument count for unknown kernels.
+//
+// Build (OpenCL only):
+//   ... -lxilinxopencl -lOpenCL -I<path_to_xcl2_header>
+// Build (with XRT backend):
+//   ... -DWITH_XRT -I$XILINX_XRT/include -L$XILINX_XRT/lib -lxrt_coreutil
+//
+// Software emulation:
+//   emconfigutil --platform <platform> && export XCL_EMULATION_MODE=sw_emu
+
+#ifndef _FRAME_BACKEND_H_
+#define _FRAME_BACKEND_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <CL/cl.h>
+#include <CL/opencl.h>
+#include "xcl2.hpp"
+#include "copy_account.h"
+
+#ifdef WITH_XRT
+#include <xrt/xrt_bo.h>
+#include <xrt/xrt_device.h>
+#include <xrt/xrt_kernel.h>
+#endif
+
+#include "hist_lut.h"
+#include "band_equalize.h"
+
+#define FRAME_BACKEND_KERNEL_NAME "equalizeHist_accel"
+#define FRAME_BACKEND_XCLBIN_NAME "krnl_hist_equalize"
+
+// Per-frame wall time of each phase, host side (microseconds)
+struct BackendTimings {
+    uint64_t write_us{0};
+    uint64_t kernel_us{0};
+    uint64_t read_us{0};
+    uint64_t total_us{0};
+};
+
+/* ---------- Kernel catalog ---------- */
+
+// How a kernel's arguments map onto a Y plane
+enum KernelLayout {
+    KL_IN_REF_OUT, // (in, in_ref, out, rows, cols)  - equalizeHist_accel and friends
+    KL_IN_OUT,     // (in, out, rows, cols)          - CLAHE, single-read variants
+    KL_HIST,       // (in, hist[256] u32, rows, cols) - histogram only, LUT applied on host
+    KL_CHAIN,      // (in, in_ref, out, rows, cols, stage_mask, gamma, alpha, beta)
+                   //                                - equalizeHist_chain_accel
+};
+
+// Register values for KL_CHAIN kernels (see xf_hist_equalize_chain_config.h)
+struct ChainParams {
+    int stage_mask{0x7};   // bit0 equalize, bit1 gamma, bit2 alpha/beta scale
+    float gamma{1.0f};
+    float alpha{1.0f};
+    float beta{0.0f};
+};
+
+struct KernelInfo {
+    std::string name;
+    KernelLayout layout;
+};
+
+static inline const char *kernel_layout_name(KernelLayout l) {
+    switch (l) {
+        case KL_IN_REF_OUT: return "in,ref,out";
+        case KL_IN_OUT:     return "in,out";
+        case KL_HIST:       return "hist";
+        case KL_CHAIN:      return "in,ref,out+chain";
+    }
+    return "?";
+}
+
+static inline KernelLayout kernel_layout_for(const std::string &name, int num_args) {
+    static const struct { const char *name; KernelLayout layout; } known[] = {
+        {"equalizeHist_accel",   KL_IN_REF_OUT},
+        {"equalizeHist_y_accel", KL_IN_REF_OUT},
+        {"clahe_accel",          KL_IN_OUT},
+        {"calcHist_accel",       KL_HIST},
+        {"hist_only_accel",      KL_HIST},
+        {"equalizeHist_chain_accel", KL_CHAIN},
+    };
+    for (const auto &k : known) {
+        if (name == k.name) return k.layout;
+    }
+    return num_args >= 5 ? KL_IN_REF_OUT : KL_IN_OUT;
+}
+
+class FrameBackend {
+public:
+    virtual ~FrameBackend() {}
+
+    virtual const char *name() const = 0;
+
+    // (Re)allocate device buffers for the given geometry. Cheap when already large enough.
+    virtual bool init(int width, int height) = 0;
+
+    // Equalize one contiguous width*height Y plane. y_in and y_out may be mapped GstBuffers.
+    virtual bool process_y(const uint8_t *y_in, uint8_t *y_out, int width, int height) = 0;
+
+    bool initialized() const { return initialized_; }
+    const BackendTimings &last_timings() const { return last_; }
+
+    // Kernels found in the loaded xclbin (empty until the first init())
+    const std::vector<KernelInfo> &kernels() const {
+        static const std::vector<KernelInfo> none;
+        return loaded_.load(std::memory_order_acquire) ? catalog_ : none;
+    }
+    const char *active_kernel_name() const {
+        if (loaded_.load(std::memory_order_acquire)) return catalog_[active_].name.c_str();
+        std::lock_guard<std::mutex> lock(catalog_mutex_);
+        return initial_kernel_.c_str();
+    }
+
+    // Select a kernel by name from any thread; takes effect at the next frame. Before the
+    // xclbin is loaded this only sets the start-up kernel.
+    bool request_kernel(const char *kname) {
+        {
+            std::lock_guard<std::mutex> lock(catalog_mutex_);
+            if (!loaded_.load(std::memory_order_relaxed)) {
+                // Not loaded yet: remember it for init()
+                initial_kernel_ = kname;
+                return true;
+            }
+        }
+        // The catalog no longer changes once loaded_ is set
+        for (size_t i = 0; i < catalog_.size(); ++i) {
+            if (catalog_[i].name == kname) {
+                pending_.store((int)i, std::memory_order_release);
+                return true;
+            }
+        }
+        g_printerr("[%s] Kernel '%s' not in xclbin\n", name(), kname);
+        return false;
+    }
+
+    // Chain stage registers from any thread; latched at the start of the next frame like
+    // a kernel switch
+    void set_chain_params(const ChainParams &p) {
+        std::lock_guard<std::mutex> lock(chain_mutex_);
+        chain_next_ = p;
+        chain_pending_.store(true, std::memory_order_release);
+    }
+    ChainParams chain_params() const {
+        std::lock_guard<std::mutex> lock(chain_mutex_);
+        return chain_next_;
+    }
+
+    // Frame boundary: adopt a pending kernel switch and chain registers, if any. Called by
+    // process_y(); the backend selector calls it before timing a candidate (same thread).
+    void apply_pending_kernel() {
+        int p = pending_.exchange(-1, std::memory_order_acq_rel);
+        if (p >= 0 && p != active_) {
+            g_print("[%s] Switching kernel %s -> %s\n", name(),
+                    catalog_[active_].name.c_str(), catalog_[p].name.c_str());
+            active_ = p;
+        }
+        if (chain_pending_.exchange(false, std::memory_order_acq_rel)) {
+            std::lock_guard<std::mutex> lock(chain_mutex_);
+            chain_ = chain_next_;
+        }
+    }
+
+    void print_kernels() const {
+        const std::vector<KernelInfo> &catalog = kernels();
+        for (size_t i = 0; i < catalog.size(); ++i) {
+            g_print("  %c %-24s (%s)\n", (int)i == active_ ? '*' : ' ',
+                    catalog[i].name.c_str(), kernel_layout_name(catalog[i].layout));
+        }
+    }
+
+protected:
+    static uint64_t us_since(std::chrono::steady_clock::time_point t0) {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+    }
+
+    // Align to 256-bit boundaries for FPGA efficiency
+    static size_t aligned_y_size(int width, int height) {
+        size_t y_size = (size_t)width * (size_t)height;
+        return ((y_size + 31) / 32) * 32;
+    }
+
+    // Pick the start-up kernel once the catalog is filled in, and publish the catalog
+    void select_initial_kernel() {
+        {
+            std::lock_guard<std::mutex> lock(catalog_mutex_);
+            active_ = 0;
+            for (size_t i = 0; i < catalog_.size(); ++i) {
+                if (catalog_[i].name == initial_kernel_) active_ = (int)i;
+            }
+            loaded_.store(true, std::memory_order_release);
+        }
+        g_print("[%s] xclbin kernels:\n", name());
+        print_kernels();
+    }
+
+    // KL_HIST kernels: finish the equalization on the host
+    void apply_hist_on_host(const uint8_t *y_in, uint8_t *y_out, int width, int height) {
+        uint8_t lut[HIST_BINS];
+        lut_from_hist(hist_host_, (uint64_t)width * (uint64_t)height, lut);
+        lut_apply(y_in, width, y_out, width, width, height, lut);
+    }
+
+    bool initialized_{false};
+    int max_width_{0};
+    int max_height_{0};
+    BackendTimings last_{};
+
+    // Written by init() only, read-only once loaded_ is set
+    std::vector<KernelInfo> catalog_;
+    std::atomic<bool> loaded_{false};
+    mutable std::mutex catalog_mutex_;    // initial_kernel_ and the loaded_ transition
+    std::string initial_kernel_{FRAME_BACKEND_KERNEL_NAME};
+    std::atomic<int> active_{0};          // processing thread writes, status readers
+    std::atomic<int> pending_{-1};
+    uint32_t hist_host_[HIST_BINS]{};
+    ChainParams chain_{};                 // processing thread only, latched per frame
+    mutable std::mutex chain_mutex_;
+    ChainParams chain_next_{};            // last set_chain_params()
+    std::atomic<bool> chain_pending_{false};
+};
+
+/* ---------- OpenCL (xcl2) backend ---------- */
+
+class OclBackend : public FrameBackend {
+public:
+    const char *name() const override { return "ocl"; }
+
+    bool init(int width, int height) override {
+        if (initialized_ && max_width_ >= width && max_height_ >= height) {
+            return true;
+        }
+        try {
+            if (!program_loaded_) {
+                std::vector<cl::Device> devices = xcl::get_xil_devices();
+                if (devices.empty()) {
+                    g_printerr("[ocl] No Xilinx devices found\n");
+                    return false;
+                }
+                device_ = devices[0];
+                std::string device_name = device_.getInfo<CL_DEVICE_NAME>();
+                g_print("[ocl] Using device: %s\n", device_name.c_str());
+
+                context_ = cl::Context(device_);
+                queue_ = cl::CommandQueue(context_, device_, CL_QUEUE_PROFILING_ENABLE);
+
+                std::string binaryFile = xcl::find_binary_file(device_name, FRAME_BACKEND_XCLBIN_NAME);
+                cl::Program::Binaries bins = xcl::import_binary_file(binaryFile);
+                std::vector<cl::Device> devices_for_program = {device_};
+                program_ = cl::Program(context_, devices_for_program, bins);
+
+                // One cl::Kernel per entry, created once and kept for the process lifetime
+                std::stringstream names(program_.getInfo<CL_PROGRAM_KERNEL_NAMES>());
+                std::string kname;
+                while (std::getline(names, kname, ';')) {
+                    if (kname.empty()) continue;
+                    cl::Kernel k(program_, kname.c_str());
+                    int nargs = (int)k.getInfo<CL_KERNEL_NUM_ARGS>();
+                    catalog_.push_back({kname, kernel_layout_for(kname, nargs)});
+                    kernels_.push_back(k);
+                }
+                if (catalog_.empty()) {
+                    g_printerr("[ocl] xclbin contains no kernels\n");
+                    return false;
+                }
+                select_initial_kernel();
+                program_loaded_ = true;
+            }
+
+            max_width_ = std::max(width, 1920);
+            max_height_ = std::max(height, 1080);
+            size_t aligned_size = aligned_y_size(max_width_, max_height_);
+
+            img_y_in_ = cl::Buffer(context_, CL_MEM_READ_ONLY, aligned_size);
+            img_y_in_ref_ = cl::Buffer(context_, CL_MEM_READ_ONLY, aligned_size);
+            img_y_out_ = cl::Buffer(context_, CL_MEM_WRITE_ONLY, aligned_size);
+            hist_out_ = cl::Buffer(context_, CL_MEM_WRITE_ONLY, sizeof(hist_host_));
+
+            initialized_ = true;
+            g_print("[ocl] Buffers allocated for max size %dx%d\n", max_width_, max_height_);
+            return true;
+        } catch (const std::exception &e) {
+            g_printerr("[ocl] init failed: %s\n", e.what());
+            return false;
+        }
+    }
+
+    bool process_y(const uint8_t *y_in, uint8_t *y_out, int width, int height) override {
+        if (!init(width, height)) return false;
+        apply_pending_kernel();
+        size_t y_size = (size_t)width * (size_t)height;
+        const KernelLayout layout = catalog_[active_].layout;
+        cl::Kernel &kernel = kernels_[active_];
+        try {
+            auto t0 = std::chrono::steady_clock::now();
+
+            queue_.enqueueWriteBuffer(img_y_in_, CL_FALSE, 0, y_size, y_in);
+            copy_note(COPY_SITE("dma_to_device"), y_size, y_size);
+            if (layout == KL_IN_REF_OUT || layout == KL_CHAIN) {
+                // Same frame is both input and histogram reference
+                queue_.enqueueWriteBuffer(img_y_in_ref_, CL_FALSE, 0, y_size, y_in);
+                copy_note(COPY_SITE("dma_to_device"), y_size, y_size);
+            }
+            queue_.finish();
+            last_.write_us = us_since(t0);
+
+            auto t1 = std::chrono::steady_clock::now();
+            int arg = 0;
+            kernel.setArg(arg++, img_y_in_);
+            if (layout == KL_IN_REF_OUT || layout == KL_CHAIN) kernel.setArg(arg++, img_y_in_ref_);
+            kernel.setArg(arg++, layout == KL_HIST ? hist_out_ : img_y_out_);
+            kernel.setArg(arg++, height);
+            kernel.setArg(arg++, width);
+            if (layout == KL_CHAIN) {
+                kernel.setArg(arg++, chain_.stage_mask);
+                kernel.setArg(arg++, chain_.gamma);
+                kernel.setArg(arg++, chain_.alpha);
+                kernel.setArg(arg++, chain_.beta);
+            }
+            cl::Event kernel_event;
+            queue_.enqueueTask(kernel, nullptr, &kernel_event);
+            kernel_event.wait();
+            last_.kernel_us = us_since(t1);
+
+            auto t2 = std::chrono::steady_clock::now();
+            if (layout == KL_HIST) {
+                queue_.enqueueReadBuffer(hist_out_, CL_TRUE, 0, sizeof(hist_host_), hist_host_);
+                apply_hist_on_host(y_in, y_out, width, height);
+            } else {
+                queue_.enqueueReadBuffer(img_y_out_, CL_TRUE, 0, y_size, y_out);
+                copy_note(COPY_SITE("dma_from_device"), y_size, y_size);
+            }
+            last_.read_us = us_since(t2);
+
+            last_.total_us = us_since(t0);
+            return true;
+        } catch (const std::exception &e) {
+            g_printerr("[ocl] process failed: %s\n", e.what());
+            return false;
+        }
+    }
+
+private:
+    bool program_loaded_{false};
+    cl::Device device_;
+    cl::Context context_;
+    cl::CommandQueue queue_;
+    cl::Program program_;
+    std::vector<cl::Kernel> kernels_;   // parallel to catalog_
+
+    cl::Buffer img_y_in_;
+    cl::Buffer img_y_in_ref_;
+    cl::Buffer img_y_out_;
+    cl::Buffer hist_out_;
+};
+
+/* ---------- Native XRT backend ---------- */
+
+#ifdef WITH_XRT
+class XrtBackend : public FrameBackend {
+public:
+    explicit XrtBackend(const std::string &xclbin_path, unsigned device_index = 0)
+        : xclbin_path_(xclbin_path), device_index_(device_index) {}
+
+    const char *name() const override { return "xrt"; }
+
+    bool init(int width, int height) override {
+        if (initialized_ && max_width_ >= width && max_height_ >= height) {
+            return true;
+        }
+        try {
+            if (!program_loaded_) {
+                xrt::xclbin xclbin(xclbin_path_);
+                device_ = xrt::device(device_index_);
+                uuid_ = device_.load_xclbin(xclbin);
+                for (const auto &k : xclbin.get_kernels()) {
+                    std::string kname = k.get_name();
+                    catalog_.push_back({kname, kernel_layout_for(kname, (int)k.get_num_args())});
+                    slots_.emplace_back();
+                    slots_.back().kernel = xrt::kernel(device_, uuid_, kname);
+                }
+                if (catalog_.empty()) {
+                    g_printerr("[xrt] %s contains no kernels\n", xclbin_path_.c_str());
+                    return false;
+                }
+                g_print("[xrt] Loaded %s on device %u\n", xclbin_path_.c_str(), device_index_);
+                select_initial_kernel();
+                program_loaded_ = true;
+            }
+
+            max_width_ = std::max(width, 1920);
+            max_height_ = std::max(height, 1080);
+            size_t aligned_size = aligned_y_size(max_width_, max_height_);
+
+            // Every kernel keeps its own BOs and run object so a switch is just an index change
+            for (size_t i = 0; i < slots_.size(); ++i) {
+                alloc_slot(slots_[i], catalog_[i], aligned_size);
+            }
+
+            initialized_ = true;
+            g_print("[xrt] BOs allocated for max size %dx%d\n", max_width_, max_height_);
+            return true;
+        } catch (const std::exception &e) {
+            g_printerr("[xrt] init failed: %s\n", e.what());
+            return false;
+        }
+    }
+
+    bool process_y(const uint8_t *y_in, uint8_t *y_out, int width, int height) override {
+        if (!init(width, height)) return false;
+        apply_pending_kernel();
+        size_t y_size = (size_t)width * (size_t)height;
+        const KernelLayout layout = catalog_[active_].layout;
+        Slot &s = slots_[active_];
+        try {
+            auto t0 = std::chrono::steady_clock::now();
+
+            // Sync only the bytes of this frame, not the whole max-size allocation
+            s.bo_in.write(y_in, y_size, 0);
+            s.bo_in.sync(XCL_BO_SYNC_BO_TO_DEVICE, y_size, 0);
+            copy_note(COPY_SITE("dma_to_device"), y_size, y_size);
+            if ((layout == KL_IN_REF_OUT || layout == KL_CHAIN) && !s.shared_ref) {
+                s.bo_ref.write(y_in, y_size, 0);
+                s.bo_ref.sync(XCL_BO_SYNC_BO_TO_DEVICE, y_size, 0);
+                copy_note(COPY_SITE("dma_to_device"), y_size, y_size);
+            }
+            last_.write_us = us_since(t0);
+
+            auto t1 = std::chrono::steady_clock::now();
+            if (width != s.width || height != s.height) {
+                int arg = (layout == KL_IN_REF_OUT || layout == KL_CHAIN) ? 3 : 2;
+                s.run.set_arg(arg, height);
+                s.run.set_arg(arg + 1, width);
+                s.width = width;
+                s.height = height;
+            }
+            if (layout == KL_CHAIN) {
+                s.run.set_arg(5, chain_.stage_mask);
+                s.run.set_arg(6, chain_.gamma);
+                s.run.set_arg(7, chain_.alpha);
+                s.run.set_arg(8, chain_.beta);
+            }
+            s.run.start();
+            s.run.wait();
+            last_.kernel_us = us_since(t1);
+
+            auto t2 = std::chrono::steady_clock::now();
+            if (layout == KL_HIST) {
+                s.bo_out.sync(XCL_BO_SYNC_BO_FROM_DEVICE, sizeof(hist_host_), 0);
+                s.bo_out.read(hist_host_, sizeof(hist_host_), 0);
+                apply_hist_on_host(y_in, y_out, width, height);
+            } else {
+                s.bo_out.sync(XCL_BO_SYNC_BO_FROM_DEVICE, y_size, 0);
+                s.bo_out.read(y_out, y_size, 0);
+                copy_note(COPY_SITE("dma_from_device"), y_size, y_size);
+            }
+            last_.read_us = us_since(t2);
+
+            last_.total_us = us_since(t0);
+            return true;
+        } catch (const std::exception &e) {
+            g_printerr("[xrt] process failed: %s\n", e.what());
+            return false;
+        }
+    }
+
+private:
+    struct Slot {
+        xrt::kernel kernel;
+        xrt::run run;
+        xrt::bo bo_in;
+        xrt::bo bo_ref;
+        xrt::bo bo_out;
+        bool shared_ref{false};
+        int width{0};
+        int height{0};
+    };
+
+    // Place every buffer in the memory bank its kernel port is connected to.
+    // When img_inp and img_inp1 share a bank one BO serves both ports, which
+    // saves a second host->device transfer of the same frame.
+    void alloc_slot(Slot &s, const KernelInfo &info, size_t aligned_size) {
+        int arg = 0;
+        int grp_in = s.kernel.group_id(arg++);
+        s.bo_in = xrt::bo(device_, aligned_size, grp_in);
+        s.run = xrt::run(s.kernel);
+        s.run.set_arg(0, s.bo_in);
+        if (info.layout == KL_IN_REF_OUT || info.layout == KL_CHAIN) {
+            int grp_ref = s.kernel.group_id(arg);
+            s.shared_ref = (grp_in == grp_ref);
+            s.bo_ref = s.shared_ref ? s.bo_in : xrt::bo(device_, aligned_size, grp_ref);
+            s.run.set_arg(arg++, s.bo_ref);
+        }
+        size_t out_size = info.layout == KL_HIST ? sizeof(hist_host_) : aligned_size;
+        s.bo_out = xrt::bo(device_, out_size, s.kernel.group_id(arg));
+        s.run.set_arg(arg, s.bo_out);
+        s.width = s.height = 0;
+    }
+
+    std::string xclbin_path_;
+    unsigned device_index_{0};
+    bool program_loaded_{false};
+
+    xrt::device device_;
+    xrt::uuid uuid_;
+    std::vector<Slot> slots_;   // parallel to catalog_
+};
+#endif // WITH_XRT
+
+/* ---------- Host backends ---------- */
+
+// Same LUT rules as cv::equalizeHist (hist_lut.h), split into row bands across a
+// persistent pool (band_equalize.h). No device transfers, so at small geometries it can
+// beat the FPGA.
+class CpuBackend : public FrameBackend {
+public:
+    explicit CpuBackend(int threads = 1) : eq_(threads) {
+        // Thread count is part of the calibration key
+        initial_kernel_ = "host-" + std::to_string(eq_.threads()) + "t";
+    }
+
+    const char *name() const override { return "cpu"; }
+
+    bool init(int width, int height) override {
+        max_width_ = std::max(max_width_, width);
+        max_height_ = std::max(max_height_, height);
+        initialized_ = true;
+        return true;
+    }
+
+    bool process_y(const uint8_t *y_in, uint8_t *y_out, int width, int height) override {
+        auto t0 = std::chrono::steady_clock::now();
+        eq_.equalize(y_in, width, y_out, width, width, height);
+        last_.write_us = last_.read_us = 0;
+        last_.kernel_us = last_.total_us = us_since(t0);
+        return true;
+    }
+
+private:
+    BandEqualizer eq_;
+};
+
+// Copies Y unchanged; the "do nothing" fallback when no processing backend keeps up
+class PassthroughBackend : public FrameBackend {
+public:
+    PassthroughBackend() { initial_kernel_ = "copy"; }
+
+    const char *name() const override { return "passthrough"; }
+
+    bool init(int width, int height) override {
+        initialized_ = true;
+        return true;
+    }
+
+    bool process_y(const uint8_t *y_in, uint8_t *y_out, int width, int height) override {
+        auto t0 = std::chrono::steady_clock::now();
+        memcpy_acct(COPY_SITE("passthrough"), y_out, y_in, (size_t)width * (size_t)height);
+        last_.write_us = last_.read_us = 0;
+        last_.kernel_us = last_.total_us = us_since(t0);
+        return true;
+    }
+};
+
+/* ---------- Factory ---------- */
+
+// name: "ocl" (default), "xrt", "cpu" or "passthrough". xclbin is only used by the XRT
+// backend, cpu_threads only by the CPU one.
+static inline std::unique_ptr<FrameBackend> make_frame_backend(const char *name, const char *xclbin,
+                                                               int cpu_threads = 1) {
+    if (name && g_ascii_strcasecmp(name, "cpu") == 0) {
+        return std::unique_ptr<FrameBackend>(new CpuBackend(cpu_threads));
+    }
+    if (name && g_ascii_strcasecmp(name, "passthrough") == 0) {
+        return std::unique_ptr<FrameBackend>(new PassthroughBackend());
+    }
+    if (name && g_ascii_strcasecmp(name, "xrt") == 0) {
+#ifdef WITH_XRT
+        return std::unique_ptr<FrameBackend>(
+            new XrtBackend(xclbin ? xclbin : FRAME_BACKEND_XCLBIN_NAME ".xclbin"));
+#else
+        g_printerr("XRT backend requested but this binary was built without -DWITH_XRT\n");
+        return nullptr;
+#endif
+    }
+    if (name && g_ascii_strcasecmp(name, "ocl") != 0) {
+        g_printerr("Unknown backend '%s' (expected ocl, xrt, cpu or passthrough)\n", name);
+        return nullptr;
+    }
+    return std::unique_ptr<FrameBackend>(new OclBackend());
+}
+
+#endif
+// _FRAME_BACKEND_H_
@@ -0,0 +1,151 @@
+// frame_jitter.h
+// Inter-frame jitter at each probe point. Frame counts per second can't tell a steady
+// 60 fps from a 5 ms / 28 ms alternation; the interval between consecutive frames can.
+//
+//   FrameJitter jitter;
+//   jitter.enable(d.ctr.reg);               // histograms live in the metrics registry
+//   int cam = jitter.add_point("camera");   // in pipeline order, before streaming
+//   int enc = jitter.add_point("encoder");
+//   jitter.set_period_us(16667);            // nominal frame time, from the caps
+//   jitter.on_buffer(cam, buf);             // from that point's probe
+//   jitter.report();                        // after reg.tick()
+//
+// Per point, each new frame records two deviations from the nominal period:
+//   arrival  |monotonic time between frames - period|   (what a consumer sees)
+//   pts      |PTS difference - period|                  (what the timestamps say)
+// plus the intervals longer than 1.5 periods (a frame missing or late). A frame is
+// counted once per point: buffers with the PTS of the previous one (RTP packets of the
+// same frame) are skipped.
+//
+// The report adds the stage that introduces the jitter: the point whose arrival p99
+// grows the most over the point before it. Arrival jitter with even PTS means
+// the stage delivers unevenly; uneven PTS means the timestamps (or drops) already are.
+//
+// Histograms: jitter_<point>_arrival_us, jitter_<point>_pts_us; counter
+// jitter_<point>_gaps_total.
+
+#ifndef _FRAME_JITTER_H_
+#define _FRAME_JITTER_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+
+class FrameJitter {
+public:
+    FrameJitter() = default;
+    FrameJitter(const FrameJitter &) = delete;
+    FrameJitter &operator=(const FrameJitter &) = delete;
+
+    // Off until enabled; points added before enable() are registered then
+    void enable(MetricsRegistry &reg) {
+        reg_ = &reg;
+        for (auto &p : points_) register_point(*p);
+    }
+
+    int add_point(const char *name) {
+        points_.emplace_back(new Point());
+        points_.back()->name = name;
+        if (reg_) register_point(*points_.back());
+        return (int)points_.size() - 1;
+    }
+
+    // Nominal frame time; 0 pauses recording (caps not known yet)
+    void set_period_us(int64_t us) { period_us_.store(us, std::memory_order_relaxed); }
+    int64_t period_us() const { return period_us_.load(std::memory_order_relaxed); }
+
+    // One point's streaming thread only
+    void on_buffer(int point, GstBuffer *buf) {
+        if (!reg_ || point < 0 || point >= (int)points_.size() || !buf) return;
+        Point &p = *points_[point];
+        const GstClockTime pts = GST_BUFFER_PTS(buf);
+        if (GST_CLOCK_TIME_IS_VALID(pts) && pts == p.last_pts) return;   // same frame
+        const int64_t now = g_get_monotonic_time();
+        const int64_t period = period_us();
+        if (period > 0 && p.last_us) {
+            const int64_t interval = now - p.last_us;
+            p.arrival->record(interval > period ? interval - period : period - interval);
+            if (GST_CLOCK_TIME_IS_VALID(pts) && GST_CLOCK_TIME_IS_VALID(p.last_pts) && pts > p.last_pts) {
+                const int64_t dpts = (int64_t)((pts - p.last_pts) / 1000);
+                p.pts->record(dpts > period ? dpts - period : period - dpts);
+            }
+            if (interval * 2 > period * 3) p.gaps->add();
+        }
+        p.last_us = now;
+        p.last_pts = pts;
+    }
+
+    // Interval table and the stage adding the most p99 jitter
+    void report() {
+        if (!reg_ || points_.empty()) return;
+        g_print("Frame jitter (interval, |dt - %.2f ms|, ms)   arrival: p50    p99    max |  pts: p50    p99 | >1.5T\n",
+                period_us() / 1000.0);
+        int culprit = -1;
+        int64_t worst_added = 0;
+        uint64_t prev_p99 = 0;
+        for (size_t i = 0; i < points_.size(); ++i) {
+            Point &p = *points_[i];
+            const MetricHistogram::Summary &a = p.arrival->interval();
+            const MetricHistogram::Summary &t = p.pts->interval();
+            const uint64_t gaps = p.gaps->value();
+            g_print("  %-10s n=%-6" G_GUINT64_FORMAT "                 %6.2f %6.2f %6.2f |     %6.2f %6.2f | %5" G_GUINT64_FORMAT
+                    "\n", p.name.c_str(), a.count, a.p50_us / 1000.0, a.p99_us / 1000.0, a.max_us / 1000.0,
+                    t.p50_us / 1000.0, t.p99_us / 1000.0, gaps - p.prev_gaps);
+            p.prev_gaps = gaps;
+            if (a.count == 0) continue;
+            const int64_t added = (int64_t)a.p99_us - (int64_t)prev_p99;
+            if (added > worst_added) {
+                worst_added = added;
+                culprit = (int)i;
+            }
+            prev_p99 = a.p99_us;
+        }
+        // Below a tenth of a frame (and a millisecond) it is noise, not a culprit
+        const int64_t floor_us = std::max<int64_t>(period_us() / 10, 1000);
+        if (culprit < 0 || worst_added < floor_us) return;
+        const Point &c = *points_[culprit];
+        const bool pts_even = c.pts->interval().p99_us * 2 < c.arrival->interval().p99_us;
+        if (culprit == 0) {
+            g_print("  jitter introduced at %s (source): p99 %.2f ms%s\n", c.name.c_str(), worst_added / 1000.0,
+                    pts_even ? ", timestamps even" : "");
+        } else {
+            g_print("  jitter introduced between %s and %s: +%.2f ms p99 (%s)\n", points_[culprit - 1]->name.c_str(),
+                    c.name.c_str(), worst_added / 1000.0,
+                    pts_even ? "uneven delivery, even PTS" : "PTS uneven too: drops or retimestamping");
+        }
+    }
+
+private:
+    struct Point {
+        std::string name;
+        MetricHistogram *arrival{nullptr};
+        MetricHistogram *pts{nullptr};
+        MetricCounter *gaps{nullptr};
+        // streaming thread of the point
+        int64_t last_us{0};
+        GstClockTime last_pts{GST_CLOCK_TIME_NONE};
+        // report() only
+        uint64_t prev_gaps{0};
+    };
+
+    void register_point(Point &p) {
+        const std::string base = "jitter_" + p.name;
+        p.arrival = &reg_->histogram((base + "_arrival_us").c_str(), "Inter-frame arrival deviation from the period");
+        p.pts = &reg_->histogram((base + "_pts_us").c_str(), "Inter-frame PTS deviation from the period");
+        p.gaps = &reg_->counter((base + "_gaps_total").c_str(), "Inter-frame intervals over 1.5 periods");
+    }
+
+    MetricsRegistry *reg_{nullptr};
+    std::vector<std::unique_ptr<Point>> points_;
+    std::atomic<int64_t> period_us_{0};
+};
+
+#endif
+// _FRAME_JITTER_H_
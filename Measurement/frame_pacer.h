@@ -0,0 +1,208 @@
+// frame_pacer.h
+// Emits processed frames at exact 1/fps intervals on the pipeline clock, with fresh
+// monotonic PTS, so processing jitter never reaches the encoder's rate control.
+//
+// Frames go into a small jitter buffer (submit(), single producer). A pacer thread
+// wakes on the pipeline clock once per slot (base_time + t0 + n * duration) and pushes
+// the oldest buffered frame, stamped PTS = t0 + n * duration, DTS = NONE,
+// DURATION = 1/fps. appsrc must run with do-timestamp=false.
+//   - the first frame is only emitted once jitter_frames are buffered (the cushion)
+//   - underrun: the last frame is repeated (shallow copy, same memory) if enabled,
+//     otherwise the slot stays empty; the cushion is rebuilt before emitting again
+//   - overrun: the oldest buffered frame is dropped
+//   - woke up more than a slot late: missed slots are skipped, PTS stays monotonic
+// Input (submit) and output (push) can be two points of a FrameJitter (set_jitter()), so
+// their |interval - period| histograms sit in the metrics registry with the other points.
+//
+// Generalizes the one-off pusher thread of donehun/bkkcode/stillalmost1.cpp.
+
+#ifndef _FRAME_PACER_H_
+#define _FRAME_PACER_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "frame_jitter.h"
+#include "frame_ring.h"
+
+/* ---------- Pacer ---------- */
+
+struct FramePacerStats {
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> emitted{0};        // fresh frames pushed
+    std::atomic<uint64_t> repeated{0};       // underrun slots filled with the last frame
+    std::atomic<uint64_t> empty_slots{0};    // underrun slots left empty (or while priming)
+    std::atomic<uint64_t> skipped_slots{0};  // pacer woke up too late for them
+    std::atomic<uint64_t> overrun_drops{0};  // jitter buffer full, oldest frame dropped
+    std::atomic<uint64_t> push_errors{0};
+};
+
+class FramePacer {
+public:
+    // Takes ownership of the buffer, like gst_app_src_push_buffer
+    using PushFn = std::function<GstFlowReturn(GstBuffer *)>;
+
+    FramePacer() = default;
+    FramePacer(const FramePacer &) = delete;
+    FramePacer &operator=(const FramePacer &) = delete;
+    ~FramePacer() { stop(); }
+
+    void configure(int fps_n, int fps_d, int jitter_frames, bool repeat_on_underrun) {
+        if (fps_n > 0 && fps_d > 0) duration_ = gst_util_uint64_scale_int(GST_SECOND, fps_d, fps_n);
+        jitter_frames_ = jitter_frames > 0 ? jitter_frames : 1;
+        repeat_ = repeat_on_underrun;
+    }
+
+    // Points already added to jitter (in pipeline order); before start()
+    void set_jitter(FrameJitter *jitter, int input_point, int output_point) {
+        jitter_ = jitter;
+        jt_in_ = input_point;
+        jt_out_ = output_point;
+    }
+
+    GstClockTime frame_duration() const { return duration_; }
+    int jitter_frames() const { return jitter_frames_; }
+    bool running() const { return thread_.joinable(); }
+    const FramePacerStats &stats() const { return stats_; }
+    size_t buffered() const { return ring_ ? ring_->size() : 0; }
+
+    // pipeline must be PLAYING (clock and base time latched here)
+    bool start(GstElement *pipeline, PushFn push) {
+        if (running()) return true;
+        clock_ = gst_element_get_clock(pipeline);
+        base_time_ = gst_element_get_base_time(pipeline);
+        if (!clock_ || !GST_CLOCK_TIME_IS_VALID(base_time_)) {
+            g_printerr("Frame pacer: pipeline has no clock/base time yet\n");
+            if (clock_) gst_object_unref(clock_);
+            clock_ = nullptr;
+            return false;
+        }
+        push_ = std::move(push);
+        // Room for the cushion plus a couple of frames of arrival burst
+        ring_.reset(new SpscRing<GstBuffer *>((size_t)jitter_frames_ + 2, true));
+        stop_.store(false, std::memory_order_release);
+        thread_ = std::thread(&FramePacer::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (!running()) return;
+        stop_.store(true, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(id_mutex_);
+            if (wait_id_) gst_clock_id_unschedule(wait_id_);
+        }
+        thread_.join();
+        GstBuffer *b;
+        while (ring_->try_pop(b)) gst_buffer_unref(b);
+        if (last_) { gst_buffer_unref(last_); last_ = nullptr; }
+        if (clock_) { gst_object_unref(clock_); clock_ = nullptr; }
+    }
+
+    // Producer side; takes ownership of buf
+    void submit(GstBuffer *buf) {
+        if (!running()) { gst_buffer_unref(buf); return; }
+        if (jitter_) jitter_->on_buffer(jt_in_, buf);
+        stats_.submitted.fetch_add(1, std::memory_order_relaxed);
+        ring_->push_overwrite(buf, [this](GstBuffer *old) {
+            gst_buffer_unref(old);
+            stats_.overrun_drops.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    void report() const {
+        g_print("Pacer (%.2f fps, cushion %d): emitted %" G_GUINT64_FORMAT " | repeated %" G_GUINT64_FORMAT
+                " | empty %" G_GUINT64_FORMAT " | skipped %" G_GUINT64_FORMAT " | overrun drops %" G_GUINT64_FORMAT
+                " | buffered %zu\n",
+                duration_ ? (double)GST_SECOND / (double)duration_ : 0.0, jitter_frames_,
+                stats_.emitted.load(), stats_.repeated.load(), stats_.empty_slots.load(),
+                stats_.skipped_slots.load(), stats_.overrun_drops.load(), buffered());
+    }
+
+private:
+    void run() {
+        const GstClockTime t0 = gst_clock_get_time(clock_) - base_time_;
+        uint64_t slot = 0;
+        bool primed = false;
+
+        while (!stop_.load(std::memory_order_acquire)) {
+            const GstClockTime slot_rt = t0 + slot * duration_;
+            GstClockID id = gst_clock_new_single_shot_id(clock_, base_time_ + slot_rt);
+            {
+                std::lock_guard<std::mutex> lock(id_mutex_);
+                wait_id_ = id;
+            }
+            if (!stop_.load(std::memory_order_acquire)) gst_clock_id_wait(id, NULL);
+            {
+                std::lock_guard<std::mutex> lock(id_mutex_);
+                wait_id_ = nullptr;
+            }
+            gst_clock_id_unref(id);
+            if (stop_.load(std::memory_order_acquire)) break;
+
+            // Woke up past the next slot: those slots are gone, keep PTS monotonic
+            const GstClockTime now_rt = gst_clock_get_time(clock_) - base_time_;
+            if (now_rt >= slot_rt + duration_) {
+                uint64_t behind = (now_rt - slot_rt) / duration_;
+                stats_.skipped_slots.fetch_add(behind, std::memory_order_relaxed);
+                slot += behind;
+            }
+
+            if (!primed) primed = ring_->size() >= (size_t)jitter_frames_;
+
+            GstBuffer *buf = nullptr;
+            if (primed && ring_->try_pop(buf)) {
+                stats_.emitted.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                primed = false; // rebuild the cushion before emitting fresh frames again
+                if (repeat_ && last_) {
+                    buf = gst_buffer_copy(last_);
+                    stats_.repeated.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    stats_.empty_slots.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            if (buf) {
+                GST_BUFFER_PTS(buf) = t0 + slot * duration_;
+                GST_BUFFER_DTS(buf) = GST_CLOCK_TIME_NONE;
+                GST_BUFFER_DURATION(buf) = duration_;
+                if (repeat_) {
+                    if (last_) gst_buffer_unref(last_);
+                    last_ = gst_buffer_ref(buf);
+                }
+                if (jitter_) jitter_->on_buffer(jt_out_, buf);
+                if (push_(buf) != GST_FLOW_OK) stats_.push_errors.fetch_add(1, std::memory_order_relaxed);
+            }
+            slot++;
+        }
+    }
+
+    GstClockTime duration_{GST_SECOND / 60};
+    int jitter_frames_{2};
+    bool repeat_{true};
+
+    GstClock *clock_{nullptr};
+    GstClockTime base_time_{GST_CLOCK_TIME_NONE};
+    PushFn push_;
+    std::unique_ptr<SpscRing<GstBuffer *>> ring_;
+    GstBuffer *last_{nullptr};            // pacer thread only
+
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    std::mutex id_mutex_;
+    GstClockID wait_id_{nullptr};
+
+    FramePacerStats stats_;
+    FrameJitter *jitter_{nullptr};
+    int jt_in_{-1}, jt_out_{-1};
+};
+
+#endif
+// _FRAME_PACER_H_
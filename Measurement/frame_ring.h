@@ -0,0 +1,351 @@
+// frame_ring.h
+// Bounded lock-free rings for handing GstBuffer* (or any trivially copyable value) between
+// threads without a mutex on the fast path.
+//
+//   SpscRing<T> - one producer, one consumer (stage-to-stage, appsink -> main loop)
+//   MpmcRing<T> - any number of producers and consumers (worker pools), Vyukov's
+//                 per-cell sequence scheme
+//
+// Both offer:
+//   try_push / try_pop        never block
+//   push_overwrite            when full, evicts the oldest item and hands it to a callback
+//                             so the caller can unref it (a leaky queue without a lock)
+//   pop_wait(v, timeout_us)   spin, then yield, then park on a condvar; producers only
+//                             touch the mutex when a consumer is actually parked
+//   push_wait(v, timeout_us)  (MpmcRing) the same for a producer waiting for space
+//                             (backpressure); consumers only touch the mutex when a
+//                             producer is parked
+//
+// Capacity is rounded up to a power of two. T must be trivially copyable.
+
+#ifndef _FRAME_RING_H_
+#define _FRAME_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+static inline void ring_cpu_relax() { _mm_pause(); }
+#elif defined(__aarch64__)
+static inline void ring_cpu_relax() { asm volatile("yield" ::: "memory"); }
+#else
+static inline void ring_cpu_relax() {}
+#endif
+
+#define RING_CACHELINE 64
+
+static inline size_t ring_round_pow2(size_t n) {
+    size_t c = 2;
+    while (c < n) c <<= 1;
+    return c;
+}
+
+/* ---------- Spin-then-park ---------- */
+
+// Consumer side waits here once the ring looks empty. The sleeper count lets producers
+// skip the mutex entirely while nobody is parked.
+class RingParker {
+public:
+    // Spin iterations (with pause) and yields before parking
+    static const int kSpins = 256;
+    static const int kYields = 16;
+
+    template <typename TryFn>
+    bool wait(TryFn try_fn, int64_t timeout_us) {
+        for (int i = 0; i < kSpins; ++i) {
+            if (try_fn()) return true;
+            ring_cpu_relax();
+        }
+        for (int i = 0; i < kYields; ++i) {
+            if (try_fn()) return true;
+            std::this_thread::yield();
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_us);
+        std::unique_lock<std::mutex> lk(mu_);
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        bool ok = false;
+        for (;;) {
+            // Re-check after announcing ourselves, so a push that missed the sleeper
+            // count is still seen here
+            if (try_fn()) { ok = true; break; }
+            if (timeout_us >= 0) {
+                if (cv_.wait_until(lk, deadline) == std::cv_status::timeout) {
+                    ok = try_fn();
+                    break;
+                }
+            } else {
+                cv_.wait(lk);
+            }
+        }
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        parks_.fetch_add(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+    // Called by producers after publishing an item
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) > 0) {
+            { std::lock_guard<std::mutex> lk(mu_); }
+            cv_.notify_one();
+        }
+    }
+
+    void notify_all() {
+        { std::lock_guard<std::mutex> lk(mu_); }
+        cv_.notify_all();
+    }
+
+    // Times a consumer fell through to the condvar (diagnostic)
+    uint64_t parks() const { return parks_.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::atomic<int> sleepers_{0};
+    std::atomic<uint64_t> parks_{0};
+};
+
+/* ---------- SPSC ---------- */
+
+template <typename T>
+class SpscRing {
+    static_assert(std::is_trivially_copyable<T>::value, "SpscRing holds trivially copyable values");
+
+public:
+    // overwrite: allow push_overwrite(). The consumer then advances head with a CAS
+    // instead of a plain store, since the producer may advance it too.
+    explicit SpscRing(size_t capacity, bool overwrite = false)
+        : cap_(ring_round_pow2(capacity)), mask_(cap_ - 1), overwrite_(overwrite),
+          buf_(new Slot[cap_]) {}
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    size_t capacity() const { return cap_; }
+
+    // Approximate when called from a third thread
+    size_t size() const {
+        size_t t = tail_.load(std::memory_order_acquire);
+        size_t h = head_.load(std::memory_order_acquire);
+        return t - h;
+    }
+
+    bool try_push(T v) {
+        const size_t t = tail_.load(std::memory_order_relaxed);
+        if (t - head_cache_ >= cap_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (t - head_cache_ >= cap_) return false;
+        }
+        buf_[t & mask_].store(v);
+        tail_.store(t + 1, std::memory_order_release);
+        parker_.notify();
+        return true;
+    }
+
+    // Always succeeds. Each evicted item is passed to on_evict (e.g. gst_buffer_unref);
+    // returns how many were evicted.
+    template <typename EvictFn>
+    int push_overwrite(T v, EvictFn on_evict) {
+        int dropped = 0;
+        while (!try_push(v)) {
+            const size_t t = tail_.load(std::memory_order_relaxed);
+            size_t h = head_.load(std::memory_order_acquire);
+            if (t - h < cap_) continue;   // consumer made room meanwhile
+            // Only this thread writes slots, so the value at h is stable until the CAS
+            T old = buf_[h & mask_].load();
+            if (head_.compare_exchange_strong(h, h + 1, std::memory_order_acq_rel)) {
+                on_evict(old);
+                ++dropped;
+            }
+        }
+        return dropped;
+    }
+
+    bool try_pop(T &v) {
+        for (;;) {
+            size_t h = head_.load(std::memory_order_relaxed);
+            // >= rather than ==: evictions can move head past a stale tail_cache_
+            if (h >= tail_cache_) {
+                tail_cache_ = tail_.load(std::memory_order_acquire);
+                if (h >= tail_cache_) return false;
+            }
+            v = buf_[h & mask_].load();
+            if (!overwrite_) {
+                head_.store(h + 1, std::memory_order_release);
+                return true;
+            }
+            // The producer may have evicted this slot under us
+            if (head_.compare_exchange_strong(h, h + 1, std::memory_order_acq_rel)) return true;
+        }
+    }
+
+    bool pop_wait(T &v, int64_t timeout_us) {
+        return parker_.wait([&] { return try_pop(v); }, timeout_us);
+    }
+
+    // Wake a parked consumer (shutdown)
+    void wake_all() { parker_.notify_all(); }
+    uint64_t parks() const { return parker_.parks(); }
+
+private:
+    const size_t cap_;
+    const size_t mask_;
+    const bool overwrite_;
+    // A slot is T split into machine words, each a relaxed atomic: lock-free for any
+    // size (std::atomic<T> of a 16-byte T is a libatomic call with a lock), and a
+    // consumer copy torn by a concurrent eviction is defined and discarded by the failed
+    // head CAS in try_pop. Publication is the release/acquire on tail_ and head_.
+    struct Slot {
+        static const size_t kWords = (sizeof(T) + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
+        std::atomic<uintptr_t> w[kWords];
+
+        void store(const T &v) {
+            uintptr_t tmp[kWords] = {};
+            memcpy(tmp, &v, sizeof(T));
+            for (size_t i = 0; i < kWords; ++i) w[i].store(tmp[i], std::memory_order_relaxed);
+        }
+        T load() const {
+            uintptr_t tmp[kWords];
+            for (size_t i = 0; i < kWords; ++i) tmp[i] = w[i].load(std::memory_order_relaxed);
+            T v;
+            memcpy(&v, tmp, sizeof(T));
+            return v;
+        }
+    };
+
+    std::unique_ptr<Slot[]> buf_;
+
+    // Producer and consumer indices on separate lines, each with a private cache of the
+    // other side's index so the shared line is only read when the ring looks full/empty
+    alignas(RING_CACHELINE) std::atomic<size_t> tail_{0};
+    size_t head_cache_{0};
+    alignas(RING_CACHELINE) std::atomic<size_t> head_{0};
+    size_t tail_cache_{0};
+    alignas(RING_CACHELINE) RingParker parker_;
+};
+
+/* ---------- MPMC ---------- */
+
+template <typename T>
+class MpmcRing {
+    static_assert(std::is_trivially_copyable<T>::value, "MpmcRing holds trivially copyable values");
+
+public:
+    explicit MpmcRing(size_t capacity) : cap_(ring_round_pow2(capacity)), mask_(cap_ - 1), cells_(new Cell[cap_]) {
+        for (size_t i = 0; i < cap_; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpmcRing(const MpmcRing &) = delete;
+    MpmcRing &operator=(const MpmcRing &) = delete;
+
+    size_t capacity() const { return cap_; }
+
+    size_t size() const {
+        size_t t = tail_.load(std::memory_order_acquire);
+        size_t h = head_.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+
+    bool try_push(T v) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &c = cells_[pos & mask_];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.value = v;
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    parker_.notify();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Always succeeds. Each evicted item is passed to on_evict; returns how many were
+    // evicted (more than one only when other producers refill the slot first).
+    template <typename EvictFn>
+    int push_overwrite(T v, EvictFn on_evict) {
+        int dropped = 0;
+        while (!try_push(v)) {
+            T old;
+            if (try_pop(old)) {
+                on_evict(old);
+                ++dropped;
+            }
+        }
+        return dropped;
+    }
+
+    bool try_pop(T &v) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &c = cells_[pos & mask_];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    v = c.value;
+                    c.seq.store(pos + cap_, std::memory_order_release);
+                    space_.notify();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // empty
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop_wait(T &v, int64_t timeout_us) {
+        return parker_.wait([&] { return try_pop(v); }, timeout_us);
+    }
+
+    // Blocking push for backpressure: false if still full after timeout_us
+    bool push_wait(T v, int64_t timeout_us) {
+        return space_.wait([&] { return try_push(v); }, timeout_us);
+    }
+
+    // Wake parked consumers and producers (shutdown)
+    void wake_all() {
+        parker_.notify_all();
+        space_.notify_all();
+    }
+    uint64_t parks() const { return parker_.parks(); }
+    uint64_t producer_parks() const { return space_.parks(); }
+
+private:
+    struct alignas(RING_CACHELINE) Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    const size_t cap_;
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+
+    alignas(RING_CACHELINE) std::atomic<size_t> tail_{0};
+    alignas(RING_CACHELINE) std::atomic<size_t> head_{0};
+    alignas(RING_CACHELINE) RingParker parker_;   // consumers waiting for items
+    alignas(RING_CACHELINE) RingParker space_;    // producers waiting for room
+};
+
+#endif
+// _FRAME_RING_H_
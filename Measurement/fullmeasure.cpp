@@ -6,9 +6,14 @@
 //  - Buffer pool for appsrc output, appsrc block=false
 //  - Encoder set to Constant + filler-data for steadier bitrate
 //
+//  - Stall watchdog (stall_watchdog.h): a stage without progress for --stall-ms
+//    (default 1000) prints a [STALL] diagnosis; --stall-recover=flush|restart then
+//    flushes or restarts the pipeline on the stalled side
+//
 // Run examples:
 //   ./histequalize_host --bitrate=10000 --codec=h265
 //   ./histequalize_host --bitrate=10000            (H.264 default)
+//   ./histequalize_host --stall-ms=500 --stall-recover=flush
 
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
@@ -18,6 +23,11 @@
 #include <opencv2/opencv.hpp>
 #include <string.h>
 #include <stdlib.h>
+#include <atomic>
+
+#include "stall_watchdog.h"
+
+typedef enum { RECOVER_NONE, RECOVER_FLUSH, RECOVER_RESTART } StallRecovery;
 
 typedef struct {
     GstElement *appsrc;
@@ -61,6 +71,15 @@ typedef struct {
     gboolean pool_ready = FALSE;
     cv::Mat y_plane_out_reuse; // persistent output Y
     cv::Mat y_cached;          // persistent cached copy of input Y
+
+    // Stall detection and recovery
+    StallWatchdog watchdog;
+    int wd_callback = -1;              // watchdog stage of the OpenCV callback
+    int wd_appsrc = -1;                // first stage of the streaming pipeline
+    StallRecovery recovery = RECOVER_NONE;
+    std::atomic<int> recover_stage{-1}; // stalled stage waiting for recovery on the main loop
+    GstElement *sink_pipeline = NULL;
+    GstElement *src_pipeline = NULL;
 } CustomData;
 
 // ---------- Helpers ----------
@@ -74,8 +93,8 @@ static inline gsize buf_size(GstBuffer *b) {
 #endif
 }
 
-typedef enum { STAGE_CAM_SRC, STAGE_SINK_IN, STAGE_APPSRC_OUT, STAGE_ENCODER_OUT, STAGE_PAY_IN } Stage;
-typedef struct { CustomData *data; Stage stage; } ProbeCtx;
+typedef enum { STAGE_CAM_SRC, STAGE_SINK_IN, STAGE_APPSRC_OUT, STAGE_ENCODER_IN, STAGE_ENCODER_OUT, STAGE_PAY_IN } Stage;
+typedef struct { CustomData *data; Stage stage; int wd_stage; } ProbeCtx;
 
 static GstPadProbeReturn on_buf_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
     if (!(GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER)) return GST_PAD_PROBE_OK;
@@ -90,13 +109,43 @@ static GstPadProbeReturn on_buf_probe(GstPad *pad, GstPadProbeInfo *info, gpoint
         case STAGE_CAM_SRC:    ctx->data->cnt_cam_src++;    ctx->data->bytes_cam_src += sz; break;
         case STAGE_SINK_IN:    ctx->data->cnt_sink_in++;    break;
         case STAGE_APPSRC_OUT: ctx->data->cnt_appsrc_out++; break;
+        case STAGE_ENCODER_IN: break;  // watchdog only
         case STAGE_ENCODER_OUT:ctx->data->cnt_enc_out++;    ctx->data->bytes_enc_out += sz; break;
         case STAGE_PAY_IN:     ctx->data->cnt_pay_in++;     ctx->data->bytes_pay_in += sz; break;
     }
     g_mutex_unlock(&ctx->data->mu);
+    ctx->data->watchdog.progress(ctx->wd_stage);
     return GST_PAD_PROBE_OK;
 }
 
+// ---------- Stall recovery (main loop) ----------
+static gboolean recover_idle(gpointer user_data) {
+    CustomData *d = (CustomData*)user_data;
+    int stage = d->recover_stage.exchange(-1);
+    if (stage < 0) return G_SOURCE_REMOVE;
+
+    // Act on the pipeline the stalled stage belongs to
+    GstElement *pipe = stage >= d->wd_appsrc ? d->src_pipeline : d->sink_pipeline;
+    const char *side = pipe == d->src_pipeline ? "src" : "sink";
+    if (d->recovery == RECOVER_FLUSH) {
+        g_printerr("[STALL]   recovery: flush %s pipeline\n", side);
+        gst_element_send_event(pipe, gst_event_new_flush_start());
+        gst_element_send_event(pipe, gst_event_new_flush_stop(FALSE));
+    } else if (d->recovery == RECOVER_RESTART) {
+        g_printerr("[STALL]   recovery: restart %s pipeline\n", side);
+        gst_element_set_state(pipe, GST_STATE_READY);
+        gst_element_set_state(pipe, GST_STATE_PLAYING);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Watchdog thread: hand the recovery to the main loop (one pending at a time)
+static void on_stall(CustomData *d, const StallReport &r) {
+    if (d->recovery == RECOVER_NONE) return;
+    int idle = -1;
+    if (d->recover_stage.compare_exchange_strong(idle, r.stage)) g_idle_add(recover_idle, d);
+}
+
 static void on_overrun(GstElement *queue, gpointer user_data) {
     CustomData *d = (CustomData*)user_data;
     g_mutex_lock(&d->mu);
@@ -293,6 +342,7 @@ GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
     g_mutex_lock(&data->mu);
     data->cnt_cb_processed++;
     g_mutex_unlock(&data->mu);
+    data->watchdog.progress(data->wd_callback);
 
     gst_video_frame_unmap(&vframe);
     gst_sample_unref(sample);
@@ -326,9 +376,11 @@ static gboolean on_bus_msg(GstBus *bus, GstMessage *msg, gpointer user_data) {
 int main(int argc, char *argv[]) {
     gst_init(&argc, &argv);
 
-    // Parse only --codec and --bitrate (kbps)
+    // Parse --codec, --bitrate (kbps) and the stall watchdog options
     gboolean use_h265 = FALSE;
     int bitrate_kbps = 20000; // default
+    int stall_ms = 1000;
+    StallRecovery recovery = RECOVER_NONE;
 
     for (int i = 1; i < argc; ++i) {
         if (g_str_has_prefix(argv[i], "--codec=")) {
@@ -341,6 +393,12 @@ int main(int argc, char *argv[]) {
             if (val) { int v = atoi(val + 1); if (v > 0) bitrate_kbps = v; }
         } else if (g_strcmp0(argv[i], "--bitrate") == 0 && i + 1 < argc) {
             int v = atoi(argv[i + 1]); if (v > 0) bitrate_kbps = v;
+        } else if (g_str_has_prefix(argv[i], "--stall-ms=")) {
+            int v = atoi(strchr(argv[i], '=') + 1); if (v > 0) stall_ms = v;
+        } else if (g_str_has_prefix(argv[i], "--stall-recover=")) {
+            const char *val = strchr(argv[i], '=') + 1;
+            if (g_ascii_strcasecmp(val, "flush") == 0) recovery = RECOVER_FLUSH;
+            else if (g_ascii_strcasecmp(val, "restart") == 0) recovery = RECOVER_RESTART;
         }
     }
 
@@ -349,6 +407,7 @@ int main(int argc, char *argv[]) {
     CustomData data = {};
     data.video_info_valid = FALSE;
     data.processing_timer = g_timer_new();
+    data.recovery = recovery;
     g_mutex_init(&data.mu);
 
     GError *error = NULL;
@@ -399,36 +458,62 @@ int main(int argc, char *argv[]) {
     data.preenc_q= gst_bin_get_by_name(GST_BIN(src_pipeline),  "preenc_q");
     data.encoder = gst_bin_get_by_name(GST_BIN(src_pipeline),  "enc");
     data.pay     = gst_bin_get_by_name(GST_BIN(src_pipeline),  "pay");
+    data.sink_pipeline = sink_pipeline;
+    data.src_pipeline  = src_pipeline;
+
+    // ---- Stall watchdog: stages in pipeline order ----
+    const int wd_cam     = data.watchdog.add_stage("camera");
+    const int wd_sink    = data.watchdog.add_stage("appsink");
+    data.wd_callback     = data.watchdog.add_stage("callback");
+    data.wd_appsrc       = data.watchdog.add_stage("appsrc");
+    const int wd_enc_in  = data.watchdog.add_stage("encoder-in");
+    const int wd_enc_out = data.watchdog.add_stage("encoder-out");
+    const int wd_pay     = data.watchdog.add_stage("payloader");
+    data.watchdog.add_queue(data.cap_q);
+    data.watchdog.add_queue(data.preenc_q);
+    data.watchdog.add_depth("appsrc_bytes", [&data] {
+        guint64 level = 0;
+        g_object_get(data.appsrc, "current-level-bytes", &level, NULL);
+        return (int64_t)level;
+    });
+    data.watchdog.add_inflight(wd_enc_in, wd_enc_out);
+    data.watchdog.on_stall([&data](const StallReport &r) { on_stall(&data, r); });
 
     // ---- Attach pad probes ----
     { // cam src pad
         GstElement *cam = gst_bin_get_by_name(GST_BIN(sink_pipeline), "cam");
         GstPad *p = gst_element_get_static_pad(cam, "src");
-        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_CAM_SRC;
+        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_CAM_SRC; ctx->wd_stage=wd_cam;
         gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, on_buf_probe, ctx, (GDestroyNotify)g_free);
         gst_object_unref(p); gst_object_unref(cam);
     }
     { // appsink sink pad
         GstPad *p = gst_element_get_static_pad(data.appsink, "sink");
-        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_SINK_IN;
+        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_SINK_IN; ctx->wd_stage=wd_sink;
         gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, on_buf_probe, ctx, (GDestroyNotify)g_free);
         gst_object_unref(p);
     }
     { // appsrc src pad
         GstPad *p = gst_element_get_static_pad(data.appsrc, "src");
-        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_APPSRC_OUT;
+        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_APPSRC_OUT; ctx->wd_stage=data.wd_appsrc;
+        gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, on_buf_probe, ctx, (GDestroyNotify)g_free);
+        gst_object_unref(p);
+    }
+    { // encoder sink pad
+        GstPad *p = gst_element_get_static_pad(data.encoder, "sink");
+        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_ENCODER_IN; ctx->wd_stage=wd_enc_in;
         gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, on_buf_probe, ctx, (GDestroyNotify)g_free);
         gst_object_unref(p);
     }
     { // encoder src pad
         GstPad *p = gst_element_get_static_pad(data.encoder, "src");
-        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_ENCODER_OUT;
+        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_ENCODER_OUT; ctx->wd_stage=wd_enc_out;
         gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, on_buf_probe, ctx, (GDestroyNotify)g_free);
         gst_object_unref(p);
     }
     { // payloader sink pad
         GstPad *p = gst_element_get_static_pad(data.pay, "sink");
-        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_PAY_IN;
+        ProbeCtx *ctx = (ProbeCtx*)g_malloc0(sizeof(ProbeCtx)); ctx->data=&data; ctx->stage=STAGE_PAY_IN; ctx->wd_stage=wd_pay;
         gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, on_buf_probe, ctx, (GDestroyNotify)g_free);
         gst_object_unref(p);
     }
@@ -456,11 +541,13 @@ int main(int argc, char *argv[]) {
     g_object_unref(bus2);
 
     g_timeout_add_seconds(1, stats_tick, &data);
+    data.watchdog.start(stall_ms);
 
     g_print("Running. Press Ctrl+C to stop.\n");
     g_main_loop_run(loop);
 
-    // Cleanup
+    // Cleanup (pipelines stopping is not a stall)
+    data.watchdog.stop();
     g_main_loop_unref(loop);
     gst_element_set_state(sink_pipeline, GST_STATE_NULL);
     gst_element_set_state(src_pipeline,  GST_STATE_NULL);
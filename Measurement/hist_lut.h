@@ -0,0 +1,74 @@
+// hist_lut.h
+// Histogram -> equalization LUT helpers shared by the CPU and FPGA paths.
+// lut_from_hist() follows cv::equalizeHist exactly, so a LUT built here from a
+// full-frame histogram reproduces OpenCV's output bit for bit.
+
+#ifndef _HIST_LUT_H_
+#define _HIST_LUT_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HIST_BINS 256
+
+// Accumulate the histogram of `rows` rows of an 8-bit plane into hist (not cleared)
+static inline void hist_accumulate(const uint8_t *plane, size_t stride, int width, int rows, uint32_t *hist) {
+    for (int r = 0; r < rows; ++r) {
+        const uint8_t *row = plane + (size_t)r * stride;
+        int c = 0;
+        for (; c + 4 <= width; c += 4) {
+            hist[row[c]]++;
+            hist[row[c + 1]]++;
+            hist[row[c + 2]]++;
+            hist[row[c + 3]]++;
+        }
+        for (; c < width; ++c) hist[row[c]]++;
+    }
+}
+
+// Sampled histogram: every `step`-th row and column. Counts are scaled by step^2
+// so lut_from_hist() sees roughly full-frame totals.
+static inline void hist_accumulate_sampled(const uint8_t *plane, size_t stride, int width, int height,
+                                           int step, uint32_t *hist) {
+    if (step < 1) step = 1;
+    const uint32_t weight = (uint32_t)(step * step);
+    for (int r = 0; r < height; r += step) {
+        const uint8_t *row = plane + (size_t)r * stride;
+        for (int c = 0; c < width; c += step) hist[row[c]] += weight;
+    }
+}
+
+// Build the equalization LUT for a histogram covering `total` pixels (cv::equalizeHist rules)
+static inline void lut_from_hist(const uint32_t *hist, uint64_t total, uint8_t *lut) {
+    int i = 0;
+    while (i < HIST_BINS && hist[i] == 0) ++i;
+    if (i == HIST_BINS || hist[i] == total) {
+        // Flat image: every pixel maps to its own value's bin
+        memset(lut, i == HIST_BINS ? 0 : i, HIST_BINS);
+        return;
+    }
+
+    float scale = 255.0f / (float)(total - hist[i]);
+    uint64_t sum = 0;
+    memset(lut, 0, (size_t)i + 1);
+    for (++i; i < HIST_BINS; ++i) {
+        sum += hist[i];
+        long v = lrintf((float)sum * scale);   // cvRound semantics
+        lut[i] = (uint8_t)(v > 255 ? 255 : v);
+    }
+}
+
+// Apply a LUT to `rows` rows of an 8-bit plane (in and out may alias)
+static inline void lut_apply(const uint8_t *in, size_t in_stride, uint8_t *out, size_t out_stride,
+                             int width, int rows, const uint8_t *lut) {
+    for (int r = 0; r < rows; ++r) {
+        const uint8_t *src = in + (size_t)r * in_stride;
+        uint8_t *dst = out + (size_t)r * out_stride;
+        for (int c = 0; c < width; ++c) dst[c] = lut[src[c]];
+    }
+}
+
+#endif
+// _HIST_LUT_H_
@@ -3,6 +3,7 @@
 #include <gst/app/gstappsrc.h>
 #include <gst/video/video.h>
 #include <glib.h>
+#include <glib-unix.h>
 #include <atomic>
 #include <string.h>
 #include <stdlib.h>
@@ -12,6 +13,25 @@
 #include <thread>
 #include <mutex>
 
+// Lock-free hand-off between appsink, workers and the main loop
+#include "frame_ring.h"
+// Puts worker output back into capture order
+#include "reorder_buffer.h"
+// Core sets / RT priority per thread role
+#include "thread_policy.h"
+// Drop / passthrough / reduced-quality decisions when the workers fall behind
+#include "overload_policy.h"
+// need-data / enough-data / level backpressure from appsrc
+#include "appsrc_flow.h"
+// Counters / histograms with JSON-lines and Prometheus export
+#include "metrics.h"
+// Per-stage capture-to-network latency (--trace-latency)
+#include "latency_trace.h"
+// Per-frame stage events as Chrome trace JSON (--trace-events)
+#include "trace_events.h"
+// Bytes moved per copy site vs. the minimum and memcpy bandwidth (--copy-report)
+#include "copy_account.h"
+
 // OpenCL/FPGA includes
 #include <CL/cl.h>
 #include <CL/opencl.h>
@@ -19,23 +39,21 @@
 #include "xcl2.hpp"
 
 struct Counters {
-    // Frame counters for rate calculation
-    std::atomic<uint64_t> camera_frames{0};      // Frames captured from camera
-    std::atomic<uint64_t> fpga_input_frames{0};  // Frames sent to FPGA
-    std::atomic<uint64_t> fpga_output_frames{0}; // Frames processed by FPGA
-    std::atomic<uint64_t> encoder_frames{0};     // Frames sent to encoder
-    std::atomic<uint64_t> output_bytes{0};       // Output bytes for bitrate calculation
-
-    // Previous counts for rate calculation
-    uint64_t prev_camera_frames{0};
-    uint64_t prev_fpga_input_frames{0};
-    uint64_t prev_fpga_output_frames{0};
-    uint64_t prev_encoder_frames{0};
-    uint64_t prev_output_bytes{0};
+    MetricsRegistry reg{"home"};
 
-    std::atomic<uint64_t> processing_errors{0};
-    std::atomic<uint64_t> total_processing_time_us{0};
-    std::atomic<uint64_t> total_idle_calls{0};
+    // Frame counters (rates come from reg.tick())
+    MetricCounter &camera_frames      = reg.counter("camera_frames_total", "Frames captured from camera");
+    MetricCounter &fpga_input_frames  = reg.counter("fpga_input_frames_total", "Frames sent to FPGA");
+    MetricCounter &fpga_output_frames = reg.counter("fpga_output_frames_total", "Frames processed by FPGA");
+    MetricCounter &encoder_frames     = reg.counter("encoder_frames_total", "Frames sent to encoder");
+    MetricCounter &output_bytes       = reg.counter("output_bytes_total", "Payloaded output bytes");
+    MetricCounter &processing_errors  = reg.counter("processing_errors_total", "Processing errors and drops");
+
+    MetricHistogram &processing_us    = reg.histogram("processing_us", "Worker time per frame");
+
+    MetricGauge &input_ring           = reg.gauge("input_ring_frames", "Frames waiting for a worker");
+    MetricGauge &output_ring          = reg.gauge("output_ring_frames", "Processed frames waiting for the main loop");
+    MetricGauge &appsrc_level         = reg.gauge("appsrc_level_bytes", "Bytes queued in appsrc");
 };
 
 // FPGA OpenCL context structure - now supports multiple contexts for worker threads
@@ -70,12 +88,22 @@ struct FPGAContext {
     }
 };
 
+// One frame in flight, tagged with its capture sequence number. On output_q a null
+// buf is a tombstone: that sequence number was dropped or failed and will never arrive.
+// reduced: overload policy asked for the cheap CPU path instead of the FPGA.
+struct FrameJob {
+    GstBuffer *buf;
+    uint64_t   seq;
+    bool       reduced{false};
+};
+
 // Worker thread structure
 struct WorkerThread {
     std::thread thread;
     FPGAContext fpga_ctx;
     std::atomic<bool> stop{false};
     int worker_id{0};
+    ReducedEqualizer reduced_eq;         // overload fallback (sampled histogram, cached LUT)
     
     // Per-worker statistics
     std::atomic<uint64_t> frames_processed{0};
@@ -90,20 +118,34 @@ struct CustomData {
     GstVideoInfo video_info{};
 
     // Worker thread processing
-    GAsyncQueue *work_q{nullptr};        // Input queue for worker threads
-    GAsyncQueue *output_q{nullptr};      // Output queue from worker threads
+    std::unique_ptr<MpmcRing<FrameJob>> work_q;   // appsink -> workers (overwrites oldest when full)
+    std::unique_ptr<MpmcRing<FrameJob>> output_q; // workers -> main loop, any order
+    uint64_t     capture_seq{0};         // next sequence number (appsink thread only)
     std::vector<WorkerThread> workers;   // Worker thread pool
     guint        output_idle_source_id{0}; // GLib idle source for output processing
-    gboolean     output_processing_active{FALSE};
+    std::atomic<bool> output_processing_active{false};
     int          num_workers{2};         // Number of worker threads
     std::atomic<bool> stop{false};
+
+    // Output ordering (main loop only)
+    ReorderBuffer<GstBuffer*> reorder;
+    guint        reorder_timer_id{0};    // fires when a held gap reaches its hold time
     
     // Queue management
     int          max_queue_depth{12};    // Maximum frames to queue (increased for workers)
     gboolean     drop_frames{TRUE};      // Enable frame dropping when overloaded
     std::mutex   video_info_mutex;       // Protect video_info access from workers
+    bool         overload_enabled{false};
+    OverloadPolicy overload;             // decide() on the appsink thread only
+    AppsrcFlow   flow;                   // frames are only started if appsrc has room
+
+    ThreadPolicy threads;                // placement + per-thread CPU report
 
     Counters     ctr{};
+    MetricsExporter metrics{ctr.reg};
+    LatencyTrace trace;
+    bool         copy_report{false};
+    uint64_t     copy_prev_frames{0};    // status_tick only
     GMainLoop   *loop{nullptr};
 };
 
@@ -181,7 +223,7 @@ static gboolean init_fpga_context_worker(FPGAContext* ctx, int width, int height
 static GstPadProbeReturn probe_cam_out(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
     auto *d = (CustomData*)user_data;
     if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
-        d->ctr.camera_frames.fetch_add(1, std::memory_order_relaxed);
+        d->ctr.camera_frames.add();
     }
     return GST_PAD_PROBE_OK;
 }
@@ -189,7 +231,7 @@ static GstPadProbeReturn probe_cam_out(GstPad *pad, GstPadProbeInfo *info, gpoin
 static GstPadProbeReturn probe_apps_sink(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
     auto *d = (CustomData*)user_data;
     if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
-        d->ctr.fpga_input_frames.fetch_add(1, std::memory_order_relaxed);
+        d->ctr.fpga_input_frames.add();
     }
     return GST_PAD_PROBE_OK;
 }
@@ -198,7 +240,17 @@ static GstPadProbeReturn probe_encoder_sink(GstPad *pad, GstPadProbeInfo *info,
     auto *d = (CustomData*)user_data;
     if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
         GstBuffer *b = GST_PAD_PROBE_INFO_BUFFER(info);
-        d->ctr.encoder_frames.fetch_add(1, std::memory_order_relaxed);
+        d->ctr.encoder_frames.add();
+        // Encoder in -> out span, keyed by PTS (no reordering with low-delay-p)
+        trace_async_begin("encode", GST_BUFFER_PTS(b));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// Only installed with --trace-events
+static GstPadProbeReturn probe_encoder_src(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
+        trace_async_end("encode", GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info)));
     }
     return GST_PAD_PROBE_OK;
 }
@@ -207,25 +259,134 @@ static GstPadProbeReturn probe_output(GstPad *pad, GstPadProbeInfo *info, gpoint
     auto *d = (CustomData*)user_data;
     if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
         GstBuffer *b = GST_PAD_PROBE_INFO_BUFFER(info);
-        d->ctr.output_bytes.fetch_add(gst_buffer_get_size(b), std::memory_order_relaxed);
+        d->ctr.output_bytes.add(gst_buffer_get_size(b));
     }
     return GST_PAD_PROBE_OK;
 }
 
+/* ---------- Main thread output: drain processed frames into appsrc ---------- */
+
+static void release_in_order(CustomData *d);
+
+static gboolean reorder_timeout_cb(gpointer user_data) {
+    auto *d = (CustomData*)user_data;
+    d->reorder_timer_id = 0;
+    if (!d->stop.load(std::memory_order_acquire)) release_in_order(d);
+    return G_SOURCE_REMOVE;
+}
+
+// Push every frame that is next in capture order. A gap left open is re-checked by a
+// one-shot timer at its hold deadline, so the stream never waits on new arrivals.
+static void release_in_order(CustomData *d) {
+    const int64_t now = g_get_monotonic_time();
+    d->reorder.drain(now,
+        [d](GstBuffer *b) {
+            d->trace.mark(TRACE_PROCESSED, b);
+            TRACE_SCOPE("push", GST_BUFFER_OFFSET(b));
+            // appsrc takes ownership, also on failure
+            if (d->flow.push(b) != GST_FLOW_OK) {
+                d->ctr.processing_errors.add();
+            }
+        },
+        [d](GstBuffer *b) {
+            gst_buffer_unref(b);
+            d->ctr.processing_errors.add();
+        });
+
+    if (d->reorder.held() > 0 && d->reorder_timer_id == 0) {
+        int64_t left_us = d->reorder.us_until_deadline(now);
+        guint ms = (guint)((left_us + 999) / 1000);
+        d->reorder_timer_id = g_timeout_add(ms > 0 ? ms : 1, reorder_timeout_cb, d);
+    }
+}
+
+static gboolean process_output_frames_idle(gpointer user_data) {
+    auto *d = (CustomData*)user_data;
+
+    int pushed = 0;
+    FrameJob job;
+    while (pushed < 8 && !d->stop.load(std::memory_order_acquire) && d->output_q->try_pop(job)) {
+        const int64_t now = g_get_monotonic_time();
+        if (job.buf) {
+            // GST_CLOCK_TIME_NONE and REORDER_PTS_NONE are both all-ones
+            d->reorder.insert(job.seq, job.buf, GST_BUFFER_PTS(job.buf), now, [d](GstBuffer *late) {
+                gst_buffer_unref(late);
+                d->ctr.processing_errors.add();
+            });
+        } else {
+            d->reorder.mark_lost(job.seq, now);
+        }
+        pushed++;
+    }
+    if (pushed > 0) release_in_order(d);
+    if (pushed > 0 && !d->stop.load(std::memory_order_acquire)) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    // Ring empty: go idle until a worker re-arms us. A frame pushed between the last
+    // pop and clearing the flag is picked up by re-arming here.
+    d->output_processing_active.store(false, std::memory_order_release);
+    if (!d->stop.load(std::memory_order_acquire) && d->output_q->size() > 0 &&
+        !d->output_processing_active.exchange(true, std::memory_order_acq_rel)) {
+        return G_SOURCE_CONTINUE;
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void arm_output(CustomData *d) {
+    if (!d->output_processing_active.exchange(true, std::memory_order_acq_rel)) {
+        d->output_idle_source_id = g_idle_add(process_output_frames_idle, d);
+    }
+}
+
+// Hand a finished frame (or a tombstone, buf == nullptr) to the main loop. If the main
+// loop has stalled long enough to fill the ring, the oldest entry goes; its sequence
+// number is then skipped by the reorder buffer once the hold time runs out.
+static void push_output(CustomData *d, FrameJob job) {
+    d->output_q->push_overwrite(job, [d](FrameJob old) {
+        if (old.buf) gst_buffer_unref(old.buf);
+        d->ctr.processing_errors.add();
+    });
+    arm_output(d);
+}
+
+// Reports the frame's sequence number as lost unless it was delivered, so the reorder
+// buffer moves past it at once instead of holding later frames
+struct LostFrameGuard {
+    CustomData *d;
+    uint64_t    seq;
+    bool        delivered{false};
+    ~LostFrameGuard() {
+        if (!delivered && !d->stop.load(std::memory_order_acquire)) push_output(d, FrameJob{nullptr, seq});
+    }
+};
+
 /* ---------- Worker thread function ---------- */
 
 static void worker_thread_func(CustomData* d, WorkerThread* worker) {
+    char thread_name[32];
+    snprintf(thread_name, sizeof(thread_name), "worker-%d", worker->worker_id);
+    d->threads.apply_current(ROLE_WORKER, thread_name);
+    TraceEvents::instance().set_thread_name(thread_name);
     g_print("Worker %d: Started\n", worker->worker_id);
     
     while (!worker->stop.load(std::memory_order_acquire) && !d->stop.load(std::memory_order_acquire)) {
-        // Get work item from queue (blocking with timeout)
-        gpointer item = g_async_queue_timeout_pop(d->work_q, 100000); // 100ms timeout
-        if (!item) {
+        // Get work item from ring (spin, then park; 100ms timeout to re-check stop)
+        FrameJob job;
+        if (!d->work_q->pop_wait(job, 100000)) {
             continue; // Timeout, check stop condition
         }
-        
-        GstBuffer *inbuf = (GstBuffer*)item;
+        GstBuffer *inbuf = job.buf;
+        LostFrameGuard guard{d, job.seq};
+
+        // Capture timestamps travel with the processed frame
+        const GstClockTime pts = GST_BUFFER_PTS(inbuf);
+        const GstClockTime dts = GST_BUFFER_DTS(inbuf);
+        const GstClockTime duration_ts = GST_BUFFER_DURATION(inbuf);
+        const uint64_t frame = GST_BUFFER_OFFSET(inbuf);   // v4l2 sequence number, trace id
+
         auto start_time = std::chrono::high_resolution_clock::now();
+        TRACE_SCOPE("process", frame);
         
         try {
             // Get video info safely
@@ -255,7 +416,12 @@ static void worker_thread_func(CustomData* d, WorkerThread* worker) {
             
             // Map input buffer for reading
             GstMapInfo map_info;
-            if (!gst_buffer_map(inbuf, &map_info, GST_MAP_READ)) {
+            gboolean mapped;
+            {
+                TRACE_SCOPE("map", frame);
+                mapped = gst_buffer_map(inbuf, &map_info, GST_MAP_READ);
+            }
+            if (!mapped) {
                 gst_buffer_unref(inbuf);
                 worker->processing_errors.fetch_add(1, std::memory_order_relaxed);
                 continue;
@@ -271,66 +437,99 @@ static void worker_thread_func(CustomData* d, WorkerThread* worker) {
                 continue;
             }
             
-            FPGAContext &ctx = worker->fpga_ctx;
-            
-            // Copy Y plane data to host buffer
-            memcpy(ctx.host_in_buffer.data(), map_info.data, y_size);
+            GstBuffer *outbuf = nullptr;
+            if (job.reduced) {
+                // Overload: CPU equalization from a sampled histogram / cached LUT
+                outbuf = gst_buffer_new_allocate(NULL, y_size + uv_size, NULL);
+                GstMapInfo out_map_info;
+                if (!outbuf || !gst_buffer_map(outbuf, &out_map_info, GST_MAP_WRITE)) {
+                    if (outbuf) gst_buffer_unref(outbuf);
+                    gst_buffer_unmap(inbuf, &map_info);
+                    gst_buffer_unref(inbuf);
+                    worker->processing_errors.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                {
+                    TRACE_SCOPE("reduced_equalize", frame);
+                    worker->reduced_eq.process(map_info.data, out_map_info.data, width, height);
+                }
+                memset_acct(COPY_SITE("uv_fill"), out_map_info.data + y_size, 128, uv_size);
+                gst_buffer_unmap(outbuf, &out_map_info);
+            } else {
+                FPGAContext &ctx = worker->fpga_ctx;
+                TraceSteps steps(frame);
+
+                // Copy Y plane data to host buffer
+                memcpy_acct(COPY_SITE("host_in"), ctx.host_in_buffer.data(), map_info.data, y_size);
+                steps.step("copy_in");
             
-            // Transfer input data to FPGA using C++ API (non-blocking)
-            ctx.queue.enqueueWriteBuffer(ctx.img_y_in, CL_FALSE, 0, y_size, ctx.host_in_buffer.data());
+                // Transfer input data to FPGA using C++ API (non-blocking)
+                ctx.queue.enqueueWriteBuffer(ctx.img_y_in, CL_FALSE, 0, y_size, ctx.host_in_buffer.data());
             
-            // Transfer reference data to FPGA (same as input for histogram equalization) (non-blocking)
-            ctx.queue.enqueueWriteBuffer(ctx.img_y_in_ref, CL_FALSE, 0, y_size, ctx.host_in_buffer.data());
-
-            // Set kernel arguments using C++ API
-            ctx.kernel.setArg(0, ctx.img_y_in);
-            ctx.kernel.setArg(1, ctx.img_y_in_ref);
-            ctx.kernel.setArg(2, ctx.img_y_out);
-            ctx.kernel.setArg(3, height);
-            ctx.kernel.setArg(4, width);
-
-            // Execute kernel (non-blocking)
-            cl::Event kernel_event;
-            ctx.queue.enqueueTask(ctx.kernel, nullptr, &kernel_event);
-
-            // Read back result (blocking on kernel completion)
-            ctx.queue.enqueueReadBuffer(ctx.img_y_out, CL_TRUE, 0, y_size, ctx.host_out_buffer.data());
-
-            // Create output buffer
-            GstBuffer *outbuf = gst_buffer_new_allocate(NULL, y_size + uv_size, NULL);
-            if (!outbuf) {
-                gst_buffer_unmap(inbuf, &map_info);
-                gst_buffer_unref(inbuf);
-                worker->processing_errors.fetch_add(1, std::memory_order_relaxed);
-                continue;
-            }
+                // Transfer reference data to FPGA (same as input for histogram equalization) (non-blocking)
+                ctx.queue.enqueueWriteBuffer(ctx.img_y_in_ref, CL_FALSE, 0, y_size, ctx.host_in_buffer.data());
+                // Device buffers live in the same DDR: each transfer is a read and a write
+                copy_note(COPY_SITE("dma_to_device"), 2 * y_size, 2 * y_size);
 
-            // Map output buffer and reconstruct NV12
-            GstMapInfo out_map_info;
-            if (gst_buffer_map(outbuf, &out_map_info, GST_MAP_WRITE)) {
-                // Copy processed Y plane from FPGA
-                memcpy(out_map_info.data, ctx.host_out_buffer.data(), y_size);
-                // Fill UV with neutral value 128
-                memset(out_map_info.data + y_size, 128, uv_size);
-                gst_buffer_unmap(outbuf, &out_map_info);
-            } else {
-                gst_buffer_unref(outbuf);
-                gst_buffer_unmap(inbuf, &map_info);
-                gst_buffer_unref(inbuf);
-                worker->processing_errors.fetch_add(1, std::memory_order_relaxed);
-                continue;
+                // Set kernel arguments using C++ API
+                ctx.kernel.setArg(0, ctx.img_y_in);
+                ctx.kernel.setArg(1, ctx.img_y_in_ref);
+                ctx.kernel.setArg(2, ctx.img_y_out);
+                ctx.kernel.setArg(3, height);
+                ctx.kernel.setArg(4, width);
+
+                // Execute kernel (non-blocking)
+                cl::Event kernel_event;
+                ctx.queue.enqueueTask(ctx.kernel, nullptr, &kernel_event);
+                steps.step("enqueue");
+
+                // Read back result (blocking on kernel completion)
+                ctx.queue.enqueueReadBuffer(ctx.img_y_out, CL_TRUE, 0, y_size, ctx.host_out_buffer.data());
+                copy_note(COPY_SITE("dma_from_device"), y_size, y_size);
+                steps.step("device_write+kernel+read");
+
+                // Create output buffer
+                outbuf = gst_buffer_new_allocate(NULL, y_size + uv_size, NULL);
+                steps.step("alloc");
+                if (!outbuf) {
+                    gst_buffer_unmap(inbuf, &map_info);
+                    gst_buffer_unref(inbuf);
+                    worker->processing_errors.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                // Map output buffer and reconstruct NV12
+                GstMapInfo out_map_info;
+                if (gst_buffer_map(outbuf, &out_map_info, GST_MAP_WRITE)) {
+                    // Copy processed Y plane from FPGA
+                    memcpy_acct(COPY_SITE("host_out"), out_map_info.data, ctx.host_out_buffer.data(), y_size);
+                    // Fill UV with neutral value 128
+                    memset_acct(COPY_SITE("uv_fill"), out_map_info.data + y_size, 128, uv_size);
+                    gst_buffer_unmap(outbuf, &out_map_info);
+                    steps.step("copy_out");
+                } else {
+                    gst_buffer_unref(outbuf);
+                    gst_buffer_unmap(inbuf, &map_info);
+                    gst_buffer_unref(inbuf);
+                    worker->processing_errors.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
             }
 
+            d->trace.carry(inbuf, outbuf);
             gst_buffer_unmap(inbuf, &map_info);
             gst_buffer_unref(inbuf);
 
-            // Fresh timestamps in appsrc pipeline
-            GST_BUFFER_PTS(outbuf)      = GST_CLOCK_TIME_NONE;
-            GST_BUFFER_DTS(outbuf)      = GST_CLOCK_TIME_NONE;
-            GST_BUFFER_DURATION(outbuf) = GST_CLOCK_TIME_NONE;
+            // Original capture timestamps; both pipelines share clock and base time,
+            // so they are valid running times on the appsrc side as well
+            GST_BUFFER_PTS(outbuf)      = pts;
+            GST_BUFFER_DTS(outbuf)      = dts;
+            GST_BUFFER_DURATION(outbuf) = duration_ts;
+            GST_BUFFER_OFFSET(outbuf)   = frame;
 
-            // Push to output queue for main thread to handle
-            g_async_queue_push(d->output_q, outbuf);
+            // Main loop restores capture order before appsrc
+            push_output(d, FrameJob{outbuf, job.seq});
+            guard.delivered = true;
             
             // Update worker statistics
             auto end_time = std::chrono::high_resolution_clock::now();
@@ -338,15 +537,15 @@ static void worker_thread_func(CustomData* d, WorkerThread* worker) {
             worker->frames_processed.fetch_add(1, std::memory_order_relaxed);
             worker->processing_time_us.fetch_add(duration.count(), std::memory_order_relaxed);
             
-            d->ctr.fpga_output_frames.fetch_add(1, std::memory_order_relaxed);
-            d->ctr.total_processing_time_us.fetch_add(duration.count(), std::memory_order_relaxed);
+            d->ctr.fpga_output_frames.add();
+            d->ctr.processing_us.record(duration.count());
 
         } catch (const GError& e) {
         g_printerr("OpenCL initialization error");
         } catch (const std::exception& e) {
             gst_buffer_unref(inbuf);
             worker->processing_errors.fetch_add(1, std::memory_order_relaxed);
-            d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+            d->ctr.processing_errors.add();
             g_printerr("Worker %d: Exception: %s\n", worker->worker_id, e.what());
         }
     }
@@ -354,32 +553,6 @@ static void worker_thread_func(CustomData* d, WorkerThread* worker) {
     g_print("Worker %d: Stopped\n", worker->worker_id);
 }
 
-/* ---------- Main thread idle processing ---------- */
-
-/* ---------- Input frame management with worker threads ---------- */
-
-static gboolean manage_input_queue(CustomData *d) {
-    // Aggressive frame dropping if queue is backing up
-    int current_queue_length = g_async_queue_length(d->work_q);
-    if (current_queue_length > d->max_queue_depth && d->drop_frames) {
-        // Drop frames to prevent backup
-        int frames_to_drop = current_queue_length - (d->max_queue_depth / 2);
-        for (int i = 0; i < frames_to_drop; i++) {
-            gpointer dropped_item = g_async_queue_try_pop(d->work_q);
-            if (dropped_item) {
-                gst_buffer_unref((GstBuffer*)dropped_item);
-                d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed); // Count as processing error for monitoring
-            } else {
-                break;
-            }
-        }
-        g_print("Dropped %d frames to prevent queue backup (queue was %d deep)\n", 
-                frames_to_drop, current_queue_length);
-        return TRUE; // Frames were dropped
-    }
-    return FALSE; // No frames dropped
-}
-
 /* ---------- appsink callback: O(1) enqueue + trigger processing ---------- */
 
 static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
@@ -389,6 +562,7 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
     if (!sample) return GST_FLOW_ERROR;
     GstBuffer *inbuf = gst_sample_get_buffer(sample);
     if (!inbuf) { gst_sample_unref(sample); return GST_FLOW_ERROR; }
+    TRACE_SCOPE("capture_cb", GST_BUFFER_OFFSET(inbuf));
 
     // Cache caps once (diagnostic only) - thread-safe access
     if (!d->video_info_valid) {
@@ -398,22 +572,63 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
                 if (gst_video_info_from_caps(&d->video_info, caps)) {
                     d->video_info_valid = TRUE;
                     g_print("Video info: %dx%d\n", d->video_info.width, d->video_info.height);
+                    d->flow.set_frame_bytes((uint64_t)d->video_info.width * d->video_info.height * 3 / 2);
                 }
             }
         }
     }
 
-    // Manage input queue (drop frames if needed)
-    manage_input_queue(d);
-
-    // O(1): ref buffer, queue to worker threads, unref sample
+    // O(1): ref buffer, tag it with its capture sequence number, hand to the workers,
+    // unref sample. A full ring (workers behind) drops the oldest queued frame instead of
+    // blocking the streaming thread; its number is reported lost so output doesn't wait.
     gst_buffer_ref(inbuf);
-    g_async_queue_push(d->work_q, inbuf);
+    FrameJob job{inbuf, d->capture_seq++};
 
-    // Trigger output processing if not already active
-    if (!d->output_processing_active) {
-        d->output_processing_active = TRUE;
-        d->output_idle_source_id = g_idle_add(process_output_frames_idle, d);
+    // appsrc has no room: shed now rather than equalize a frame it would only queue
+    if (!d->flow.admit()) {
+        gst_buffer_unref(inbuf);
+        push_output(d, FrameJob{nullptr, job.seq});
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+
+    // Overload policy: load is input ring occupancy
+    if (d->overload_enabled) {
+        const double cap = (double)d->work_q->capacity();
+        const OverloadAction act = d->overload.decide((double)d->work_q->size() / cap);
+        if (act == ACT_DROP_OLDEST) {
+            // Trim to the exit level so the fresh frame doesn't queue behind stale ones
+            FrameJob old;
+            while ((double)d->work_q->size() > d->overload.exit_load() * cap && d->work_q->try_pop(old)) {
+                gst_buffer_unref(old.buf);
+                push_output(d, FrameJob{nullptr, old.seq});
+            }
+        } else if (act == ACT_DROP_NEWEST) {
+            gst_buffer_unref(inbuf);
+            push_output(d, FrameJob{nullptr, job.seq});
+            gst_sample_unref(sample);
+            return GST_FLOW_OK;
+        } else if (act == ACT_PASSTHROUGH) {
+            // Zero-copy: the captured buffer goes to the encoder as is, in sequence
+            push_output(d, job);
+            gst_sample_unref(sample);
+            return GST_FLOW_OK;
+        } else if (act == ACT_REDUCED) {
+            job.reduced = true;
+        }
+    }
+
+    if (d->drop_frames) {
+        d->work_q->push_overwrite(job, [d](FrameJob old) {
+            gst_buffer_unref(old.buf);
+            d->ctr.processing_errors.add(); // Count as processing error for monitoring
+            push_output(d, FrameJob{nullptr, old.seq});
+        });
+    } else {
+        // Never lose a frame: park until a worker frees a slot (100ms timeout to re-check stop)
+        while (!d->work_q->push_wait(job, 100000)) {
+            if (d->stop.load(std::memory_order_acquire)) { gst_buffer_unref(inbuf); break; }
+        }
     }
 
     gst_sample_unref(sample);
@@ -425,58 +640,85 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
 static gboolean status_tick(gpointer user_data) {
     auto *d = (CustomData*)user_data;
 
-    // Get current frame counts
-    uint64_t current_camera = d->ctr.camera_frames.load();
-    uint64_t current_fpga_in = d->ctr.fpga_input_frames.load();
-    uint64_t current_fpga_out = d->ctr.fpga_output_frames.load();
-    uint64_t current_encoder = d->ctr.encoder_frames.load();
-    uint64_t current_output_bytes = d->ctr.output_bytes.load();
-
-    // Calculate frame rates (frames per second over 2 second interval)
-    double camera_fps = (current_camera - d->ctr.prev_camera_frames) / 2.0;
-    double fpga_input_fps = (current_fpga_in - d->ctr.prev_fpga_input_frames) / 2.0;
-    double fpga_output_fps = (current_fpga_out - d->ctr.prev_fpga_output_frames) / 2.0;
-    double encoder_fps = (current_encoder - d->ctr.prev_encoder_frames) / 2.0;
-    
-    // Calculate output bitrate in kbps (kilobits per second over 2 second interval)
-    double output_bitrate_kbps = ((current_output_bytes - d->ctr.prev_output_bytes) * 8.0) / (2.0 * 1000.0);
-
     // Queue lengths and processing info
-    const int input_qlen = g_async_queue_length(d->work_q);
-    const int output_qlen = g_async_queue_length(d->output_q);
-    const uint64_t proc_errors = d->ctr.processing_errors.load();
-    const uint64_t total_proc_time = d->ctr.total_processing_time_us.load();
-    const uint64_t processed_total = current_fpga_out;
+    const int input_qlen = (int)d->work_q->size();
+    const int output_qlen = (int)d->output_q->size();
+    d->ctr.input_ring.set(input_qlen);
+    d->ctr.output_ring.set(output_qlen);
+    d->ctr.appsrc_level.set((int64_t)d->flow.level_bytes());
 
-    double avg_proc_time_ms = 0.0;
-    if (processed_total > 0) {
-        avg_proc_time_ms = (double)total_proc_time / (double)processed_total / 1000.0; // convert µs to ms
-    }
+    // Rates over the measured interval: the timer fires late when the main loop is busy
+    const double interval_s = d->ctr.reg.tick();
+    double camera_fps = d->ctr.camera_frames.rate();
+    double fpga_input_fps = d->ctr.fpga_input_frames.rate();
+    double fpga_output_fps = d->ctr.fpga_output_frames.rate();
+    double encoder_fps = d->ctr.encoder_frames.rate();
+    double output_bitrate_kbps = d->ctr.output_bytes.rate() * 8.0 / 1000.0;
+
+    const uint64_t proc_errors = d->ctr.processing_errors.value();
+    const MetricHistogram::Summary &pt = d->ctr.processing_us.interval();
+    double avg_proc_time_ms = d->ctr.processing_us.mean_us() / 1000.0;
 
     // Worker statistics
     g_print(
-        "\n=== FPGA WORKER FRAME RATE MONITORING (every 2s) ===\n"
+        "\n=== FPGA WORKER FRAME RATE MONITORING (%.2fs interval) ===\n"
         "Camera Capture Rate:     %6.1f fps\n"
         "FPGA Input Rate:         %6.1f fps\n"
         "FPGA Output Rate:        %6.1f fps\n"
         "Encoder Input Rate:      %6.1f fps\n"
         "Output Bitrate:          %6.1f kbps\n"
         "\n"
-        "Input Queue: %d (max=%d) | Output Queue: %d | Processing Errors/Drops: %" G_GUINT64_FORMAT "\n"
-        "Avg Process Time: %.2f ms | Output Processing: %s\n"
+        "Input Ring: %d (cap=%d) | Output Ring: %d | Processing Errors/Drops: %" G_GUINT64_FORMAT "\n"
+        "Avg Process Time: %.2f ms (interval p50 %.2f / p99 %.2f / max %.2f ms) | Output Processing: %s\n"
         "Workers: %d | Frame Dropping: %s\n",
+        interval_s,
         camera_fps,
         fpga_input_fps,
         fpga_output_fps,
         encoder_fps,
         output_bitrate_kbps,
-        input_qlen, d->max_queue_depth, output_qlen, proc_errors,
-        avg_proc_time_ms,
+        input_qlen, (int)d->work_q->capacity(), output_qlen, proc_errors,
+        avg_proc_time_ms, pt.p50_us / 1000.0, pt.p99_us / 1000.0, pt.max_us / 1000.0,
         d->output_processing_active ? "ACTIVE" : "IDLE",
         d->num_workers,
         d->drop_frames ? "ENABLED" : "DISABLED"
     );
 
+    const ReorderStats &rs = d->reorder.stats();
+    g_print("Reorder: held %zu (max %" G_GUINT64_FORMAT ") | released %" G_GUINT64_FORMAT
+            " | skipped %" G_GUINT64_FORMAT " | late %" G_GUINT64_FORMAT " | lost %" G_GUINT64_FORMAT
+            " | PTS inversions %" G_GUINT64_FORMAT " | longest hold %.1f ms\n",
+            d->reorder.held(), rs.max_held, rs.released, rs.skipped, rs.late_dropped,
+            rs.lost_upstream, rs.pts_inversions, rs.max_hold_us / 1000.0);
+
+    const AppsrcFlowStats &fs = d->flow.stats();
+    g_print("appsrc (%s): level %" G_GUINT64_FORMAT " / %" G_GUINT64_FORMAT " KB (peak %" G_GUINT64_FORMAT
+            ") | need-data %" G_GUINT64_FORMAT " | enough-data %" G_GUINT64_FORMAT " | admitted %" G_GUINT64_FORMAT
+            " | shed %" G_GUINT64_FORMAT " | wasted %" G_GUINT64_FORMAT " | push errors %" G_GUINT64_FORMAT "\n",
+            d->flow.gating() ? "demand-driven" : "observe", d->flow.level_bytes() / 1024, d->flow.max_bytes() / 1024,
+            fs.max_level_bytes.load() / 1024, fs.need_data.load(), fs.enough_data.load(), fs.admitted.load(),
+            fs.shed.load(), fs.wasted.load(), fs.push_errors.load());
+
+    d->trace.report();
+
+    if (d->copy_report) {
+        const uint64_t frames = d->ctr.fpga_output_frames.value();
+        CopyAccount::instance().report(frames - d->copy_prev_frames, fpga_output_fps);
+        d->copy_prev_frames = frames;
+    }
+
+    if (d->overload_enabled) {
+        const OverloadPolicy &op = d->overload;
+        g_print("Overload: %s [%s] | transitions %" G_GUINT64_FORMAT " | process %" G_GUINT64_FORMAT
+                " | drop-oldest %" G_GUINT64_FORMAT " | drop-newest %" G_GUINT64_FORMAT
+                " | passthrough %" G_GUINT64_FORMAT " | reduced %" G_GUINT64_FORMAT "\n",
+                overload_mode_name(op.mode()), op.overloaded() ? "OVERLOADED" : "normal", op.transitions(),
+                op.count(ACT_PROCESS), op.count(ACT_DROP_OLDEST), op.count(ACT_DROP_NEWEST),
+                op.count(ACT_PASSTHROUGH), op.count(ACT_REDUCED));
+    }
+
+    d->threads.report();
+
     // Individual worker statistics
     for (size_t i = 0; i < d->workers.size(); i++) {
         const auto& worker = d->workers[i];
@@ -494,12 +736,7 @@ static gboolean status_tick(gpointer user_data) {
                 worker.fpga_ctx.initialized ? "OK" : "NOT INIT");
     }
 
-    // Store current counts as previous for next calculation
-    d->ctr.prev_camera_frames = current_camera;
-    d->ctr.prev_fpga_input_frames = current_fpga_in;
-    d->ctr.prev_fpga_output_frames = current_fpga_out;
-    d->ctr.prev_encoder_frames = current_encoder;
-    d->ctr.prev_output_bytes = current_output_bytes;
+    d->metrics.write_json();
 
     return TRUE;
 }
@@ -526,6 +763,13 @@ static gboolean bus_cb(GstBus *bus, GstMessage *msg, gpointer user_data) {
     return TRUE;
 }
 
+// Ctrl+C / SIGTERM: leave the main loop so the shutdown path (trace file, reports) runs
+static gboolean quit_cb(gpointer user_data) {
+    auto *d = (CustomData*)user_data;
+    if (d->loop) g_main_loop_quit(d->loop);
+    return G_SOURCE_CONTINUE;
+}
+
 int main(int argc, char *argv[]) {
     setvbuf(stdout, NULL, _IONBF, 0);
     gst_init(&argc, &argv);
@@ -533,6 +777,21 @@ int main(int argc, char *argv[]) {
     gboolean use_h265 = FALSE;
     int bitrate_kbps = 20000; // Match basic.cpp default (20 Mbps)
     int v_width = 1920, v_height = 1080, fps = 60; // defaults
+    int num_workers = 2;
+    int reorder_hold_ms = 50, reorder_depth = 16;
+    const char *thread_spec = NULL;
+    const char *overload_mode = NULL;
+    double overload_enter = 0.75, overload_exit = 0.25;
+    int overload_enter_dwell = 3;   // frames at/above --overload-enter before overloading
+    int overload_dwell = 15;        // frames at/below --overload-exit before recovering
+    int appsrc_queue = 2;
+    gboolean appsrc_gate = TRUE;
+    const char *metrics_json = NULL, *metrics_listen = NULL;
+    gboolean trace_latency = FALSE;
+    const char *trace_events = NULL;
+    double trace_ring_s = 0.0;
+    int trace_buffer = 1 << 16;
+    gboolean copy_report = FALSE;
 
     // --- argv parsing ---
     for (int i=1;i<argc;++i){
@@ -546,16 +805,72 @@ int main(int argc, char *argv[]) {
         else if (g_strcmp0(argv[i],"--height")==0 && i+1<argc){ int h=atoi(argv[i+1]); if(h>0) v_height=h; }
         else if (g_str_has_prefix(argv[i],"--fps=")) { const char* v=strchr(argv[i],'='); if(v){ int f=atoi(v+1); if(f>0) fps=f; } }
         else if (g_strcmp0(argv[i],"--fps")==0 && i+1<argc){ int f=atoi(argv[i+1]); if(f>0) fps=f; }
+        else if (g_str_has_prefix(argv[i],"--workers=")) { const char* v=strchr(argv[i],'='); if(v){ int w=atoi(v+1); if(w>0 && w<=8) num_workers=w; } }
+        else if (g_strcmp0(argv[i],"--workers")==0 && i+1<argc){ int w=atoi(argv[i+1]); if(w>0 && w<=8) num_workers=w; }
+        else if (g_str_has_prefix(argv[i],"--reorder-hold-ms=")) { int m=atoi(strchr(argv[i],'=')+1); if(m>0) reorder_hold_ms=m; }
+        else if (g_str_has_prefix(argv[i],"--reorder-depth=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) reorder_depth=n; }
+        else if (g_str_has_prefix(argv[i],"--thread-policy=")) { thread_spec=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--overload=")) { overload_mode=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--overload-enter=")) { double v=atof(strchr(argv[i],'=')+1); if(v>0.0 && v<=1.0) overload_enter=v; }
+        else if (g_str_has_prefix(argv[i],"--overload-exit=")) { double v=atof(strchr(argv[i],'=')+1); if(v>=0.0 && v<1.0) overload_exit=v; }
+        else if (g_str_has_prefix(argv[i],"--overload-dwell=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) overload_dwell=n; }
+        else if (g_str_has_prefix(argv[i],"--overload-enter-dwell=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) overload_enter_dwell=n; }
+        else if (g_str_has_prefix(argv[i],"--appsrc-queue=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) appsrc_queue=n; }
+        else if (g_str_has_prefix(argv[i],"--appsrc-flow=")) { appsrc_gate = g_ascii_strcasecmp(strchr(argv[i],'=')+1, "observe") != 0; }
+        else if (g_str_has_prefix(argv[i],"--metrics-json=")) { metrics_json=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--metrics-port=")) { metrics_listen=strchr(argv[i],'=')+1; }
+        else if (g_strcmp0(argv[i],"--trace-latency")==0) { trace_latency=TRUE; }
+        else if (g_str_has_prefix(argv[i],"--trace-events=")) { trace_events=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--trace-ring=")) { double v=atof(strchr(argv[i],'=')+1); if(v>0) trace_ring_s=v; }
+        else if (g_str_has_prefix(argv[i],"--trace-buffer=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) trace_buffer=n; }
+        else if (g_strcmp0(argv[i],"--copy-report")==0) { copy_report=TRUE; }
     }
-    g_print("Encoder: %s, target-bitrate: %d kbps, FPGA main thread processing, %dx%d@%dfps\n",
-            use_h265 ? "H.265" : "H.264", bitrate_kbps, v_width, v_height, fps);
+    g_print("Encoder: %s, target-bitrate: %d kbps, FPGA worker processing (%d workers), %dx%d@%dfps\n",
+            use_h265 ? "H.265" : "H.264", bitrate_kbps, num_workers, v_width, v_height, fps);
+    g_print("Reorder: hold up to %d ms / %d frames for a missing frame\n", reorder_hold_ms, reorder_depth);
 
     CustomData d{};
-    d.work_q = g_async_queue_new();
-    d.frames_per_batch = 1; // Start with 1 frame per batch for FPGA
-    d.processing_active = FALSE;
-    d.max_queue_depth = 6; // Reasonable queue depth for 60fps
+    d.num_workers = num_workers;
+    d.max_queue_depth = 6; // Reasonable queue depth for 60fps (ring rounds up to 8)
     d.drop_frames = TRUE;  // Enable aggressive frame dropping
+    d.work_q.reset(new MpmcRing<FrameJob>(d.max_queue_depth));
+    d.output_q.reset(new MpmcRing<FrameJob>(16));
+    d.reorder.set_limits((int64_t)reorder_hold_ms * 1000, (size_t)reorder_depth);
+    d.flow.configure(appsrc_queue, appsrc_gate);
+    if (metrics_json && !d.metrics.open_json(metrics_json)) return -1;
+    if (metrics_listen && !d.metrics.serve(metrics_listen)) return -1;
+    if (trace_latency) d.trace.enable(d.ctr.reg);
+    if (trace_events) {
+        TraceEvents::instance().enable((size_t)trace_buffer, trace_ring_s);
+        TraceEvents::instance().set_thread_name("main-loop");
+        if (trace_ring_s > 0) g_print("Event trace: ring of the last %.1f s -> %s\n", trace_ring_s, trace_events);
+        else g_print("Event trace: first %d events per thread -> %s\n", trace_buffer, trace_events);
+    }
+    if (copy_report) {
+        // Minimum: read the captured Y plane once, write the NV12 output once
+        const uint64_t y_size = (uint64_t)v_width * v_height;
+        d.copy_report = true;
+        CopyAccount::instance().set_min_bytes_per_frame(y_size + y_size * 3 / 2);
+        CopyAccount::instance().measure_bandwidth();
+    }
+    if (thread_spec) {
+        if (!d.threads.parse(thread_spec)) return -1;
+        d.threads.print_config();
+    }
+    if (overload_mode) {
+        OverloadMode m;
+        if (!overload_mode_from_name(overload_mode, &m)) {
+            g_printerr("Unknown --overload=%s (drop-oldest, drop-newest, passthrough, reduced)\n", overload_mode);
+            return -1;
+        }
+        d.overload_enabled = true;
+        d.overload.set_mode(m);
+        d.overload.set_thresholds(overload_enter, overload_exit);
+        d.overload.set_dwell(overload_enter_dwell, overload_dwell);
+        g_print("Overload policy: %s when input ring >= %.0f%% for %d frames (back below %.0f%% for %d frames)\n",
+                overload_mode_name(m), overload_enter * 100.0, overload_enter_dwell, overload_exit * 100.0,
+                overload_dwell);
+    }
 
     // Capture pipeline with more aggressive buffering for FPGA
     GError *err=NULL;
@@ -577,26 +892,26 @@ int main(int argc, char *argv[]) {
     gchar *src_str=NULL;
     if (use_h265) {
         src_str = g_strdup_printf(
-            "appsrc name=my_src is-live=true format=GST_FORMAT_TIME do-timestamp=true ! "
+            "appsrc name=my_src is-live=true format=GST_FORMAT_TIME do-timestamp=false ! "
             "video/x-raw,format=NV12,width=%d,height=%d,framerate=%d/1 ! "
             "queue name=q_after_src leaky=downstream max-size-buffers=2 max-size-time=0 max-size-bytes=0 ! "
             "omxh265enc name=enc num-slices=8 periodicity-idr=240 cpb-size=500 gdr-mode=horizontal "
             "initial-delay=250 control-rate=low-latency prefetch-buffer=true target-bitrate=%d "
             "gop-mode=low-delay-p ! video/x-h265,alignment=au ! "
             "rtph265pay name=pay ! "
-            "udpsink buffer-size=60000000 host=192.168.25.69 port=5004 async=false max-lateness=-1 qos-dscp=60",
+            "udpsink name=net buffer-size=60000000 host=192.168.25.69 port=5004 async=false max-lateness=-1 qos-dscp=60",
             v_width, v_height, fps, bitrate_kbps
         );
     } else {
         src_str = g_strdup_printf(
-            "appsrc name=my_src is-live=true format=GST_FORMAT_TIME do-timestamp=true ! "
+            "appsrc name=my_src is-live=true format=GST_FORMAT_TIME do-timestamp=false ! "
             "video/x-raw,format=NV12,width=%d,height=%d,framerate=%d/1 ! "
             "queue name=q_after_src leaky=downstream max-size-buffers=2 max-size-time=0 max-size-bytes=0 ! "
             "omxh264enc name=enc num-slices=8 periodicity-idr=240 cpb-size=500 gdr-mode=horizontal "
             "initial-delay=250 control-rate=low-latency prefetch-buffer=true target-bitrate=%d "
             "gop-mode=low-delay-p ! video/x-h264,alignment=nal ! "
             "rtph264pay name=pay ! "
-            "udpsink buffer-size=60000000 host=192.168.25.69 port=5004 async=false max-lateness=-1 qos-dscp=60",
+            "udpsink name=net buffer-size=60000000 host=192.168.25.69 port=5004 async=false max-lateness=-1 qos-dscp=60",
             v_width, v_height, fps, bitrate_kbps
         );
     }
@@ -615,6 +930,7 @@ int main(int argc, char *argv[]) {
         gst_object_unref(sink_pipe);
         return -1;
     }
+    d.flow.attach(d.appsrc);
 
     // Setup probes for frame rate monitoring
     {
@@ -642,6 +958,12 @@ int main(int argc, char *argv[]) {
                 gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, probe_encoder_sink, &d, NULL); 
                 gst_object_unref(p); 
             } 
+            if (trace_enabled()) {
+                if (GstPad *p = gst_element_get_static_pad(enc, "src")) {
+                    gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, probe_encoder_src, &d, NULL);
+                    gst_object_unref(p);
+                }
+            }
             gst_object_unref(enc); 
         }
     }
@@ -657,7 +979,35 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    // Callback (triggers main thread idle processing)
+    // Latency trace points (capture meta is carried across the bridge by the workers)
+    if (d.trace.enabled()) {
+        d.trace.add_probe(sink_pipe, "v4l2src0", "src", TRACE_CAPTURE);
+        d.trace.add_probe(sink_pipe, "cv_sink", "sink", TRACE_APPSINK);
+        d.trace.add_probe(src_pipe, "enc", "sink", TRACE_ENCODER);
+        d.trace.add_probe(src_pipe, "pay", "sink", TRACE_PAYLOADER);
+        d.trace.add_probe(src_pipe, "net", "sink", TRACE_UDPSINK);
+    }
+
+    // Streaming threads are placed as they start (sync handler on both buses)
+    d.threads.bind("v4l2src", ROLE_CAPTURE);
+    d.threads.bind("q_cam", ROLE_APPSINK);       // runs new_sample_cb
+    d.threads.bind("my_src", ROLE_PUSH);
+    d.threads.bind("q_after_src", ROLE_ENCODER); // feeds the encoder
+    d.threads.bind("enc", ROLE_ENCODER);
+    d.threads.attach(sink_pipe);
+    d.threads.attach(src_pipe);
+
+    // Worker pool (WorkerThread is not movable, so the vector is built in place)
+    {
+        std::vector<WorkerThread> pool(d.num_workers);
+        d.workers.swap(pool);
+    }
+    for (int i = 0; i < d.num_workers; i++) {
+        d.workers[i].worker_id = i;
+        d.workers[i].thread = std::thread(worker_thread_func, &d, &d.workers[i]);
+    }
+
+    // Callback (hands frames to the workers)
     g_signal_connect(d.appsink, "new-sample", G_CALLBACK(new_sample_cb), &d);
 
     // GLib loop + watches + status timer
@@ -666,36 +1016,70 @@ int main(int argc, char *argv[]) {
     GstBus *bus_src  = gst_element_get_bus(src_pipe);
     gst_bus_add_watch(bus_sink, bus_cb, &d);
     gst_bus_add_watch(bus_src,  bus_cb, &d);
+    g_unix_signal_add(SIGINT, quit_cb, &d);
+    g_unix_signal_add(SIGTERM, quit_cb, &d);
     g_timeout_add_seconds(2, status_tick, &d);
 
+    // One clock and one base time for both pipelines: a capture PTS (running time of the
+    // sink pipeline) is then the same running time in the src pipeline and can be passed
+    // through unchanged
+    {
+        GstClock *clock = gst_system_clock_obtain();
+        gst_pipeline_use_clock(GST_PIPELINE(sink_pipe), clock);
+        gst_pipeline_use_clock(GST_PIPELINE(src_pipe), clock);
+        GstClockTime base = gst_clock_get_time(clock);
+        gst_element_set_start_time(sink_pipe, GST_CLOCK_TIME_NONE);
+        gst_element_set_start_time(src_pipe, GST_CLOCK_TIME_NONE);
+        gst_element_set_base_time(sink_pipe, base);
+        gst_element_set_base_time(src_pipe, base);
+        gst_object_unref(clock);
+    }
+
     // Start & run
     gst_element_set_state(src_pipe,  GST_STATE_PLAYING);
     gst_element_set_state(sink_pipe, GST_STATE_PLAYING);
+    if (d.trace.enabled() && gst_element_get_state(sink_pipe, NULL, NULL, GST_SECOND) != GST_STATE_CHANGE_FAILURE) {
+        d.trace.set_capture_clock(sink_pipe);
+    }
     g_print("FPGA histogram equalization processing with frame rate monitoring. Press Ctrl+C to exit.\n");
     g_print("Make sure equalizeHist_accel.xclbin is in the current directory.\n");
+    // The main loop pushes into appsrc. Placed last so threads created above don't
+    // inherit its mask.
+    d.threads.apply_current(ROLE_PUSH, "main-loop");
     g_main_loop_run(d.loop);
 
     // Shutdown
+    gst_element_set_state(sink_pipe, GST_STATE_NULL); // no more new-sample callbacks
     d.stop.store(true, std::memory_order_release);
-    
-    // Remove idle source if still active
-    if (d.processing_active && d.idle_source_id > 0) {
-        g_source_remove(d.idle_source_id);
-        d.processing_active = FALSE;
+
+    // Wake parked workers and wait for them
+    d.work_q->wake_all();
+    for (auto &w : d.workers) {
+        w.stop.store(true, std::memory_order_release);
+        if (w.thread.joinable()) w.thread.join();
     }
-    
-    // Drain worker queue
-    while (GstBuffer *b = (GstBuffer*)g_async_queue_try_pop(d.work_q)) {
-        gst_buffer_unref(b);
+
+    // Remove idle source if still active
+    if (d.output_processing_active.load() && d.output_idle_source_id > 0) {
+        g_source_remove(d.output_idle_source_id);
+        d.output_processing_active.store(false);
     }
 
-    if (d.work_q) { 
-        g_async_queue_unref(d.work_q); 
-        d.work_q = nullptr; 
+    if (d.reorder_timer_id > 0) {
+        g_source_remove(d.reorder_timer_id);
+        d.reorder_timer_id = 0;
     }
 
-    gst_element_set_state(sink_pipe, GST_STATE_NULL);
+    // Drain both rings and whatever the reorder stage still holds
+    FrameJob job;
+    while (d.work_q->try_pop(job)) gst_buffer_unref(job.buf);
+    while (d.output_q->try_pop(job)) if (job.buf) gst_buffer_unref(job.buf);
+    d.reorder.flush(g_get_monotonic_time(),
+                    [](GstBuffer *b) { gst_buffer_unref(b); },
+                    [](GstBuffer *b) { gst_buffer_unref(b); });
+
     gst_element_set_state(src_pipe,  GST_STATE_NULL);
+    if (trace_events) TraceEvents::instance().write_chrome_json(trace_events);
     gst_object_unref(bus_sink);
     gst_object_unref(bus_src);
     gst_object_unref(d.appsink);
@@ -704,6 +1088,6 @@ int main(int argc, char *argv[]) {
     gst_object_unref(src_pipe);
     g_main_loop_unref(d.loop);
     
-    g_print("FPGA main thread processing shutdown complete.\n");
+    g_print("FPGA worker processing shutdown complete.\n");
     return 0;
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 // relay_debug_nv12_worker_opencv.cpp
 // Worker-based processing with OpenCV histogram equalization + queue-level probes.
+// By default each worker equalizes Y with single-threaded cv::equalizeHist, as before;
+// --band-threads=N splits it into row bands on a small per-worker pool (band_equalize.h).
+// --copy-report prints the bytes each copy site moves per frame (copy_account.h).
 //
 // Build:
 // g++ -O3 -DNDEBUG -std=c++17 relay_debug_nv12_worker_opencv.cpp -o relay_debug_worker_opencv \
@@ -15,6 +18,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <memory>
+
+#include "band_equalize.h"
+#include "copy_account.h"
 
 struct Counters {
     // Camera queue (q_cam)
@@ -53,8 +60,12 @@ struct CustomData {
     // Multi-threading support
     int num_workers{1};
     GThread     **workers{nullptr};
+    int band_threads{0};            // per worker; 0 = cv::equalizeHist
 
     Counters     ctr{};
+    bool         copy_report{false};
+    uint64_t     copy_prev_frames{0};   // status_tick only
+    int64_t      copy_prev_us{0};
     GMainLoop   *loop{nullptr};
 };
 
@@ -141,6 +152,10 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
 static gpointer worker_thread_fn(gpointer user_data) {
     auto *d = (CustomData*)user_data;
 
+    // Pool threads live as long as the worker
+    std::unique_ptr<BandEqualizer> band_eq;
+    if (d->band_threads > 0) band_eq.reset(new BandEqualizer(d->band_threads));
+
     while (!d->stop.load(std::memory_order_acquire)) {
         // Pop with timeout to allow graceful exit
         gpointer item = g_async_queue_timeout_pop(d->work_q, 50 * G_TIME_SPAN_MILLISECOND);
@@ -175,20 +190,6 @@ static gpointer worker_thread_fn(gpointer user_data) {
                 continue;
             }
 
-            auto start_time = std::chrono::high_resolution_clock::now();
-
-            // Extract Y plane from NV12 and apply histogram equalization (using clone as requested)
-            cv::Mat nv12_input(height * 3 / 2, width, CV_8UC1, map_info.data);
-            cv::Mat y_plane_in = nv12_input(cv::Rect(0, 0, width, height)).clone();
-            cv::Mat y_plane_out(height, width, CV_8UC1);
-
-            // Histogram Equalization on Y channel
-            cv::equalizeHist(y_plane_in, y_plane_out);
-
-            auto end_time = std::chrono::high_resolution_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
-            d->ctr.total_processing_time_us.fetch_add(duration.count(), std::memory_order_relaxed);
-
             // Create output buffer
             GstBuffer *outbuf = gst_buffer_new_allocate(NULL, y_size + uv_size, NULL);
             if (!outbuf) {
@@ -201,10 +202,27 @@ static gpointer worker_thread_fn(gpointer user_data) {
             // Map output buffer and reconstruct NV12
             GstMapInfo out_map_info;
             if (gst_buffer_map(outbuf, &out_map_info, GST_MAP_WRITE)) {
-                // Copy processed Y plane
-                memcpy(out_map_info.data, y_plane_out.data, y_size);
+                auto start_time = std::chrono::high_resolution_clock::now();
+
+                if (band_eq) {
+                    // Banded: straight from the camera buffer into the output buffer
+                    band_eq->equalize(map_info.data, width, out_map_info.data, width, width, height);
+                } else {
+                    // Extract Y plane from NV12 and apply histogram equalization (using clone as requested)
+                    cv::Mat nv12_input(height * 3 / 2, width, CV_8UC1, map_info.data);
+                    cv::Mat y_plane_in = clone_acct(COPY_SITE("y_clone"), nv12_input(cv::Rect(0, 0, width, height)));
+                    cv::Mat y_plane_out(height, width, CV_8UC1, out_map_info.data);
+
+                    // Histogram Equalization on Y channel
+                    cv::equalizeHist(y_plane_in, y_plane_out);
+                }
+
+                auto end_time = std::chrono::high_resolution_clock::now();
+                auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+                d->ctr.total_processing_time_us.fetch_add(duration.count(), std::memory_order_relaxed);
+
                 // Fill UV with neutral value 128 (like basic.cpp)
-                memset(out_map_info.data + y_size, 128, uv_size);
+                memset_acct(COPY_SITE("uv_fill"), out_map_info.data + y_size, 128, uv_size);
                 gst_buffer_unmap(outbuf, &out_map_info);
             } else {
                 gst_buffer_unref(outbuf);
@@ -296,6 +314,14 @@ static gboolean status_tick(gpointer user_data) {
     if (proc != aft)         g_print("LOSS between appsrc push and queue out:   %" G_GUINT64_FORMAT "\n", proc - aft);
     if (aft != enc)          g_print("LOSS between queue out and encoder sink:  %" G_GUINT64_FORMAT "\n", aft - enc);
 
+    if (d->copy_report) {
+        const int64_t now = g_get_monotonic_time();
+        const double dt = d->copy_prev_us ? (now - d->copy_prev_us) / 1e6 : 0.0;
+        CopyAccount::instance().report(proc - d->copy_prev_frames, dt > 0 ? (proc - d->copy_prev_frames) / dt : 0.0);
+        d->copy_prev_frames = proc;
+        d->copy_prev_us = now;
+    }
+
     return TRUE;
 }
 
@@ -328,6 +354,8 @@ int main(int argc, char *argv[]) {
     gboolean use_h265 = FALSE;
     int bitrate_kbps = 20000; // Match basic.cpp default (20 Mbps)
     int num_workers = 2; // Default to 2 workers for better performance
+    int band_threads = 0;
+    gboolean copy_report = FALSE;
     
     for (int i=1;i<argc;++i){
         if (g_str_has_prefix(argv[i],"--codec=")) { const char* v=strchr(argv[i],'='); if(v&&g_ascii_strcasecmp(v+1,"h265")==0) use_h265=TRUE; }
@@ -336,12 +364,23 @@ int main(int argc, char *argv[]) {
         else if (g_strcmp0(argv[i],"--bitrate")==0 && i+1<argc){ int b=atoi(argv[i+1]); if(b>0) bitrate_kbps=b; }
         else if (g_str_has_prefix(argv[i],"--workers=")) { const char* v=strchr(argv[i],'='); if(v){ int w=atoi(v+1); if(w>0 && w<=8) num_workers=w; } }
         else if (g_strcmp0(argv[i],"--workers")==0 && i+1<argc){ int w=atoi(argv[i+1]); if(w>0 && w<=8) num_workers=w; }
+        else if (g_str_has_prefix(argv[i],"--band-threads=")) { int t=atoi(strchr(argv[i],'=')+1); if(t>=0 && t<=8) band_threads=t; }
+        else if (g_strcmp0(argv[i],"--copy-report")==0) { copy_report=TRUE; }
     }
     g_print("Encoder: %s, target-bitrate: %d kbps, workers: %d\n", use_h265 ? "H.265" : "H.264", bitrate_kbps, num_workers);
+    if (band_threads > 0) g_print("Equalize: %d band thread(s) per worker\n", band_threads);
+    else g_print("Equalize: cv::equalizeHist\n");
 
     CustomData d{};
     d.work_q = g_async_queue_new();
     d.num_workers = num_workers;
+    d.band_threads = band_threads;
+    if (copy_report) {
+        // Minimum: read the captured 1920x1080 Y plane once, write the NV12 output once
+        d.copy_report = true;
+        CopyAccount::instance().set_min_bytes_per_frame(1920 * 1080 + 1920 * 1080 * 3 / 2);
+        CopyAccount::instance().measure_bandwidth();
+    }
 
     // Capture pipeline (bump queue to 8 for smoothing)
     GError *err=NULL;
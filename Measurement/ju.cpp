@@ -4,6 +4,9 @@
 // Build:
 // g++ -O3 -DNDEBUG -std=c++17 relay_debug_nv12_worker_opencv.cpp -o relay_debug_worker_opencv \
 //   $(pkg-config --cflags --libs gstreamer-1.0 gstreamer-app-1.0 gstreamer-video-1.0 opencv4) -lpthread
+//
+// --copy-report accounts the Y clone, the Y copy-out and the UV fill (copy_account.h)
+// and reports traffic per frame against the minimum and the memcpy bandwidth.
 
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
@@ -17,16 +20,23 @@
 #include <stdio.h>
 #include <chrono>
 
+#include "thread_policy.h"
+#include "metrics.h"
+#include "copy_account.h"
+
 struct FrameRateCounters {
-    // Frame counters for rate calculation (reset every 2 seconds)
-    std::atomic<uint64_t> camera_frames{0};          // Frames captured from camera
-    std::atomic<uint64_t> opencv_input_frames{0};    // Frames sent to OpenCV processing  
-    std::atomic<uint64_t> opencv_output_frames{0};   // Frames processed by OpenCV
-    std::atomic<uint64_t> encoder_frames{0};         // Frames sent to encoder
+    MetricsRegistry reg{"ju"};
+
+    // Frame counters (rates come from reg.tick(), nothing is reset)
+    MetricCounter &camera_frames        = reg.counter("camera_frames_total", "Frames captured from camera");
+    MetricCounter &opencv_input_frames  = reg.counter("opencv_input_frames_total", "Frames sent to OpenCV processing");
+    MetricCounter &opencv_output_frames = reg.counter("opencv_output_frames_total", "Frames processed by OpenCV");
+    MetricCounter &encoder_frames       = reg.counter("encoder_frames_total", "Frames sent to encoder");
 
     // For error tracking
-    std::atomic<uint64_t> processing_errors{0};
-    std::atomic<uint64_t> push_failures{0};
+    MetricCounter &processing_errors    = reg.counter("processing_errors_total", "Processing errors");
+    MetricCounter &push_failures        = reg.counter("push_failures_total", "appsrc push failures");
+    MetricGauge &queue_length           = reg.gauge("queue_frames", "Frames waiting for a worker");
 };
 
 struct CustomData {
@@ -44,7 +54,12 @@ struct CustomData {
     int num_workers{1};
     GThread     **workers{nullptr};
 
+    ThreadPolicy threads;           // placement + per-thread CPU report
+
     FrameRateCounters ctr{};
+    MetricsExporter metrics{ctr.reg};
+    bool         copy_report{false};     // --copy-report
+    uint64_t     copy_prev_frames{0};    // status tick only
     GMainLoop   *loop{nullptr};
 };
 
@@ -53,7 +68,7 @@ struct CustomData {
 static GstPadProbeReturn probe_camera_output(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
     auto *d = (CustomData*)user_data;
     if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
-        d->ctr.camera_frames.fetch_add(1, std::memory_order_relaxed);
+        d->ctr.camera_frames.add();
     }
     return GST_PAD_PROBE_OK;
 }
@@ -61,7 +76,7 @@ static GstPadProbeReturn probe_camera_output(GstPad *pad, GstPadProbeInfo *info,
 static GstPadProbeReturn probe_encoder_input(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
     auto *d = (CustomData*)user_data;
     if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
-        d->ctr.encoder_frames.fetch_add(1, std::memory_order_relaxed);
+        d->ctr.encoder_frames.add();
     }
     return GST_PAD_PROBE_OK;
 }
@@ -87,7 +102,7 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
     }
 
     // Count frame sent to OpenCV processing
-    d->ctr.opencv_input_frames.fetch_add(1, std::memory_order_relaxed);
+    d->ctr.opencv_input_frames.add();
 
     // O(1): ref buffer, queue to worker, unref sample (returns one ref to pool)
     gst_buffer_ref(inbuf);
@@ -102,6 +117,12 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
 static gpointer worker_thread_fn(gpointer user_data) {
     auto *d = (CustomData*)user_data;
 
+    // Workers also push to appsrc, so they carry the worker role only
+    static std::atomic<int> next_id{0};
+    char thread_name[32];
+    snprintf(thread_name, sizeof(thread_name), "opencv-worker-%d", next_id.fetch_add(1));
+    d->threads.apply_current(ROLE_WORKER, thread_name);
+
     while (!d->stop.load(std::memory_order_acquire)) {
         // Pop with timeout to allow graceful exit
         gpointer item = g_async_queue_timeout_pop(d->work_q, 50 * G_TIME_SPAN_MILLISECOND);
@@ -114,7 +135,7 @@ static gpointer worker_thread_fn(gpointer user_data) {
             GstMapInfo map_info;
             if (!gst_buffer_map(inbuf, &map_info, GST_MAP_READ)) {
                 gst_buffer_unref(inbuf);
-                d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+                d->ctr.processing_errors.add();
                 continue;
             }
 
@@ -132,13 +153,13 @@ static gpointer worker_thread_fn(gpointer user_data) {
             if (map_info.size < y_size + uv_size) {
                 gst_buffer_unmap(inbuf, &map_info);
                 gst_buffer_unref(inbuf);
-                d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+                d->ctr.processing_errors.add();
                 continue;
             }
 
             // Extract Y plane from NV12 and apply histogram equalization (using clone as requested)
             cv::Mat nv12_input(height * 3 / 2, width, CV_8UC1, map_info.data);
-            cv::Mat y_plane_in = nv12_input(cv::Rect(0, 0, width, height)).clone();
+            cv::Mat y_plane_in = clone_acct(COPY_SITE("y_clone"), nv12_input(cv::Rect(0, 0, width, height)));
             cv::Mat y_plane_out(height, width, CV_8UC1);
 
             // Histogram Equalization on Y channel
@@ -149,7 +170,7 @@ static gpointer worker_thread_fn(gpointer user_data) {
             if (!outbuf) {
                 gst_buffer_unmap(inbuf, &map_info);
                 gst_buffer_unref(inbuf);
-                d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+                d->ctr.processing_errors.add();
                 continue;
             }
 
@@ -157,15 +178,15 @@ static gpointer worker_thread_fn(gpointer user_data) {
             GstMapInfo out_map_info;
             if (gst_buffer_map(outbuf, &out_map_info, GST_MAP_WRITE)) {
                 // Copy processed Y plane
-                memcpy(out_map_info.data, y_plane_out.data, y_size);
+                memcpy_acct(COPY_SITE("y_out"), out_map_info.data, y_plane_out.data, y_size);
                 // Fill UV with neutral value 128 (like basic.cpp)
-                memset(out_map_info.data + y_size, 128, uv_size);
+                memset_acct(COPY_SITE("uv_fill"), out_map_info.data + y_size, 128, uv_size);
                 gst_buffer_unmap(outbuf, &out_map_info);
             } else {
                 gst_buffer_unref(outbuf);
                 gst_buffer_unmap(inbuf, &map_info);
                 gst_buffer_unref(inbuf);
-                d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+                d->ctr.processing_errors.add();
                 continue;
             }
 
@@ -178,17 +199,17 @@ static gpointer worker_thread_fn(gpointer user_data) {
             GST_BUFFER_DURATION(outbuf) = GST_CLOCK_TIME_NONE;
 
             // Count frame processed by OpenCV
-            d->ctr.opencv_output_frames.fetch_add(1, std::memory_order_relaxed);
+            d->ctr.opencv_output_frames.add();
 
             GstFlowReturn ret = gst_app_src_push_buffer(GST_APP_SRC(d->appsrc), outbuf);
             if (ret != GST_FLOW_OK) {
-                d->ctr.push_failures.fetch_add(1, std::memory_order_relaxed);
+                d->ctr.push_failures.add();
                 gst_buffer_unref(outbuf);
             }
 
         } catch (const std::exception& e) {
             gst_buffer_unref(inbuf);
-            d->ctr.processing_errors.fetch_add(1, std::memory_order_relaxed);
+            d->ctr.processing_errors.add();
             g_printerr("OpenCV error: %s\n", e.what());
         }
     }
@@ -200,35 +221,35 @@ static gpointer worker_thread_fn(gpointer user_data) {
 static gboolean framerate_status_tick(gpointer user_data) {
     auto *d = (CustomData*)user_data;
 
-    // Get current counts
-    uint64_t camera_fps = d->ctr.camera_frames.load();
-    uint64_t opencv_input_fps = d->ctr.opencv_input_frames.load();
-    uint64_t opencv_output_fps = d->ctr.opencv_output_frames.load();
-    uint64_t encoder_fps = d->ctr.encoder_frames.load();
-    
-    uint64_t processing_errors = d->ctr.processing_errors.load();
-    uint64_t push_failures = d->ctr.push_failures.load();
+    uint64_t processing_errors = d->ctr.processing_errors.value();
+    uint64_t push_failures = d->ctr.push_failures.value();
     int queue_length = g_async_queue_length(d->work_q);
+    d->ctr.queue_length.set(queue_length);
 
-    // Reset counters for next interval (divide by 2 since we're measuring over 2 seconds)
-    d->ctr.camera_frames.store(0);
-    d->ctr.opencv_input_frames.store(0);
-    d->ctr.opencv_output_frames.store(0);
-    d->ctr.encoder_frames.store(0);
+    // Rates over the measured interval
+    const double interval_s = d->ctr.reg.tick();
 
     g_print(
-        "\n=== FRAME RATE STATUS (2s interval) ===\n"
+        "\n=== FRAME RATE STATUS (%.2fs interval) ===\n"
         "Camera capture rate:     %.1f fps\n"
         "OpenCV input rate:       %.1f fps\n"
         "OpenCV output rate:      %.1f fps\n"
         "Encoder input rate:      %.1f fps\n"
         "Queue length: %d | Processing errors: %" G_GUINT64_FORMAT " | Push failures: %" G_GUINT64_FORMAT "\n",
-        camera_fps / 2.0,
-        opencv_input_fps / 2.0,
-        opencv_output_fps / 2.0,
-        encoder_fps / 2.0,
+        interval_s,
+        d->ctr.camera_frames.rate(),
+        d->ctr.opencv_input_frames.rate(),
+        d->ctr.opencv_output_frames.rate(),
+        d->ctr.encoder_frames.rate(),
         queue_length, processing_errors, push_failures
     );
+    if (d->copy_report) {
+        const uint64_t frames = d->ctr.opencv_output_frames.value();
+        CopyAccount::instance().report(frames - d->copy_prev_frames, d->ctr.opencv_output_frames.rate());
+        d->copy_prev_frames = frames;
+    }
+    d->threads.report();
+    d->metrics.write_json();
 
     return TRUE;
 }
@@ -264,6 +285,9 @@ int main(int argc, char *argv[]) {
     int num_workers = 2; // Default to 2 workers for better performance
 
     int v_width = 1920, v_height = 1080, fps = 60; // defaults
+    const char *thread_spec = NULL;
+    const char *metrics_json = NULL, *metrics_listen = NULL;
+    gboolean copy_report = FALSE;
 
     // --- extend argv parsing with width/height/fps ---
     for (int i=1;i<argc;++i){
@@ -279,6 +303,10 @@ int main(int argc, char *argv[]) {
         else if (g_strcmp0(argv[i],"--height")==0 && i+1<argc){ int h=atoi(argv[i+1]); if(h>0) v_height=h; }
         else if (g_str_has_prefix(argv[i],"--fps=")) { const char* v=strchr(argv[i],'='); if(v){ int f=atoi(v+1); if(f>0) fps=f; } }
         else if (g_strcmp0(argv[i],"--fps")==0 && i+1<argc){ int f=atoi(argv[i+1]); if(f>0) fps=f; }
+        else if (g_str_has_prefix(argv[i],"--thread-policy=")) { thread_spec=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--metrics-json=")) { metrics_json=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--metrics-port=")) { metrics_listen=strchr(argv[i],'=')+1; }
+        else if (g_strcmp0(argv[i],"--copy-report")==0) { copy_report=TRUE; }
     }
     g_print("Encoder: %s, target-bitrate: %d kbps, workers: %d, %dx%d@%dfps\n",
             use_h265 ? "H.265" : "H.264", bitrate_kbps, num_workers, v_width, v_height, fps);
@@ -286,6 +314,21 @@ int main(int argc, char *argv[]) {
     CustomData d{};
     d.work_q = g_async_queue_new();
     d.num_workers = num_workers;
+    if (metrics_json && !d.metrics.open_json(metrics_json)) return -1;
+    if (metrics_listen && !d.metrics.serve(metrics_listen)) return -1;
+    if (copy_report) {
+        // Minimum: read the captured Y plane once, write the NV12 output once
+        const uint64_t y_size = (uint64_t)v_width * v_height;
+        d.copy_report = true;
+        CopyAccount::instance().set_min_bytes_per_frame(y_size + y_size * 3 / 2);
+        CopyAccount::instance().measure_bandwidth();
+    }
+    if (thread_spec) {
+        if (!d.threads.parse(thread_spec)) return -1;
+        d.threads.print_config();
+        // equalizeHist runs its own parallel_for_ on this pool
+        if (d.threads.opencv_threads() >= 0) cv::setNumThreads(d.threads.opencv_threads());
+    }
 
     // Capture pipeline (bump queue to 8 for smoothing; add videorate dropper)
     GError *err=NULL;
@@ -390,6 +433,15 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // Streaming threads are placed as they start (sync handler on both buses)
+    d.threads.bind("v4l2src", ROLE_CAPTURE);
+    d.threads.bind("q_cam", ROLE_APPSINK);       // runs new_sample_cb
+    d.threads.bind("my_src", ROLE_PUSH);
+    d.threads.bind("q_after_src", ROLE_ENCODER); // feeds the encoder
+    d.threads.bind("enc", ROLE_ENCODER);
+    d.threads.attach(sink_pipe);
+    d.threads.attach(src_pipe);
+
     // Callback + workers
     g_signal_connect(d.appsink, "new-sample", G_CALLBACK(new_sample_cb), &d);
 
@@ -413,6 +465,8 @@ int main(int argc, char *argv[]) {
     gst_element_set_state(src_pipe,  GST_STATE_PLAYING);
     gst_element_set_state(sink_pipe, GST_STATE_PLAYING);
     g_print("OpenCV histogram equalization pipeline started. Press Ctrl+C to exit.\n");
+    // Placed last so threads created above don't inherit the main loop's mask
+    d.threads.apply_current(ROLE_MAIN, "main-loop");
     g_main_loop_run(d.loop);
 
     // Shutdown
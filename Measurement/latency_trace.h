@@ -0,0 +1,213 @@
+// latency_trace.h
+// Capture-to-network latency per frame, split by stage.
+//
+// The capture probe attaches a GstReferenceTimestampMeta (reference caps
+// "timestamp/x-latency-trace") holding the monotonic capture time. The meta is independent
+// of PTS, so it survives bridges that clear or regenerate timestamps. The bridge copies it
+// onto its output buffer (carry()). GstVideoEncoder and the RTP payloaders copy untagged
+// metas onto their output, so the encoder and payloader probes still see it.
+//
+// Trace points, in pipeline order:
+//   capture    v4l2src output (attaches the meta; with set_capture_clock() also records
+//              sensor -> v4l2src, i.e. running time now minus the driver's PTS)
+//   appsink    capture queue drained into the bridge
+//   processed  bridge output, right before appsrc (mark() from code)
+//   encoder    encoder sink pad (appsrc queue + encoder input queue behind it)
+//   payloader  payloader sink pad (encode + parse)
+//   udpsink    udpsink sink pad (payloading)
+// Each point records two histograms in the metrics registry: the time since capture
+// (<point>_since_capture_us) and the time since the previous point the frame passed
+// (<point>_stage_us). The meta's duration field carries the elapsed time at the
+// previous point. A point records a frame once, even when it is split into a
+// buffer list of RTP packets or repeated by a pacer.
+
+#ifndef _LATENCY_TRACE_H_
+#define _LATENCY_TRACE_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "metrics.h"
+
+enum TracePoint {
+    TRACE_CAPTURE = 0,
+    TRACE_APPSINK,
+    TRACE_PROCESSED,
+    TRACE_ENCODER,
+    TRACE_PAYLOADER,
+    TRACE_UDPSINK,
+    TRACE_POINTS
+};
+
+static inline const char *trace_point_name(TracePoint p) {
+    static const char *names[TRACE_POINTS] = {"capture", "appsink", "processed", "encoder", "payloader", "udpsink"};
+    return (p >= 0 && p < TRACE_POINTS) ? names[p] : "?";
+}
+
+class LatencyTrace {
+public:
+    LatencyTrace() = default;
+    LatencyTrace(const LatencyTrace &) = delete;
+    LatencyTrace &operator=(const LatencyTrace &) = delete;
+    ~LatencyTrace() {
+        if (ref_caps_) gst_caps_unref(ref_caps_);
+        if (clock_) gst_object_unref(clock_);
+    }
+
+    // Off until enabled; registers the histograms in reg
+    void enable(MetricsRegistry &reg) {
+        if (enabled_) return;
+        ref_caps_ = gst_caps_new_empty_simple("timestamp/x-latency-trace");
+        sensor_us_ = &reg.histogram("sensor_to_capture_us", "Driver timestamp to v4l2src output");
+        untraced_ = &reg.counter("trace_untraced_total", "Buffers reaching a trace point without the capture meta");
+        for (int p = 0; p < TRACE_POINTS; ++p) {
+            char name[64];
+            hooks_[p].trace = this;
+            hooks_[p].point = (TracePoint)p;
+            snprintf(name, sizeof(name), "%s_since_capture_us", trace_point_name((TracePoint)p));
+            since_[p] = &reg.histogram(name, "Capture to this trace point");
+            snprintf(name, sizeof(name), "%s_stage_us", trace_point_name((TracePoint)p));
+            stage_[p] = &reg.histogram(name, "Previous trace point to this one");
+        }
+        enabled_ = true;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    // Optional: capture pipeline (PLAYING) whose clock the v4l2src PTS refer to
+    void set_capture_clock(GstElement *pipeline) {
+        if (!enabled_ || clock_) return;
+        GstClock *clock = gst_element_get_clock(pipeline);
+        if (!clock) return;
+        base_time_ = gst_element_get_base_time(pipeline);
+        clock_ = clock;
+    }
+
+    // Probe on a pad of the named element ("src"/"sink"); capture probes must be the
+    // first trace point, on v4l2src's src pad or any pad right after it
+    bool add_probe(GstElement *pipeline, const char *element, const char *pad_name, TracePoint p) {
+        if (!enabled_) return false;
+        GstElement *e = gst_bin_get_by_name(GST_BIN(pipeline), element);
+        if (!e) {
+            g_printerr("Latency trace: no element '%s' for point %s\n", element, trace_point_name(p));
+            return false;
+        }
+        GstPad *pad = gst_element_get_static_pad(e, pad_name);
+        gst_object_unref(e);
+        if (!pad) return false;
+        gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                          p == TRACE_CAPTURE ? probe_capture : probe_point, &hooks_[p], NULL);
+        gst_object_unref(pad);
+        return true;
+    }
+
+    // Copy the capture meta from a bridge's input buffer to its (writable) output buffer
+    void carry(GstBuffer *from, GstBuffer *to) const {
+        if (!enabled_) return;
+        GstReferenceTimestampMeta *m = gst_buffer_get_reference_timestamp_meta(from, ref_caps_);
+        if (m) gst_buffer_add_reference_timestamp_meta(to, ref_caps_, m->timestamp, m->duration);
+    }
+
+    // Trace point reached by code rather than a probe (TRACE_PROCESSED)
+    void mark(TracePoint p, GstBuffer *buf) {
+        if (enabled_) record(p, buf);
+    }
+
+    void report() const {
+        if (!enabled_) return;
+        g_print("Latency trace (interval, ms)     since capture: p50    p99    max |  stage: p50    p99    max\n");
+        if (clock_) {
+            const MetricHistogram::Summary &s = sensor_us_->interval();
+            g_print("  %-10s n=%-6" G_GUINT64_FORMAT "              %6.2f %6.2f %6.2f |\n", "sensor", s.count,
+                    s.p50_us / 1000.0, s.p99_us / 1000.0, s.max_us / 1000.0);
+        }
+        for (int p = 0; p < TRACE_POINTS; ++p) {
+            const MetricHistogram::Summary &a = since_[p]->interval();
+            const MetricHistogram::Summary &b = stage_[p]->interval();
+            g_print("  %-10s n=%-6" G_GUINT64_FORMAT "              %6.2f %6.2f %6.2f |         %6.2f %6.2f %6.2f\n",
+                    trace_point_name((TracePoint)p), a.count, a.p50_us / 1000.0, a.p99_us / 1000.0,
+                    a.max_us / 1000.0, b.p50_us / 1000.0, b.p99_us / 1000.0, b.max_us / 1000.0);
+        }
+        if (untraced_->value()) g_print("  untraced buffers: %" G_GUINT64_FORMAT "\n", untraced_->value());
+    }
+
+private:
+    struct Hook {
+        LatencyTrace *trace;
+        TracePoint point;
+    };
+
+    static GstClockTime now_ns() { return (GstClockTime)g_get_monotonic_time() * 1000; }
+
+    static GstPadProbeReturn probe_capture(GstPad *, GstPadProbeInfo *info, gpointer user_data) {
+        auto *h = (Hook *)user_data;
+        if (!(GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) || !GST_PAD_PROBE_INFO_BUFFER(info)) {
+            return GST_PAD_PROBE_OK;
+        }
+        // Shallow copy at most (metadata only, the dmabuf memory is shared)
+        GstBuffer *buf = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+        GST_PAD_PROBE_INFO_DATA(info) = buf;
+        h->trace->stamp(buf);
+        return GST_PAD_PROBE_OK;
+    }
+
+    static GstPadProbeReturn probe_point(GstPad *, GstPadProbeInfo *info, gpointer user_data) {
+        auto *h = (Hook *)user_data;
+        GstBuffer *buf = nullptr;
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+            buf = GST_PAD_PROBE_INFO_BUFFER(info);
+        } else if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+            GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+            if (list && gst_buffer_list_length(list) > 0) buf = gst_buffer_list_get(list, 0);
+        }
+        if (buf) h->trace->record(h->point, buf);
+        return GST_PAD_PROBE_OK;
+    }
+
+    void stamp(GstBuffer *buf) {
+        const GstClockTime now = now_ns();
+        gst_buffer_add_reference_timestamp_meta(buf, ref_caps_, now, 0);
+        last_ts_[TRACE_CAPTURE] = now;
+        since_[TRACE_CAPTURE]->record(0);
+        stage_[TRACE_CAPTURE]->record(0);
+        if (clock_ && GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buf))) {
+            const GstClockTime running = gst_clock_get_time(clock_) - base_time_;
+            if (running >= GST_BUFFER_PTS(buf)) sensor_us_->record((int64_t)((running - GST_BUFFER_PTS(buf)) / 1000));
+        }
+    }
+
+    // Called from the streaming thread of one pad per point: last_ts_[p] needs no lock
+    void record(TracePoint p, GstBuffer *buf) {
+        GstReferenceTimestampMeta *m = gst_buffer_get_reference_timestamp_meta(buf, ref_caps_);
+        if (!m) {
+            untraced_->add();
+            return;
+        }
+        if (m->timestamp == last_ts_[p]) return;     // same frame again (RTP packets, repeats)
+        last_ts_[p] = m->timestamp;
+
+        const GstClockTime now = now_ns();
+        const GstClockTime elapsed = now > m->timestamp ? now - m->timestamp : 0;
+        const GstClockTime prev = GST_CLOCK_TIME_IS_VALID(m->duration) ? m->duration : 0;
+        since_[p]->record((int64_t)(elapsed / 1000));
+        stage_[p]->record((int64_t)((elapsed > prev ? elapsed - prev : 0) / 1000));
+        m->duration = elapsed;
+    }
+
+    bool enabled_{false};
+    GstCaps *ref_caps_{nullptr};
+    GstClock *clock_{nullptr};
+    GstClockTime base_time_{0};
+    Hook hooks_[TRACE_POINTS]{};
+    GstClockTime last_ts_[TRACE_POINTS]{};
+
+    MetricHistogram *since_[TRACE_POINTS]{};
+    MetricHistogram *stage_[TRACE_POINTS]{};
+    MetricHistogram *sensor_us_{nullptr};
+    MetricCounter *untraced_{nullptr};
+};
+
+#endif
+// _LATENCY_TRACE_H_
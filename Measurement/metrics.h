@@ -0,0 +1,481 @@
+// metrics.h
+// One metrics registry for the bridges: counters, gauges and latency histograms, plus an
+// exporter that appends JSON lines to a file and serves Prometheus text over HTTP.
+//
+// Hot path (any thread, no mutex):
+//   MetricCounter::add()      sharded: each thread adds into its own cache line
+//   MetricGauge::set()/add()  one atomic
+//   MetricHistogram::record() log-linear buckets (HDR style: 8 linear sub-buckets per
+//                             power of two, <= 12.5% relative error), relaxed atomics
+// Registration (counter()/gauge()/histogram()) takes a mutex and belongs at startup;
+// the returned references stay valid for the lifetime of the registry.
+//
+// Intervals: tick() closes one reporting interval on the measured wall time (not an
+// assumed timer period) and computes per-counter rates and per-interval histogram
+// percentiles. Call it from one thread only (the status tick); rate() and interval()
+// read what the last tick() left.
+//
+// MetricsExporter:
+//   open_json(path)   write_json() appends one line per interval:
+//                     {"ts_us":..,"interval_s":..,"counters":{"n":{"total":..,"rate":..}},
+//                      "gauges":{..},"histograms_us":{"n":{"count":..,"p50":..,...}}}
+//   serve("[addr:]port")  Prometheus text exposition on http://addr:port/metrics
+//                     (addr defaults to 127.0.0.1), answered from its own thread
+//                     straight off the atomics, so scrapes never wait for the main loop.
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define METRICS_SHARDS 16
+
+// Shard of the calling thread, assigned round-robin on first use
+static inline unsigned metrics_shard() {
+    static std::atomic<unsigned> next{0};
+    thread_local unsigned shard = next.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+    return shard;
+}
+
+/* ---------- Counter ---------- */
+
+class MetricCounter {
+public:
+    MetricCounter(const std::string &name, const std::string &help) : name_(name), help_(help) {}
+
+    void add(uint64_t n = 1) { shards_[metrics_shard()].v.fetch_add(n, std::memory_order_relaxed); }
+
+    uint64_t value() const {
+        uint64_t sum = 0;
+        for (const Shard &s : shards_) sum += s.v.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    // Per second over the last closed interval
+    double rate() const { return rate_; }
+    const std::string &name() const { return name_; }
+    const std::string &help() const { return help_; }
+
+    void tick(double interval_s) {
+        const uint64_t now = value();
+        rate_ = interval_s > 0.0 ? (double)(now - prev_) / interval_s : 0.0;
+        prev_ = now;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> v{0};
+    };
+    Shard shards_[METRICS_SHARDS];
+    std::string name_, help_;
+    uint64_t prev_{0};      // tick thread only
+    double rate_{0.0};
+};
+
+/* ---------- Gauge ---------- */
+
+class MetricGauge {
+public:
+    MetricGauge(const std::string &name, const std::string &help) : name_(name), help_(help) {}
+
+    void set(int64_t v) { v_.store(v, std::memory_order_relaxed); }
+    void add(int64_t d) { v_.fetch_add(d, std::memory_order_relaxed); }
+    int64_t value() const { return v_.load(std::memory_order_relaxed); }
+    const std::string &name() const { return name_; }
+    const std::string &help() const { return help_; }
+
+private:
+    std::atomic<int64_t> v_{0};
+    std::string name_, help_;
+};
+
+/* ---------- Latency histogram ---------- */
+
+// Values in microseconds, 0 .. 2^36 us; larger values land in the last bucket
+class MetricHistogram {
+public:
+    static const int SUB_BITS = 3;
+    static const int SUB = 1 << SUB_BITS;
+    static const int MAX_EXP = 36;
+    static const int BUCKETS = (MAX_EXP - SUB_BITS + 1) * SUB;
+
+    // Percentiles of one set of bucket counts
+    struct Summary {
+        uint64_t count{0};
+        double mean_us{0.0};
+        uint64_t p50_us{0}, p90_us{0}, p99_us{0}, p999_us{0}, max_us{0};
+    };
+
+    MetricHistogram(const std::string &name, const std::string &help)
+        : name_(name), help_(help), prev_(BUCKETS, 0) {}
+
+    void record(int64_t us) {
+        const uint64_t v = us > 0 ? (uint64_t)us : 0;
+        buckets_[bucket_of(v)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_us_.fetch_add(v, std::memory_order_relaxed);
+        uint64_t prev = max_us_.load(std::memory_order_relaxed);
+        while (v > prev && !max_us_.compare_exchange_weak(prev, v)) {}
+    }
+
+    static int bucket_of(uint64_t v) {
+        if (v < (uint64_t)SUB) return (int)v;
+        const int e = 63 - __builtin_clzll(v);          // v in [2^e, 2^(e+1))
+        if (e >= MAX_EXP) return BUCKETS - 1;
+        return (e - SUB_BITS + 1) * SUB + (int)((v >> (e - SUB_BITS)) & (SUB - 1));
+    }
+    static uint64_t bucket_low(int b) {
+        if (b < SUB) return (uint64_t)b;
+        const int e = b / SUB + SUB_BITS - 1;
+        return (uint64_t)(SUB + b % SUB) << (e - SUB_BITS);
+    }
+    static uint64_t bucket_high(int b) {                // exclusive
+        if (b < SUB) return (uint64_t)b + 1;
+        const int e = b / SUB + SUB_BITS - 1;
+        return bucket_low(b) + ((uint64_t)1 << (e - SUB_BITS));
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max_us() const { return max_us_.load(std::memory_order_relaxed); }
+    uint64_t sum_us() const { return sum_us_.load(std::memory_order_relaxed); }
+    double mean_us() const {
+        const uint64_t n = count();
+        return n ? (double)sum_us() / (double)n : 0.0;
+    }
+    uint64_t bucket(int b) const { return buckets_[b].load(std::memory_order_relaxed); }
+    const std::string &name() const { return name_; }
+    const std::string &help() const { return help_; }
+
+    // Since start
+    Summary total() const {
+        std::vector<uint64_t> counts(BUCKETS);
+        for (int b = 0; b < BUCKETS; ++b) counts[b] = bucket(b);
+        return summarize(counts, sum_us(), max_us());
+    }
+
+    // Last closed interval (max is the bucket bound, the exact max is only kept overall)
+    const Summary &interval() const { return interval_; }
+
+    void tick() {
+        std::vector<uint64_t> counts(BUCKETS);
+        for (int b = 0; b < BUCKETS; ++b) {
+            const uint64_t now = bucket(b);
+            counts[b] = now - prev_[b];
+            prev_[b] = now;
+        }
+        const uint64_t sum = sum_us();
+        interval_ = summarize(counts, sum - prev_sum_, 0);
+        prev_sum_ = sum;
+    }
+
+private:
+    static Summary summarize(const std::vector<uint64_t> &counts, uint64_t sum_us, uint64_t max_us) {
+        Summary s;
+        int top = -1;
+        for (int b = 0; b < BUCKETS; ++b) {
+            s.count += counts[b];
+            if (counts[b]) top = b;
+        }
+        if (!s.count) return s;
+        s.mean_us = (double)sum_us / (double)s.count;
+        s.p50_us = percentile(counts, s.count, 0.50);
+        s.p90_us = percentile(counts, s.count, 0.90);
+        s.p99_us = percentile(counts, s.count, 0.99);
+        s.p999_us = percentile(counts, s.count, 0.999);
+        s.max_us = max_us ? max_us : bucket_high(top) - 1;
+        return s;
+    }
+
+    // Upper bound of the bucket holding the q-quantile
+    static uint64_t percentile(const std::vector<uint64_t> &counts, uint64_t total, double q) {
+        const uint64_t rank = (uint64_t)(q * (double)total + 0.5);
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            seen += counts[b];
+            if (seen >= rank && seen > 0) return bucket_high(b) - 1;
+        }
+        return bucket_high(BUCKETS - 1) - 1;
+    }
+
+    std::atomic<uint64_t> buckets_[BUCKETS]{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_us_{0};
+    std::atomic<uint64_t> max_us_{0};
+    std::string name_, help_;
+
+    std::vector<uint64_t> prev_;    // tick thread only
+    uint64_t prev_sum_{0};
+    Summary interval_;
+};
+
+/* ---------- Registry ---------- */
+
+class MetricsRegistry {
+public:
+    // prefix: prepended to every exported name ("home" -> home_camera_frames_total)
+    explicit MetricsRegistry(const char *prefix) : prefix_(prefix ? prefix : "") {
+        last_tick_us_ = start_us_ = g_get_monotonic_time();
+    }
+    MetricsRegistry(const MetricsRegistry &) = delete;
+    MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+
+    MetricCounter &counter(const char *name, const char *help) {
+        std::lock_guard<std::mutex> lock(mu_);
+        counters_.emplace_back(new MetricCounter(full_name(name), help));
+        return *counters_.back();
+    }
+    MetricGauge &gauge(const char *name, const char *help) {
+        std::lock_guard<std::mutex> lock(mu_);
+        gauges_.emplace_back(new MetricGauge(full_name(name), help));
+        return *gauges_.back();
+    }
+    MetricHistogram &histogram(const char *name, const char *help) {
+        std::lock_guard<std::mutex> lock(mu_);
+        histograms_.emplace_back(new MetricHistogram(full_name(name), help));
+        return *histograms_.back();
+    }
+
+    // Close the current interval; returns its measured length in seconds
+    double tick() {
+        const int64_t now = g_get_monotonic_time();
+        interval_s_ = (double)(now - last_tick_us_) / 1e6;
+        last_tick_us_ = now;
+        std::lock_guard<std::mutex> lock(mu_);
+        for (auto &c : counters_) c->tick(interval_s_);
+        for (auto &h : histograms_) h->tick();
+        return interval_s_;
+    }
+
+    double interval_s() const { return interval_s_; }
+    double uptime_s() const { return (double)(g_get_monotonic_time() - start_us_) / 1e6; }
+
+    // Visit everything registered (exporter side)
+    template <typename C, typename G, typename H>
+    void for_each(C on_counter, G on_gauge, H on_histogram) const {
+        std::lock_guard<std::mutex> lock(mu_);
+        for (const auto &c : counters_) on_counter(*c);
+        for (const auto &g : gauges_) on_gauge(*g);
+        for (const auto &h : histograms_) on_histogram(*h);
+    }
+
+private:
+    std::string full_name(const char *name) const { return prefix_.empty() ? name : prefix_ + "_" + name; }
+
+    std::string prefix_;
+    mutable std::mutex mu_;
+    std::vector<std::unique_ptr<MetricCounter>> counters_;
+    std::vector<std::unique_ptr<MetricGauge>> gauges_;
+    std::vector<std::unique_ptr<MetricHistogram>> histograms_;
+    int64_t start_us_{0};
+    int64_t last_tick_us_{0};
+    double interval_s_{0.0};
+};
+
+/* ---------- Exporter ---------- */
+
+class MetricsExporter {
+public:
+    explicit MetricsExporter(const MetricsRegistry &reg) : reg_(reg) {}
+    MetricsExporter(const MetricsExporter &) = delete;
+    MetricsExporter &operator=(const MetricsExporter &) = delete;
+    ~MetricsExporter() {
+        stop_serving();
+        if (json_) fclose(json_);
+    }
+
+    bool open_json(const char *path) {
+        json_ = fopen(path, "a");
+        if (!json_) {
+            g_printerr("Metrics: cannot open %s for writing\n", path);
+            return false;
+        }
+        g_print("Metrics: JSON lines -> %s\n", path);
+        return true;
+    }
+
+    // One line for the interval the registry last closed; call right after tick()
+    void write_json() {
+        if (!json_) return;
+        std::string s;
+        char tmp[256];
+        snprintf(tmp, sizeof(tmp), "{\"ts_us\":%" G_GINT64_FORMAT ",\"uptime_s\":%.3f,\"interval_s\":%.3f",
+                 g_get_real_time(), reg_.uptime_s(), reg_.interval_s());
+        s += tmp;
+        std::string counters, gauges, histograms;
+        reg_.for_each(
+            [&](const MetricCounter &c) {
+                snprintf(tmp, sizeof(tmp), "%s\"%s\":{\"total\":%" G_GUINT64_FORMAT ",\"rate\":%.3f}",
+                         counters.empty() ? "" : ",", c.name().c_str(), c.value(), c.rate());
+                counters += tmp;
+            },
+            [&](const MetricGauge &g) {
+                snprintf(tmp, sizeof(tmp), "%s\"%s\":%" G_GINT64_FORMAT, gauges.empty() ? "" : ",",
+                         g.name().c_str(), g.value());
+                gauges += tmp;
+            },
+            [&](const MetricHistogram &h) {
+                const MetricHistogram::Summary &i = h.interval();
+                snprintf(tmp, sizeof(tmp),
+                         "%s\"%s\":{\"total\":%" G_GUINT64_FORMAT ",\"count\":%" G_GUINT64_FORMAT
+                         ",\"mean\":%.1f,\"p50\":%" G_GUINT64_FORMAT ",\"p90\":%" G_GUINT64_FORMAT
+                         ",\"p99\":%" G_GUINT64_FORMAT ",\"p999\":%" G_GUINT64_FORMAT ",\"max\":%" G_GUINT64_FORMAT "}",
+                         histograms.empty() ? "" : ",", h.name().c_str(), h.count(), i.count, i.mean_us, i.p50_us,
+                         i.p90_us, i.p99_us, i.p999_us, i.max_us);
+                histograms += tmp;
+            });
+        s += ",\"counters\":{" + counters + "},\"gauges\":{" + gauges + "},\"histograms_us\":{" + histograms + "}}\n";
+        fputs(s.c_str(), json_);
+        fflush(json_);
+    }
+
+    // Prometheus text exposition format 0.0.4
+    std::string prometheus_text() const {
+        std::string s;
+        char tmp[256];
+        reg_.for_each(
+            [&](const MetricCounter &c) {
+                s += "# HELP " + c.name() + " " + c.help() + "\n# TYPE " + c.name() + " counter\n";
+                snprintf(tmp, sizeof(tmp), "%s %" G_GUINT64_FORMAT "\n", c.name().c_str(), c.value());
+                s += tmp;
+            },
+            [&](const MetricGauge &g) {
+                s += "# HELP " + g.name() + " " + g.help() + "\n# TYPE " + g.name() + " gauge\n";
+                snprintf(tmp, sizeof(tmp), "%s %" G_GINT64_FORMAT "\n", g.name().c_str(), g.value());
+                s += tmp;
+            },
+            [&](const MetricHistogram &h) {
+                s += "# HELP " + h.name() + " " + h.help() + " (microseconds)\n# TYPE " + h.name() + " histogram\n";
+                // Cumulative buckets at power-of-two bounds; the fine buckets stay internal.
+                // le is inclusive and samples are whole microseconds: everything below 2^e
+                // is exactly le="2^e - 1".
+                uint64_t cum = 0;
+                int b = 0;
+                for (int e = 0; e <= MetricHistogram::MAX_EXP; ++e) {
+                    const uint64_t bound = (uint64_t)1 << e;
+                    while (b < MetricHistogram::BUCKETS && MetricHistogram::bucket_high(b) <= bound) cum += h.bucket(b++);
+                    snprintf(tmp, sizeof(tmp), "%s_bucket{le=\"%" G_GUINT64_FORMAT "\"} %" G_GUINT64_FORMAT "\n",
+                             h.name().c_str(), bound - 1, cum);
+                    s += tmp;
+                }
+                while (b < MetricHistogram::BUCKETS) cum += h.bucket(b++);
+                snprintf(tmp, sizeof(tmp),
+                         "%s_bucket{le=\"+Inf\"} %" G_GUINT64_FORMAT "\n%s_sum %" G_GUINT64_FORMAT
+                         "\n%s_count %" G_GUINT64_FORMAT "\n",
+                         h.name().c_str(), cum, h.name().c_str(), h.sum_us(), h.name().c_str(), cum);
+                s += tmp;
+            });
+        return s;
+    }
+
+    // spec: "port" or "addr:port"
+    bool serve(const char *spec) {
+        std::string addr = "127.0.0.1";
+        const char *colon = strrchr(spec, ':');
+        const int port = atoi(colon ? colon + 1 : spec);
+        if (colon) addr.assign(spec, colon - spec);
+        if (port <= 0 || port > 65535) {
+            g_printerr("Metrics: bad listen address '%s' (expected [addr:]port)\n", spec);
+            return false;
+        }
+
+        struct sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons((uint16_t)port);
+        if (inet_pton(AF_INET, addr.c_str(), &sa.sin_addr) != 1) {
+            g_printerr("Metrics: bad listen address '%s'\n", addr.c_str());
+            return false;
+        }
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (listen_fd_ < 0 || bind(listen_fd_, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(listen_fd_, 4) != 0) {
+            g_printerr("Metrics: cannot listen on %s:%d\n", addr.c_str(), port);
+            if (listen_fd_ >= 0) close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+        stop_.store(false, std::memory_order_release);
+        server_ = std::thread(&MetricsExporter::serve_loop, this);
+        g_print("Metrics: Prometheus endpoint http://%s:%d/metrics\n", addr.c_str(), port);
+        return true;
+    }
+
+    void stop_serving() {
+        if (!server_.joinable()) return;
+        stop_.store(true, std::memory_order_release);
+        server_.join();
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+
+private:
+    void serve_loop() {
+        while (!stop_.load(std::memory_order_acquire)) {
+            struct pollfd pfd = {listen_fd_, POLLIN, 0};
+            if (poll(&pfd, 1, 250) <= 0) continue;     // timeout: re-check stop_
+            const int fd = accept(listen_fd_, NULL, NULL);
+            if (fd < 0) continue;
+            answer(fd);
+            close(fd);
+        }
+    }
+
+    void answer(int fd) {
+        struct timeval tv = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char req[1024];
+        const ssize_t n = recv(fd, req, sizeof(req) - 1, 0);
+        if (n <= 0) return;
+        req[n] = '\0';
+
+        std::string body, status = "200 OK", type = "text/plain; version=0.0.4";
+        if (strncmp(req, "GET /metrics", 12) == 0 || strncmp(req, "GET / ", 6) == 0) {
+            body = prometheus_text();
+        } else {
+            status = "404 Not Found";
+            type = "text/plain";
+            body = "try /metrics\n";
+        }
+        char head[256];
+        const int hl = snprintf(head, sizeof(head),
+                                "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                                status.c_str(), type.c_str(), body.size());
+        send_all(fd, head, (size_t)hl);
+        send_all(fd, body.data(), body.size());
+    }
+
+    static void send_all(int fd, const char *p, size_t len) {
+        while (len > 0) {
+            const ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+            if (n <= 0) return;
+            p += n;
+            len -= (size_t)n;
+        }
+    }
+
+    const MetricsRegistry &reg_;
+    FILE *json_{nullptr};
+    int listen_fd_{-1};
+    std::thread server_;
+    std::atomic<bool> stop_{false};
+};
+
+#endif
+// _METRICS_H_
@@ -0,0 +1,166 @@
+// overload_policy.h
+// What to do with a new frame when processing falls behind.
+//
+// Load is sampled once per incoming frame (e.g. input ring occupancy, 0..1). The policy
+// is either NORMAL or OVERLOADED, with hysteresis:
+//   NORMAL -> OVERLOADED  load >= enter_load for enter_frames frames in a row
+//   OVERLOADED -> NORMAL  load <= exit_load  for exit_frames frames in a row
+// While overloaded every frame gets the configured mode's action:
+//   drop-oldest   evict queued frames down to the exit level, then queue this one
+//                 (lowest latency, the freshest frame wins)
+//   drop-newest   don't queue this frame; finish what is already queued
+//   passthrough   send the input buffer on unprocessed (a ref, no copy), so the encoder
+//                 keeps the full frame rate
+//   reduced       queue it, but process it with ReducedEqualizer (sampled histogram,
+//                 LUT reused for a few frames) instead of the full path
+// Every decision is counted.
+//
+// decide() is called from one thread (the appsink callback); counters may be read
+// from anywhere.
+
+#ifndef _OVERLOAD_POLICY_H_
+#define _OVERLOAD_POLICY_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+#include "hist_lut.h"
+
+enum OverloadMode {
+    OVERLOAD_DROP_OLDEST = 0,
+    OVERLOAD_DROP_NEWEST,
+    OVERLOAD_PASSTHROUGH,
+    OVERLOAD_REDUCED,
+    OVERLOAD_MODE_COUNT
+};
+
+// Per-frame decision; ACT_PROCESS is the normal path
+enum OverloadAction {
+    ACT_PROCESS = 0,
+    ACT_DROP_OLDEST,
+    ACT_DROP_NEWEST,
+    ACT_PASSTHROUGH,
+    ACT_REDUCED,
+    ACT_COUNT
+};
+
+static inline const char *overload_mode_name(OverloadMode m) {
+    static const char *names[OVERLOAD_MODE_COUNT] = {"drop-oldest", "drop-newest", "passthrough", "reduced"};
+    return (m >= 0 && m < OVERLOAD_MODE_COUNT) ? names[m] : "?";
+}
+
+static inline const char *overload_action_name(OverloadAction a) {
+    static const char *names[ACT_COUNT] = {"process", "drop-oldest", "drop-newest", "passthrough", "reduced"};
+    return (a >= 0 && a < ACT_COUNT) ? names[a] : "?";
+}
+
+// Returns false for an unknown name
+static inline bool overload_mode_from_name(const char *name, OverloadMode *mode) {
+    for (int m = 0; m < OVERLOAD_MODE_COUNT; ++m) {
+        if (name && g_ascii_strcasecmp(name, overload_mode_name((OverloadMode)m)) == 0) {
+            *mode = (OverloadMode)m;
+            return true;
+        }
+    }
+    return false;
+}
+
+class OverloadPolicy {
+public:
+    OverloadPolicy() = default;
+
+    void set_mode(OverloadMode m) { mode_ = m; }
+    void set_thresholds(double enter_load, double exit_load) {
+        enter_load_ = enter_load;
+        exit_load_ = exit_load < enter_load ? exit_load : enter_load;
+    }
+    void set_dwell(int enter_frames, int exit_frames) {
+        enter_frames_ = enter_frames > 0 ? enter_frames : 1;
+        exit_frames_ = exit_frames > 0 ? exit_frames : 1;
+    }
+
+    OverloadMode mode() const { return mode_; }
+    double exit_load() const { return exit_load_; }
+    bool overloaded() const { return overloaded_.load(std::memory_order_relaxed); }
+    uint64_t count(OverloadAction a) const { return counts_[a].load(std::memory_order_relaxed); }
+    uint64_t transitions() const { return transitions_.load(std::memory_order_relaxed); }
+
+    OverloadAction decide(double load) {
+        const bool was = overloaded_.load(std::memory_order_relaxed);
+        if (!was) {
+            streak_ = load >= enter_load_ ? streak_ + 1 : 0;
+            if (streak_ >= enter_frames_) set_state(true);
+        } else {
+            streak_ = load <= exit_load_ ? streak_ + 1 : 0;
+            if (streak_ >= exit_frames_) set_state(false);
+        }
+
+        OverloadAction a = ACT_PROCESS;
+        if (overloaded_.load(std::memory_order_relaxed)) {
+            switch (mode_) {
+                case OVERLOAD_DROP_OLDEST: a = ACT_DROP_OLDEST; break;
+                case OVERLOAD_DROP_NEWEST: a = ACT_DROP_NEWEST; break;
+                case OVERLOAD_PASSTHROUGH: a = ACT_PASSTHROUGH; break;
+                case OVERLOAD_REDUCED:     a = ACT_REDUCED; break;
+                default: break;
+            }
+        }
+        counts_[a].fetch_add(1, std::memory_order_relaxed);
+        return a;
+    }
+
+private:
+    void set_state(bool over) {
+        overloaded_.store(over, std::memory_order_relaxed);
+        transitions_.fetch_add(1, std::memory_order_relaxed);
+        streak_ = 0;
+    }
+
+    OverloadMode mode_{OVERLOAD_DROP_OLDEST};
+    double enter_load_{0.75};
+    double exit_load_{0.25};
+    int enter_frames_{3};
+    int exit_frames_{15};
+    int streak_{0};
+    std::atomic<bool> overloaded_{false};
+    std::atomic<uint64_t> transitions_{0};
+    std::atomic<uint64_t> counts_[ACT_COUNT]{};
+};
+
+/* ---------- Reduced-quality path ---------- */
+
+// Histogram from every step-th row/column, and the LUT reused for refresh_frames
+// frames. Costs one table lookup per pixel plus ~1/step^2 of a histogram.
+class ReducedEqualizer {
+public:
+    explicit ReducedEqualizer(int step = 4, int refresh_frames = 4)
+        : step_(step > 0 ? step : 1), refresh_frames_(refresh_frames > 0 ? refresh_frames : 1) {}
+
+    void process(const uint8_t *in, uint8_t *out, int width, int height) {
+        if (age_ < 0 || ++age_ >= refresh_frames_ || width != width_ || height != height_) {
+            uint32_t hist[HIST_BINS];
+            memset(hist, 0, sizeof(hist));
+            hist_accumulate_sampled(in, width, width, height, step_, hist);
+            uint64_t total = 0;
+            for (int i = 0; i < HIST_BINS; ++i) total += hist[i];
+            lut_from_hist(hist, total, lut_);
+            age_ = 0;
+            width_ = width;
+            height_ = height;
+        }
+        lut_apply(in, width, out, width, width, height, lut_);
+    }
+
+private:
+    int step_;
+    int refresh_frames_;
+    int age_{-1};
+    int width_{0};
+    int height_{0};
+    uint8_t lut_[HIST_BINS]{};
+};
+
+#endif
+// _OVERLOAD_POLICY_H_
@@ -0,0 +1,343 @@
+// perf_counters.h
+// Hardware performance counters per thread (perf_event_open), accumulated per stage, so
+// a stage's wall time can be split into "not enough instructions per cycle" and "waiting
+// for memory".
+//
+//   perf_counters_enable();                 // once; false (and wall time only) if the
+//                                           // kernel refuses perf events
+//   static PerfStageStats eq("equalize");
+//   { PerfScope scope(&eq); ... perf_count_bytes(y_size * 2); ... }
+//   eq.report_line(...)                     // IPC, miss rates, bytes/cycle, GHz
+//
+// Counters are opened lazily on each thread that enters a scope and count that thread
+// only, user space only (works with perf_event_paranoid <= 2). Two groups, each read
+// with one read():
+//   core    cycles (leader), instructions, branch-misses, page-faults (software)
+//   memory  cache-references (leader), cache-misses, LLC loads, LLC load misses
+// Small cores (Cortex-A53: 6 counters) can't schedule all seven hardware events at once;
+// the kernel multiplexes the two groups. A scope keeps the raw values and enabled/running
+// times at both ends and scales its own delta (dvalue * denabled / drunning), so a ratio
+// that changes between the two reads doesn't skew it.
+// Events the PMU doesn't have are left out and shown as "-".
+//
+// Work a stage hands to other threads (e.g. the CPU backend's pool with --cpu-threads>1)
+// is not counted: use one thread per backend for per-stage numbers.
+
+#ifndef _PERF_COUNTERS_H_
+#define _PERF_COUNTERS_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <atomic>
+#include <string>
+
+enum PerfCounterId {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_PAGE_FAULTS,
+    PERF_CACHE_REFS,
+    PERF_CACHE_MISSES,
+    PERF_LLC_LOADS,
+    PERF_LLC_MISSES,
+    PERF_COUNTERS
+};
+
+// Raw counts plus the time enabled / running of each group (0 = core, 1 = memory)
+struct PerfValues {
+    uint64_t v[PERF_COUNTERS]{};
+    uint64_t enabled[2]{};
+    uint64_t running[2]{};
+};
+
+static inline int perf_group_of(int id) { return id < PERF_CACHE_REFS ? 0 : 1; }
+
+// end - begin, scaled up by the share of the interval each group was on the PMU; events
+// of a group that never ran in between read 0
+static inline void perf_scaled_delta(const PerfValues &begin, const PerfValues &end, PerfValues &out) {
+    for (int e = 0; e < PERF_COUNTERS; ++e) {
+        const int g = perf_group_of(e);
+        const uint64_t dv = end.v[e] > begin.v[e] ? end.v[e] - begin.v[e] : 0;
+        const uint64_t de = end.enabled[g] - begin.enabled[g], dr = end.running[g] - begin.running[g];
+        if (dr == 0) out.v[e] = 0;
+        else if (dr >= de) out.v[e] = dv;
+        else out.v[e] = (uint64_t)((double)dv * (double)de / (double)dr);
+    }
+}
+
+/* ---------- per-thread counter groups ---------- */
+
+class PerfThreadCounters {
+public:
+    PerfThreadCounters() {
+        for (int &fd : fd_) fd = -1;
+    }
+    PerfThreadCounters(const PerfThreadCounters &) = delete;
+    PerfThreadCounters &operator=(const PerfThreadCounters &) = delete;
+    ~PerfThreadCounters() {
+        for (int fd : fd_) if (fd >= 0) close(fd);
+    }
+
+    // Opens both groups for the calling thread; false if not even cycles are available
+    bool open(int *err = nullptr) {
+        if (tried_) return ok_;
+        tried_ = true;
+        const int core[] = {PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_PAGE_FAULTS};
+        const int mem[] = {PERF_CACHE_REFS, PERF_CACHE_MISSES, PERF_LLC_LOADS, PERF_LLC_MISSES};
+        ok_ = open_group(core, 4, err);
+        if (ok_) open_group(mem, 4, nullptr);
+        return ok_;
+    }
+
+    bool ok() const { return ok_; }
+    bool has(int id) const { return fd_[id] >= 0; }
+
+    // Current raw totals of every open event, with each group's enabled/running time
+    bool read(PerfValues &out) const {
+        return read_group(PERF_CYCLES, out) && (fd_[PERF_CACHE_REFS] < 0 || read_group(PERF_CACHE_REFS, out));
+    }
+
+private:
+    static long perf_open(perf_event_attr *attr, int group_fd) {
+        return syscall(__NR_perf_event_open, attr, 0 /* this thread */, -1 /* any cpu */, group_fd, 0);
+    }
+
+    static void attr_for(int id, perf_event_attr &a) {
+        memset(&a, 0, sizeof(a));
+        a.size = sizeof(a);
+        a.exclude_kernel = 1;
+        a.exclude_hv = 1;
+        a.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                        PERF_FORMAT_TOTAL_TIME_RUNNING;
+        const uint64_t llc = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8);
+        switch (id) {
+            case PERF_CYCLES:        a.type = PERF_TYPE_HARDWARE; a.config = PERF_COUNT_HW_CPU_CYCLES; break;
+            case PERF_INSTRUCTIONS:  a.type = PERF_TYPE_HARDWARE; a.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+            case PERF_BRANCH_MISSES: a.type = PERF_TYPE_HARDWARE; a.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+            case PERF_PAGE_FAULTS:   a.type = PERF_TYPE_SOFTWARE; a.config = PERF_COUNT_SW_PAGE_FAULTS; break;
+            case PERF_CACHE_REFS:    a.type = PERF_TYPE_HARDWARE; a.config = PERF_COUNT_HW_CACHE_REFERENCES; break;
+            case PERF_CACHE_MISSES:  a.type = PERF_TYPE_HARDWARE; a.config = PERF_COUNT_HW_CACHE_MISSES; break;
+            case PERF_LLC_LOADS:
+                a.type = PERF_TYPE_HW_CACHE;
+                a.config = llc | ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+                break;
+            default:
+                a.type = PERF_TYPE_HW_CACHE;
+                a.config = llc | ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+        }
+    }
+
+    // First id is the leader; members that fail to open are skipped
+    bool open_group(const int *ids, int n, int *err) {
+        perf_event_attr a;
+        attr_for(ids[0], a);
+        int leader = (int)perf_open(&a, -1);
+        if (leader < 0) {
+            if (err) *err = errno;
+            return false;
+        }
+        fd_[ids[0]] = leader;
+        for (int i = 1; i < n; ++i) {
+            attr_for(ids[i], a);
+            fd_[ids[i]] = (int)perf_open(&a, leader);
+        }
+        for (int i = 0; i < n; ++i) {
+            if (fd_[ids[i]] >= 0) ioctl(fd_[ids[i]], PERF_EVENT_IOC_ID, &id_[ids[i]]);
+        }
+        return true;
+    }
+
+    bool read_group(int leader, PerfValues &out) const {
+        // nr, time_enabled, time_running, then {value, id} per member
+        uint64_t buf[3 + 2 * PERF_COUNTERS];
+        const ssize_t got = ::read(fd_[leader], buf, sizeof(buf));
+        if (got < (ssize_t)(3 * sizeof(uint64_t))) return false;
+        const uint64_t nr = buf[0];
+        const int g = perf_group_of(leader);
+        out.enabled[g] = buf[1];
+        out.running[g] = buf[2];
+        for (uint64_t i = 0; i < nr && i < PERF_COUNTERS; ++i) {
+            const uint64_t value = buf[3 + 2 * i], id = buf[4 + 2 * i];
+            for (int e = 0; e < PERF_COUNTERS; ++e) {
+                if (fd_[e] >= 0 && id_[e] == id) {
+                    out.v[e] = value;
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    int fd_[PERF_COUNTERS];
+    uint64_t id_[PERF_COUNTERS]{};
+    bool tried_{false};
+    bool ok_{false};
+};
+
+/* ---------- process-wide switch ---------- */
+
+class PerfCounters {
+public:
+    static PerfCounters &instance() {
+        static PerfCounters p;
+        return p;
+    }
+
+    // Probes on the calling thread; on failure says why once and stays off
+    bool enable() {
+        int err = 0;
+        if (!thread_counters().open(&err)) {
+            int paranoid = -1;
+            if (FILE *f = fopen("/proc/sys/kernel/perf_event_paranoid", "r")) {
+                if (fscanf(f, "%d", &paranoid) != 1) paranoid = -1;
+                fclose(f);
+            }
+            g_print("Perf counters unavailable (%s, perf_event_paranoid=%d): wall time only\n", strerror(err),
+                    paranoid);
+            return false;
+        }
+        enabled_.store(true, std::memory_order_release);
+        return true;
+    }
+
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    static PerfThreadCounters &thread_counters() {
+        thread_local PerfThreadCounters tc;
+        return tc;
+    }
+
+private:
+    PerfCounters() = default;
+    std::atomic<bool> enabled_{false};
+};
+
+static inline bool perf_counters_enable() { return PerfCounters::instance().enable(); }
+static inline bool perf_counters_enabled() { return PerfCounters::instance().enabled(); }
+
+/* ---------- per-stage totals ---------- */
+
+class PerfStageStats {
+public:
+    void add(const PerfValues &delta, uint64_t bytes, uint64_t wall_us, const PerfThreadCounters &tc) {
+        for (int e = 0; e < PERF_COUNTERS; ++e) {
+            if (!tc.has(e)) continue;
+            sum_[e].fetch_add(delta.v[e], std::memory_order_relaxed);
+            seen_.fetch_or(1u << e, std::memory_order_relaxed);
+        }
+        bytes_.fetch_add(bytes, std::memory_order_relaxed);
+        wall_us_.fetch_add(wall_us, std::memory_order_relaxed);
+        samples_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t samples() const { return samples_.load(std::memory_order_relaxed); }
+
+    // "IPC ... | cache miss ... | LLC miss ... | br miss/ki ... | faults/item ... |
+    // B/cycle ... | GHz ..." over the interval since the previous call (one reader)
+    std::string report_line() {
+        uint64_t d[PERF_COUNTERS];
+        for (int e = 0; e < PERF_COUNTERS; ++e) {
+            const uint64_t now = sum_[e].load(std::memory_order_relaxed);
+            d[e] = now - prev_[e];
+            prev_[e] = now;
+        }
+        const uint64_t bytes = bytes_.load() - prev_bytes_, wall = wall_us_.load() - prev_wall_;
+        const uint64_t n = samples_.load() - prev_samples_;
+        prev_bytes_ += bytes;
+        prev_wall_ += wall;
+        prev_samples_ += n;
+        const unsigned seen = seen_.load(std::memory_order_relaxed);
+        auto has = [seen](int e) { return (seen >> e) & 1u; };
+
+        char buf[256], ipc[16] = "-", cm[16] = "-", llc[16] = "-", br[16] = "-", pf[16] = "-", bpc[16] = "-",
+             ghz[16] = "-";
+        if (d[PERF_CYCLES]) {
+            if (has(PERF_INSTRUCTIONS)) snprintf(ipc, sizeof(ipc), "%.2f", (double)d[PERF_INSTRUCTIONS] / d[PERF_CYCLES]);
+            if (bytes) snprintf(bpc, sizeof(bpc), "%.2f", (double)bytes / d[PERF_CYCLES]);
+            if (wall) snprintf(ghz, sizeof(ghz), "%.2f", d[PERF_CYCLES] / (wall * 1000.0));
+        }
+        if (has(PERF_CACHE_MISSES) && d[PERF_CACHE_REFS])
+            snprintf(cm, sizeof(cm), "%.1f%%", 100.0 * d[PERF_CACHE_MISSES] / d[PERF_CACHE_REFS]);
+        if (has(PERF_LLC_MISSES) && d[PERF_LLC_LOADS])
+            snprintf(llc, sizeof(llc), "%.1f%%", 100.0 * d[PERF_LLC_MISSES] / d[PERF_LLC_LOADS]);
+        if (has(PERF_BRANCH_MISSES) && d[PERF_INSTRUCTIONS])
+            snprintf(br, sizeof(br), "%.2f", 1000.0 * d[PERF_BRANCH_MISSES] / d[PERF_INSTRUCTIONS]);
+        if (has(PERF_PAGE_FAULTS) && n) snprintf(pf, sizeof(pf), "%.1f", (double)d[PERF_PAGE_FAULTS] / n);
+        snprintf(buf, sizeof(buf), "%6s %10s %9s %11s %11s %8s %6s  (%.1f Mcycles/item)", ipc, cm, llc, br, pf, bpc, ghz,
+                 n ? d[PERF_CYCLES] / 1e6 / n : 0.0);
+        return buf;
+    }
+
+    static const char *report_header() {
+        return "   IPC cache-miss  LLC-miss  br-miss/ki faults/item  B/cycle    GHz";
+    }
+
+private:
+    std::atomic<uint64_t> sum_[PERF_COUNTERS]{};
+    std::atomic<uint64_t> bytes_{0}, wall_us_{0}, samples_{0};
+    std::atomic<unsigned> seen_{0};
+    // report_line() only
+    uint64_t prev_[PERF_COUNTERS]{};
+    uint64_t prev_bytes_{0}, prev_wall_{0}, prev_samples_{0};
+};
+
+/* ---------- scope ---------- */
+
+// Counts the enclosed block into stats (nothing when perf counters are off)
+class PerfScope {
+public:
+    explicit PerfScope(PerfStageStats *stats) {
+        if (!stats || !perf_counters_enabled()) return;
+        PerfThreadCounters &tc = PerfCounters::thread_counters();
+        if (!tc.open() || !tc.read(begin_)) return;
+        stats_ = stats;
+        tc_ = &tc;
+        begin_us_ = g_get_monotonic_time();
+        prev_ = current();
+        current() = this;
+    }
+    ~PerfScope() {
+        if (!stats_) return;
+        PerfValues end;
+        if (tc_->read(end)) {
+            PerfValues delta;
+            perf_scaled_delta(begin_, end, delta);
+            stats_->add(delta, bytes_, (uint64_t)(g_get_monotonic_time() - begin_us_), *tc_);
+        }
+        current() = prev_;
+    }
+    PerfScope(const PerfScope &) = delete;
+    PerfScope &operator=(const PerfScope &) = delete;
+
+    // Innermost open scope on this thread
+    static PerfScope *&current() {
+        thread_local PerfScope *scope = nullptr;
+        return scope;
+    }
+
+    void add_bytes(uint64_t n) { bytes_ += n; }
+
+private:
+    PerfStageStats *stats_{nullptr};
+    PerfThreadCounters *tc_{nullptr};
+    PerfValues begin_;
+    PerfScope *prev_{nullptr};
+    int64_t begin_us_{0};
+    uint64_t bytes_{0};
+};
+
+// Bytes the running stage reads + writes, for bytes/cycle
+static inline void perf_count_bytes(uint64_t n) {
+    if (PerfScope *s = PerfScope::current()) s->add_bytes(n);
+}
+
+#endif
+// _PERF_COUNTERS_H_
@@ -0,0 +1,152 @@
+// reorder_buffer.h
+// Puts frames finished by parallel workers back into capture order.
+//
+// Frames are keyed by the capture sequence number assigned at the appsink and carry
+// their capture PTS. drain() releases them strictly in sequence order:
+//   - a frame that arrives after its slot was already passed is dropped (late)
+//   - a sequence number reported lost upstream (input overwrite, worker error) is
+//     skipped as soon as it is reached, without waiting
+//   - a missing frame is waited for at most max_hold_us (measured from when the
+//     oldest frame behind it arrived), or until max_frames are held; then the gap is
+//     skipped so one slow or lost frame never stalls the stream
+//   - PTS must increase on output; a frame whose PTS does not is dropped
+//
+// Single-threaded: insert and drain from the same thread (the main loop).
+
+#ifndef _REORDER_BUFFER_H_
+#define _REORDER_BUFFER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+
+#define REORDER_PTS_NONE UINT64_MAX
+
+struct ReorderStats {
+    uint64_t released{0};
+    uint64_t lost_upstream{0};   // tombstones reached in order
+    uint64_t late_dropped{0};    // arrived after their slot was skipped
+    uint64_t skipped{0};         // sequence numbers given up on (hold time / depth)
+    uint64_t pts_inversions{0};  // dropped because PTS went backwards
+    uint64_t max_held{0};
+    uint64_t max_hold_us{0};     // longest any released frame sat in the buffer
+};
+
+template <typename T>
+class ReorderBuffer {
+public:
+    ReorderBuffer(int64_t max_hold_us = 50000, size_t max_frames = 32)
+        : max_hold_us_(max_hold_us), max_frames_(max_frames) {}
+
+    void set_limits(int64_t max_hold_us, size_t max_frames) {
+        max_hold_us_ = max_hold_us;
+        max_frames_ = max_frames > 0 ? max_frames : 1;
+    }
+
+    size_t held() const { return held_.size(); }
+    uint64_t next_seq() const { return next_seq_; }
+    const ReorderStats &stats() const { return stats_; }
+
+    // A finished frame. drop(item) is called right away if it is already too late.
+    template <typename DropFn>
+    void insert(uint64_t seq, T item, uint64_t pts, int64_t now_us, DropFn drop) {
+        if (seq < next_seq_) {
+            stats_.late_dropped++;
+            drop(item);
+            return;
+        }
+        Entry &e = held_[seq];
+        e.item = item;
+        e.pts = pts;
+        e.arrived_us = now_us;
+        e.lost = false;
+        if (held_.size() > stats_.max_held) stats_.max_held = held_.size();
+    }
+
+    // seq will never arrive (dropped or failed before reaching us)
+    void mark_lost(uint64_t seq, int64_t now_us) {
+        if (seq < next_seq_) return;
+        Entry &e = held_[seq];
+        e.lost = true;
+        e.arrived_us = now_us;
+    }
+
+    // Release everything that is in order, skipping gaps that waited too long.
+    // Returns the number of frames passed to emit(item).
+    template <typename EmitFn, typename DropFn>
+    int drain(int64_t now_us, EmitFn emit, DropFn drop) {
+        int emitted = 0;
+        while (!held_.empty()) {
+            auto it = held_.begin();
+            if (it->first != next_seq_) {
+                const bool expired = now_us - it->second.arrived_us >= max_hold_us_;
+                const bool overflow = held_.size() > max_frames_;
+                if (!expired && !overflow) break;
+                // Give up on the gap
+                stats_.skipped += it->first - next_seq_;
+                next_seq_ = it->first;
+            }
+            Entry e = it->second;
+            held_.erase(it);
+            next_seq_++;
+            emitted += release(e, now_us, emit, drop) ? 1 : 0;
+        }
+        return emitted;
+    }
+
+    // Shutdown: hand back every held frame in order, gaps or not
+    template <typename EmitFn, typename DropFn>
+    void flush(int64_t now_us, EmitFn emit, DropFn drop) {
+        while (!held_.empty()) {
+            auto it = held_.begin();
+            Entry e = it->second;
+            next_seq_ = it->first + 1;
+            held_.erase(it);
+            release(e, now_us, emit, drop);
+        }
+    }
+
+    // Time until the oldest held frame would force a skip (for arming a timer), or -1
+    int64_t us_until_deadline(int64_t now_us) const {
+        if (held_.empty()) return -1;
+        int64_t left = held_.begin()->second.arrived_us + max_hold_us_ - now_us;
+        return left > 0 ? left : 0;
+    }
+
+private:
+    struct Entry {
+        T item{};
+        uint64_t pts{REORDER_PTS_NONE};
+        int64_t arrived_us{0};
+        bool lost{false};
+    };
+
+    template <typename EmitFn, typename DropFn>
+    bool release(const Entry &e, int64_t now_us, EmitFn &emit, DropFn &drop) {
+        if (e.lost) {
+            stats_.lost_upstream++;
+            return false;
+        }
+        if (e.pts != REORDER_PTS_NONE && last_pts_ != REORDER_PTS_NONE && e.pts <= last_pts_) {
+            stats_.pts_inversions++;
+            drop(e.item);
+            return false;
+        }
+        if (e.pts != REORDER_PTS_NONE) last_pts_ = e.pts;
+        uint64_t waited = (uint64_t)(now_us - e.arrived_us);
+        if (waited > stats_.max_hold_us) stats_.max_hold_us = waited;
+        stats_.released++;
+        emit(e.item);
+        return true;
+    }
+
+    int64_t max_hold_us_;
+    size_t max_frames_;
+    uint64_t next_seq_{0};
+    uint64_t last_pts_{REORDER_PTS_NONE};
+    std::map<uint64_t, Entry> held_;
+    ReorderStats stats_{};
+};
+
+#endif
+// _REORDER_BUFFER_H_
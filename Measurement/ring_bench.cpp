@@ -0,0 +1,162 @@
+// ring_bench.cpp
+// SpscRing / MpmcRing (frame_ring.h) against GAsyncQueue for pointer hand-off.
+//
+// Two runs per queue:
+//   burst - producer pushes as fast as it can: throughput and queueing latency
+//   paced - one item every --pace-us (default 1000 us, i.e. faster than 60 fps but the
+//           consumer still goes idle): wake-up latency from a parked consumer, which is
+//           what the appsink -> worker hand-off sees
+// The pushed pointer value is the push timestamp, so no memory is touched.
+//
+// Build:
+// g++ -O3 -DNDEBUG -std=c++17 ring_bench.cpp -o ring_bench \
+//   $(pkg-config --cflags --libs glib-2.0) -lpthread
+//
+// Run:
+//   ./ring_bench --items=1000000 --consumers=1 --capacity=64
+//   ./ring_bench --consumers=4 --pace-us=500 --paced-items=4000
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "frame_ring.h"
+
+#define BENCH_SENTINEL ((void *)1)
+
+// Full ring: spin briefly, then yield so a consumer on the same core can drain it
+template <typename Ring>
+static void push_backoff(Ring &r, void *v) {
+    for (int spins = 0; !r.try_push(v); ++spins) {
+        if (spins < 64) ring_cpu_relax();
+        else std::this_thread::yield();
+    }
+}
+
+static uint64_t now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct QueueOps {
+    const char *name;
+    std::function<void(void *)> push;               // must not drop
+    std::function<bool(void *&, int64_t)> pop_wait; // timeout in us
+    std::function<uint64_t()> parks;                // 0 when not tracked
+};
+
+struct RunResult {
+    double seconds{0};
+    uint64_t items{0};
+    std::vector<uint64_t> lat_ns;
+};
+
+static RunResult run_case(QueueOps &q, int consumers, uint64_t items, int pace_us) {
+    std::vector<std::vector<uint64_t>> lat(consumers);
+    std::vector<std::thread> threads;
+    std::atomic<int> ready{0};
+
+    for (int c = 0; c < consumers; ++c) {
+        lat[c].reserve(items / consumers + 16);
+        threads.emplace_back([&, c] {
+            ready.fetch_add(1);
+            for (;;) {
+                void *v = NULL;
+                if (!q.pop_wait(v, 100000)) continue;
+                if (v == BENCH_SENTINEL) break;
+                lat[c].push_back(now_ns() - ((uint64_t)(uintptr_t)v - 2));
+            }
+        });
+    }
+    while (ready.load() < consumers) std::this_thread::yield();
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto next = t0;
+    for (uint64_t i = 0; i < items; ++i) {
+        if (pace_us > 0) {
+            next += std::chrono::microseconds(pace_us);
+            std::this_thread::sleep_until(next);
+        }
+        q.push((void *)(uintptr_t)(now_ns() + 2));
+    }
+    for (int c = 0; c < consumers; ++c) q.push(BENCH_SENTINEL);
+    for (auto &t : threads) t.join();
+
+    RunResult r;
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    for (auto &l : lat) r.lat_ns.insert(r.lat_ns.end(), l.begin(), l.end());
+    r.items = r.lat_ns.size();
+    std::sort(r.lat_ns.begin(), r.lat_ns.end());
+    return r;
+}
+
+static double pct_us(const std::vector<uint64_t> &v, double p) {
+    if (v.empty()) return 0.0;
+    return v[(size_t)(p * (double)(v.size() - 1))] / 1000.0;
+}
+
+static void report(const char *mode, QueueOps &q, const RunResult &r, uint64_t parks_before) {
+    g_print("  %-6s %-12s %11.0f items/s  lat p50 %8.2f us  p99 %8.2f us  max %9.2f us  parks %" G_GUINT64_FORMAT "\n",
+            mode, q.name, r.seconds > 0 ? r.items / r.seconds : 0.0,
+            pct_us(r.lat_ns, 0.50), pct_us(r.lat_ns, 0.99), pct_us(r.lat_ns, 1.0),
+            q.parks() - parks_before);
+}
+
+int main(int argc, char *argv[]) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    uint64_t items = 1000000, paced_items = 2000;
+    int consumers = 1, capacity = 64, pace_us = 1000;
+
+    for (int i=1;i<argc;++i){
+        if (g_str_has_prefix(argv[i],"--items=")) { long long n=atoll(strchr(argv[i],'=')+1); if(n>0) items=(uint64_t)n; }
+        else if (g_str_has_prefix(argv[i],"--paced-items=")) { long long n=atoll(strchr(argv[i],'=')+1); if(n>0) paced_items=(uint64_t)n; }
+        else if (g_str_has_prefix(argv[i],"--consumers=")) { int c=atoi(strchr(argv[i],'=')+1); if(c>0) consumers=c; }
+        else if (g_str_has_prefix(argv[i],"--capacity=")) { int c=atoi(strchr(argv[i],'=')+1); if(c>1) capacity=c; }
+        else if (g_str_has_prefix(argv[i],"--pace-us=")) { int p=atoi(strchr(argv[i],'=')+1); if(p>0) pace_us=p; }
+    }
+
+    SpscRing<void *> spsc(capacity);
+    MpmcRing<void *> mpmc(capacity);
+    GAsyncQueue *aq = g_async_queue_new();
+
+    std::vector<QueueOps> queues;
+    if (consumers == 1) {
+        queues.push_back({"SpscRing",
+                          [&](void *v) { push_backoff(spsc, v); },
+                          [&](void *&v, int64_t t) { return spsc.pop_wait(v, t); },
+                          [&] { return spsc.parks(); }});
+    }
+    queues.push_back({"MpmcRing",
+                      [&](void *v) { push_backoff(mpmc, v); },
+                      [&](void *&v, int64_t t) { return mpmc.pop_wait(v, t); },
+                      [&] { return mpmc.parks(); }});
+    queues.push_back({"GAsyncQueue",
+                      [&](void *v) { g_async_queue_push(aq, v); },
+                      [&](void *&v, int64_t t) { v = g_async_queue_timeout_pop(aq, t); return v != NULL; },
+                      [] { return (uint64_t)0; }});
+
+    g_print("Ring bench: 1 producer, %d consumer(s), ring capacity %zu (GAsyncQueue unbounded)\n",
+            consumers, mpmc.capacity());
+    g_print("burst: %" G_GUINT64_FORMAT " items, paced: %" G_GUINT64_FORMAT " items every %d us\n\n",
+            items, paced_items, pace_us);
+
+    for (auto &q : queues) {
+        uint64_t p0 = q.parks();
+        RunResult burst = run_case(q, consumers, items, 0);
+        report("burst", q, burst, p0);
+        p0 = q.parks();
+        RunResult paced = run_case(q, consumers, paced_items, pace_us);
+        report("paced", q, paced, p0);
+    }
+
+    g_async_queue_unref(aq);
+    return 0;
+}
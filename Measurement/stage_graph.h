@@ -0,0 +1,408 @@
+// stage_graph.h
+// Small executor for a linear chain of processing stages
+// (e.g. capture -> convert -> equalize -> pack -> push).
+//
+// Each stage is a function object fn(item, worker) run by its own threads (1..N) and fed
+// by a bounded MpmcRing (frame_ring.h). fn returns true to pass the item downstream,
+// false to drop it; the last stage's fn is the sink. What happens when a stage's input
+// ring is full is per stage:
+//   block        the upstream thread parks until there is room (backpressure)
+//   drop-oldest  the oldest queued item is dropped (leaky, freshest frame wins)
+//   drop-newest  the new item is dropped
+// A stage with several threads finishes items out of order. A stage marked ordered
+// (single thread, always blocks when full) puts them back into submission order with a
+// ReorderBuffer; items dropped anywhere upstream are reported to it so it never waits for
+// them.
+//
+// Per stage: items in / out, drops (full ring, fn), mean and max service time, mean
+// queue wait, and ring occupancy (sampled on every enqueue). With event tracing on
+// (trace_events.h) every fn call is also a trace event named after the stage, and with
+// perf counters on (perf_counters.h) it is counted into the stage's PerfStageStats,
+// reported as a second table. The topology (threads and
+// ring depth per stage) is configuration: parse_topology() reads
+// "name=THREADSxDEPTH[:block|drop-oldest|drop-newest],..." for stages added by name.
+//
+// T must be trivially copyable (a pointer, typically). Items still queued at stop() go
+// to the drop function.
+
+#ifndef _STAGE_GRAPH_H_
+#define _STAGE_GRAPH_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_ring.h"
+#include "perf_counters.h"
+#include "reorder_buffer.h"
+#include "trace_events.h"
+
+enum StageFullPolicy {
+    STAGE_BLOCK = 0,
+    STAGE_DROP_OLDEST,
+    STAGE_DROP_NEWEST
+};
+
+static inline const char *stage_policy_name(StageFullPolicy p) {
+    switch (p) {
+        case STAGE_DROP_OLDEST: return "drop-oldest";
+        case STAGE_DROP_NEWEST: return "drop-newest";
+        default:                return "block";
+    }
+}
+
+struct StageConfig {
+    std::string name;
+    int threads{1};
+    size_t depth{4};
+    StageFullPolicy full{STAGE_BLOCK};
+    bool ordered{false};            // forces threads = 1
+    int64_t reorder_hold_us{50000}; // ordered: longest wait for a missing item
+};
+
+struct StageMetrics {
+    std::atomic<uint64_t> in{0};
+    std::atomic<uint64_t> out{0};
+    std::atomic<uint64_t> dropped_full{0};
+    std::atomic<uint64_t> dropped_fn{0};
+    std::atomic<uint64_t> busy_us{0};
+    std::atomic<uint64_t> max_service_us{0};
+    std::atomic<uint64_t> wait_us{0};
+    std::atomic<uint64_t> depth_sum{0};
+    std::atomic<uint64_t> depth_samples{0};
+    std::atomic<uint64_t> max_depth{0};
+};
+
+template <typename T>
+class StageGraph {
+public:
+    using StageFn = std::function<bool(T &, int)>;
+    using DropFn = std::function<void(T &)>;
+    // Called on every stage thread before its first item (placement, naming)
+    using ThreadHook = std::function<void(const char *stage, int worker)>;
+
+    explicit StageGraph(DropFn drop) : drop_(std::move(drop)) {}
+    StageGraph(const StageGraph &) = delete;
+    StageGraph &operator=(const StageGraph &) = delete;
+    ~StageGraph() { stop(); }
+
+    // Stages run in the order they are added
+    int add_stage(const StageConfig &cfg, StageFn fn) {
+        std::unique_ptr<Stage> s(new Stage());
+        s->cfg = cfg;
+        s->fn = std::move(fn);
+        stages_.push_back(std::move(s));
+        return (int)stages_.size() - 1;
+    }
+
+    void set_thread_hook(ThreadHook hook) { hook_ = std::move(hook); }
+
+    size_t stage_count() const { return stages_.size(); }
+    const StageConfig &config(int i) const { return stages_[i]->cfg; }
+    const StageMetrics &metrics(int i) const { return stages_[i]->m; }
+
+    // "equalize=2x4,push=1x8:block" -> threads / depth / policy of named stages.
+    // Returns false on a malformed entry or an unknown stage name.
+    bool parse_topology(const char *spec) {
+        if (!spec || !*spec) return true;
+        gchar **items = g_strsplit(spec, ",", -1);
+        bool ok = true;
+        for (gchar **it = items; ok && *it; ++it) {
+            gchar *eq = strchr(*it, '=');
+            if (!eq) { ok = false; break; }
+            *eq = '\0';
+            Stage *s = find(g_strstrip(*it));
+            if (!s) {
+                g_printerr("Topology: no stage named '%s'\n", *it);
+                ok = false;
+                break;
+            }
+            int threads = 0, depth = 0;
+            char policy[16] = {0};
+            int n = sscanf(eq + 1, "%dx%d:%15s", &threads, &depth, policy);
+            if (n < 2 || threads <= 0 || depth <= 0) { ok = false; break; }
+            s->cfg.threads = threads;
+            s->cfg.depth = (size_t)depth;
+            if (n == 3) {
+                if (g_ascii_strcasecmp(policy, "block") == 0) s->cfg.full = STAGE_BLOCK;
+                else if (g_ascii_strcasecmp(policy, "drop-oldest") == 0) s->cfg.full = STAGE_DROP_OLDEST;
+                else if (g_ascii_strcasecmp(policy, "drop-newest") == 0) s->cfg.full = STAGE_DROP_NEWEST;
+                else ok = false;
+            }
+        }
+        if (!ok) g_printerr("Topology '%s': expected name=THREADSxDEPTH[:block|drop-oldest|drop-newest],...\n", spec);
+        g_strfreev(items);
+        return ok;
+    }
+
+    void print_topology() const {
+        g_print("Stages:");
+        for (size_t i = 0; i < stages_.size(); ++i) {
+            const StageConfig &c = stages_[i]->cfg;
+            g_print("%s %s %dx%zu %s%s", i ? " ->" : "", c.name.c_str(), c.threads, c.depth,
+                    stage_policy_name(c.full), c.ordered ? " ordered" : "");
+        }
+        g_print("\n");
+    }
+
+    void start() {
+        if (running_) return;
+        stop_.store(false, std::memory_order_release);
+        for (size_t i = 0; i < stages_.size(); ++i) {
+            Stage &s = *stages_[i];
+            if (s.cfg.ordered) {
+                s.cfg.threads = 1;
+                s.cfg.full = STAGE_BLOCK;   // an evicted tombstone would stall the reorder
+                s.reorder.set_limits(s.cfg.reorder_hold_us, s.cfg.depth * 4);
+            }
+            s.q.reset(new MpmcRing<Envelope>(s.cfg.depth));
+            for (int w = 0; w < s.cfg.threads; ++w) s.threads.emplace_back(&StageGraph::run, this, (int)i, w);
+        }
+        running_ = true;
+    }
+
+    void stop() {
+        if (!running_) return;
+        stop_.store(true, std::memory_order_release);
+        for (auto &s : stages_) {
+            s->q->wake_all();
+            for (auto &t : s->threads) t.join();
+            s->threads.clear();
+        }
+        for (auto &s : stages_) {
+            Envelope e;
+            while (s->q->try_pop(e)) if (!e.lost) drop_(e.item);
+            s->reorder.flush(now_us(), [this](Held h) { drop_(h.item); }, [this](Held h) { drop_(h.item); });
+        }
+        running_ = false;
+    }
+
+    // Entry point (first stage). False if the item was dropped (ring full, drop-newest).
+    bool submit(T item) {
+        if (stages_.empty() || !running_) { drop_(item); return false; }
+        Envelope e;
+        e.item = item;
+        e.seq = next_seq_.fetch_add(1, std::memory_order_relaxed);
+        e.enq_us = now_us();
+        e.lost = false;
+        return enqueue(0, e);
+    }
+
+    // Per-stage table; rates over the time since the previous call
+    void report() {
+        const int64_t now = now_us();
+        const double dt = last_report_us_ ? (now - last_report_us_) / 1e6 : 0.0;
+        last_report_us_ = now;
+        g_print("  %-10s %7s %9s %9s %8s %8s %9s %9s %9s\n", "stage", "thr", "in fps", "out fps", "drop q", "drop fn",
+                "svc ms", "max ms", "wait ms");
+        for (auto &sp : stages_) {
+            Stage &s = *sp;
+            const uint64_t in = s.m.in.load(), out = s.m.out.load();
+            const uint64_t processed = s.processed.load();
+            const uint64_t samples = s.m.depth_samples.load();
+            g_print("  %-10s %7d %9.1f %9.1f %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT " %9.2f %9.2f %9.2f"
+                    "  ring %zu/%zu (avg %.1f, max %" G_GUINT64_FORMAT ")\n",
+                    s.cfg.name.c_str(), s.cfg.threads,
+                    dt > 0 ? (in - s.prev_in) / dt : 0.0, dt > 0 ? (out - s.prev_out) / dt : 0.0,
+                    s.m.dropped_full.load(), s.m.dropped_fn.load(),
+                    processed ? s.m.busy_us.load() / (double)processed / 1000.0 : 0.0,
+                    s.m.max_service_us.load() / 1000.0,
+                    processed ? s.m.wait_us.load() / (double)processed / 1000.0 : 0.0,
+                    s.q ? s.q->size() : 0, s.q ? s.q->capacity() : 0,
+                    samples ? s.m.depth_sum.load() / (double)samples : 0.0, s.m.max_depth.load());
+            s.prev_in = in;
+            s.prev_out = out;
+        }
+        if (!perf_counters_enabled()) return;
+        g_print("  %-10s %s\n", "perf", PerfStageStats::report_header());
+        for (auto &sp : stages_) {
+            if (sp->perf.samples() == 0) continue;
+            g_print("  %-10s %s\n", sp->cfg.name.c_str(), sp->perf.report_line().c_str());
+        }
+    }
+
+private:
+    // A blocked producer re-checks stop_ this often while parked
+    static const int64_t kBlockPollUs = 100000;
+
+    struct Envelope {
+        T item;
+        uint64_t seq;
+        int64_t enq_us;
+        bool lost;      // tombstone for an ordered stage: seq was dropped upstream
+    };
+
+    // What an ordered stage holds while waiting for the sequence gap to close
+    struct Held {
+        T item;
+        int64_t enq_us;   // queue wait covers the reorder hold as well
+    };
+
+    struct Stage {
+        StageConfig cfg;
+        StageFn fn;
+        std::unique_ptr<MpmcRing<Envelope>> q;
+        std::vector<std::thread> threads;
+        StageMetrics m;
+        PerfStageStats perf;
+        std::atomic<uint64_t> processed{0};
+        ReorderBuffer<Held> reorder;       // ordered stages only (their single thread)
+        uint64_t prev_in{0}, prev_out{0};  // report() only
+    };
+
+    static int64_t now_us() { return g_get_monotonic_time(); }
+
+    static void update_max(std::atomic<uint64_t> &a, uint64_t v) {
+        uint64_t prev = a.load(std::memory_order_relaxed);
+        while (v > prev && !a.compare_exchange_weak(prev, v)) {}
+    }
+
+    Stage *find(const char *name) {
+        for (auto &s : stages_) if (s->cfg.name == name) return s.get();
+        return nullptr;
+    }
+
+    // The next ordered stage at or after 'from' learns that seq will never arrive
+    void report_lost(size_t from, uint64_t seq) {
+        for (size_t i = from; i < stages_.size(); ++i) {
+            if (!stages_[i]->cfg.ordered) continue;
+            Envelope t;
+            t.item = T();
+            t.seq = seq;
+            t.enq_us = now_us();
+            t.lost = true;
+            while (!stages_[i]->q->push_wait(t, kBlockPollUs)) {
+                if (stop_.load(std::memory_order_acquire)) return;
+            }
+            return;
+        }
+    }
+
+    void drop_item(size_t stage, Envelope &e) {
+        drop_(e.item);
+        report_lost(stage, e.seq);
+    }
+
+    bool enqueue(size_t i, Envelope e) {
+        Stage &s = *stages_[i];
+        bool ok = true;
+        if (s.q->try_push(e)) {
+        } else if (s.cfg.full == STAGE_DROP_OLDEST) {
+            s.q->push_overwrite(e, [&](Envelope old) {
+                s.m.dropped_full.fetch_add(1, std::memory_order_relaxed);
+                drop_item(i + 1, old);
+            });
+        } else if (s.cfg.full == STAGE_DROP_NEWEST) {
+            s.m.dropped_full.fetch_add(1, std::memory_order_relaxed);
+            drop_item(i + 1, e);
+            ok = false;
+        } else {
+            // Parks (no spinning core) until the stage frees a slot; stop() wakes it
+            while (!s.q->push_wait(e, kBlockPollUs)) {
+                if (stop_.load(std::memory_order_acquire)) { drop_(e.item); return false; }
+            }
+        }
+        if (ok) {
+            s.m.in.fetch_add(1, std::memory_order_relaxed);
+            const uint64_t depth = s.q->size();
+            s.m.depth_sum.fetch_add(depth, std::memory_order_relaxed);
+            s.m.depth_samples.fetch_add(1, std::memory_order_relaxed);
+            update_max(s.m.max_depth, depth);
+        }
+        return ok;
+    }
+
+    // Runs fn on one item and hands it on (or drops it)
+    void process(size_t i, Envelope &e, int worker) {
+        Stage &s = *stages_[i];
+        const int64_t t0 = now_us();
+        s.m.wait_us.fetch_add((uint64_t)(t0 > e.enq_us ? t0 - e.enq_us : 0), std::memory_order_relaxed);
+        bool pass;
+        {
+            PerfScope scope(&s.perf);
+            pass = s.fn(e.item, worker);
+        }
+        const int64_t t1 = now_us();
+        const uint64_t svc = (uint64_t)(t1 - t0);
+        trace_complete(s.cfg.name.c_str(), t0, t1, e.seq);
+        s.m.busy_us.fetch_add(svc, std::memory_order_relaxed);
+        update_max(s.m.max_service_us, svc);
+        s.processed.fetch_add(1, std::memory_order_relaxed);
+
+        if (!pass) {
+            s.m.dropped_fn.fetch_add(1, std::memory_order_relaxed);
+            drop_item(i + 1, e);
+            return;
+        }
+        s.m.out.fetch_add(1, std::memory_order_relaxed);
+        if (i + 1 < stages_.size()) {
+            e.enq_us = now_us();
+            enqueue(i + 1, e);
+        }
+    }
+
+    void run(int stage, int worker) {
+        Stage &s = *stages_[stage];
+        if (hook_) hook_(s.cfg.name.c_str(), worker);
+        if (trace_enabled()) {
+            char name[48];
+            snprintf(name, sizeof(name), "stage-%s-%d", s.cfg.name.c_str(), worker);
+            TraceEvents::instance().set_thread_name(name);
+        }
+
+        while (!stop_.load(std::memory_order_acquire)) {
+            int64_t timeout = 100000;
+            if (s.cfg.ordered && s.reorder.held() > 0) {
+                int64_t left = s.reorder.us_until_deadline(now_us());
+                timeout = left < 1 ? 1 : (left < timeout ? left : timeout);
+            }
+            Envelope e;
+            const bool got = s.q->pop_wait(e, timeout);
+            if (!s.cfg.ordered) {
+                if (got) process(stage, e, worker);
+                continue;
+            }
+
+            // Ordered: collect, then release whatever is next in sequence
+            const int64_t now = now_us();
+            if (got) {
+                if (e.lost) s.reorder.mark_lost(e.seq, now);
+                else s.reorder.insert(e.seq, Held{e.item, e.enq_us}, REORDER_PTS_NONE, now, [&](Held late) {
+                    s.m.dropped_fn.fetch_add(1, std::memory_order_relaxed);
+                    drop_(late.item);
+                });
+            }
+            s.reorder.drain(now,
+                [&](Held h) {
+                    Envelope r;
+                    r.item = h.item;
+                    r.seq = s.reorder.next_seq() - 1;
+                    r.enq_us = h.enq_us;
+                    r.lost = false;
+                    process(stage, r, worker);
+                },
+                [&](Held h) {
+                    s.m.dropped_fn.fetch_add(1, std::memory_order_relaxed);
+                    drop_(h.item);
+                });
+        }
+    }
+
+    DropFn drop_;
+    ThreadHook hook_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> next_seq_{0};
+    std::atomic<bool> running_{false};
+    int64_t last_report_us_{0};
+};
+
+#endif
+// _STAGE_GRAPH_H_
@@ -0,0 +1,554 @@
+// staged.cpp
+// The equalization bridge built from stages (stage_graph.h) instead of a hand-rolled
+// thread layout:
+//
+//   appsink -> convert -> equalize -> pack -> push -> appsrc
+//
+//   convert   map the captured NV12 buffer, allocate and map the output buffer
+//   equalize  Y plane through a frame backend (one instance per stage thread)
+//   pack      chroma (neutral or copied), unmap, carry the capture timestamps over
+//   push      back into capture order, then into appsrc (appsrc_flow.h)
+//
+// Threads, ring depth and full-ring policy per stage are configuration:
+//   --topology=convert=1x4:drop-oldest,equalize=2x4,pack=1x4,push=1x8
+// or a preset: --topology=serial (one thread per stage) / parallel (default,
+// equalize on 2 threads). Every stage reports throughput, drops, service time, queue
+// wait and ring occupancy in the status output, so layouts can be compared directly.
+// --perf adds hardware counters per stage (perf_counters.h): IPC, cache and LLC miss
+// rates, branch misses, page faults and bytes/cycle, to tell compute-bound stages from
+// memory-bound ones (wall time only when the kernel doesn't allow perf events).
+// --copy-report accounts the copies (copy_account.h: device transfers, chroma copy or
+// fill) and reports traffic per frame against the minimum and the memcpy bandwidth.
+//
+// Build:
+// g++ -O3 -DNDEBUG -std=c++17 staged.cpp -o staged \
+//   $(pkg-config --cflags --libs gstreamer-1.0 gstreamer-app-1.0 gstreamer-video-1.0) -lpthread \
+//   -lxilinxopencl -lOpenCL -I<path_to_xcl2_header>
+//
+// Run:
+//   ./staged --backend=cpu --topology=equalize=4x4
+//   ./staged --backend=ocl --topology=serial --thread-policy=default
+//   ./staged --backend=cpu --trace-latency --metrics-json=staged.jsonl
+//   ./staged --trace-events=staged.json --trace-ring=10   (per-stage spans, ui.perfetto.dev)
+//   ./staged --backend=cpu --cpu-threads=1 --perf
+//   ./staged --backend=ocl --keep-chroma --copy-report
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
+#include <glib.h>
+#include <glib-unix.h>
+#include <atomic>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <memory>
+#include <vector>
+
+#include "frame_backend.h"
+#include "stage_graph.h"
+#include "appsrc_flow.h"
+#include "thread_policy.h"
+#include "metrics.h"
+#include "latency_trace.h"
+#include "copy_account.h"
+
+#define TOPOLOGY_PARALLEL "convert=1x4:drop-oldest,equalize=2x4:block,pack=1x4:block,push=1x8"
+#define TOPOLOGY_SERIAL   "convert=1x2:drop-oldest,equalize=1x2:block,pack=1x2:block,push=1x4"
+
+struct Counters {
+    MetricsRegistry reg{"staged"};
+
+    MetricCounter &camera_frames     = reg.counter("camera_frames_total", "Frames captured from camera");
+    MetricCounter &encoder_frames    = reg.counter("encoder_frames_total", "Frames sent to encoder");
+    MetricCounter &output_bytes      = reg.counter("output_bytes_total", "Payloaded output bytes");
+    MetricCounter &processing_errors = reg.counter("processing_errors_total", "Processing errors");
+    MetricGauge &appsrc_level        = reg.gauge("appsrc_level_bytes", "Bytes queued in appsrc");
+};
+
+// One frame on its way through the stages
+struct StagedFrame {
+    GstBuffer *in{nullptr};
+    GstBuffer *out{nullptr};
+    GstMapInfo in_map{};
+    GstMapInfo out_map{};
+    bool in_mapped{false};
+    bool out_mapped{false};
+    int width{0};
+    int height{0};
+};
+
+struct CustomData {
+    GstElement  *appsrc{nullptr};
+    GstElement  *appsink{nullptr};
+    GstVideoInfo video_info{};           // appsink thread only
+    GstCaps     *last_caps{nullptr};     // appsink thread only
+    std::atomic<uint64_t> geometry{0};   // (width << 32) | height of the current caps
+
+    std::unique_ptr<StageGraph<StagedFrame*>> graph;
+    std::vector<std::unique_ptr<FrameBackend>> backends; // one per equalize thread
+    gboolean     keep_chroma{FALSE};
+
+    AppsrcFlow   flow;
+    ThreadPolicy threads;
+
+    Counters     ctr{};
+    MetricsExporter metrics{ctr.reg};
+    LatencyTrace trace;
+    bool         copy_report{false};     // --copy-report
+    uint64_t     copy_prev_frames{0};    // status_tick only
+    GMainLoop   *loop{nullptr};
+};
+
+static void free_frame(StagedFrame *f) {
+    if (f->in_mapped) gst_buffer_unmap(f->in, &f->in_map);
+    if (f->out_mapped) gst_buffer_unmap(f->out, &f->out_map);
+    if (f->in) gst_buffer_unref(f->in);
+    if (f->out) gst_buffer_unref(f->out);
+    delete f;
+}
+
+/* ---------- Stages ---------- */
+
+static bool stage_convert(CustomData *d, StagedFrame *f) {
+    const size_t y_size = (size_t)f->width * (size_t)f->height;
+    const size_t frame_size = y_size + y_size / 2;
+    if (!gst_buffer_map(f->in, &f->in_map, GST_MAP_READ)) goto fail;
+    f->in_mapped = true;
+    if (f->in_map.size < frame_size) goto fail;
+
+    f->out = gst_buffer_new_allocate(NULL, frame_size, NULL);
+    if (!f->out || !gst_buffer_map(f->out, &f->out_map, GST_MAP_WRITE)) goto fail;
+    f->out_mapped = true;
+    return true;
+
+fail:
+    d->ctr.processing_errors.add();
+    return false;
+}
+
+static bool stage_equalize(CustomData *d, StagedFrame *f, int worker) {
+    FrameBackend *be = d->backends[worker].get();
+    if (!be->init(f->width, f->height) ||
+        !be->process_y(f->in_map.data, f->out_map.data, f->width, f->height)) {
+        d->ctr.processing_errors.add();
+        return false;
+    }
+    perf_count_bytes(2 * (uint64_t)f->width * f->height);   // Y in + Y out
+    return true;
+}
+
+static bool stage_pack(CustomData *d, StagedFrame *f) {
+    const size_t y_size = (size_t)f->width * (size_t)f->height;
+    if (d->keep_chroma) memcpy_acct(COPY_SITE("uv_copy"), f->out_map.data + y_size, f->in_map.data + y_size, y_size / 2);
+    else memset_acct(COPY_SITE("uv_fill"), f->out_map.data + y_size, 128, y_size / 2);   // neutral UV, as the other bridges
+    perf_count_bytes(d->keep_chroma ? y_size : y_size / 2);
+
+    gst_buffer_unmap(f->out, &f->out_map);
+    f->out_mapped = false;
+    gst_buffer_unmap(f->in, &f->in_map);
+    f->in_mapped = false;
+    d->trace.carry(f->in, f->out);
+
+    // Both pipelines share clock and base time: capture timestamps are valid downstream
+    GST_BUFFER_PTS(f->out)      = GST_BUFFER_PTS(f->in);
+    GST_BUFFER_DTS(f->out)      = GST_BUFFER_DTS(f->in);
+    GST_BUFFER_DURATION(f->out) = GST_BUFFER_DURATION(f->in);
+    gst_buffer_unref(f->in);
+    f->in = nullptr;
+    return true;
+}
+
+static bool stage_push(CustomData *d, StagedFrame *f) {
+    d->flow.set_frame_bytes(gst_buffer_get_size(f->out));
+    d->trace.mark(TRACE_PROCESSED, f->out);
+    // appsrc takes ownership, also on failure
+    if (d->flow.push(f->out) != GST_FLOW_OK) d->ctr.processing_errors.add();
+    f->out = nullptr;
+    free_frame(f);
+    return true;
+}
+
+/* ---------- Pad probes ---------- */
+
+static GstPadProbeReturn probe_cam_out(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    auto *d = (CustomData*)user_data;
+    if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
+        d->ctr.camera_frames.add();
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn probe_encoder_sink(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    auto *d = (CustomData*)user_data;
+    if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
+        d->ctr.encoder_frames.add();
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn probe_output(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    auto *d = (CustomData*)user_data;
+    if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) && GST_PAD_PROBE_INFO_BUFFER(info)) {
+        d->ctr.output_bytes.add(gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info)));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/* ---------- appsink callback: capture stage ---------- */
+
+static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
+    auto *d = (CustomData *)user_data;
+
+    GstSample *sample = gst_app_sink_pull_sample(appsink);
+    if (!sample) return GST_FLOW_ERROR;
+    GstBuffer *inbuf = gst_sample_get_buffer(sample);
+    if (!inbuf) { gst_sample_unref(sample); return GST_FLOW_ERROR; }
+
+    // Re-parse caps only when they change; each frame carries the geometry it was captured with
+    GstCaps *caps = gst_sample_get_caps(sample);
+    if (caps && caps != d->last_caps) {
+        gst_caps_replace(&d->last_caps, caps);
+        if (gst_video_info_from_caps(&d->video_info, caps)) {
+            const uint64_t geom = ((uint64_t)d->video_info.width << 32) | (uint32_t)d->video_info.height;
+            if (geom != d->geometry.load(std::memory_order_relaxed)) {
+                g_print("Video info: %dx%d\n", d->video_info.width, d->video_info.height);
+            }
+            d->geometry.store(geom, std::memory_order_release);
+        }
+    }
+    const uint64_t geom = d->geometry.load(std::memory_order_acquire);
+    if (geom == 0) { gst_sample_unref(sample); return GST_FLOW_OK; }
+
+    // Don't start a frame appsrc has no room for
+    if (!d->flow.admit()) { gst_sample_unref(sample); return GST_FLOW_OK; }
+
+    StagedFrame *f = new StagedFrame();
+    f->in = gst_buffer_ref(inbuf);
+    f->width = (int)(geom >> 32);
+    f->height = (int)(geom & 0xffffffffu);
+    d->graph->submit(f);
+
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+/* ---------- periodic status ---------- */
+
+static gboolean status_tick(gpointer user_data) {
+    auto *d = (CustomData*)user_data;
+
+    d->ctr.appsrc_level.set((int64_t)d->flow.level_bytes());
+
+    // Rates over the measured interval
+    const double interval_s = d->ctr.reg.tick();
+    double camera_fps = d->ctr.camera_frames.rate();
+    double encoder_fps = d->ctr.encoder_frames.rate();
+    double output_bitrate_kbps = d->ctr.output_bytes.rate() * 8.0 / 1000.0;
+
+    g_print(
+        "\n=== STAGED PIPELINE MONITORING (%.2fs interval) ===\n"
+        "Camera Capture Rate:     %6.1f fps\n"
+        "Encoder Input Rate:      %6.1f fps\n"
+        "Output Bitrate:          %6.1f kbps\n"
+        "Processing Errors:       %" G_GUINT64_FORMAT "\n",
+        interval_s, camera_fps, encoder_fps, output_bitrate_kbps, d->ctr.processing_errors.value());
+    d->graph->report();
+
+    const AppsrcFlowStats &fs = d->flow.stats();
+    g_print("appsrc (%s): level %" G_GUINT64_FORMAT " / %" G_GUINT64_FORMAT " KB | admitted %" G_GUINT64_FORMAT
+            " | shed %" G_GUINT64_FORMAT " | wasted %" G_GUINT64_FORMAT "\n",
+            d->flow.gating() ? "demand-driven" : "observe", d->flow.level_bytes() / 1024, d->flow.max_bytes() / 1024,
+            fs.admitted.load(), fs.shed.load(), fs.wasted.load());
+
+    d->trace.report();
+    if (d->copy_report) {
+        const uint64_t frames = d->ctr.encoder_frames.value();
+        CopyAccount::instance().report(frames - d->copy_prev_frames, encoder_fps);
+        d->copy_prev_frames = frames;
+    }
+    d->threads.report();
+    d->metrics.write_json();
+    return TRUE;
+}
+
+/* ---------- bus watch (quit main loop) ---------- */
+
+static gboolean bus_cb(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    auto *d = (CustomData*)user_data;
+    switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_ERROR: {
+            GError *e=NULL; gchar *dbg=NULL;
+            gst_message_parse_error(msg, &e, &dbg);
+            g_printerr("ERROR from %s: %s\n", GST_OBJECT_NAME(msg->src), e->message);
+            g_error_free(e); g_free(dbg);
+            if (d->loop) g_main_loop_quit(d->loop);
+            break;
+        }
+        case GST_MESSAGE_EOS:
+            g_print("EOS from %s\n", GST_OBJECT_NAME(msg->src));
+            if (d->loop) g_main_loop_quit(d->loop);
+            break;
+        default: break;
+    }
+    return TRUE;
+}
+
+// Ctrl+C / SIGTERM: leave the main loop so the shutdown path (trace file, reports) runs
+static gboolean quit_cb(gpointer user_data) {
+    auto *d = (CustomData*)user_data;
+    if (d->loop) g_main_loop_quit(d->loop);
+    return G_SOURCE_CONTINUE;
+}
+
+int main(int argc, char *argv[]) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+    gst_init(&argc, &argv);
+
+    gboolean use_h265 = FALSE;
+    int bitrate_kbps = 20000;
+    int v_width = 1920, v_height = 1080, fps = 60;
+    const char *backend_name = "cpu";
+    const char *xclbin_path = NULL;
+    const char *topology = TOPOLOGY_PARALLEL;
+    const char *thread_spec = NULL;
+    int cpu_threads = 1, appsrc_queue = 2;
+    gboolean keep_chroma = FALSE;
+    const char *metrics_json = NULL, *metrics_listen = NULL;
+    gboolean trace_latency = FALSE;
+    const char *trace_events = NULL;
+    double trace_ring_s = 0.0;
+    gboolean perf = FALSE;
+    gboolean copy_report = FALSE;
+
+    // --- argv parsing ---
+    for (int i=1;i<argc;++i){
+        if (g_str_has_prefix(argv[i],"--codec=")) { const char* v=strchr(argv[i],'='); if(v&&g_ascii_strcasecmp(v+1,"h265")==0) use_h265=TRUE; }
+        else if (g_str_has_prefix(argv[i],"--bitrate=")) { int b=atoi(strchr(argv[i],'=')+1); if(b>0) bitrate_kbps=b; }
+        else if (g_str_has_prefix(argv[i],"--width=")) { int w=atoi(strchr(argv[i],'=')+1); if(w>0) v_width=w; }
+        else if (g_str_has_prefix(argv[i],"--height=")) { int h=atoi(strchr(argv[i],'=')+1); if(h>0) v_height=h; }
+        else if (g_str_has_prefix(argv[i],"--fps=")) { int f=atoi(strchr(argv[i],'=')+1); if(f>0) fps=f; }
+        else if (g_str_has_prefix(argv[i],"--backend=")) { backend_name=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--xclbin=")) { xclbin_path=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--cpu-threads=")) { int t=atoi(strchr(argv[i],'=')+1); if(t>0) cpu_threads=t; }
+        else if (g_str_has_prefix(argv[i],"--topology=")) { topology=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--thread-policy=")) { thread_spec=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--appsrc-queue=")) { int n=atoi(strchr(argv[i],'=')+1); if(n>0) appsrc_queue=n; }
+        else if (g_strcmp0(argv[i],"--keep-chroma")==0) { keep_chroma=TRUE; }
+        else if (g_str_has_prefix(argv[i],"--metrics-json=")) { metrics_json=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--metrics-port=")) { metrics_listen=strchr(argv[i],'=')+1; }
+        else if (g_strcmp0(argv[i],"--trace-latency")==0) { trace_latency=TRUE; }
+        else if (g_str_has_prefix(argv[i],"--trace-events=")) { trace_events=strchr(argv[i],'=')+1; }
+        else if (g_str_has_prefix(argv[i],"--trace-ring=")) { double v=atof(strchr(argv[i],'=')+1); if(v>0) trace_ring_s=v; }
+        else if (g_strcmp0(argv[i],"--perf")==0) { perf=TRUE; }
+        else if (g_strcmp0(argv[i],"--copy-report")==0) { copy_report=TRUE; }
+    }
+    if (g_ascii_strcasecmp(topology, "parallel") == 0) topology = TOPOLOGY_PARALLEL;
+    else if (g_ascii_strcasecmp(topology, "serial") == 0) topology = TOPOLOGY_SERIAL;
+
+    CustomData d{};
+    d.keep_chroma = keep_chroma;
+    d.flow.configure(appsrc_queue, true);
+    if (metrics_json && !d.metrics.open_json(metrics_json)) return -1;
+    if (metrics_listen && !d.metrics.serve(metrics_listen)) return -1;
+    if (trace_latency) d.trace.enable(d.ctr.reg);
+    if (trace_events) TraceEvents::instance().enable(1 << 16, trace_ring_s);
+    if (perf) perf_counters_enable();
+    if (copy_report) {
+        // Minimum: read the captured Y plane (and chroma when kept) once, write NV12 once
+        const uint64_t y_size = (uint64_t)v_width * v_height;
+        d.copy_report = true;
+        CopyAccount::instance().set_min_bytes_per_frame((keep_chroma ? y_size * 3 / 2 : y_size) + y_size * 3 / 2);
+        CopyAccount::instance().measure_bandwidth();
+    }
+    if (thread_spec) {
+        if (!d.threads.parse(thread_spec)) return -1;
+        d.threads.print_config();
+    }
+    // Band helpers of the CPU backends (created below) are placed as the "pool" role
+    ForkJoinPool::set_thread_init([&d](int worker) {
+        char name[32];
+        snprintf(name, sizeof(name), "pool-%d", worker);
+        d.threads.apply_current(ROLE_POOL, name);
+    });
+
+    // Stage chain; defaults are overridden by the topology string
+    d.graph.reset(new StageGraph<StagedFrame*>([](StagedFrame *&f) { free_frame(f); }));
+    CustomData *dp = &d;
+    StageConfig c_convert; c_convert.name = "convert";
+    StageConfig c_equalize; c_equalize.name = "equalize";
+    StageConfig c_pack; c_pack.name = "pack";
+    StageConfig c_push; c_push.name = "push"; c_push.ordered = true;
+    d.graph->add_stage(c_convert, [dp](StagedFrame *&f, int) { return stage_convert(dp, f); });
+    const int eq_stage = d.graph->add_stage(c_equalize, [dp](StagedFrame *&f, int w) { return stage_equalize(dp, f, w); });
+    d.graph->add_stage(c_pack, [dp](StagedFrame *&f, int) { return stage_pack(dp, f); });
+    d.graph->add_stage(c_push, [dp](StagedFrame *&f, int) { return stage_push(dp, f); });
+    if (!d.graph->parse_topology(topology)) return -1;
+
+    // One backend per equalize thread (device contexts are not shared between threads)
+    for (int i = 0; i < d.graph->config(eq_stage).threads; ++i) {
+        std::unique_ptr<FrameBackend> be = make_frame_backend(backend_name, xclbin_path, cpu_threads);
+        if (!be) return -1;
+        d.backends.push_back(std::move(be));
+    }
+
+    g_print("Encoder: %s, target-bitrate: %d kbps, %s backend, %dx%d@%dfps\n",
+            use_h265 ? "H.265" : "H.264", bitrate_kbps, backend_name, v_width, v_height, fps);
+    d.graph->print_topology();
+
+    // Stage threads: equalize counts as worker, push feeds appsrc
+    d.graph->set_thread_hook([dp](const char *stage, int worker) {
+        char name[32];
+        snprintf(name, sizeof(name), "%s-%d", stage, worker);
+        dp->threads.apply_current(g_strcmp0(stage, "push") == 0 ? ROLE_PUSH : ROLE_WORKER, name);
+    });
+
+    // Capture pipeline
+    GError *err=NULL;
+    gchar *sink_str = g_strdup_printf(
+        "v4l2src device=/dev/video0 io-mode=4 ! "
+        "video/x-raw,format=NV12,width=%d,height=%d,framerate=60/1 ! "
+        "videorate drop-only=true max-rate=%d ! "
+        "queue name=q_cam leaky=downstream max-size-buffers=12 max-size-time=0 max-size-bytes=0 ! "
+        "appsink name=cv_sink emit-signals=true max-buffers=2 drop=true sync=false",
+        v_width, v_height, fps
+    );
+    GstElement *sink_pipe = gst_parse_launch(sink_str, &err);
+    g_free(sink_str);
+    if (!sink_pipe) { g_printerr("Create sink pipeline failed: %s\n", err?err->message:"?"); g_clear_error(&err); return -1; }
+    d.appsink = gst_bin_get_by_name(GST_BIN(sink_pipe), "cv_sink");
+    if (!d.appsink) { g_printerr("Failed to find appsink 'cv_sink'\n"); gst_object_unref(sink_pipe); return -1; }
+
+    // Streaming pipeline; capture timestamps are passed through
+    gchar *src_str = g_strdup_printf(
+        "appsrc name=my_src is-live=true format=GST_FORMAT_TIME do-timestamp=false ! "
+        "video/x-raw,format=NV12,width=%d,height=%d,framerate=%d/1 ! "
+        "queue name=q_after_src leaky=downstream max-size-buffers=2 max-size-time=0 max-size-bytes=0 ! "
+        "%s name=enc num-slices=8 periodicity-idr=240 cpb-size=500 gdr-mode=horizontal "
+        "initial-delay=250 control-rate=low-latency prefetch-buffer=true target-bitrate=%d "
+        "gop-mode=low-delay-p ! %s ! "
+        "%s name=pay ! "
+        "udpsink name=net buffer-size=60000000 host=192.168.25.69 port=5004 async=false max-lateness=-1 qos-dscp=60",
+        v_width, v_height, fps,
+        use_h265 ? "omxh265enc" : "omxh264enc", bitrate_kbps,
+        use_h265 ? "video/x-h265,alignment=au" : "video/x-h264,alignment=nal",
+        use_h265 ? "rtph265pay" : "rtph264pay"
+    );
+    GstElement *src_pipe = gst_parse_launch(src_str, &err);
+    g_free(src_str);
+    if (!src_pipe) {
+        g_printerr("Create src pipeline failed: %s\n", err?err->message:"?");
+        g_clear_error(&err);
+        gst_object_unref(sink_pipe);
+        return -1;
+    }
+    d.appsrc = gst_bin_get_by_name(GST_BIN(src_pipe), "my_src");
+    if (!d.appsrc) {
+        g_printerr("Failed to find appsrc 'my_src'\n");
+        gst_object_unref(src_pipe);
+        gst_object_unref(sink_pipe);
+        return -1;
+    }
+    d.flow.attach(d.appsrc);
+
+    // Probes for frame rate monitoring
+    {
+        GstElement *q_cam = gst_bin_get_by_name(GST_BIN(sink_pipe), "q_cam");
+        if (q_cam) {
+            if (GstPad *p = gst_element_get_static_pad(q_cam, "src")) {
+                gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, probe_cam_out, &d, NULL);
+                gst_object_unref(p);
+            }
+            gst_object_unref(q_cam);
+        }
+    }
+    {
+        GstElement *enc = gst_bin_get_by_name(GST_BIN(src_pipe), "enc");
+        if (enc) {
+            if (GstPad *p = gst_element_get_static_pad(enc, "sink")) {
+                gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, probe_encoder_sink, &d, NULL);
+                gst_object_unref(p);
+            }
+            gst_object_unref(enc);
+        }
+    }
+    {
+        GstElement *pay = gst_bin_get_by_name(GST_BIN(src_pipe), "pay");
+        if (pay) {
+            if (GstPad *p = gst_element_get_static_pad(pay, "src")) {
+                gst_pad_add_probe(p, GST_PAD_PROBE_TYPE_BUFFER, probe_output, &d, NULL);
+                gst_object_unref(p);
+            }
+            gst_object_unref(pay);
+        }
+    }
+
+    // Latency trace points (capture meta is carried across the bridge in the pack stage)
+    if (d.trace.enabled()) {
+        d.trace.add_probe(sink_pipe, "v4l2src0", "src", TRACE_CAPTURE);
+        d.trace.add_probe(sink_pipe, "cv_sink", "sink", TRACE_APPSINK);
+        d.trace.add_probe(src_pipe, "enc", "sink", TRACE_ENCODER);
+        d.trace.add_probe(src_pipe, "pay", "sink", TRACE_PAYLOADER);
+        d.trace.add_probe(src_pipe, "net", "sink", TRACE_UDPSINK);
+    }
+
+    // Streaming threads are placed as they start
+    d.threads.bind("v4l2src", ROLE_CAPTURE);
+    d.threads.bind("q_cam", ROLE_APPSINK);       // runs new_sample_cb (capture stage)
+    d.threads.bind("q_after_src", ROLE_ENCODER);
+    d.threads.bind("enc", ROLE_ENCODER);
+    d.threads.attach(sink_pipe);
+    d.threads.attach(src_pipe);
+
+    d.graph->start();
+    g_signal_connect(d.appsink, "new-sample", G_CALLBACK(new_sample_cb), &d);
+
+    // GLib loop + watches + status timer
+    d.loop = g_main_loop_new(NULL, FALSE);
+    GstBus *bus_sink = gst_element_get_bus(sink_pipe);
+    GstBus *bus_src  = gst_element_get_bus(src_pipe);
+    gst_bus_add_watch(bus_sink, bus_cb, &d);
+    gst_bus_add_watch(bus_src,  bus_cb, &d);
+    g_unix_signal_add(SIGINT, quit_cb, &d);
+    g_unix_signal_add(SIGTERM, quit_cb, &d);
+    g_timeout_add_seconds(2, status_tick, &d);
+
+    // One clock and one base time for both pipelines, so capture PTS pass through
+    {
+        GstClock *clock = gst_system_clock_obtain();
+        gst_pipeline_use_clock(GST_PIPELINE(sink_pipe), clock);
+        gst_pipeline_use_clock(GST_PIPELINE(src_pipe), clock);
+        GstClockTime base = gst_clock_get_time(clock);
+        gst_element_set_start_time(sink_pipe, GST_CLOCK_TIME_NONE);
+        gst_element_set_start_time(src_pipe, GST_CLOCK_TIME_NONE);
+        gst_element_set_base_time(sink_pipe, base);
+        gst_element_set_base_time(src_pipe, base);
+        gst_object_unref(clock);
+    }
+
+    // Start & run
+    gst_element_set_state(src_pipe,  GST_STATE_PLAYING);
+    gst_element_set_state(sink_pipe, GST_STATE_PLAYING);
+    if (d.trace.enabled() && gst_element_get_state(sink_pipe, NULL, NULL, GST_SECOND) != GST_STATE_CHANGE_FAILURE) {
+        d.trace.set_capture_clock(sink_pipe);
+    }
+    g_print("Staged equalization pipeline running. Press Ctrl+C to exit.\n");
+    d.threads.apply_current(ROLE_MAIN, "main-loop");
+    g_main_loop_run(d.loop);
+
+    // Shutdown: no more captures, then stop the stages (queued frames are freed)
+    gst_element_set_state(sink_pipe, GST_STATE_NULL);
+    d.graph->stop();
+    gst_element_set_state(src_pipe,  GST_STATE_NULL);
+    if (trace_events) TraceEvents::instance().write_chrome_json(trace_events);
+    gst_object_unref(bus_sink);
+    gst_object_unref(bus_src);
+    gst_caps_replace(&d.last_caps, NULL);
+    gst_object_unref(d.appsink);
+    gst_object_unref(d.appsrc);
+    gst_object_unref(sink_pipe);
+    gst_object_unref(src_pipe);
+    g_main_loop_unref(d.loop);
+    return 0;
+}
@@ -0,0 +1,279 @@
+// stall_watchdog.h
+// Watchdog thread over per-stage progress timestamps. Frame-count deltas per tick can't
+// tell a stall from a slow second; last-progress times can. When a stage makes no
+// progress for the threshold, the watchdog prints a structured diagnosis and runs an
+// optional recovery hook.
+//
+//   StallWatchdog wd;
+//   int cam = wd.add_stage("camera");       // stages in pipeline order
+//   int enc = wd.add_stage("encoder-out");
+//   wd.add_queue(queue_element);             // GstQueue: current-level-* in the report
+//   wd.add_depth("appsrc_bytes", [] { ... });
+//   wd.add_inflight(enc_in, enc_out);        // frames between two stages that never drop
+//   wd.on_stall([](const StallReport &r) { ... });   // recovery, on the watchdog thread
+//   wd.on_poll([] { ... });                  // other periodic work on the same thread
+//   wd.start(1000);
+//   wd.progress(cam);                        // from probes / callbacks, any thread
+//   wd.wake();                               // poll now (e.g. work queued for on_poll)
+//
+// The reported stage is the most upstream stalled one; stages below it that stall
+// afterwards are consequences and are not reported. If a stage upstream of it still
+// advances, the stall sits between the two (cause=blocked_after:<stage>; the queue
+// levels show where frames pile up), otherwise the source stopped. Each stall is
+// reported once; the stage re-arms when it advances again.
+//
+// Report (one "[STALL]" block, key=value):
+//   [STALL] stage=encoder-in stalled_ms=1012 cause=blocked_after:appsrc upstream_frames_since=61 in_flight=10 stalls=1
+//   [STALL]   stages: camera=2ms/#3601 appsink=2ms/#3598 ... encoder-in=1012ms/#3520 ...
+//   [STALL]   queues: preenc_q=8/8buf,24883200B,133.3ms cap_q=0/8buf,0B,0.0ms
+//   [STALL]   depths: appsrc_bytes=6220800
+//   [STALL]   recovery: flush src pipeline
+//
+// This is the one stall detector; the flight recorder (flight_recorder.h) runs its stall
+// dumps and incident snapshots on it (on_stall / on_poll) instead of a thread of its own.
+
+#ifndef _STALL_WATCHDOG_H_
+#define _STALL_WATCHDOG_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct StallReport {
+    int         stage{-1};                // stalled stage (most upstream one)
+    std::string stage_name;
+    int64_t     stalled_us{0};            // since its last progress
+    int         upstream{-1};             // neighbour still advancing, -1 = none (source stopped)
+    uint64_t    upstream_frames_since{0}; // frames it passed since the stalled stage last moved
+    int64_t     in_flight{0};             // queued + between add_inflight() stage pairs
+    uint64_t    stalls{0};                // reports so far, this one included
+    std::string text;                     // the printed block
+};
+
+class StallWatchdog {
+public:
+    using StallFn = std::function<void(const StallReport &)>;
+    using DepthFn = std::function<int64_t()>;
+
+    StallWatchdog() = default;
+    StallWatchdog(const StallWatchdog &) = delete;
+    StallWatchdog &operator=(const StallWatchdog &) = delete;
+    ~StallWatchdog() {
+        stop();
+        for (GstElement *q : queues_) gst_object_unref(q);
+    }
+
+    /* ---------- setup, before start() ---------- */
+
+    int add_stage(const char *name) {
+        stages_.emplace_back(new Stage());
+        stages_.back()->name = name;
+        return (int)stages_.size() - 1;
+    }
+
+    // GstQueue (or anything with current-level-buffers/-bytes/-time and max-size-buffers)
+    void add_queue(GstElement *queue) {
+        if (queue) queues_.push_back((GstElement *)gst_object_ref(queue));
+    }
+
+    // Extra level in the report; frames=true adds it to in_flight
+    void add_depth(const char *name, DepthFn fn, bool frames = false) {
+        depths_.push_back(Depth{name, std::move(fn), frames});
+    }
+
+    // Frames that passed `from` and not yet `to`; only for spans that never drop
+    void add_inflight(int from, int to) { inflight_.emplace_back(from, to); }
+
+    void on_stall(StallFn fn) { on_stall_ = std::move(fn); }
+
+    // Runs on the watchdog thread after every poll's stall check
+    void on_poll(std::function<void()> fn) { on_poll_ = std::move(fn); }
+
+    /* ---------- runtime ---------- */
+
+    // Stage advanced; relaxed stores only, callable from any streaming thread
+    void progress(int stage) {
+        if (stage < 0 || stage >= (int)stages_.size()) return;
+        Stage &s = *stages_[stage];
+        s.count.fetch_add(1, std::memory_order_relaxed);
+        s.last_us.store(g_get_monotonic_time(), std::memory_order_relaxed);
+    }
+
+    // threshold_ms <= 0: no stall checks, on_poll only
+    void start(int threshold_ms) {
+        if (worker_.joinable() || (stages_.empty() && !on_poll_)) return;
+        threshold_us_ = (int64_t)threshold_ms * 1000;
+        quit_ = false;
+        worker_ = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        if (!worker_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            quit_ = true;
+        }
+        cv_.notify_one();
+        worker_.join();
+    }
+
+    // Next poll now rather than at the end of the interval
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            wake_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    bool running() const { return worker_.joinable(); }
+    uint64_t stalls() const { return stalls_.load(std::memory_order_relaxed); }
+
+private:
+    struct Stage {
+        std::string name;
+        std::atomic<uint64_t> count{0};
+        std::atomic<int64_t> last_us{0};
+        // watchdog thread only
+        uint64_t seen_count{0};          // count at the previous poll
+        uint64_t upstream_at_progress{0}; // upstream neighbour's count when this one last moved
+        bool stalled{false};
+    };
+
+    struct Depth {
+        std::string name;
+        DepthFn fn;
+        bool frames;
+    };
+
+    void run() {
+        const int64_t poll_us = std::max<int64_t>(threshold_us_ / 4, 20000);
+        std::unique_lock<std::mutex> lock(mu_);
+        while (!quit_) {
+            cv_.wait_for(lock, std::chrono::microseconds(poll_us), [this] { return quit_ || wake_; });
+            if (quit_) break;
+            wake_ = false;
+            lock.unlock();
+            if (threshold_us_ > 0) check(g_get_monotonic_time());
+            if (on_poll_) on_poll_();
+            lock.lock();
+        }
+    }
+
+    // A stage that stalls while something upstream is already stalled is a consequence,
+    // not a new stall
+    void check(int64_t now) {
+        const int n = (int)stages_.size();
+        int culprit = -1;
+        bool upstream_stalled = false;
+        for (int i = 0; i < n; ++i) {
+            Stage &s = *stages_[i];
+            const uint64_t count = s.count.load(std::memory_order_relaxed);
+            const int64_t last = s.last_us.load(std::memory_order_relaxed);
+            if (count != s.seen_count) {
+                s.seen_count = count;
+                s.upstream_at_progress = i > 0 ? stages_[i - 1]->count.load(std::memory_order_relaxed) : 0;
+            }
+            const bool late = last != 0 && now - last > threshold_us_;
+            if (!late) {
+                s.stalled = false;
+                continue;
+            }
+            if (!s.stalled && !upstream_stalled) culprit = i;
+            s.stalled = true;
+            upstream_stalled = true;
+        }
+        if (culprit >= 0) report(culprit, now);
+    }
+
+    void report(int stage, int64_t now) {
+        const Stage &s = *stages_[stage];
+        StallReport r;
+        r.stage = stage;
+        r.stage_name = s.name;
+        r.stalled_us = now - s.last_us.load(std::memory_order_relaxed);
+        r.stalls = stalls_.fetch_add(1, std::memory_order_relaxed) + 1;
+        // Nearest upstream stage that is running (stages that never ran don't count)
+        for (int i = stage - 1; i >= 0; --i) {
+            if (stages_[i]->last_us.load(std::memory_order_relaxed) == 0) continue;
+            r.upstream = i;
+            if (i == stage - 1) {
+                r.upstream_frames_since = stages_[i]->count.load(std::memory_order_relaxed) - s.upstream_at_progress;
+            }
+            break;
+        }
+
+        std::string stage_line, queue_line, depth_line;
+        char buf[256];
+        for (const auto &st : stages_) {
+            const int64_t last = st->last_us.load(std::memory_order_relaxed);
+            if (last) snprintf(buf, sizeof(buf), " %s=%" G_GINT64_FORMAT "ms/#%" G_GUINT64_FORMAT, st->name.c_str(),
+                               (now - last) / 1000, st->count.load(std::memory_order_relaxed));
+            else snprintf(buf, sizeof(buf), " %s=never", st->name.c_str());
+            stage_line += buf;
+        }
+        for (GstElement *q : queues_) {
+            guint level_buffers = 0, level_bytes = 0, max_buffers = 0;
+            guint64 level_time = 0;
+            g_object_get(q, "current-level-buffers", &level_buffers, "current-level-bytes", &level_bytes,
+                         "current-level-time", &level_time, "max-size-buffers", &max_buffers, NULL);
+            snprintf(buf, sizeof(buf), " %s=%u/%ubuf,%uB,%.1fms", GST_OBJECT_NAME(q), level_buffers, max_buffers,
+                     level_bytes, level_time / 1e6);
+            queue_line += buf;
+            r.in_flight += level_buffers;
+        }
+        for (const Depth &dp : depths_) {
+            const int64_t v = dp.fn();
+            snprintf(buf, sizeof(buf), " %s=%" G_GINT64_FORMAT, dp.name.c_str(), v);
+            depth_line += buf;
+            if (dp.frames) r.in_flight += v;
+        }
+        for (const auto &p : inflight_) {
+            const uint64_t a = stages_[p.first]->count.load(std::memory_order_relaxed);
+            const uint64_t b = stages_[p.second]->count.load(std::memory_order_relaxed);
+            if (a > b) r.in_flight += (int64_t)(a - b);
+        }
+
+        const std::string cause = r.upstream >= 0 ? "blocked_after:" + stages_[r.upstream]->name : "source_stopped";
+        snprintf(buf, sizeof(buf),
+                 "[STALL] stage=%s stalled_ms=%" G_GINT64_FORMAT " cause=%s upstream_frames_since=%" G_GUINT64_FORMAT
+                 " in_flight=%" G_GINT64_FORMAT " stalls=%" G_GUINT64_FORMAT "\n",
+                 s.name.c_str(), r.stalled_us / 1000, cause.c_str(), r.upstream_frames_since, r.in_flight, r.stalls);
+        r.text = buf;
+        r.text += "[STALL]   stages:" + stage_line + "\n";
+        if (!queue_line.empty()) r.text += "[STALL]   queues:" + queue_line + "\n";
+        if (!depth_line.empty()) r.text += "[STALL]   depths:" + depth_line + "\n";
+        g_printerr("%s", r.text.c_str());
+
+        if (on_stall_) on_stall_(r);
+    }
+
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::vector<GstElement *> queues_;
+    std::vector<Depth> depths_;
+    std::vector<std::pair<int, int>> inflight_;
+    StallFn on_stall_;
+    std::function<void()> on_poll_;
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::thread worker_;
+    bool quit_{false};
+    bool wake_{false};
+    int64_t threshold_us_{1000000};
+    std::atomic<uint64_t> stalls_{0};
+};
+
+#endif
+// _STALL_WATCHDOG_H_
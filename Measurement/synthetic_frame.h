@@ -0,0 +1,26 @@
+// synthetic_frame.h
+// Deterministic test Y planes for the offline benches (backend_bench, coprocess_demo):
+// a low-contrast gradient plus noise so the equalizer has real work to do, different
+// but reproducible per frame index.
+
+#ifndef _SYNTHETIC_FRAME_H_
+#define _SYNTHETIC_FRAME_H_
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+static inline void fill_synthetic_frame(std::vector<uint8_t> &y, int width, int height, int frame) {
+    guint32 seed = 0x9e3779b9u * (guint32)(frame + 1);
+    for (int r = 0; r < height; ++r) {
+        uint8_t *row = y.data() + (size_t)r * width;
+        for (int c = 0; c < width; ++c) {
+            seed = seed * 1664525u + 1013904223u;
+            row[c] = (uint8_t)(64 + ((r + c + frame) & 63) + ((seed >> 28) & 7));
+        }
+    }
+}
+
+#endif
+// _SYNTHETIC_FRAME_H_
@@ -0,0 +1,368 @@
+// thread_policy.h
+// Thread placement for the two-pipeline bridges: which cores each role may run on,
+// optional SCHED_FIFO priority, and per-thread CPU time to check the result.
+//
+// Roles:
+//   capture  - v4l2src streaming thread
+//   appsink  - the thread that runs new-sample (the queue in front of the appsink)
+//   worker   - frame worker threads
+//   pool     - intra-frame helper threads (BandEqualizer / CpuBackend pools; the program
+//              applies it from ForkJoinPool::set_thread_init, see staged.cpp)
+//   push     - whoever calls gst_app_src_push_buffer (main loop or pacer) and appsrc's task
+//   encoder  - the queue in front of the encoder and the encoder's own output task
+//   main     - the GLib main loop
+//
+// Spec (--thread-policy=...), comma separated, every entry optional:
+//   <role>=<cpus>[@<fifo prio>]   cpus: "2", "1-2", "0+3" (ranges joined with '+')
+//   cvthreads=<n>                 OpenCV pool size (cv::setNumThreads); the pool inherits
+//                                 the affinity of the thread that first uses it
+// e.g. capture=0@60,appsink=0@50,worker=1-2,push=3@40,encoder=3,cvthreads=2
+// "default" picks THREAD_POLICY_DEFAULT_4CORE.
+//
+// GStreamer streaming threads are placed from a bus sync handler: the STREAM_STATUS
+// ENTER message is posted from the new thread itself, so the policy of the element that
+// owns the task (matched by name prefix, see bind()) is applied right there.
+//
+// When SCHED_FIFO is refused (no CAP_SYS_NICE), the priority is retried at the
+// RLIMIT_RTPRIO ceiling; if that fails too the thread stays SCHED_OTHER, a warning is
+// printed once and the report shows "other(rt denied)".
+
+#ifndef _THREAD_POLICY_H_
+#define _THREAD_POLICY_H_
+
+#include <gst/gst.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define THREAD_POLICY_DEFAULT_4CORE "capture=0,appsink=0,worker=1-2,pool=1-2,push=3,encoder=3,main=3,cvthreads=2"
+
+enum ThreadRole {
+    ROLE_CAPTURE = 0,
+    ROLE_APPSINK,
+    ROLE_WORKER,
+    ROLE_POOL,
+    ROLE_PUSH,
+    ROLE_ENCODER,
+    ROLE_MAIN,
+    ROLE_COUNT
+};
+
+static inline const char *thread_role_name(ThreadRole r) {
+    static const char *names[ROLE_COUNT] = {"capture", "appsink", "worker", "pool", "push", "encoder", "main"};
+    return (r >= 0 && r < ROLE_COUNT) ? names[r] : "?";
+}
+
+class ThreadPolicy {
+public:
+    ThreadPolicy() {
+        for (auto &r : roles_) CPU_ZERO(&r.cpus);
+    }
+
+    ThreadPolicy(const ThreadPolicy &) = delete;
+    ThreadPolicy &operator=(const ThreadPolicy &) = delete;
+
+    // Parse a spec (see header). Unknown keys or bad CPU lists fail the whole spec.
+    bool parse(const char *spec) {
+        if (!spec || !*spec) return false;
+        if (strcmp(spec, "default") == 0) spec = THREAD_POLICY_DEFAULT_4CORE;
+
+        std::string s(spec);
+        size_t pos = 0;
+        while (pos <= s.size()) {
+            size_t end = s.find(',', pos);
+            if (end == std::string::npos) end = s.size();
+            std::string item = s.substr(pos, end - pos);
+            pos = end + 1;
+            if (item.empty()) continue;
+
+            size_t eq = item.find('=');
+            if (eq == std::string::npos) {
+                g_printerr("[threads] bad entry '%s' (expected role=cpus[@prio])\n", item.c_str());
+                return false;
+            }
+            std::string key = item.substr(0, eq), val = item.substr(eq + 1);
+            if (key == "cvthreads") {
+                cv_threads_ = atoi(val.c_str());
+                continue;
+            }
+            int role = -1;
+            for (int r = 0; r < ROLE_COUNT; ++r) {
+                if (key == thread_role_name((ThreadRole)r)) role = r;
+            }
+            if (role < 0) {
+                g_printerr("[threads] unknown role '%s'\n", key.c_str());
+                return false;
+            }
+            RoleConfig &rc = roles_[role];
+            size_t at = val.find('@');
+            if (at != std::string::npos) {
+                rc.rt_prio = atoi(val.c_str() + at + 1);
+                val = val.substr(0, at);
+            }
+            if (!parse_cpus(val, &rc.cpus)) {
+                g_printerr("[threads] bad CPU list '%s' for %s\n", val.c_str(), key.c_str());
+                return false;
+            }
+            rc.has_cpus = CPU_COUNT(&rc.cpus) > 0;
+        }
+        enabled_ = true;
+        return true;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    // -1 when not configured (leave OpenCV's default)
+    int opencv_threads() const { return cv_threads_; }
+
+    // Streaming threads of elements whose name starts with prefix get this role
+    void bind(const char *element_prefix, ThreadRole role) {
+        binds_.push_back({element_prefix, role});
+    }
+
+    // Install the STREAM_STATUS sync handler on a pipeline's bus (other messages pass
+    // through to the regular watch)
+    void attach(GstElement *pipeline) {
+        GstBus *bus = gst_element_get_bus(pipeline);
+        gst_bus_set_sync_handler(bus, &ThreadPolicy::sync_handler, this, NULL);
+        gst_object_unref(bus);
+    }
+
+    // Place the calling thread and register it for the CPU-time report. Always
+    // registers; placement only happens when a policy was parsed.
+    void apply_current(ThreadRole role, const char *name) {
+        ThreadRecord rec;
+        rec.tid = (pid_t)syscall(SYS_gettid);
+        rec.name = name ? name : thread_role_name(role);
+        rec.role = role;
+
+        const RoleConfig &rc = roles_[role];
+        if (enabled_ && rc.has_cpus) {
+            int rc_aff = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &rc.cpus);
+            if (rc_aff != 0) {
+                g_printerr("[threads] %s: affinity failed (%s), left unpinned\n", rec.name.c_str(), strerror(rc_aff));
+            } else {
+                rec.pinned = true;
+            }
+        }
+        if (enabled_ && rc.rt_prio > 0) rec.sched = set_fifo(rc.rt_prio, &rec.prio);
+
+        std::lock_guard<std::mutex> lk(mu_);
+        threads_.push_back(rec);
+    }
+
+    // One line per registered thread: allowed CPUs, scheduling, CPU use since the last
+    // call (percent of one core over the wall interval) and the CPU it last ran on
+    void report() {
+        std::lock_guard<std::mutex> lk(mu_);
+        const gint64 now = g_get_monotonic_time();
+        const double wall_s = last_report_us_ > 0 ? (now - last_report_us_) / 1e6 : 0.0;
+        last_report_us_ = now;
+        const long ticks = sysconf(_SC_CLK_TCK);
+
+        g_print("Threads (cpu%% of one core since last report):\n");
+        for (auto &t : threads_) {
+            uint64_t cpu_ticks = 0;
+            int last_cpu = -1;
+            if (!read_task_stat(t.tid, &cpu_ticks, &last_cpu)) {
+                if (!t.exited) g_print("  %-16s %-8s exited\n", t.name.c_str(), thread_role_name(t.role));
+                t.exited = true;
+                continue;
+            }
+            double pct = 0.0;
+            if (wall_s > 0.0 && t.seen) pct = 100.0 * (double)(cpu_ticks - t.prev_ticks) / (double)ticks / wall_s;
+            t.prev_ticks = cpu_ticks;
+            t.seen = true;
+
+            char cpus[64];
+            format_cpus(t.tid, cpus, sizeof(cpus));
+            char sched[32];
+            if (t.sched == SCHED_RESULT_FIFO) snprintf(sched, sizeof(sched), "fifo/%d", t.prio);
+            else if (t.sched == SCHED_RESULT_DENIED) snprintf(sched, sizeof(sched), "other(rt denied)");
+            else snprintf(sched, sizeof(sched), "other");
+            g_print("  %-16s %-8s tid %-6d cpus %-8s %-16s %5.1f%%  on cpu %d\n",
+                    t.name.c_str(), thread_role_name(t.role), (int)t.tid, cpus, sched, pct, last_cpu);
+        }
+    }
+
+    void print_config() const {
+        if (!enabled_) return;
+        for (int r = 0; r < ROLE_COUNT; ++r) {
+            const RoleConfig &rc = roles_[r];
+            if (!rc.has_cpus && rc.rt_prio <= 0) continue;
+            char cpus[64];
+            format_set(&rc.cpus, cpus, sizeof(cpus));
+            g_print("[threads] %-8s cpus %s%s", thread_role_name((ThreadRole)r), rc.has_cpus ? cpus : "any",
+                    rc.rt_prio > 0 ? "" : "\n");
+            if (rc.rt_prio > 0) g_print(" fifo %d\n", rc.rt_prio);
+        }
+        if (cv_threads_ >= 0) g_print("[threads] opencv pool %d thread(s)\n", cv_threads_);
+    }
+
+private:
+    enum SchedResult { SCHED_RESULT_OTHER = 0, SCHED_RESULT_FIFO, SCHED_RESULT_DENIED };
+
+    struct RoleConfig {
+        cpu_set_t cpus;
+        bool has_cpus{false};
+        int rt_prio{0};
+    };
+
+    struct Bind {
+        std::string prefix;
+        ThreadRole role;
+    };
+
+    struct ThreadRecord {
+        pid_t tid{0};
+        std::string name;
+        ThreadRole role{ROLE_MAIN};
+        bool pinned{false};
+        SchedResult sched{SCHED_RESULT_OTHER};
+        int prio{0};
+        uint64_t prev_ticks{0};
+        bool seen{false};
+        bool exited{false};
+    };
+
+    static GstBusSyncReply sync_handler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+        if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_STREAM_STATUS) return GST_BUS_PASS;
+        auto *self = (ThreadPolicy *)user_data;
+
+        GstStreamStatusType type;
+        GstElement *owner = NULL;
+        gst_message_parse_stream_status(msg, &type, &owner);
+        if (type != GST_STREAM_STATUS_TYPE_ENTER || !owner) return GST_BUS_PASS;
+
+        // Posted from the streaming thread that is starting, so "current" is that thread
+        const gchar *name = GST_OBJECT_NAME(owner);
+        for (const Bind &b : self->binds_) {
+            if (g_str_has_prefix(name, b.prefix.c_str())) {
+                self->apply_current(b.role, name);
+                return GST_BUS_PASS;
+            }
+        }
+        return GST_BUS_PASS;
+    }
+
+    SchedResult set_fifo(int prio, int *applied) {
+        struct sched_param sp;
+        memset(&sp, 0, sizeof(sp));
+        sp.sched_priority = prio;
+        int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+        if (rc == EPERM) {
+            // Unprivileged but allowed some RT range: retry at the ceiling
+            struct rlimit rl;
+            if (getrlimit(RLIMIT_RTPRIO, &rl) == 0 && rl.rlim_cur > 0 && rl.rlim_cur != RLIM_INFINITY &&
+                (rlim_t)prio > rl.rlim_cur) {
+                sp.sched_priority = (int)rl.rlim_cur;
+                rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+            }
+        }
+        if (rc == 0) {
+            *applied = sp.sched_priority;
+            return SCHED_RESULT_FIFO;
+        }
+        if (!rt_warned_.exchange(true)) {
+            struct rlimit rl;
+            long lim = getrlimit(RLIMIT_RTPRIO, &rl) == 0 ? (long)rl.rlim_cur : -1;
+            g_printerr("[threads] SCHED_FIFO refused (%s, RLIMIT_RTPRIO=%ld); continuing with SCHED_OTHER. "
+                       "Grant it with 'ulimit -r 99' or CAP_SYS_NICE.\n", strerror(rc), lim);
+        }
+        return SCHED_RESULT_DENIED;
+    }
+
+    static bool parse_cpus(const std::string &val, cpu_set_t *set) {
+        CPU_ZERO(set);
+        size_t pos = 0;
+        while (pos < val.size()) {
+            size_t end = val.find('+', pos);
+            if (end == std::string::npos) end = val.size();
+            std::string part = val.substr(pos, end - pos);
+            pos = end + 1;
+            if (part.empty()) return false;
+            char *rest = NULL;
+            long lo = strtol(part.c_str(), &rest, 10), hi = lo;
+            if (rest == part.c_str()) return false;
+            if (*rest == '-') hi = strtol(rest + 1, &rest, 10);
+            if (*rest != '\0' || lo < 0 || hi < lo || hi >= CPU_SETSIZE) return false;
+            for (long c = lo; c <= hi; ++c) CPU_SET((int)c, set);
+        }
+        return true;
+    }
+
+    static void format_set(const cpu_set_t *set, char *out, size_t len) {
+        out[0] = '\0';
+        size_t n = 0;
+        for (int c = 0; c < CPU_SETSIZE && n + 8 < len; ++c) {
+            if (!CPU_ISSET(c, set)) continue;
+            int e = c;
+            while (e + 1 < CPU_SETSIZE && CPU_ISSET(e + 1, set)) ++e;
+            n += (size_t)snprintf(out + n, len - n, n ? "+%d" : "%d", c);
+            if (e > c) n += (size_t)snprintf(out + n, len - n, "-%d", e);
+            c = e;
+        }
+    }
+
+    static void format_cpus(pid_t tid, char *out, size_t len) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(tid, sizeof(set), &set) != 0) {
+            snprintf(out, len, "?");
+            return;
+        }
+        format_set(&set, out, len);
+    }
+
+    // utime+stime (clock ticks) and last CPU from /proc/self/task/<tid>/stat
+    static bool read_task_stat(pid_t tid, uint64_t *ticks, int *cpu) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int)tid);
+        FILE *f = fopen(path, "r");
+        if (!f) return false;
+        char buf[1024];
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        buf[n] = '\0';
+        // comm may contain spaces; fields restart after the last ')'
+        char *p = strrchr(buf, ')');
+        if (!p) return false;
+        p += 2;
+        // p is at field 3 (state); utime is field 14, stime 15, processor 39
+        unsigned long long utime = 0, stime = 0;
+        int processor = -1;
+        int field = 3;
+        char *save = NULL;
+        for (char *tok = strtok_r(p, " ", &save); tok; tok = strtok_r(NULL, " ", &save), ++field) {
+            if (field == 14) utime = strtoull(tok, NULL, 10);
+            else if (field == 15) stime = strtoull(tok, NULL, 10);
+            else if (field == 39) { processor = atoi(tok); break; }
+        }
+        *ticks = utime + stime;
+        *cpu = processor;
+        return true;
+    }
+
+    bool enabled_{false};
+    int cv_threads_{-1};
+    RoleConfig roles_[ROLE_COUNT];
+    std::vector<Bind> binds_;
+
+    std::mutex mu_;
+    std::vector<ThreadRecord> threads_;
+    gint64 last_report_us_{0};
+    std::atomic<bool> rt_warned_{false};
+};
+
+#endif
+// _THREAD_POLICY_H_
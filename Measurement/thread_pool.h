@@ -0,0 +1,117 @@
+// thread_pool.h
+// Persistent fork-join pool for intra-frame work. Threads are created once and
+// parked between frames; run(n, fn) hands out task indices 0..n-1 and returns
+// when all of them have finished. The calling thread takes tasks too, so a pool
+// of N threads gives N+1 way parallelism.
+
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ForkJoinPool {
+public:
+    explicit ForkJoinPool(int helper_threads) {
+        for (int i = 0; i < helper_threads; ++i) {
+            threads_.emplace_back([this, i] { worker_main(i + 1); });
+        }
+    }
+
+    ~ForkJoinPool() {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            stop_ = true;
+            ++generation_;
+        }
+        cv_start_.notify_all();
+        for (auto &t : threads_) t.join();
+    }
+
+    ForkJoinPool(const ForkJoinPool &) = delete;
+    ForkJoinPool &operator=(const ForkJoinPool &) = delete;
+
+    // Helper threads plus the caller
+    int concurrency() const { return (int)threads_.size() + 1; }
+
+    // Run fn(task, worker) for task in [0, n). worker is 0 for the caller and
+    // 1..N for the helpers, so callers can index per-thread scratch.
+    void run(int n, const std::function<void(int, int)> &fn) {
+        if (n <= 0) return;
+        if (threads_.empty() || n == 1) {
+            for (int t = 0; t < n; ++t) fn(t, 0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            job_ = &fn;
+            n_tasks_ = n;
+            next_.store(0, std::memory_order_relaxed);
+            pending_ = (int)threads_.size();
+            ++generation_;
+        }
+        cv_start_.notify_all();
+
+        drain(0);
+
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_done_.wait(lk, [this] { return pending_ == 0; });
+        job_ = nullptr;
+    }
+
+    // Hook run on each helper thread as it starts (e.g. affinity, naming)
+    static void set_thread_init(std::function<void(int)> init) { thread_init() = std::move(init); }
+
+private:
+    static std::function<void(int)> &thread_init() {
+        static std::function<void(int)> init;
+        return init;
+    }
+
+    void drain(int worker) {
+        const std::function<void(int, int)> &fn = *job_;
+        for (;;) {
+            int t = next_.fetch_add(1, std::memory_order_relaxed);
+            if (t >= n_tasks_) break;
+            fn(t, worker);
+        }
+    }
+
+    void worker_main(int worker) {
+        if (thread_init()) thread_init()(worker);
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                cv_start_.wait(lk, [&] { return generation_ != seen; });
+                seen = generation_;
+                if (stop_) return;
+            }
+            drain(worker);
+            {
+                std::lock_guard<std::mutex> lk(mu_);
+                if (--pending_ == 0) cv_done_.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mu_;
+    std::condition_variable cv_start_;
+    std::condition_variable cv_done_;
+    uint64_t generation_{0};
+    bool stop_{false};
+    int pending_{0};
+
+    const std::function<void(int, int)> *job_{nullptr};
+    int n_tasks_{0};
+    std::atomic<int> next_{0};
+};
+
+#endif
+// _THREAD_POOL_H_
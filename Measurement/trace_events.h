@@ -0,0 +1,253 @@
+// trace_events.h
+// Opt-in per-frame event tracer; writes Chrome trace JSON (opens in ui.perfetto.dev
+// and chrome://tracing), so individual stalls and periodic spikes are visible instead of
+// being averaged away.
+//
+//   TRACE_SCOPE("map", frame);                       complete event around a block
+//   trace_complete("kernel", begin_us, end_us, frame) span measured elsewhere
+//   trace_async_begin/end("encode", id)              span that starts and ends on
+//                                                    different threads (pad probes)
+//   trace_instant("drop", frame)
+//   TraceSteps st(frame); ...; st.step("copy"); ...; st.step("kernel");
+//
+// Every thread writes into its own fixed-size event buffer, registered on its first
+// event; recording is a couple of relaxed stores and one release store, no lock and no
+// allocation. With tracing disabled every call is a single branch.
+//   linear mode   events after a full buffer are counted as dropped (first N events kept)
+//   ring mode     the buffer wraps; the flush keeps only the last ring_seconds
+// write_chrome_json() may run while threads keep recording: events overwritten during
+// the copy are detected by the write index and skipped.
+
+#ifndef _TRACE_EVENTS_H_
+#define _TRACE_EVENTS_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TraceEvent {
+    const char *name;      // static string
+    int64_t ts_us;
+    int64_t dur_us;        // complete events
+    uint64_t id;           // frame number / async id
+    char phase;            // 'X', 'b', 'e', 'i'
+};
+
+class TraceEvents {
+public:
+    static TraceEvents &instance() {
+        static TraceEvents t;
+        return t;
+    }
+
+    // events_per_thread: buffer size; ring_seconds > 0 selects ring mode
+    void enable(size_t events_per_thread, double ring_seconds) {
+        capacity_ = events_per_thread > 0 ? events_per_thread : 1;
+        ring_us_ = (int64_t)(ring_seconds * 1e6);
+        enabled_.store(true, std::memory_order_release);
+    }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    void complete(const char *name, int64_t begin_us, int64_t end_us, uint64_t id) {
+        if (enabled()) emit(TraceEvent{name, begin_us, end_us - begin_us, id, 'X'});
+    }
+    void async_begin(const char *name, uint64_t id) {
+        if (enabled()) emit(TraceEvent{name, g_get_monotonic_time(), 0, id, 'b'});
+    }
+    void async_end(const char *name, uint64_t id) {
+        if (enabled()) emit(TraceEvent{name, g_get_monotonic_time(), 0, id, 'e'});
+    }
+    void instant(const char *name, uint64_t id) {
+        if (enabled()) emit(TraceEvent{name, g_get_monotonic_time(), 0, id, 'i'});
+    }
+
+    // Name shown for the calling thread's track
+    void set_thread_name(const char *name) {
+        if (!enabled()) return;
+        ThreadBuffer *tb = local();
+        std::lock_guard<std::mutex> lock(mu_);
+        tb->name = name;
+    }
+
+    uint64_t dropped() const {
+        uint64_t n = 0;
+        std::lock_guard<std::mutex> lock(mu_);
+        for (const auto &tb : threads_) n += tb->dropped.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    bool write_chrome_json(const char *path) const {
+        FILE *f = fopen(path, "w");
+        if (!f) {
+            g_printerr("Trace: cannot open %s for writing\n", path);
+            return false;
+        }
+        const int pid = (int)getpid();
+        std::vector<std::pair<const ThreadBuffer *, std::vector<TraceEvent>>> snap;
+        int64_t newest = 0;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            for (const auto &tb : threads_) {
+                snap.emplace_back(tb.get(), copy_events(*tb));
+                for (const TraceEvent &e : snap.back().second) newest = std::max(newest, e.ts_us + e.dur_us);
+            }
+        }
+        const int64_t cutoff = ring_us_ > 0 ? newest - ring_us_ : INT64_MIN;
+
+        size_t written = 0;
+        fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+        for (const auto &s : snap) {
+            const ThreadBuffer *tb = s.first;
+            fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", pid, tb->tid, tb->name.empty() ? "thread" : tb->name.c_str());
+            first = false;
+            for (const TraceEvent &e : s.second) {
+                if (e.ts_us < cutoff) continue;
+                switch (e.phase) {
+                    case 'X':
+                        fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%" G_GINT64_FORMAT
+                                   ",\"dur\":%" G_GINT64_FORMAT ",\"args\":{\"frame\":%" G_GUINT64_FORMAT "}}",
+                                e.name, pid, tb->tid, e.ts_us, e.dur_us, e.id);
+                        break;
+                    case 'b':
+                    case 'e':
+                        fprintf(f, ",\n{\"ph\":\"%c\",\"cat\":\"frame\",\"name\":\"%s\",\"id\":\"0x%" G_GINT64_MODIFIER
+                                   "x\",\"pid\":%d,\"tid\":%d,\"ts\":%" G_GINT64_FORMAT "}",
+                                e.phase, e.name, e.id, pid, tb->tid, e.ts_us);
+                        break;
+                    default:
+                        fprintf(f, ",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%" G_GINT64_FORMAT
+                                   ",\"args\":{\"frame\":%" G_GUINT64_FORMAT "}}",
+                                e.name, pid, tb->tid, e.ts_us, e.id);
+                        break;
+                }
+                ++written;
+            }
+        }
+        fprintf(f, "\n]}\n");
+        fclose(f);
+        g_print("Trace: %zu events from %zu threads -> %s (%" G_GUINT64_FORMAT " dropped)\n", written, snap.size(),
+                path, dropped());
+        return true;
+    }
+
+private:
+    struct ThreadBuffer {
+        std::unique_ptr<TraceEvent[]> events;
+        size_t capacity{0};
+        std::atomic<uint64_t> head{0};       // events ever written
+        std::atomic<uint64_t> dropped{0};
+        int tid{0};
+        std::string name;
+    };
+
+    TraceEvents() = default;
+
+    ThreadBuffer *local() {
+        thread_local ThreadBuffer *tb = nullptr;
+        if (!tb) {
+            std::unique_ptr<ThreadBuffer> b(new ThreadBuffer());
+            b->events.reset(new TraceEvent[capacity_]);
+            b->capacity = capacity_;
+            b->tid = (int)syscall(SYS_gettid);
+            std::lock_guard<std::mutex> lock(mu_);
+            tb = b.get();
+            threads_.push_back(std::move(b));
+        }
+        return tb;
+    }
+
+    void emit(const TraceEvent &e) {
+        ThreadBuffer *tb = local();
+        const uint64_t h = tb->head.load(std::memory_order_relaxed);
+        if (ring_us_ <= 0 && h >= tb->capacity) {
+            tb->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        tb->events[h % tb->capacity] = e;
+        tb->head.store(h + 1, std::memory_order_release);
+    }
+
+    // Consistent copy of one thread's events, oldest first
+    static std::vector<TraceEvent> copy_events(const ThreadBuffer &tb) {
+        const uint64_t h1 = tb.head.load(std::memory_order_acquire);
+        const uint64_t first = h1 > tb.capacity ? h1 - tb.capacity : 0;
+        std::vector<TraceEvent> out;
+        out.reserve((size_t)(h1 - first));
+        for (uint64_t i = first; i < h1; ++i) out.push_back(tb.events[i % tb.capacity]);
+        // Slots the writer reached again while we copied (up to and including the one
+        // it may be writing now, index h2 - capacity) are not trustworthy
+        const uint64_t h2 = tb.head.load(std::memory_order_acquire);
+        if (h2 >= tb.capacity && h2 - tb.capacity >= first) {
+            const uint64_t bad = std::min<uint64_t>(h2 - tb.capacity - first + 1, out.size());
+            out.erase(out.begin(), out.begin() + (ptrdiff_t)bad);
+        }
+        return out;
+    }
+
+    std::atomic<bool> enabled_{false};
+    size_t capacity_{1 << 16};
+    int64_t ring_us_{0};
+    mutable std::mutex mu_;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads_;
+};
+
+/* ---------- Convenience ---------- */
+
+static inline bool trace_enabled() { return TraceEvents::instance().enabled(); }
+static inline void trace_complete(const char *name, int64_t begin_us, int64_t end_us, uint64_t id) {
+    TraceEvents::instance().complete(name, begin_us, end_us, id);
+}
+static inline void trace_async_begin(const char *name, uint64_t id) { TraceEvents::instance().async_begin(name, id); }
+static inline void trace_async_end(const char *name, uint64_t id) { TraceEvents::instance().async_end(name, id); }
+static inline void trace_instant(const char *name, uint64_t id) { TraceEvents::instance().instant(name, id); }
+
+// Complete event from construction to end of scope
+class TraceScope {
+public:
+    TraceScope(const char *name, uint64_t id)
+        : name_(name), id_(id), begin_us_(trace_enabled() ? g_get_monotonic_time() : 0) {}
+    ~TraceScope() {
+        if (begin_us_) trace_complete(name_, begin_us_, g_get_monotonic_time(), id_);
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name_;
+    uint64_t id_;
+    int64_t begin_us_;
+};
+
+// Back-to-back phases: each step() closes the span since the previous one
+class TraceSteps {
+public:
+    explicit TraceSteps(uint64_t id) : id_(id), last_us_(trace_enabled() ? g_get_monotonic_time() : 0) {}
+    void step(const char *name) {
+        if (!last_us_) return;
+        const int64_t now = g_get_monotonic_time();
+        trace_complete(name, last_us_, now, id_);
+        last_us_ = now;
+    }
+
+private:
+    uint64_t id_;
+    int64_t last_us_;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name, id) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, id)
+
+#endif
+// _TRACE_EVENTS_H_
@@ -8,7 +8,10 @@
 #include "xcl2.hpp"
 #include "xf_config_params.h"
 #include "xf_hist_equalize_tb_config.h"
+#include "Measurement/async_log.h"
+#include "Measurement/copy_account.h"
 
+#include <csignal>
 #include <cstddef>
 #include <glib.h>
 #include <gst/app/gstappsink.h>
@@ -33,6 +36,7 @@ static char *input_resolution = "4K"; // New parameter for resolution
 static int v_width = 3840;  // Will be set dynamically
 static int v_height = 2160; // Will be set dynamically
 int k = 4;
+static gboolean copy_report = FALSE;
 
 static GOptionEntry entries[] = {
     {"port", 'p', 0, G_OPTION_ARG_STRING, &port, "RTSP port (default: 5000)", NULL},
@@ -42,6 +46,7 @@ static GOptionEntry entries[] = {
     {"fps", 'f', 0, G_OPTION_ARG_STRING, &fps, "Frames per second (default: 60)", NULL},
     {"input", 'r', 0, G_OPTION_ARG_STRING, &input_resolution, "Input resolution: 2K or 4K (default: 4K)", NULL},
     {"k", 'k', 0, G_OPTION_ARG_INT, &k, "K parameter (default: 4)", NULL},
+    {"copy-report", 0, 0, G_OPTION_ARG_NONE, &copy_report, "Print bytes moved per copy site every 2 s", NULL},
     {NULL}
 };
 
@@ -56,6 +61,9 @@ typedef struct {
   cl::Kernel krnl;
 
   GTimer *rate_timer;
+  gdouble copy_report_at;   // rate_timer seconds of the last copy report
+  gint copy_report_frames;  // frames since the last copy report (g_atomic_int)
+  gboolean copy_min_set;    // streaming thread has set the per-frame minimum
 } CustomData;
 
 int counter = 0;
@@ -128,7 +136,9 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
   cv::Mat converted_frame;
 
   gdouble elapsed_time = g_timer_elapsed(data->rate_timer, NULL);
-  g_print("Elapsed time %.2f    Counter: %d\n", elapsed_time, counter++);
+  const int frame = counter++;
+  ALOG(LOG_INFO, 1000, "Elapsed time %.2f    Counter: %d    Log drops: %llu\n",
+       elapsed_time, frame, (unsigned long long)AsyncLog::instance().dropped());
 
   // Pull the sample
   sample = gst_app_sink_pull_sample(appsink);
@@ -169,21 +179,27 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
     cv::Mat yuy2_image_input =
         cv::Mat(data->video_info.height, data->video_info.width, CV_8UC2,
                 map_info.data);
-    cv::cvtColor(yuy2_image_input, converted_frame, cv::COLOR_YUV2BGR_YUY2);
+    convert_acct(COPY_SITE("to_bgr"), yuy2_image_input, converted_frame, [&] {
+      cv::cvtColor(yuy2_image_input, converted_frame, cv::COLOR_YUV2BGR_YUY2);
+    });
   } else if (GST_VIDEO_INFO_FORMAT(&data->video_info) ==
              GST_VIDEO_FORMAT_NV12) {
     // NV12 format has Y plane first, then interleaved UV plane
     cv::Mat nv12_image_input =
         cv::Mat(data->video_info.height + data->video_info.height / 2,
                 data->video_info.width, CV_8UC1, map_info.data);
-    cv::cvtColor(nv12_image_input, converted_frame, cv::COLOR_YUV2BGR_NV12);
+    convert_acct(COPY_SITE("to_bgr"), nv12_image_input, converted_frame, [&] {
+      cv::cvtColor(nv12_image_input, converted_frame, cv::COLOR_YUV2BGR_NV12);
+    });
   } else if (GST_VIDEO_INFO_FORMAT(&data->video_info) ==
              GST_VIDEO_FORMAT_I420) {
     // I420 format has Y plane, then U plane, then V plane
     cv::Mat i420_image_input =
         cv::Mat(data->video_info.height + data->video_info.height / 2,
                 data->video_info.width, CV_8UC1, map_info.data);
-    cv::cvtColor(i420_image_input, converted_frame, cv::COLOR_YUV2BGR_I420);
+    convert_acct(COPY_SITE("to_bgr"), i420_image_input, converted_frame, [&] {
+      cv::cvtColor(i420_image_input, converted_frame, cv::COLOR_YUV2BGR_I420);
+    });
   } else if (GST_VIDEO_INFO_FORMAT(&data->video_info) == GST_VIDEO_FORMAT_BGR) {
     converted_frame =
         cv::Mat(data->video_info.height, data->video_info.width, CV_8UC3,
@@ -209,7 +225,7 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
     cv::Mat in_img_copy, out_img;
 
     // create memory for output images
-    input_frame.copyTo(in_img_copy);
+    copy_to_acct(COPY_SITE("in_img_copy"), input_frame, in_img_copy);
     out_img.create(height, width, CV_OUT_TYPE);
     /////////////////////////////////////// CL ///////////////////////////
 
@@ -233,6 +249,9 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
     data->q.enqueueWriteBuffer(imageToDevice2, CL_TRUE, 0,
                                height * width * CHANNEL_TYPE_3,
                                in_img_copy.data);
+    // Device buffers share the DDR: every transfer is a read and a write
+    copy_note(COPY_SITE("dma_to_device"), 2 * (uint64_t)height * width * CHANNEL_TYPE_3,
+              2 * (uint64_t)height * width * CHANNEL_TYPE_3);
 
     cl::Event event_sp;
 
@@ -242,11 +261,14 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
 
     data->q.enqueueReadBuffer(imageFromDevice, CL_TRUE, 0,
                               height * width * CHANNEL_TYPE_3, out_img.data);
+    copy_note(COPY_SITE("dma_from_device"), (uint64_t)height * width * CHANNEL_TYPE_3,
+              (uint64_t)height * width * CHANNEL_TYPE_3);
     data->q.finish();
 
     // --- Create a NEW GstBuffer for the processed data ---
     cv::Mat yuv_i420;
-    cv::cvtColor(out_img, yuv_i420, cv::COLOR_BGR2YUV_I420);
+    convert_acct(COPY_SITE("to_i420"), out_img, yuv_i420,
+                 [&] { cv::cvtColor(out_img, yuv_i420, cv::COLOR_BGR2YUV_I420); });
 
     // Extract Y, U, V plane data pointers from the I420 Mat
     // Y plane is (width x height)
@@ -259,7 +281,7 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
 
     cv::Mat nv12_image = cv::Mat(height * 3 / 2, width, CV_8UC1);
 
-    memcpy(nv12_image.data, y_data, width * height);
+    memcpy_acct(COPY_SITE("nv12_y"), nv12_image.data, y_data, width * height);
 
     // Get pointer to the start of the NV12 UV plane
     uchar *nv12_uv_plane_start_ptr = nv12_image.data + (width * height);
@@ -274,6 +296,8 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
                       InterleaveUV_Parallel(nv12_uv_plane_start_ptr, u_data,
                                             v_data, uv_plane_width_pixels,
                                             u_v_plane_stride));
+    copy_note(COPY_SITE("nv12_uv_interleave"), (uint64_t)width * height / 2,
+              (uint64_t)width * height / 2);
 
     gsize processed_size = width * height * 1.5;
     processed_buffer = gst_buffer_new_allocate(NULL, processed_size, NULL);
@@ -284,7 +308,8 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
     } else if (gst_buffer_map(processed_buffer, &processed_map_info,
                               GST_MAP_WRITE)) {
 
-      memcpy(processed_map_info.data, nv12_image.data, processed_size);
+      memcpy_acct(COPY_SITE("to_gstbuffer"), processed_map_info.data,
+                  nv12_image.data, processed_size);
       gst_buffer_unmap(processed_buffer, &processed_map_info);
 
       gst_buffer_copy_into(processed_buffer, buffer, GST_BUFFER_COPY_TIMESTAMPS,
@@ -305,6 +330,17 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
 #endif
   // ------------------------
 
+  if (copy_report) {
+    // Only count here; copy_report_tick() prints from the main thread
+    if (!data->copy_min_set) {
+      // Minimum: read the captured frame once, write the NV12 output once
+      CopyAccount::instance().set_min_bytes_per_frame(
+          map_info.size + (uint64_t)width * height * 3 / 2);
+      data->copy_min_set = TRUE;
+    }
+    g_atomic_int_inc(&data->copy_report_frames);
+  }
+
   gst_buffer_unmap(buffer, &map_info);
 
   // Push the processed buffer to appsrc (if successfully created)
@@ -331,6 +367,25 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
   return ret;
 }
 
+// Prints the copy report for the frames counted since the last call
+static void copy_report_tick(CustomData *data) {
+  gint frames;
+  do {
+    frames = g_atomic_int_get(&data->copy_report_frames);
+  } while (!g_atomic_int_compare_and_exchange(&data->copy_report_frames,
+                                              frames, 0));
+  gdouble now = g_timer_elapsed(data->rate_timer, NULL);
+  if (frames > 0 && now > data->copy_report_at)
+    CopyAccount::instance().report(frames,
+                                   frames / (now - data->copy_report_at));
+  data->copy_report_at = now;
+}
+
+// Ctrl+C / SIGTERM only set a flag; the bus wait in main() polls it so the log
+// report and drain below still run
+static volatile sig_atomic_t interrupted = 0;
+static void on_interrupt(int) { interrupted = 1; }
+
 int main(int argc, char *argv[]) {
   gst_init(&argc, &argv);
 
@@ -368,6 +423,8 @@ int main(int argc, char *argv[]) {
   g_print("Bitrate: %d kbps\n", bitrate);
   g_print("Port: %s\n", port);
   g_print("====================\n\n");
+  if (copy_report)
+    CopyAccount::instance().measure_bandwidth();
 
   std::vector<cl::Device> devices = xcl::get_xil_devices();
   cl::Device device = devices[0];
@@ -460,9 +517,22 @@ int main(int argc, char *argv[]) {
 
   g_print("\nRTP Application is ready.\n");
   GstBus *bus = gst_element_get_bus(app_sink_pipeline);
-  GstMessage *msg = gst_bus_timed_pop_filtered(
-      bus, GST_CLOCK_TIME_NONE,
-      (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+  // The bus wait wakes every 200 ms to notice Ctrl+C and, with --copy-report,
+  // to print the report here every 2 s
+  signal(SIGINT, on_interrupt);
+  signal(SIGTERM, on_interrupt);
+  GstMessage *msg;
+  while (!(msg = gst_bus_timed_pop_filtered(
+               bus, 200 * GST_MSECOND,
+               (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS)))) {
+    if (interrupted) {
+      g_print("Interrupted.\n");
+      break;
+    }
+    if (copy_report &&
+        g_timer_elapsed(data.rate_timer, NULL) - data.copy_report_at >= 2.0)
+      copy_report_tick(&data);
+  }
 
   if (msg != nullptr) {
     GError *err;
@@ -490,6 +560,8 @@ int main(int argc, char *argv[]) {
   gst_object_unref(app_sink_pipeline);
   gst_element_set_state(app_src_pipeline, GST_STATE_NULL);
   gst_object_unref(app_src_pipeline);
+  AsyncLog::instance().report();
+  AsyncLog::instance().stop();
   return 0;
 }
 }
\ No newline at end of file
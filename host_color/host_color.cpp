@@ -11,6 +11,9 @@
 #include <vector>
 #include <iostream>
 
+// Allocations per stage; build with -DALLOC_TRACKER to count them
+#include "../Measurement/alloc_tracker.h"
+
 // ---------------- CLI / options ----------------
 #define DEFAULT_RTSP_PORT "5000"
 #define DEFAULT_DISABLE_RTCP FALSE
@@ -25,6 +28,9 @@ static char *input_resolution = (char*)"4K";
 static int v_width = 3840;
 static int v_height = 2160;
 static int k = 4;
+static gboolean alloc_report = FALSE;
+static int alloc_check = -1;          // warm-up frames; -1 = off
+static int alloc_check_frames = 600;  // checked frames before PASS
 
 static GOptionEntry entries[] = {
     {"port", 'p', 0, G_OPTION_ARG_STRING, &port, "RTSP port (default: 5000)", NULL},
@@ -34,6 +40,9 @@ static GOptionEntry entries[] = {
     {"fps", 'f', 0, G_OPTION_ARG_STRING, &fps, "Frames per second (default: 60)", NULL},
     {"input", 'r', 0, G_OPTION_ARG_STRING, &input_resolution, "Input resolution: 2K or 4K (default: 4K)", NULL},
     {"k", 'k', 0, G_OPTION_ARG_INT, &k, "K parameter (default: 4)", NULL},
+    {"alloc-report", 0, 0, G_OPTION_ARG_NONE, &alloc_report, "Print allocations per frame and stage every 2 s", NULL},
+    {"alloc-check", 0, 0, G_OPTION_ARG_INT, &alloc_check, "Fail on any allocation in a stage after N warm-up frames", "N"},
+    {"alloc-check-frames", 0, 0, G_OPTION_ARG_INT, &alloc_check_frames, "Checked frames before the check passes (default: 600)", "N"},
     {NULL}
 };
 
@@ -71,8 +80,62 @@ typedef struct {
   cl::Context context;
   cl::CommandQueue q;
   cl::Kernel krnl;
+
+  // Per-frame working set, sized on the first frame and reused
+  std::vector<uint8_t> y_in, y_out;
+  cl::Buffer dev_in, dev_out;
+  size_t dev_size = 0;
+  int arg_width = 0, arg_height = 0;  // rows/cols last passed to the kernel
+  GstBufferPool *out_pool = nullptr;  // NV12 output buffers with video meta
+  int pool_width = 0, pool_height = 0;  // geometry out_pool was made for
+
+  GstBus *bus = nullptr;              // input pipeline bus (check result)
+  int64_t alloc_report_us = 0;
 } CustomData;
 
+// Output buffers come back to the pool once the encoder releases them
+static GstBufferPool *make_output_pool(int width, int height) {
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, GST_VIDEO_FORMAT_NV12, width, height);
+    GstCaps *caps = gst_video_info_to_caps(&info);
+    GstBufferPool *pool = gst_video_buffer_pool_new();
+    GstStructure *cfg = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(cfg, caps, GST_VIDEO_INFO_SIZE(&info), 4, 0);
+    gst_buffer_pool_config_add_option(cfg, GST_BUFFER_POOL_OPTION_VIDEO_META);
+    gst_caps_unref(caps);
+    if (!gst_buffer_pool_set_config(pool, cfg) || !gst_buffer_pool_set_active(pool, TRUE)) {
+        gst_object_unref(pool);
+        return nullptr;
+    }
+    return pool;
+}
+
+static int st_y_copy = -1, st_device = -1, st_pack = -1;
+
+// Per-frame bookkeeping of the allocation report / check
+static void alloc_frame_done(CustomData *data) {
+    AllocTracker &at = AllocTracker::instance();
+    at.frame();
+    const int64_t now = g_get_monotonic_time();
+    if (alloc_report && now - data->alloc_report_us >= 2000000) {
+        at.report();
+        data->alloc_report_us = now;
+    }
+    if (alloc_check < 0 || !at.armed()) return;
+    if (at.violations() > 0) {
+        at.print_violations();
+        GError *e = g_error_new(GST_CORE_ERROR, GST_CORE_ERROR_FAILED, "allocation after warm-up");
+        gst_bus_post(data->bus, gst_message_new_error(GST_OBJECT(data->app_sink), e, NULL));
+        g_error_free(e);
+        alloc_check = -1;   // report once
+    } else if (at.frames() == (uint64_t)alloc_check + (uint64_t)alloc_check_frames) {
+        g_print("Allocation check PASSED: no allocations in %d frames after %d warm-up frames\n",
+                alloc_check_frames, alloc_check);
+        gst_bus_post(data->bus, gst_message_new_eos(GST_OBJECT(data->app_sink)));
+        alloc_check = -1;
+    }
+}
+
 // ---------------- Appsink callback ----------------
 static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
     CustomData *data = (CustomData *)user_data;
@@ -136,27 +199,39 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
 
     // Build contiguous Y (W*H) for the kernel
     const size_t y_size = (size_t)width * (size_t)height;
-    std::vector<uint8_t> y_in(y_size);
-    copy_plane_rows(y_in.data(), width, src_y, src_y_stride, width, height);
-
-    // Output Y (equalized)
-    std::vector<uint8_t> y_out(y_size);
+    std::vector<uint8_t> &y_in = data->y_in;
+    std::vector<uint8_t> &y_out = data->y_out;   // equalized
+    {
+        AllocScope scope(st_y_copy);
+        y_in.resize(y_size);
+        y_out.resize(y_size);
+        copy_plane_rows(y_in.data(), width, src_y, src_y_stride, width, height);
+    }
 
     // ---- Run FPGA kernel: equalize Y only (single-port kernel, 4 args) ----
     try {
-        cl::Buffer dIn (data->context, CL_MEM_READ_ONLY,  y_size);
-        cl::Buffer dOut(data->context, CL_MEM_WRITE_ONLY, y_size);
-
-        // equalizeHist_accel(img_y_in, img_y_out, rows, cols)
-        data->krnl.setArg(0, dIn);
-        data->krnl.setArg(1, dOut);
-        data->krnl.setArg(2, height);
-        data->krnl.setArg(3, width);
+        AllocScope scope(st_device);
+        if (data->dev_size != y_size) {
+            data->dev_in  = cl::Buffer(data->context, CL_MEM_READ_ONLY,  y_size);
+            data->dev_out = cl::Buffer(data->context, CL_MEM_WRITE_ONLY, y_size);
+            data->dev_size = y_size;
+
+            // equalizeHist_accel(img_y_in, img_y_out, rows, cols)
+            data->krnl.setArg(0, data->dev_in);
+            data->krnl.setArg(1, data->dev_out);
+        }
+        // Same size is not same geometry (e.g. 1280x720 after 720x1280)
+        if (data->arg_width != width || data->arg_height != height) {
+            data->krnl.setArg(2, height);
+            data->krnl.setArg(3, width);
+            data->arg_width = width;
+            data->arg_height = height;
+        }
 
-        data->q.enqueueWriteBuffer(dIn, CL_TRUE, 0, y_size, y_in.data());
+        data->q.enqueueWriteBuffer(data->dev_in, CL_TRUE, 0, y_size, y_in.data());
         data->q.enqueueTask(data->krnl);
         data->q.finish();
-        data->q.enqueueReadBuffer(dOut, CL_TRUE, 0, y_size, y_out.data());
+        data->q.enqueueReadBuffer(data->dev_out, CL_TRUE, 0, y_size, y_out.data());
         data->q.finish();
     } catch (const cl::Error &e) {
         g_printerr("OpenCL error: %s (%d)\n", e.what(), e.err());
@@ -174,26 +249,29 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
     const int dst_y_stride  = width;             // publish tight layout
     const int dst_uv_stride = width;             // NV12 UV plane row bytes = width
     const size_t y_bytes_out  = (size_t)dst_y_stride * (size_t)height;
-    const size_t uv_bytes_out = (size_t)dst_uv_stride * (size_t)(height/2);
-    const size_t total_bytes  = y_bytes_out + uv_bytes_out;
-
-    GstBuffer *processed = gst_buffer_new_and_alloc(total_bytes);
-    if (!processed) {
+    AllocScope pack_scope(st_pack);
+
+    // Pooled NV12 buffer; the pool attaches the video meta (two planes, tight strides)
+    if (data->out_pool && (data->pool_width != width || data->pool_height != height)) {
+        // Caps changed: buffers still held downstream return to the old pool and are freed with it
+        gst_buffer_pool_set_active(data->out_pool, FALSE);
+        gst_object_unref(data->out_pool);
+        data->out_pool = nullptr;
+    }
+    if (!data->out_pool) {
+        data->out_pool = make_output_pool(width, height);
+        data->pool_width = width;
+        data->pool_height = height;
+    }
+    GstBuffer *processed = nullptr;
+    if (!data->out_pool ||
+        gst_buffer_pool_acquire_buffer(data->out_pool, &processed, NULL) != GST_FLOW_OK) {
         g_printerr("Failed to allocate output buffer\n");
         gst_buffer_unmap(buffer, &map_info);
         gst_sample_unref(sample);
         return GST_FLOW_ERROR;
     }
 
-    // Attach video meta (two planes, tight strides)
-    {
-      gsize offsets[GST_VIDEO_MAX_PLANES] = { 0, (gsize)y_bytes_out, 0, 0 };
-      gint  strides[GST_VIDEO_MAX_PLANES] = { dst_y_stride, dst_uv_stride, 0, 0 };
-      gst_buffer_add_video_meta_full(processed, GST_VIDEO_FRAME_FLAG_NONE,
-                                     GST_VIDEO_FORMAT_NV12, width, height,
-                                     2, offsets, strides);
-    }
-
     // Fill payload
     GstMapInfo out_map;
     if (!gst_buffer_map(processed, &out_map, GST_MAP_WRITE)) {
@@ -217,6 +295,7 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
 
     // Preserve timestamps from input
     gst_buffer_copy_into(processed, buffer, GST_BUFFER_COPY_TIMESTAMPS, 0, (gsize)-1);
+    pack_scope.leave();   // appsrc's queueing is not ours
 
     // Push to appsrc
     GstFlowReturn fret = gst_app_src_push_buffer(GST_APP_SRC(data->app_source), processed);
@@ -227,6 +306,7 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
 
     gst_buffer_unmap(buffer, &map_info);
     gst_sample_unref(sample);
+    alloc_frame_done(data);
     return GST_FLOW_OK;
 }
 
@@ -249,6 +329,15 @@ int main(int argc, char *argv[]) {
 
   if (!set_resolution_from_input(input_resolution)) return -1;
 
+  // The OpenCL runtime allocates per enqueue: counted, not enforced
+  st_y_copy = alloc_stage("y_copy");
+  st_device = alloc_stage("device", false);
+  st_pack   = alloc_stage("pack");
+  if (alloc_check >= 0 && !AllocTracker::instance().check((uint64_t)alloc_check)) {
+    g_printerr("--alloc-check cannot run in this build/environment\n");
+    return -1;
+  }
+
   g_print("=== Configuration ===\n");
   g_print("Input device: %s\n", in);
   g_print("Resolution: %dx%d (%s)\n", v_width, v_height, input_resolution);
@@ -336,6 +425,7 @@ int main(int argc, char *argv[]) {
   }
 
   // Hook callback
+  data.bus = gst_element_get_bus(pin);
   g_signal_connect(data.app_sink, "new-sample", G_CALLBACK(new_sample_cb), &data);
 
   // Start pipelines
@@ -357,7 +447,7 @@ int main(int argc, char *argv[]) {
           in, v_width, v_height, fps, bitrate);
 
   // Wait for EOS/ERROR on input
-  GstBus *bus = gst_element_get_bus(pin);
+  GstBus *bus = data.bus;
   GstMessage *msg = gst_bus_timed_pop_filtered(
       bus, GST_CLOCK_TIME_NONE,
       (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
@@ -373,13 +463,17 @@ int main(int argc, char *argv[]) {
     }
     gst_message_unref(msg);
   }
-  gst_object_unref(bus);
 
   gst_element_set_state(pin,  GST_STATE_NULL);
   gst_element_set_state(pout, GST_STATE_NULL);
+  gst_object_unref(bus);
   if (data.app_sink)   gst_object_unref(data.app_sink);
   if (data.app_source) gst_object_unref(data.app_source);
   gst_object_unref(pin);
   gst_object_unref(pout);
-  return 0;
+  if (data.out_pool) {
+    gst_buffer_pool_set_active(data.out_pool, FALSE);
+    gst_object_unref(data.out_pool);
+  }
+  return AllocTracker::instance().violations() > 0 ? 1 : 0;
 }
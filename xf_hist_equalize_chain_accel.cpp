@@ -0,0 +1,190 @@
+/*
+ * Copyright 2022 Xilinx, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fused Y-plane chain in one dataflow region:
+//   Array2xfMat -> equalize -> gamma LUT -> convertScaleAbs -> xfMat2Array
+// Stages are switched at run time through stage_mask; a disabled stage passes pixels
+// through unchanged, so any combination still costs one frame read for the histogram,
+// one for the pixels and one write.
+
+#include "xf_hist_equalize_chain_config.h"
+
+typedef xf::cv::Mat<CHAIN_TYPE, HEIGHT_4k, WIDTH_4k, CHAIN_NPPC, CHAIN_DEPTH> ChainMat;
+
+// Histogram of hist_in, LUT built on chip, then applied to in_mat while it streams
+static void equalize_stage(ChainMat &hist_in, ChainMat &in_mat, ChainMat &out_mat, bool enable) {
+    ap_uint<32> hist[CHAIN_HIST_SIZE];
+    ap_uint<8> lut[CHAIN_HIST_SIZE];
+    const int loop_count = hist_in.rows * (hist_in.cols >> XF_BITSHIFT(CHAIN_NPPC));
+
+clear_hist:
+    for (int i = 0; i < CHAIN_HIST_SIZE; i++) {
+// clang-format off
+        #pragma HLS PIPELINE II=1
+        // clang-format on
+        hist[i] = 0;
+    }
+
+    // A run of equal pixels is counted in acc and written back when the value changes
+    // (as xf::cv's histogram does). The bin written in the previous iteration is
+    // forwarded from acc_prev, so hist[] is only read two or more iterations after a
+    // write to the same bin.
+    ap_uint<8> cur = 0, prev = 0;
+    ap_uint<32> acc = 0, acc_prev = 0;
+compute_hist:
+    for (int i = 0; i < loop_count; i++) {
+// clang-format off
+        #pragma HLS LOOP_TRIPCOUNT min=1 max=HEIGHT_4k*WIDTH_4k/CHAIN_NPPC
+        #pragma HLS PIPELINE
+        #pragma HLS DEPENDENCE variable=hist inter RAW distance=2 true
+        // clang-format on
+        XF_TNAME(CHAIN_TYPE, CHAIN_NPPC) word = hist_in.read(i);
+        for (int p = 0; p < CHAIN_NPPC; p++) {
+            ap_uint<8> px = word.range(p * 8 + 7, p * 8);
+            if (px == cur) {
+                acc++;
+            } else {
+                ap_uint<32> count = (px == prev) ? acc_prev : hist[px];
+                hist[cur] = acc;
+                prev = cur;
+                acc_prev = acc;
+                cur = px;
+                acc = count + 1;
+            }
+        }
+    }
+    hist[cur] = acc;
+
+    // Same rule as cv::equalizeHist: the first occupied bin maps to 0
+    ap_uint<32> total = hist_in.rows * hist_in.cols;
+    int first = 0;
+find_first:
+    for (int i = CHAIN_HIST_SIZE - 1; i >= 0; i--) {
+// clang-format off
+        #pragma HLS PIPELINE II=1
+        // clang-format on
+        if (hist[i] != 0) first = i;
+    }
+    ap_uint<32> denom = total - hist[first];
+    ap_uint<32> sum = 0;
+
+build_lut:
+    for (int i = 0; i < CHAIN_HIST_SIZE; i++) {
+// clang-format off
+        #pragma HLS PIPELINE II=1
+        // clang-format on
+        if (!enable) {
+            lut[i] = i;
+        } else if (denom == 0) {
+            lut[i] = first;
+        } else if (i <= first) {
+            lut[i] = 0;
+        } else {
+            sum += hist[i];
+            ap_uint<64> v = ((ap_uint<64>)sum * 255 + (denom >> 1)) / denom;
+            lut[i] = v > 255 ? (ap_uint<64>)255 : v;
+        }
+    }
+
+apply_lut:
+    for (int i = 0; i < loop_count; i++) {
+// clang-format off
+        #pragma HLS LOOP_TRIPCOUNT min=1 max=HEIGHT_4k*WIDTH_4k/CHAIN_NPPC
+        #pragma HLS PIPELINE II=1
+        // clang-format on
+        XF_TNAME(CHAIN_TYPE, CHAIN_NPPC) in_word = in_mat.read(i);
+        XF_TNAME(CHAIN_TYPE, CHAIN_NPPC) out_word;
+        for (int p = 0; p < CHAIN_NPPC; p++) {
+            out_word.range(p * 8 + 7, p * 8) = lut[(ap_uint<8>)in_word.range(p * 8 + 7, p * 8)];
+        }
+        out_mat.write(i, out_word);
+    }
+}
+
+// out = 255 * (in / 255) ^ gamma, table built once per frame from the register value
+static void gamma_stage(ChainMat &in_mat, ChainMat &out_mat, float gamma, bool enable) {
+    ap_uint<8> lut[CHAIN_HIST_SIZE];
+    const int loop_count = in_mat.rows * (in_mat.cols >> XF_BITSHIFT(CHAIN_NPPC));
+
+build_lut:
+    for (int i = 0; i < CHAIN_HIST_SIZE; i++) {
+// clang-format off
+        #pragma HLS PIPELINE
+        // clang-format on
+        if (!enable) {
+            lut[i] = i;
+        } else {
+            float v = 255.0f * hls::pow((float)i / 255.0f, gamma) + 0.5f;
+            lut[i] = v >= 255.0f ? 255 : (v <= 0.0f ? 0 : (int)v);
+        }
+    }
+
+apply_lut:
+    for (int i = 0; i < loop_count; i++) {
+// clang-format off
+        #pragma HLS LOOP_TRIPCOUNT min=1 max=HEIGHT_4k*WIDTH_4k/CHAIN_NPPC
+        #pragma HLS PIPELINE II=1
+        // clang-format on
+        XF_TNAME(CHAIN_TYPE, CHAIN_NPPC) in_word = in_mat.read(i);
+        XF_TNAME(CHAIN_TYPE, CHAIN_NPPC) out_word;
+        for (int p = 0; p < CHAIN_NPPC; p++) {
+            out_word.range(p * 8 + 7, p * 8) = lut[(ap_uint<8>)in_word.range(p * 8 + 7, p * 8)];
+        }
+        out_mat.write(i, out_word);
+    }
+}
+
+extern "C" {
+void equalizeHist_chain_accel(ap_uint<CHAIN_PTR_WIDTH> *img_inp, ap_uint<CHAIN_PTR_WIDTH> *img_inp1,
+                              ap_uint<CHAIN_PTR_WIDTH> *img_out, int rows, int cols,
+                              int stage_mask, float gamma, float alpha, float beta) {
+  // clang-format off
+    #pragma HLS INTERFACE m_axi     port=img_inp  offset=slave bundle=gmem1
+    #pragma HLS INTERFACE m_axi     port=img_inp1 offset=slave bundle=gmem2
+    #pragma HLS INTERFACE m_axi     port=img_out  offset=slave bundle=gmem3
+
+    #pragma HLS INTERFACE s_axilite port=rows
+    #pragma HLS INTERFACE s_axilite port=cols
+    #pragma HLS INTERFACE s_axilite port=stage_mask
+    #pragma HLS INTERFACE s_axilite port=gamma
+    #pragma HLS INTERFACE s_axilite port=alpha
+    #pragma HLS INTERFACE s_axilite port=beta
+    #pragma HLS INTERFACE s_axilite port=return
+  // clang-format on
+
+  ChainMat hist_mat(rows, cols);
+  ChainMat in_mat(rows, cols);
+  ChainMat eq_mat(rows, cols);
+  ChainMat gamma_mat(rows, cols);
+  ChainMat out_mat(rows, cols);
+
+  // Resolve the register values once, before the region starts
+  const bool en_eq = (stage_mask & CHAIN_STAGE_EQUALIZE) != 0;
+  const bool en_gamma = (stage_mask & CHAIN_STAGE_GAMMA) != 0;
+  const float scale = (stage_mask & CHAIN_STAGE_SCALE) ? alpha : 1.0f;
+  const float shift = (stage_mask & CHAIN_STAGE_SCALE) ? beta : 0.0f;
+
+// clang-format off
+  #pragma HLS DATAFLOW
+  // clang-format on
+  xf::cv::Array2xfMat<CHAIN_PTR_WIDTH, CHAIN_TYPE, HEIGHT_4k, WIDTH_4k, CHAIN_NPPC, CHAIN_DEPTH>(img_inp, hist_mat);
+  xf::cv::Array2xfMat<CHAIN_PTR_WIDTH, CHAIN_TYPE, HEIGHT_4k, WIDTH_4k, CHAIN_NPPC, CHAIN_DEPTH>(img_inp1, in_mat);
+  equalize_stage(hist_mat, in_mat, eq_mat, en_eq);
+  gamma_stage(eq_mat, gamma_mat, gamma, en_gamma);
+  xf::cv::convertScaleAbs<CHAIN_TYPE, CHAIN_TYPE, HEIGHT_4k, WIDTH_4k, CHAIN_NPPC, CHAIN_DEPTH, CHAIN_DEPTH>(gamma_mat, out_mat, scale, shift);
+  xf::cv::xfMat2Array<CHAIN_PTR_WIDTH, CHAIN_TYPE, HEIGHT_4k, WIDTH_4k, CHAIN_NPPC, CHAIN_DEPTH>(out_mat, img_out);
+}
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2022 Xilinx, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _XF_HIST_EQUALIZE_CHAIN_CONFIG_H_
+#define _XF_HIST_EQUALIZE_CHAIN_CONFIG_H_
+
+#include "hls_stream.h"
+#include "hls_math.h"
+#include "ap_int.h"
+#include "common/xf_common.hpp"
+#include "common/xf_utility.hpp"
+#include "imgproc/xf_convertscaleabs.hpp"
+
+#define WIDTH_4k 3840
+#define HEIGHT_4k 2160
+
+#define CHAIN_DEPTH 2
+
+#define CHAIN_NPPC XF_NPPC1
+
+// The chain works on the NV12 Y plane directly
+#define CHAIN_TYPE XF_8UC1
+#define CV_CHAIN_TYPE CV_8UC1
+
+#define CHAIN_PTR_WIDTH 256
+
+// stage_mask bits (s_axilite). A cleared bit turns the stage into an identity pass,
+// the stream still flows so the dataflow region never changes shape.
+#define CHAIN_STAGE_EQUALIZE 0x1
+#define CHAIN_STAGE_GAMMA    0x2
+#define CHAIN_STAGE_SCALE    0x4
+#define CHAIN_STAGE_ALL      (CHAIN_STAGE_EQUALIZE | CHAIN_STAGE_GAMMA | CHAIN_STAGE_SCALE)
+
+#define CHAIN_HIST_SIZE 256
+
+extern "C" {
+void equalizeHist_chain_accel(ap_uint<CHAIN_PTR_WIDTH> *img_inp, ap_uint<CHAIN_PTR_WIDTH> *img_inp1,
+                              ap_uint<CHAIN_PTR_WIDTH> *img_out, int rows, int cols,
+                              int stage_mask, float gamma, float alpha, float beta);
+}
+
+#endif
+// _XF_HIST_EQUALIZE_CHAIN_CONFIG_H_
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2022 Xilinx, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// C-sim testbench for equalizeHist_chain_accel.
+// Runs every stage_mask combination against the OpenCV reference chain
+//   cv::equalizeHist -> cv::LUT(gamma) -> cv::convertScaleAbs
+// and fails if any pixel differs by more than 1 (rounding of the on-chip LUTs).
+//
+// Usage: csim with argv = <input image> [gamma] [alpha] [beta]
+
+#include "common/xf_headers.hpp"
+#include "xf_hist_equalize_chain_config.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static cv::Mat reference_chain(const cv::Mat &in, int mask, float gamma, float alpha, float beta) {
+    cv::Mat cur = in.clone();
+    if (mask & CHAIN_STAGE_EQUALIZE) {
+        cv::Mat eq;
+        cv::equalizeHist(cur, eq);
+        cur = eq;
+    }
+    if (mask & CHAIN_STAGE_GAMMA) {
+        cv::Mat lut(1, 256, CV_8UC1);
+        for (int i = 0; i < 256; i++) {
+            float v = 255.0f * std::pow((float)i / 255.0f, gamma) + 0.5f;
+            lut.at<uchar>(i) = v >= 255.0f ? 255 : (v <= 0.0f ? 0 : (uchar)v);
+        }
+        cv::Mat g;
+        cv::LUT(cur, lut, g);
+        cur = g;
+    }
+    if (mask & CHAIN_STAGE_SCALE) {
+        cv::Mat s;
+        cv::convertScaleAbs(cur, s, alpha, beta);
+        cur = s;
+    }
+    return cur;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <INPUT IMAGE PATH> [gamma] [alpha] [beta]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    float gamma = argc > 2 ? (float)atof(argv[2]) : 0.8f;
+    float alpha = argc > 3 ? (float)atof(argv[3]) : 1.2f;
+    float beta = argc > 4 ? (float)atof(argv[4]) : -10.0f;
+
+    // Grayscale stands in for the NV12 Y plane
+    cv::Mat in_img = cv::imread(argv[1], 0);
+    if (in_img.data == NULL) {
+        fprintf(stderr, "ERROR: Cannot open image %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    int rows = in_img.rows;
+    int cols = in_img.cols;
+    cv::Mat out_img(rows, cols, CV_CHAIN_TYPE);
+    cv::Mat diff;
+
+    std::cout << "Input: " << cols << "x" << rows << "  gamma=" << gamma << " alpha=" << alpha
+              << " beta=" << beta << std::endl;
+
+    int failures = 0;
+    for (int mask = 0; mask <= CHAIN_STAGE_ALL; mask++) {
+        equalizeHist_chain_accel((ap_uint<CHAIN_PTR_WIDTH> *)in_img.data,
+                                 (ap_uint<CHAIN_PTR_WIDTH> *)in_img.data,
+                                 (ap_uint<CHAIN_PTR_WIDTH> *)out_img.data, rows, cols,
+                                 mask, gamma, alpha, beta);
+
+        cv::Mat ref = reference_chain(in_img, mask, gamma, alpha, beta);
+        cv::absdiff(ref, out_img, diff);
+
+        double max_err = 0;
+        cv::minMaxLoc(diff, NULL, &max_err);
+        int over_tol = cv::countNonZero(diff > 1);
+
+        std::cout << "stage_mask=" << mask << " [" << ((mask & CHAIN_STAGE_EQUALIZE) ? "eq " : "-- ")
+                  << ((mask & CHAIN_STAGE_GAMMA) ? "gamma " : "----- ")
+                  << ((mask & CHAIN_STAGE_SCALE) ? "scale" : "-----") << "] max_err=" << max_err
+                  << " pixels>1: " << over_tol << (over_tol ? "  FAIL" : "  PASS") << std::endl;
+
+        if (over_tol) {
+            char name[64];
+            snprintf(name, sizeof(name), "chain_diff_mask%d.png", mask);
+            cv::imwrite(name, diff);
+            failures++;
+        }
+    }
+
+    if (failures) {
+        fprintf(stderr, "ERROR: Test Failed (%d stage combinations).\n ", failures);
+        return EXIT_FAILURE;
+    }
+    std::cout << "Test Passed " << std::endl;
+    return 0;
+}
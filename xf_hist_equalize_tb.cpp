@@ -24,7 +24,9 @@
 #include "xcl2.hpp"
 #include "xf_config_params.h"
 #include "xf_hist_equalize_tb_config.h"
+#include "Measurement/async_log.h"
 
+#include <csignal>
 #include <cstddef>
 #include <glib.h>
 #include <gst/app/gstappsink.h>
@@ -122,7 +124,9 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
   cv::Mat converted_frame;
 
   gdouble elapsed_time = g_timer_elapsed(data->rate_timer, NULL);
-  g_print("Elapsed time %.2f    Counter: %d\n", elapsed_time, counter++);
+  const int frame = counter++;
+  ALOG(LOG_INFO, 1000, "Elapsed time %.2f    Counter: %d    Log drops: %llu\n",
+       elapsed_time, frame, (unsigned long long)AsyncLog::instance().dropped());
 
   // Pull the sample
   sample = gst_app_sink_pull_sample(appsink);
@@ -318,6 +322,11 @@ static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
   return ret;
 }
 
+// Ctrl+C / SIGTERM only set a flag; the bus wait in main() polls it so the log
+// report and drain below still run
+static volatile sig_atomic_t interrupted = 0;
+static void on_interrupt(int) { interrupted = 1; }
+
 int main(int argc, char *argv[]) {
   gst_init(&argc, &argv);
 
@@ -435,9 +444,17 @@ int main(int argc, char *argv[]) {
 
   g_print("\nRTP Application is ready.\n");
   GstBus *bus = gst_element_get_bus(app_sink_pipeline);
-  GstMessage *msg = gst_bus_timed_pop_filtered(
-      bus, GST_CLOCK_TIME_NONE,
-      (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+  signal(SIGINT, on_interrupt);
+  signal(SIGTERM, on_interrupt);
+  GstMessage *msg;
+  while (!(msg = gst_bus_timed_pop_filtered(
+               bus, 200 * GST_MSECOND,
+               (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS)))) {
+    if (interrupted) {
+      g_print("Interrupted.\n");
+      break;
+    }
+  }
 
   if (msg != nullptr) {
     GError *err;
@@ -465,6 +482,8 @@ int main(int argc, char *argv[]) {
   gst_object_unref(app_sink_pipeline);
   gst_element_set_state(app_src_pipeline, GST_STATE_NULL);
   gst_object_unref(app_src_pipeline);
+  AsyncLog::instance().report();
+  AsyncLog::instance().stop();
   return 0;
 }
 }
\ No newline at end of file